@@ -0,0 +1,382 @@
+/*
+ * Scan-callback benchmark: replays an advertisement corpus through
+ *   - legacy  a replica of the pre-filter onScanResultReceived (deviceName() String, serviceUUID()
+ *             Vector, address/UUID toString(), five-plus Log.info per report), and
+ *   - current the firmware's onScanResultReceived (raw AD walk, no allocation for non-matches),
+ * and reports callbacks/sec plus heap allocations and bytes per callback. Log lines are formatted
+ * but not printed, which is what a SerialLogHandler costs on device.
+ *
+ * It also reports what fraction of the corpus the stack-level BleScanFilter (name == "SmartStall")
+ * would still deliver to the callback at all, and first runs the advertised-telemetry parser and
+ * ingest decision (adv_status.h) over synthetic adverts, exiting non-zero on any mismatch.
+ *
+ * The default corpus is a synthetic busy restroom: Apple Continuity / Find My, iBeacons, Eddystone,
+ * named phones and earbuds, and SmartStall peripherals. --corpus reads one report per line:
+ *   AA:BB:CC:DD:EE:FF <rssi> <adv hex> [<scan response hex>|-]
+ *
+ *   adv_bench [--reports N] [--smartstall-pct P] [--corpus FILE]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "adv_status.h"
+#include "fleet_sim.h"
+
+void onScanResultReceived(const BleScanResult &scanResult);
+int registerOrUpdateDevice(const BleAddress &addr);
+
+// Global allocation counters for this binary (covers String, Vector and std:: containers)
+static uint64_t g_allocs = 0;
+static uint64_t g_allocBytes = 0;
+
+void *operator new(size_t n) {
+    g_allocs++;
+    g_allocBytes += n;
+    void *p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+const BleUuid LEGACY_SERVICE_UUID("c56a1b98-6c1e-413a-b138-0e9f320c7e8b");
+
+// Pre-filter callback body, kept verbatim apart from the queueing tail (registration is kept).
+void legacyOnScanResultReceived(const BleScanResult &scanResult) {
+    String deviceName = scanResult.advertisingData().deviceName();
+
+    Log.info("Found device - Name: '%s', Address: %s, RSSI: %d",
+             deviceName.c_str(),
+             scanResult.address().toString().c_str(),
+             scanResult.rssi());
+
+    bool hasSmartStallService = false;
+    Vector<BleUuid> serviceUuids = scanResult.advertisingData().serviceUUID();
+    if (serviceUuids.size() > 0) {
+        Log.info("Device has %d advertised service UUIDs:", serviceUuids.size());
+        int svcCount = serviceUuids.size();
+        for (int i = 0; i < svcCount; i++) {
+            BleUuid serviceUuid = serviceUuids.at(i);
+            Log.info("  Service UUID %d: %s", i, serviceUuid.toString().c_str());
+            if (serviceUuid == LEGACY_SERVICE_UUID) {
+                hasSmartStallService = true;
+                Log.info("  ✓ Found SmartStall service UUID!");
+            }
+        }
+    }
+
+    Log.info("Advertising data length: %d bytes", (int)scanResult.advertisingData().length());
+
+    bool isSmartStall = false;
+    if (deviceName == "SmartStall") {
+        Log.info("SmartStall device found by name!");
+        isSmartStall = true;
+    } else if (hasSmartStallService) {
+        Log.info("SmartStall device found by service UUID!");
+        isSmartStall = true;
+    } else if (deviceName.length() == 0 && serviceUuids.size() > 0) {
+        Log.info("Unnamed device with services - might be SmartStall in different mode");
+    }
+
+    if (isSmartStall) {
+        registerOrUpdateDevice(scanResult.address());
+        Log.info("Device %s registered; will be polled in rotation", scanResult.address().toString().c_str());
+    }
+}
+
+struct AdBuilder {
+    uint8_t buf[BLE_MAX_ADV_DATA_LEN];
+    size_t len = 0;
+    void field(uint8_t type, const uint8_t *payload, size_t n) {
+        if (len + 2 + n > sizeof(buf)) return;
+        buf[len++] = (uint8_t)(n + 1);
+        buf[len++] = type;
+        memcpy(buf + len, payload, n);
+        len += n;
+    }
+    void flags() {
+        uint8_t f = 0x06;
+        field(0x01, &f, 1);
+    }
+    void name(const char *s) { field(0x09, (const uint8_t *)s, strlen(s)); }
+};
+
+BleAddress randomAddress(std::mt19937 &rng) {
+    uint8_t a[BLE_SIG_ADDR_LEN];
+    for (uint8_t &b : a) b = (uint8_t)rng();
+    a[5] |= 0xC0; // random static
+    return BleAddress(a);
+}
+
+std::vector<BleScanResult> syntheticCorpus(size_t reports, double smartstallPct, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::normal_distribution<double> rssi(-75.0, 8.0);
+
+    // A fixed population re-advertising, as a scan window sees it
+    std::vector<BleAddress> stalls, others;
+    for (int i = 0; i < 12; ++i) stalls.push_back(randomAddress(rng));
+    for (int i = 0; i < 80; ++i) others.push_back(randomAddress(rng));
+
+    const char *phoneNames[] = {"Pixel 8", "Galaxy Buds2 Pro", "Jabra Elite 75t", "Fitbit Charge 6", "LE-Bose QC"};
+    const uint8_t *svc = LEGACY_SERVICE_UUID.rawBytes();
+
+    std::vector<BleScanResult> out;
+    out.reserve(reports);
+    for (size_t n = 0; n < reports; ++n) {
+        AdBuilder adv, sr;
+        BleAddress addr;
+        double kind = u(rng) * 100.0;
+        if (kind < smartstallPct) {
+            addr = stalls[rng() % stalls.size()];
+            adv.flags();
+            adv.name("SmartStall");
+            sr.field(0x07, svc, 16);
+        } else {
+            addr = others[rng() % others.size()];
+            double k = u(rng);
+            if (k < 0.55) {
+                // Apple Continuity / Find My: manufacturer data only
+                uint8_t m[27] = {0x4C, 0x00, 0x10, 0x05};
+                for (size_t i = 4; i < sizeof(m); ++i) m[i] = (uint8_t)rng();
+                adv.flags();
+                adv.field(0xFF, m, 4 + (rng() % 20));
+            } else if (k < 0.70) {
+                // iBeacon
+                uint8_t m[25] = {0x4C, 0x00, 0x02, 0x15};
+                for (size_t i = 4; i < sizeof(m); ++i) m[i] = (uint8_t)rng();
+                adv.flags();
+                adv.field(0xFF, m, sizeof(m));
+            } else if (k < 0.80) {
+                // Eddystone-UID: 16-bit service list + service data
+                uint8_t list[2] = {0xAA, 0xFE};
+                uint8_t sd[20] = {0xAA, 0xFE, 0x00, 0xEE};
+                for (size_t i = 4; i < sizeof(sd); ++i) sd[i] = (uint8_t)rng();
+                adv.flags();
+                adv.field(0x03, list, 2);
+                adv.field(0x16, sd, sizeof(sd));
+            } else if (k < 0.93) {
+                // Named wearables / phones with a 128-bit vendor service in the scan response
+                uint8_t vendor[16];
+                for (uint8_t &b : vendor) b = (uint8_t)rng();
+                adv.flags();
+                adv.name(phoneNames[rng() % (sizeof(phoneNames) / sizeof(phoneNames[0]))]);
+                sr.field(0x07, vendor, 16);
+            } else {
+                // Generic 16-bit service advertisers (Battery, Device Information)
+                uint8_t list[4] = {0x0F, 0x18, 0x0A, 0x18};
+                adv.flags();
+                adv.field(0x03, list, sizeof(list));
+            }
+        }
+        int8_t r = (int8_t)std::max(-100.0, std::min(-30.0, rssi(rng)));
+        out.push_back(BleScanResult(addr, BleAdvertisingData(adv.buf, adv.len), BleAdvertisingData(sr.buf, sr.len), r));
+    }
+    return out;
+}
+
+size_t parseHex(const char *s, uint8_t *out, size_t cap) {
+    size_t n = 0;
+    if (!strcmp(s, "-")) return 0;
+    for (; s[0] && s[1] && n < cap; s += 2) {
+        char byte[3] = {s[0], s[1], 0};
+        out[n++] = (uint8_t)strtoul(byte, nullptr, 16);
+    }
+    return n;
+}
+
+bool loadCorpus(const char *path, std::vector<BleScanResult> &out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char addr[32], advHex[80], srHex[80] = "-";
+        int rssi = 0;
+        if (line[0] == '#' || sscanf(line, "%31s %d %79s %79s", addr, &rssi, advHex, srHex) < 3) continue;
+        uint8_t adv[BLE_MAX_ADV_DATA_LEN], sr[BLE_MAX_ADV_DATA_LEN];
+        size_t advLen = parseHex(advHex, adv, sizeof(adv));
+        size_t srLen = parseHex(srHex, sr, sizeof(sr));
+        out.push_back(BleScanResult(BleAddress(addr), BleAdvertisingData(adv, advLen), BleAdvertisingData(sr, srLen),
+                                    (int8_t)rssi));
+    }
+    fclose(f);
+    return true;
+}
+
+// adv_status.h checks over hand-built adverts; returns the number of failures
+int checkAdvStatus() {
+    int failures = 0;
+    auto expect = [&](bool ok, const char *what) {
+        if (!ok) {
+            fprintf(stderr, "adv_status check failed: %s\n", what);
+            failures++;
+        }
+    };
+    const uint8_t *svc = LEGACY_SERVICE_UUID.rawBytes();
+    AdvStatus in = {2, 3712, sensorCountsDigest(150, 89, 145), 7};
+    uint8_t payload[ADV_STATUS_PAYLOAD_LEN];
+    encodeAdvStatusPayload(in, payload);
+
+    // Manufacturer data in the advert, after flags and name
+    AdBuilder mfg;
+    mfg.flags();
+    mfg.name("SmartStall");
+    uint8_t field[2 + ADV_STATUS_PAYLOAD_LEN] = {0xFF, 0xFF};
+    memcpy(field + 2, payload, sizeof(payload));
+    mfg.field(AD_TYPE_MANUFACTURER_DATA, field, sizeof(field));
+    AdvStatus out = {};
+    expect(mfg.len <= 31, "manufacturer-data advert fits in 31 bytes");
+    expect(parseSmartStallAdvStatus(mfg.buf, mfg.len, svc, out), "manufacturer data parses");
+    expect(out.status == in.status && out.batteryMv == in.batteryMv && out.countsDigest == in.countsDigest
+               && out.sequence == in.sequence,
+           "manufacturer data round-trips");
+
+    // 128-bit service data in the scan response, after the service UUID list
+    AdBuilder sd;
+    sd.field(0x07, svc, 16);
+    uint8_t sfield[16 + ADV_STATUS_PAYLOAD_LEN];
+    memcpy(sfield, svc, 16);
+    memcpy(sfield + 16, payload, sizeof(payload));
+    AdBuilder sdOnly;
+    sdOnly.field(AD_TYPE_SERVICE_DATA_UUID128, sfield, sizeof(sfield));
+    out = {};
+    expect(sdOnly.len <= 31, "service-data scan response fits in 31 bytes");
+    expect(parseSmartStallAdvStatus(sdOnly.buf, sdOnly.len, svc, out) && out.countsDigest == in.countsDigest,
+           "service data parses");
+
+    // Rejections: other company, other service, version bump, truncation, malformed length
+    AdBuilder other;
+    uint8_t apple[2 + ADV_STATUS_PAYLOAD_LEN] = {0x4C, 0x00};
+    memcpy(apple + 2, payload, sizeof(payload));
+    other.field(AD_TYPE_MANUFACTURER_DATA, apple, sizeof(apple));
+    expect(!parseSmartStallAdvStatus(other.buf, other.len, svc, out), "other company ignored");
+    uint8_t otherSvc[sizeof(sfield)];
+    memcpy(otherSvc, sfield, sizeof(sfield));
+    otherSvc[0] ^= 0x01;
+    AdBuilder wrongSvc;
+    wrongSvc.field(AD_TYPE_SERVICE_DATA_UUID128, otherSvc, sizeof(otherSvc));
+    expect(!parseSmartStallAdvStatus(wrongSvc.buf, wrongSvc.len, svc, out), "other service ignored");
+    uint8_t v2[sizeof(field)];
+    memcpy(v2, field, sizeof(field));
+    v2[2] = ADV_STATUS_VERSION + 1;
+    AdBuilder future;
+    future.field(AD_TYPE_MANUFACTURER_DATA, v2, sizeof(v2));
+    expect(!parseSmartStallAdvStatus(future.buf, future.len, svc, out), "unknown version ignored");
+    AdBuilder shortField;
+    shortField.field(AD_TYPE_MANUFACTURER_DATA, field, sizeof(field) - 1);
+    expect(!parseSmartStallAdvStatus(shortField.buf, shortField.len, svc, out), "truncated payload ignored");
+    uint8_t overrun[4] = {0x0C, AD_TYPE_MANUFACTURER_DATA, 0xFF, 0xFF};
+    expect(!parseSmartStallAdvStatus(overrun, sizeof(overrun), svc, out), "length past end ignored");
+    expect(!parseSmartStallAdvStatus(nullptr, 0, svc, out), "empty payload ignored");
+
+    // Ingest decision
+    const unsigned long FULL = 600000;
+    expect(decideAdvIngest(in, false, 0, 0, 1000, FULL) == ADV_INGEST_FULL_READ, "never read -> full read");
+    expect(decideAdvIngest(in, true, in.countsDigest, 1000, 2000, FULL) == ADV_INGEST_UPDATE,
+           "same digest -> update");
+    expect(decideAdvIngest(in, true, in.countsDigest ^ 1, 1000, 2000, FULL) == ADV_INGEST_FULL_READ,
+           "digest changed -> full read");
+    expect(decideAdvIngest(in, true, in.countsDigest, 1000, 1000 + FULL, FULL) == ADV_INGEST_FULL_READ,
+           "periodic full read due");
+    expect(decideAdvIngest(in, true, in.countsDigest, 0UL - 4096, 4096, FULL) == ADV_INGEST_UPDATE,
+           "millis() wrap");
+    expect(sensorCountsDigest(1, 0, 0) != sensorCountsDigest(0, 1, 0), "digest is order-sensitive");
+    return failures;
+}
+
+struct Result {
+    double callbacksPerSec;
+    double allocsPerCallback;
+    double bytesPerCallback;
+};
+
+template <typename Fn>
+Result replay(const std::vector<BleScanResult> &corpus, int rounds, Fn fn) {
+    uint64_t a0 = g_allocs, b0 = g_allocBytes;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (const BleScanResult &res : corpus) fn(res);
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    double calls = (double)corpus.size() * rounds;
+    return Result{calls / s, (double)(g_allocs - a0) / calls, (double)(g_allocBytes - b0) / calls};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t reports = 20000;
+    double smartstallPct = 5.0;
+    const char *corpusPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--reports") && i + 1 < argc) {
+            reports = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--smartstall-pct") && i + 1 < argc) {
+            smartstallPct = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--corpus") && i + 1 < argc) {
+            corpusPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--reports N] [--smartstall-pct P] [--corpus FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int advStatusFailures = checkAdvStatus();
+    if (advStatusFailures) {
+        return 1;
+    }
+    printf("adv_status parser/decision checks: ok\n");
+
+    std::vector<BleScanResult> corpus;
+    if (corpusPath) {
+        if (!loadCorpus(corpusPath, corpus) || corpus.empty()) {
+            fprintf(stderr, "cannot read corpus %s\n", corpusPath);
+            return 1;
+        }
+    } else {
+        corpus = syntheticCorpus(reports, smartstallPct, 1);
+    }
+
+    // Registry lives in the firmware; the world just supplies the clock. Format (don't print) logs.
+    sim::FleetConfig cfg;
+    cfg.devices = 0;
+    cfg.bystanders = 0;
+    sim::world().reset(cfg);
+    sim::world().formatLogs = true;
+
+    BleScanFilter filter;
+    filter.deviceName("SmartStall");
+    size_t delivered = 0, matched = 0;
+    for (const BleScanResult &r : corpus) {
+        delivered += filter.matches(r) ? 1 : 0;
+        matched += (r.advertisingData().deviceName() == "SmartStall") ? 1 : 0;
+    }
+
+    const int rounds = 5;
+    replay(corpus, 1, legacyOnScanResultReceived); // warm up registry and caches
+    Result legacy = replay(corpus, rounds, legacyOnScanResultReceived);
+    Result current = replay(corpus, rounds, onScanResultReceived);
+
+    printf("corpus: %zu reports, %zu SmartStall (%.1f%%)\n", corpus.size(), matched,
+           100.0 * (double)matched / (double)corpus.size());
+    printf("%-10s %16s %16s %16s\n", "callback", "callbacks/s", "allocs/callback", "bytes/callback");
+    printf("%-10s %16.0f %16.2f %16.1f\n", "legacy", legacy.callbacksPerSec, legacy.allocsPerCallback,
+           legacy.bytesPerCallback);
+    printf("%-10s %16.0f %16.2f %16.1f\n", "current", current.callbacksPerSec, current.allocsPerCallback,
+           current.bytesPerCallback);
+    printf("stack filter (name == SmartStall) delivers %zu / %zu reports (%.1f%%) to the callback\n", delivered,
+           corpus.size(), 100.0 * (double)delivered / (double)corpus.size());
+    return 0;
+}
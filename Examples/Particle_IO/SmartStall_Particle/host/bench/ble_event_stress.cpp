@@ -0,0 +1,187 @@
+/*
+ * Stress check for the hand-off between BLE callbacks and loop(). Built with ThreadSanitizer together
+ * with its own copy of the simulator and firmware; any data race it reports makes the process exit
+ * non-zero, as does any check below.
+ *
+ *   1. SpscRing alone: a producer thread pushes numbered items into a small ring, retrying while it is
+ *      full, as the consumer pops. Every item must arrive once, in order and intact, and dropped()
+ *      must equal the producer's failed pushes.
+ *   2. Firmware: after setup(), a producer thread plays the BLE thread. It calls onScanResultReceived()
+ *      for a set of SmartStall and bystander adverts, plus onConnected()/onDisconnected(), while the
+ *      main thread runs processBleEvents() as loop() does. Every SmartStall address must end up in the
+ *      registry, and no bystander may.
+ *
+ *   ble_event_stress [--items N] [--devices N] [--rounds N]
+ */
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "fleet_sim.h"
+#include "spsc_ring.h"
+
+void setup();
+void processBleEvents();
+void onScanResultReceived(const BleScanResult &scanResult);
+void onConnected(const BlePeerDevice &peer);
+void onDisconnected(const BlePeerDevice &peer);
+int findDeviceIndex(const BleAddress &addr);
+
+namespace {
+
+struct Item {
+    uint32_t seq;
+    uint32_t check;
+    uint8_t pad[24];
+};
+
+uint32_t checkOf(uint32_t seq) { return seq * 2654435761u ^ 0x5A5A5A5Au; }
+
+int stressRing(uint32_t items) {
+    SpscRing<Item, 64> ring;
+    std::atomic<bool> done{false};
+    uint32_t fullPushes = 0;
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < items; ++i) {
+            Item it;
+            it.seq = i;
+            it.check = checkOf(i);
+            memset(it.pad, (int)(i & 0xFF), sizeof(it.pad));
+            while (!ring.push(it)) {
+                fullPushes++;
+                std::this_thread::yield();
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    int failures = 0;
+    uint64_t popped = 0;
+    int64_t last = -1;
+    Item it;
+    for (;;) {
+        bool finished = done.load(std::memory_order_acquire);
+        bool any = false;
+        while (ring.pop(it)) {
+            any = true;
+            popped++;
+            bool padOk = true;
+            for (uint8_t b : it.pad) padOk = padOk && b == (uint8_t)(it.seq & 0xFF);
+            if ((int64_t)it.seq != last + 1 || it.check != checkOf(it.seq) || !padOk) {
+                if (failures++ < 5) fprintf(stderr, "ring: item %u out of order or torn\n", it.seq);
+            }
+            last = it.seq;
+        }
+        if (finished && !any) break;
+    }
+    producer.join();
+    if (popped != items || ring.dropped() != fullPushes) {
+        fprintf(stderr, "ring: popped %llu of %u, dropped %u vs %u full pushes\n", (unsigned long long)popped, items,
+                ring.dropped(), fullPushes);
+        failures++;
+    }
+    printf("SpscRing: %u items in order and intact; %u pushes found the ring full\n", items, fullPushes);
+    return failures;
+}
+
+BleAddress addressOf(int i, bool smartstall) {
+    uint8_t a[BLE_SIG_ADDR_LEN] = {(uint8_t)i, (uint8_t)(i >> 8), 0x5E, 0x11, (uint8_t)(smartstall ? 0xC0 : 0xB0), 0xE4};
+    return BleAddress(a);
+}
+
+BleAdvertisingData advertOf(bool smartstall) {
+    uint8_t buf[31];
+    size_t n = 0;
+    buf[n++] = 0x02;
+    buf[n++] = (uint8_t)BleAdvertisingDataType::FLAGS;
+    buf[n++] = 0x06;
+    const char *name = smartstall ? "SmartStall" : "Beacon";
+    size_t len = strlen(name);
+    buf[n++] = (uint8_t)(len + 1);
+    buf[n++] = (uint8_t)BleAdvertisingDataType::COMPLETE_LOCAL_NAME;
+    memcpy(buf + n, name, len);
+    n += len;
+    return BleAdvertisingData(buf, n);
+}
+
+int stressFirmware(int devices, int rounds) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    sim::FleetConfig cfg;
+    cfg.devices = 0;
+    cfg.bystanders = 0;
+    w.reset(cfg);
+    setup();
+
+    std::vector<BleScanResult> results;
+    for (int i = 0; i < devices; ++i) {
+        results.push_back(BleScanResult(addressOf(i, true), advertOf(true), BleAdvertisingData(), -60));
+        results.push_back(BleScanResult(addressOf(i, false), advertOf(false), BleAdvertisingData(), -70));
+    }
+    std::atomic<bool> done{false};
+    std::thread bleThread([&] {
+        for (int r = 0; r < rounds; ++r) {
+            for (const BleScanResult &res : results) {
+                onScanResultReceived(res);
+            }
+            BlePeerDevice p(-1, addressOf(r % devices, true));
+            onConnected(p);
+            onDisconnected(p);
+        }
+        done.store(true, std::memory_order_release);
+    });
+    for (;;) {
+        bool finished = done.load(std::memory_order_acquire);
+        processBleEvents();
+        if (finished) {
+            processBleEvents();
+            break;
+        }
+    }
+    bleThread.join();
+
+    int failures = 0;
+    for (int i = 0; i < devices; ++i) {
+        if (findDeviceIndex(addressOf(i, true)) < 0) {
+            if (failures++ < 5) fprintf(stderr, "SmartStall %d never registered\n", i);
+        }
+        if (findDeviceIndex(addressOf(i, false)) >= 0) {
+            if (failures++ < 5) fprintf(stderr, "bystander %d registered\n", i);
+        }
+    }
+    printf("firmware: %d rounds of %zu scan results + connect/disconnect from a second thread; %d devices registered\n",
+           rounds, results.size(), devices);
+    return failures;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    uint32_t items = 200000;
+    int devices = 100;
+    int rounds = 200;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--items") && i + 1 < argc) {
+            items = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--devices") && i + 1 < argc) {
+            devices = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rounds") && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--items N] [--devices N] [--rounds N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (devices < 1 || devices > 500 || rounds < 1) {
+        fprintf(stderr, "--devices must be 1..500 and --rounds at least 1\n");
+        return 2;
+    }
+    if (stressRing(items) || stressFirmware(devices, rounds)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * smartstall/bin round-trip check: encodes random per-device snapshot streams with the hub's
+ * keyframe policy (src/delta_codec.h) and decodes them with the host receiver
+ * (host/decoder). Every decoded snapshot, rendered through the smartstall/data field table, must
+ * equal the JSON the hub would have published for the original snapshot.
+ *
+ * Streams include counter resets and clock steps back (forced keyframes). They are replayed with
+ * increasing event loss; after a loss the receiver must refuse deltas and resynchronise at the next
+ * keyframe, never producing a wrong snapshot. Truncated and corrupted events must be rejected.
+ * Exits non-zero on any failure, then reports payload bytes per event against the JSON format.
+ *
+ *   delta_bench [--events N] [--devices N] [--seed N]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "delta_codec.h"
+#include "smartstall_data.h"
+#include "smartstall_decoder.h"
+
+namespace {
+
+const uint8_t KEYFRAME_INTERVAL = 8; // BIN_KEYFRAME_INTERVAL in the firmware
+
+struct Event {
+    SmartStallData data;
+    std::string payload; // base64 frame
+    bool keyframe;
+};
+
+std::string renderJson(const SmartStallData &d) {
+    char buf[SMARTSTALL_DATA_JSON_MAX];
+    JsonWriter w(buf, sizeof(buf));
+    writeJsonFields(w, SMARTSTALL_DATA_JSON_FIELDS, d);
+    return buf;
+}
+
+SmartStallData fromDecoded(const smartstall::DecodedSnapshot &s) {
+    SmartStallData d;
+    d.deviceAddress = s.address().c_str();
+    d.timestamp = s.fields.timestamp;
+    d.stallStatus = s.fields.status;
+    d.batteryVoltage = s.fields.batteryMv;
+    d.sensorCounts.limit_switch_triggers = s.fields.counts[0];
+    d.sensorCounts.cap_touch_triggers = s.fields.counts[1];
+    d.sensorCounts.hall_sensor_triggers = s.fields.counts[2];
+    d.isValid = true;
+    return d;
+}
+
+// Per-device encoder state, as DeviceInfo keeps it in the firmware
+struct Encoder {
+    bool hasBase = false;
+    uint8_t sequence = 0;
+    uint8_t sinceKeyframe = 0;
+    SnapshotFields base = {};
+};
+
+std::vector<Event> makeStream(int events, int devices, std::mt19937 &rng) {
+    std::vector<SnapshotFields> state(devices);
+    std::vector<Encoder> enc(devices);
+    for (int i = 0; i < devices; ++i) {
+        SnapshotFields &s = state[i];
+        s.address[0] = 0x02;
+        for (int b = 1; b < 6; ++b) s.address[b] = (uint8_t)rng();
+        s.timestamp = 1767254400u + rng() % 1000;
+        s.status = 1;
+        s.batteryMv = (uint16_t)(3500 + rng() % 700);
+        for (uint32_t &c : s.counts) c = rng() % 2 ? rng() % 100 : (uint32_t)rng();
+    }
+
+    std::vector<Event> out;
+    out.reserve(events);
+    for (int e = 0; e < events; ++e) {
+        int i = (int)(rng() % devices);
+        SnapshotFields &s = state[i];
+        uint32_t r = rng() % 1000;
+        if (r < 5) {
+            for (uint32_t &c : s.counts) c = rng() % 3; // peripheral reboot
+        } else if (r < 8) {
+            s.timestamp -= rng() % 3600; // hub clock stepped back
+        } else {
+            s.timestamp += rng() % 600;
+            for (uint32_t &c : s.counts) c += rng() % 4 == 0 ? rng() % 50 : 0;
+        }
+        s.status = (uint16_t)(rng() % 6);
+        s.batteryMv = (uint16_t)(s.batteryMv + (int)(rng() % 21) - 10);
+
+        Encoder &en = enc[i];
+        const SnapshotFields *base =
+            (en.hasBase && en.sinceKeyframe < KEYFRAME_INTERVAL && deltaEncodable(s, en.base)) ? &en.base : nullptr;
+        uint8_t frame[DELTA_FRAME_MAX];
+        size_t n = encodeSnapshotFrame(s, base, (uint16_t)i, en.sequence, frame);
+        char b64[DELTA_BASE64_MAX];
+        base64Encode(frame, n, b64, sizeof(b64));
+        en.sinceKeyframe = base ? en.sinceKeyframe + 1 : 0;
+        en.hasBase = true;
+        en.sequence++;
+        en.base = s;
+
+        Event ev;
+        char addr[18];
+        snprintf(addr, sizeof(addr), "%02X:%02X:%02X:%02X:%02X:%02X", s.address[0], s.address[1], s.address[2],
+                 s.address[3], s.address[4], s.address[5]);
+        ev.data.deviceAddress = addr;
+        ev.data.timestamp = s.timestamp;
+        ev.data.stallStatus = s.status;
+        ev.data.batteryVoltage = s.batteryMv;
+        ev.data.sensorCounts.limit_switch_triggers = s.counts[0];
+        ev.data.sensorCounts.cap_touch_triggers = s.counts[1];
+        ev.data.sensorCounts.hall_sensor_triggers = s.counts[2];
+        ev.data.isValid = true;
+        ev.payload = b64;
+        ev.keyframe = (base == nullptr);
+        out.push_back(ev);
+    }
+    return out;
+}
+
+struct Replay {
+    size_t delivered = 0;
+    size_t decoded = 0;
+    size_t refused = 0;
+    int failures = 0;
+};
+
+// Deliver the stream with the given loss rate; every decoded snapshot must match its source JSON
+Replay replay(const std::vector<Event> &events, int devices, double loss, std::mt19937 &rng) {
+    Replay r;
+    smartstall::DeltaDecoder dec;
+    std::vector<bool> lostSinceKeyframe(devices, false);
+    std::uniform_real_distribution<double> u(0, 1);
+    for (size_t e = 0; e < events.size(); ++e) {
+        const Event &ev = events[e];
+        int dev = -1;
+        // device index from the frame itself, for the resync bookkeeping
+        uint8_t frame[DELTA_FRAME_MAX];
+        int n = base64Decode(ev.payload.c_str(), ev.payload.size(), frame, sizeof(frame));
+        const uint8_t *p = frame + 1;
+        uint32_t index = 0;
+        if (n > 1 && getVarint(p, frame + n, index)) dev = (int)index;
+        if (dev < 0 || dev >= devices) {
+            fprintf(stderr, "event %zu: cannot read device index\n", e);
+            r.failures++;
+            continue;
+        }
+        if (ev.keyframe) lostSinceKeyframe[dev] = false;
+        if (u(rng) < loss) {
+            lostSinceKeyframe[dev] = true;
+            continue;
+        }
+        r.delivered++;
+        smartstall::DecodedSnapshot snap;
+        smartstall::DecodeStatus st = dec.decodeEvent(ev.payload.c_str(), snap);
+        if (st == smartstall::DecodeStatus::NeedKeyframe) {
+            r.refused++;
+            if (!lostSinceKeyframe[dev]) {
+                fprintf(stderr, "event %zu: delta refused without a preceding loss\n", e);
+                r.failures++;
+            }
+            continue;
+        }
+        if (st != smartstall::DecodeStatus::Ok) {
+            fprintf(stderr, "event %zu: decode failed (%d)\n", e, (int)st);
+            r.failures++;
+            continue;
+        }
+        if (lostSinceKeyframe[dev]) {
+            fprintf(stderr, "event %zu: delta applied across a lost event\n", e);
+            r.failures++;
+        }
+        r.decoded++;
+        std::string expect = renderJson(ev.data);
+        std::string got = renderJson(fromDecoded(snap));
+        if (expect != got) {
+            if (r.failures++ < 5) fprintf(stderr, "event %zu mismatch:\n  json    %s\n  decoded %s\n", e, expect.c_str(), got.c_str());
+        }
+    }
+    return r;
+}
+
+int checkMalformed(const std::vector<Event> &events) {
+    int failures = 0;
+    smartstall::DeltaDecoder dec;
+    smartstall::DecodedSnapshot snap;
+    for (size_t e = 0; e < events.size() && e < 2000; ++e) {
+        uint8_t frame[DELTA_FRAME_MAX];
+        const std::string &b64 = events[e].payload;
+        int n = base64Decode(b64.c_str(), b64.size(), frame, sizeof(frame));
+        for (int cut = 0; cut < n; ++cut) {
+            smartstall::DeltaDecoder fresh;
+            if (fresh.decodeFrame(frame, (size_t)cut, snap) == smartstall::DecodeStatus::Ok) {
+                fprintf(stderr, "truncated frame (%d of %d bytes) accepted\n", cut, n);
+                failures++;
+                break;
+            }
+        }
+        std::string bad = b64;
+        bad[bad.size() / 2] = '*';
+        if (dec.decodeEvent(bad.c_str(), snap) != smartstall::DecodeStatus::Malformed) {
+            fprintf(stderr, "corrupted base64 accepted\n");
+            failures++;
+        }
+    }
+    uint8_t futureVersion[] = {(uint8_t)((DELTA_FORMAT_VERSION + 1) << 4), 0, 0};
+    if (dec.decodeFrame(futureVersion, sizeof(futureVersion), snap) != smartstall::DecodeStatus::UnsupportedVersion) {
+        fprintf(stderr, "unknown version not reported\n");
+        failures++;
+    }
+    return failures;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int events = 100000;
+    int devices = 50;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--events") && i + 1 < argc) {
+            events = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--devices") && i + 1 < argc) {
+            devices = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--events N] [--devices N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (devices < 1 || devices > 0xFFFE) {
+        fprintf(stderr, "--devices must be 1..65534\n");
+        return 2;
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<Event> stream = makeStream(events, devices, rng);
+    if (checkMalformed(stream)) {
+        return 1;
+    }
+    printf("truncated/corrupted/unknown-version events rejected: ok\n");
+
+    printf("%8s %10s %10s %10s\n", "loss", "delivered", "decoded", "refused");
+    const double losses[] = {0.0, 0.01, 0.05, 0.20};
+    for (double loss : losses) {
+        Replay r = replay(stream, devices, loss, rng);
+        if (r.failures) {
+            fprintf(stderr, "round trip failed (%d) at %.0f%% loss\n", r.failures, 100 * loss);
+            return 1;
+        }
+        printf("%7.0f%% %10zu %10zu %10zu\n", 100 * loss, r.delivered, r.decoded, r.refused);
+    }
+    printf("every decoded snapshot matched its smartstall/data JSON\n");
+
+    size_t binBytes = 0, jsonBytes = 0, keyframes = 0;
+    for (const Event &ev : stream) {
+        binBytes += ev.payload.size();
+        jsonBytes += renderJson(ev.data).size();
+        keyframes += ev.keyframe ? 1 : 0;
+    }
+    printf("payload bytes/event: smartstall/data %.1f, smartstall/bin %.1f (%.1f%% keyframes)\n",
+           (double)jsonBytes / stream.size(), (double)binBytes / stream.size(), 100.0 * keyframes / stream.size());
+    return 0;
+}
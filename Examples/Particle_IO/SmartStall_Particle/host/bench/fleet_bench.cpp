@@ -0,0 +1,185 @@
+/*
+ * Fleet throughput benchmark: runs the unmodified hub firmware (setup()/loop()) against a
+ * simulated SmartStall fleet in accelerated virtual time and reports, per fleet size:
+ *   - polls/hour (successful status reads)
+ *   - p50/p99 time-to-detect (peripheral status change -> smartstall/data or smartstall/batch publish)
+ *   - radio airtime split between scanning and links, and link time per successful poll
+ *   - share of polls avoided by advertised status telemetry (from the hub's own ledger metrics)
+ *   - cloud events published and their payload bytes (build with -DSMARTSTALL_PUBLISH_FORMAT=1 or 2 to
+ *     compare the batched or binary delta formats)
+ *
+ * Each fleet size runs in a forked child so the firmware's globals start fresh.
+ *
+ *   fleet_bench [--hours H] [--sizes 12,25,50,100,200] [--seed N] [--bystanders N] [--adv-telemetry F]
+ *               [--verbose]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+
+namespace {
+
+struct Summary {
+    int devices;
+    int polled;
+    double pollsPerHour;
+    double p50DetectS;
+    double p99DetectS;
+    uint64_t detected;
+    uint64_t missed;
+    uint64_t changes;
+    uint64_t connects;
+    uint64_t connectFailures;
+    uint64_t publishes;
+    uint64_t publishRejected;
+    uint64_t publishBytes;
+    uint64_t ledgerBytes;
+    double scanAirPct;
+    double linkAirPct;
+    double linkMsPerPoll;
+    double advAvoidedPct;
+};
+
+double percentile(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)] / 1000.0;
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours, bool verbose) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    w.verbose = verbose;
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    while (w.now() < end) {
+        loop();
+    }
+    const sim::Stats &s = w.stats();
+    Summary r;
+    r.devices = cfg.devices;
+    r.polled = w.distinctPolled();
+    r.pollsPerHour = s.statusReads / hours;
+    r.p50DetectS = percentile(s.detectMs, 0.50);
+    r.p99DetectS = percentile(s.detectMs, 0.99);
+    r.detected = s.detectMs.size();
+    r.missed = s.missedChanges;
+    r.changes = s.statusChanges;
+    r.connects = s.connectAttempts;
+    r.connectFailures = s.connectFailures;
+    r.publishes = s.publishes;
+    r.publishRejected = s.publishRejected;
+    r.publishBytes = s.publishBytes;
+    r.ledgerBytes = s.ledgerBytes;
+    r.scanAirPct = 100.0 * (double)s.scanAirMs / (double)w.now();
+    r.linkAirPct = 100.0 * (double)s.linkAirMs / (double)w.now();
+    r.linkMsPerPoll = s.statusReads ? (double)s.linkAirMs / (double)s.statusReads : 0;
+    Variant metrics = Particle.ledger("device-to-cloud").get().get("hub").get("metrics");
+    double avoided = (double)metrics.get("adv_polls_avoided").toInt();
+    double polled = (double)metrics.get("poll_ok").toInt();
+    r.advAvoidedPct = (avoided + polled) > 0 ? 100.0 * avoided / (avoided + polled) : 0;
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, bool verbose, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours, verbose);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseSizes(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 6.0;
+    std::vector<int> sizes = {12, 25, 50, 100, 200};
+    sim::FleetConfig base;
+    bool verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--bystanders") && i + 1 < argc) {
+            base.bystanders = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--adv-telemetry") && i + 1 < argc) {
+            base.advTelemetryFraction = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--verbose")) {
+            verbose = true;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--hours H] [--sizes 12,25,...] [--seed N] [--bystanders N] [--adv-telemetry F]"
+                    " [--verbose]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    printf("SmartStall hub fleet benchmark: %.1f virtual hours, seed %u, %d bystanders, %.0f%% adv telemetry\n",
+           hours, base.seed, base.bystanders, 100.0 * base.advTelemetryFraction);
+    printf("%7s %7s %10s %8s %8s %9s %7s %9s %9s %7s %7s %8s %8s %7s %8s\n", "devices", "polled", "polls/h", "p50 ttd",
+           "p99 ttd", "detected", "missed", "connects", "conn_fail", "scan%", "link%", "ms/poll", "avoided",
+           "events", "pub KB");
+    for (int n : sizes) {
+        sim::FleetConfig cfg = base;
+        cfg.devices = n;
+        Summary s;
+        if (!runForked(cfg, hours, verbose, s)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        printf("%7d %7d %10.1f %7.1fs %7.1fs %9llu %7llu %9llu %9llu %6.1f%% %6.1f%% %8.0f %7.1f%% %7llu %8.1f\n", s.devices,
+               s.polled, s.pollsPerHour, s.p50DetectS, s.p99DetectS, (unsigned long long)s.detected,
+               (unsigned long long)s.missed, (unsigned long long)s.connects, (unsigned long long)s.connectFailures,
+               s.scanAirPct, s.linkAirPct, s.linkMsPerPoll, s.advAvoidedPct,
+               (unsigned long long)s.publishes, s.publishBytes / 1024.0);
+        if (s.publishRejected > 0) {
+            fprintf(stderr, "%d devices: %llu publishes rejected over the event data limit\n", n,
+                    (unsigned long long)s.publishRejected);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * Event payload benchmark: renders smartstall/data payloads with
+ *   - legacy  a replica of the former publishSmartStallData() body (String::format with "%.2f"), and
+ *   - current the firmware's field table (smartstall_data.h) through JsonWriter into a stack buffer,
+ * each followed by the "Publishing SmartStall data" log line (formatted, not printed), and reports
+ * ns/event plus heap allocations and bytes per event.
+ *
+ * It first checks that the writer is byte-for-byte identical to the legacy output. The check covers
+ * every battery millivolt value 0..65535 and random snapshots with edge-case counts and statuses,
+ * plus the batch item form against its snprintf equivalent. It exits non-zero on any mismatch.
+ *
+ *   json_bench [--events N] [--seed N]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "fleet_sim.h"
+#include "smartstall_data.h"
+
+// Global allocation counters for this binary (covers String and std:: containers)
+static uint64_t g_allocs = 0;
+static uint64_t g_allocBytes = 0;
+
+void *operator new(size_t n) {
+    g_allocs++;
+    g_allocBytes += n;
+    void *p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+// Former publishSmartStallData() payload, kept verbatim apart from unsigned long casts (64-bit host)
+String legacyPayload(const SmartStallData &currentData) {
+    bool isOccupied = (currentData.stallStatus == 2 || currentData.stallStatus == 5);
+    return String::format(
+        "{"
+        "\"device\":\"%s\","
+        "\"timestamp\":%lu,"
+        "\"status\":%d,"
+        "\"status_name\":\"%s\","
+        "\"occupied\":%s,"
+        "\"battery_mv\":%d,"
+        "\"battery_v\":%.2f,"
+        "\"sensor_counts\":{"
+            "\"limit_switch\":%lu,"
+            "\"cap_touch\":%lu,"
+            "\"hall_sensor\":%lu"
+        "}"
+        "}",
+        currentData.deviceAddress.c_str(),
+        currentData.timestamp,
+        currentData.stallStatus,
+        getStatusString(currentData.stallStatus),
+        isOccupied ? "true" : "false",
+        currentData.batteryVoltage,
+        currentData.batteryVoltage / 1000.0f,
+        (unsigned long)currentData.sensorCounts.limit_switch_triggers,
+        (unsigned long)currentData.sensorCounts.cap_touch_triggers,
+        (unsigned long)currentData.sensorCounts.hall_sensor_triggers
+    );
+}
+
+uint32_t randomCount(std::mt19937 &rng) {
+    switch (rng() % 4) {
+        case 0: return 0;
+        case 1: return 0xFFFFFFFFu;
+        case 2: return rng() % 1000;
+        default: return (uint32_t)rng();
+    }
+}
+
+SmartStallData randomSnapshot(std::mt19937 &rng) {
+    SmartStallData d;
+    char addr[18];
+    snprintf(addr, sizeof(addr), "%02X:%02X:%02X:%02X:%02X:%02X", (unsigned)(rng() & 0xFF),
+             (unsigned)(rng() & 0xFF), (unsigned)(rng() & 0xFF), (unsigned)(rng() & 0xFF),
+             (unsigned)(rng() & 0xFF), (unsigned)(rng() & 0xFF));
+    d.deviceAddress = addr;
+    d.stallStatus = (uint16_t)(rng() % 4 == 0 ? rng() % 0x10000 : rng() % 6);
+    d.batteryVoltage = (uint16_t)(rng() % 2 ? 3000 + rng() % 1300 : rng() % 0x10000);
+    d.sensorCounts.limit_switch_triggers = randomCount(rng);
+    d.sensorCounts.cap_touch_triggers = randomCount(rng);
+    d.sensorCounts.hall_sensor_triggers = randomCount(rng);
+    d.timestamp = rng() % 8 == 0 ? 0xFFFFFFFFUL : 1767254400UL + rng() % 100000000;
+    d.isValid = true;
+    return d;
+}
+
+int checkIdentical(uint32_t seed, int samples) {
+    int failures = 0;
+    char buf[SMARTSTALL_DATA_JSON_MAX];
+
+    for (uint32_t mv = 0; mv <= 0xFFFF; ++mv) {
+        char expect[16];
+        snprintf(expect, sizeof(expect), "%.2f", (uint16_t)mv / 1000.0f);
+        JsonWriter w(buf, sizeof(buf));
+        w.volts(mv);
+        if (strcmp(expect, w.c_str()) != 0) {
+            if (failures++ < 5) fprintf(stderr, "volts(%u): \"%s\" != \"%s\"\n", mv, w.c_str(), expect);
+        }
+    }
+
+    std::mt19937 rng(seed);
+    for (int i = 0; i < samples; ++i) {
+        SmartStallData d = randomSnapshot(rng);
+        String expect = legacyPayload(d);
+        JsonWriter w(buf, sizeof(buf));
+        if (!writeJsonFields(w, SMARTSTALL_DATA_JSON_FIELDS, d) || strcmp(expect.c_str(), w.c_str()) != 0) {
+            if (failures++ < 5) fprintf(stderr, "payload mismatch:\n  legacy %s\n  writer %s\n", expect.c_str(), w.c_str());
+        }
+
+        char item[SMARTSTALL_BATCH_ITEM_MAX];
+        char itemExpect[SMARTSTALL_BATCH_ITEM_MAX];
+        snprintf(itemExpect, sizeof(itemExpect), "[\"%s\",%lu,%d,%d,%lu,%lu,%lu]", d.deviceAddress.c_str(), d.timestamp,
+                 d.stallStatus, d.batteryVoltage, (unsigned long)d.sensorCounts.limit_switch_triggers,
+                 (unsigned long)d.sensorCounts.cap_touch_triggers, (unsigned long)d.sensorCounts.hall_sensor_triggers);
+        JsonWriter wi(item, sizeof(item));
+        if (!writeJsonFields(wi, SMARTSTALL_BATCH_ITEM_FIELDS, d) || strcmp(itemExpect, item) != 0) {
+            if (failures++ < 5) fprintf(stderr, "batch item mismatch:\n  snprintf %s\n  writer   %s\n", itemExpect, item);
+        }
+    }
+
+    // Overflow is reported and leaves a terminated buffer
+    char tiny[16];
+    JsonWriter w(tiny, sizeof(tiny));
+    std::mt19937 rng2(seed);
+    SmartStallData d = randomSnapshot(rng2);
+    if (writeJsonFields(w, SMARTSTALL_DATA_JSON_FIELDS, d) || strlen(tiny) >= sizeof(tiny)) {
+        fprintf(stderr, "overflow not detected\n");
+        failures++;
+    }
+    return failures;
+}
+
+struct PathResult {
+    double nsPerEvent;
+    double allocsPerEvent;
+    double bytesPerEvent;
+};
+
+template <typename Fn>
+PathResult measure(const std::vector<SmartStallData> &events, int rounds, Fn fn) {
+    uint64_t a0 = g_allocs, b0 = g_allocBytes;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (const SmartStallData &d : events) {
+            fn(d);
+        }
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    double n = (double)events.size() * rounds;
+    return {s * 1e9 / n, (double)(g_allocs - a0) / n, (double)(g_allocBytes - b0) / n};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int events = 10000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--events") && i + 1 < argc) {
+            events = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--events N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (checkIdentical(seed, 200000)) {
+        return 1;
+    }
+    printf("writer output identical to String::format (all battery mV, 200000 snapshots): ok\n");
+
+    // Log lines are formatted but not printed, which is what a SerialLogHandler costs on device
+    sim::FleetConfig cfg;
+    cfg.devices = 0;
+    cfg.bystanders = 0;
+    sim::world().reset(cfg);
+    sim::world().formatLogs = true;
+
+    std::mt19937 rng(seed + 1);
+    std::vector<SmartStallData> corpus;
+    corpus.reserve(events);
+    for (int i = 0; i < events; ++i) {
+        SmartStallData d = randomSnapshot(rng);
+        d.stallStatus = (uint16_t)(d.stallStatus % 6); // realistic statuses and battery for timing
+        d.batteryVoltage = (uint16_t)(3000 + d.batteryVoltage % 1300);
+        corpus.push_back(d);
+    }
+
+    const int rounds = 20;
+    volatile size_t sink = 0;
+    PathResult legacy = measure(corpus, rounds, [&](const SmartStallData &d) {
+        String jsonData = legacyPayload(d);
+        Log.info("Publishing SmartStall data: %s", jsonData.c_str());
+        sink = sink + jsonData.length();
+    });
+    PathResult current = measure(corpus, rounds, [&](const SmartStallData &d) {
+        char payload[SMARTSTALL_DATA_JSON_MAX];
+        JsonWriter json(payload, sizeof(payload));
+        writeJsonFields(json, SMARTSTALL_DATA_JSON_FIELDS, d);
+        Log.info("Publishing SmartStall data: %s", payload);
+        sink = sink + json.length();
+    });
+    PathResult bare = measure(corpus, rounds, [&](const SmartStallData &d) {
+        char payload[SMARTSTALL_DATA_JSON_MAX];
+        JsonWriter json(payload, sizeof(payload));
+        writeJsonFields(json, SMARTSTALL_DATA_JSON_FIELDS, d);
+        sink = sink + json.length();
+    });
+
+    printf("%-28s %10s %12s %12s\n", "path", "ns/event", "allocs/event", "bytes/event");
+    printf("%-28s %10.0f %12.2f %12.1f\n", "legacy String::format + log", legacy.nsPerEvent, legacy.allocsPerEvent,
+           legacy.bytesPerEvent);
+    printf("%-28s %10.0f %12.2f %12.1f\n", "JsonWriter + log", current.nsPerEvent, current.allocsPerEvent,
+           current.bytesPerEvent);
+    printf("%-28s %10.0f %12.2f %12.1f\n", "JsonWriter only", bare.nsPerEvent, bare.allocsPerEvent,
+           bare.bytesPerEvent);
+    return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * Latency histogram benchmark and check.
+ *
+ * First the histogram itself (latency_histogram.h): random samples spanning 0 ms to several minutes are
+ * recorded and p50/p90/p99 compared with the exact sorted-sample percentiles. A reported percentile must
+ * not be below the exact value nor more than one bucket (25 %, at least 1) above it; max must be exact.
+ * Also reports the cost of record().
+ *
+ * Then the hub: setup()/loop() run against the simulated fleet (a forked child per fleet size, so the
+ * firmware's globals start fresh) and the hub ledger's "latency" section is printed per phase, with the
+ * simulator's own change-to-publish p50/p99 next to the hub's detect_ms for reference. The
+ * latency_reset cloud function is then called and every phase must read n = 0 in the next ledger write.
+ * Virtual time: micros() only advances in blocking BLE calls, so publish_us reads 0 on the host.
+ *
+ * Exits non-zero when any check fails.
+ *
+ *   latency_bench [--hours H] [--sizes 12,50] [--seed N]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+#include "latency_histogram.h"
+
+void setup();
+void loop();
+void writeLedgers(bool force);
+
+namespace {
+
+const char *const PHASES[] = {"scan_to_connect_ms", "connect_ms", "discovery_ms", "reads_ms", "publish_us",
+                              "cooldown_ms", "cycle_ms", "detect_ms"};
+const int PHASE_COUNT = sizeof(PHASES) / sizeof(PHASES[0]);
+
+struct PhaseSummary {
+    int64_t n, p50, p90, p99, max;
+};
+
+struct Summary {
+    int devices;
+    PhaseSummary phases[PHASE_COUNT];
+    double simP50DetectMs;
+    double simP99DetectMs;
+    int resetReturn;
+    int64_t samplesAfterReset;
+};
+
+uint32_t exactPercentile(const std::vector<uint32_t> &sorted, uint16_t permille) {
+    uint64_t rank = ((uint64_t)sorted.size() * permille + 999) / 1000;
+    if (rank == 0) rank = 1;
+    return sorted[rank - 1];
+}
+
+// Log-uniform samples from 0 to ~2^19 plus a share of exact small values
+bool checkHistogram(uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> octaves(0.0, 19.0);
+    bool ok = true;
+    for (int trial = 0; trial < 20; ++trial) {
+        LatencyHistogram h;
+        std::vector<uint32_t> samples;
+        size_t n = 1 + rng() % 5000;
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t v = (rng() % 10 == 0) ? rng() % 4 : (uint32_t)std::exp2(octaves(rng));
+            samples.push_back(v);
+            h.record(v);
+        }
+        std::sort(samples.begin(), samples.end());
+        if (h.count() != n || h.max() != samples.back()) {
+            fprintf(stderr, "trial %d: count/max %u/%u, expected %zu/%u\n", trial, h.count(), h.max(), n,
+                    samples.back());
+            ok = false;
+        }
+        for (uint16_t pm : {500, 900, 990, 1000}) {
+            uint32_t exact = exactPercentile(samples, pm);
+            uint32_t got = h.percentile(pm);
+            uint32_t limit = exact + std::max<uint32_t>(1, exact / 4);
+            if (got < exact || got > limit) {
+                fprintf(stderr, "trial %d: p%.1f = %u, exact %u (allowed up to %u)\n", trial, pm / 10.0, got, exact,
+                        limit);
+                ok = false;
+            }
+        }
+    }
+    LatencyHistogram empty;
+    if (empty.percentile(500) != 0 || empty.max() != 0) {
+        fprintf(stderr, "empty histogram: p50 %u max %u\n", empty.percentile(500), empty.max());
+        ok = false;
+    }
+    LatencyHistogram big;
+    big.record(0xFFFFFFFFu);
+    if (big.percentile(990) != 0xFFFFFFFFu) {
+        fprintf(stderr, "top bucket: p99 %u\n", big.percentile(990));
+        ok = false;
+    }
+    return ok;
+}
+
+double recordNs() {
+    LatencyHistogram h;
+    std::vector<uint32_t> values(4096);
+    std::mt19937 rng(1);
+    for (uint32_t &v : values) v = rng() >> (rng() % 32);
+    const int rounds = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (uint32_t v : values) h.record(v);
+    }
+    auto end = std::chrono::steady_clock::now();
+    volatile uint32_t sink = h.percentile(500);
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(end - start).count() / ((double)rounds * values.size());
+}
+
+double simPercentileMs(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)];
+}
+
+// Two forced writes: with sharded ledgers one may go to a device shard, the other then goes to the hub
+void writeHubLedger() {
+    writeLedgers(true);
+    writeLedgers(true);
+}
+
+Variant latencySection() {
+    return Particle.ledger("device-to-cloud").get().get("hub").get("latency");
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    while (w.now() < end) {
+        loop();
+    }
+    writeHubLedger();
+    Summary r = {};
+    r.devices = cfg.devices;
+    Variant latency = latencySection();
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        Variant ph = latency.get(PHASES[p]);
+        r.phases[p] = {ph.get("n").toInt(), ph.get("p50").toInt(), ph.get("p90").toInt(), ph.get("p99").toInt(),
+                       ph.get("max").toInt()};
+    }
+    r.simP50DetectMs = simPercentileMs(w.stats().detectMs, 0.50);
+    r.simP99DetectMs = simPercentileMs(w.stats().detectMs, 0.99);
+
+    r.resetReturn = Particle.callFunction("latency_reset", "");
+    writeHubLedger();
+    latency = latencySection();
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        r.samplesAfterReset += latency.get(PHASES[p]).get("n").toInt();
+    }
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseList(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 2.0;
+    std::vector<int> sizes = {12, 50};
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool ok = checkHistogram(seed);
+    printf("histogram: %d buckets, %zu bytes, percentiles within one bucket of exact: %s, record() %.1f ns\n",
+           LATENCY_HISTOGRAM_BUCKETS, sizeof(LatencyHistogram), ok ? "yes" : "NO", recordNs());
+
+    for (int n : sizes) {
+        sim::FleetConfig cfg;
+        cfg.devices = n;
+        cfg.seed = seed;
+        Summary s;
+        if (!runForked(cfg, hours, s)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        printf("\n%d devices, %.1f virtual hours (simulator change-to-publish p50 %.0f ms, p99 %.0f ms)\n", n, hours,
+               s.simP50DetectMs, s.simP99DetectMs);
+        printf("%-20s %8s %8s %8s %8s %8s\n", "phase", "n", "p50", "p90", "p99", "max");
+        for (int p = 0; p < PHASE_COUNT; ++p) {
+            const PhaseSummary &ph = s.phases[p];
+            printf("%-20s %8lld %8lld %8lld %8lld %8lld\n", PHASES[p], (long long)ph.n, (long long)ph.p50,
+                   (long long)ph.p90, (long long)ph.p99, (long long)ph.max);
+        }
+        int64_t recorded = 0;
+        for (const PhaseSummary &ph : s.phases) recorded += ph.n;
+        bool resetOk = s.samplesAfterReset == 0 && s.resetReturn == (recorded > 0x7FFFFFFF ? 0x7FFFFFFF : recorded);
+        printf("latency_reset returned %d, samples after reset %lld: %s\n", s.resetReturn,
+               (long long)s.samplesAfterReset, resetOk ? "ok" : "FAILED");
+        ok = ok && resetOk && s.phases[1].n > 0;
+        fflush(stdout);
+    }
+    return ok ? 0 : 1;
+}
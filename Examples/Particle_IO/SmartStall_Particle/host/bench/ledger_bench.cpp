@@ -0,0 +1,169 @@
+/*
+ * Ledger cost benchmark. Built twice from the same source: ledger_bench links the firmware with the
+ * sharded device ledgers (SMARTSTALL_LEDGER_SHARDED=1, the default), ledger_bench_unified with the
+ * former single ledger rebuilt in full on every write. Per fleet size it reports:
+ *   - fleet run: ledger writes and bytes per minute from setup()/loop() against the simulated fleet,
+ *     the largest document offered and writes rejected over the 16 KB ledger limit;
+ *   - steady state: after the fleet run, every device is re-sighted each 5 s and a read completes
+ *     (writeLedgers(true)) as it does at the hub's poll rate. Reports host CPU spent in the ledger
+ *     writer and bytes written per minute of virtual time.
+ *
+ * Each fleet size runs in a forked child so the firmware's globals start fresh.
+ *
+ *   ledger_bench [--hours H] [--sizes 12,100,500] [--minutes M] [--seed N]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+int registerOrUpdateDevice(const BleAddress &addr);
+void writeLedgers(bool force);
+
+namespace {
+
+const uint64_t STEADY_STEP_MS = 5000; // LEDGER_MIN_GAP_MS, about one completed read at ~700 polls/h
+
+struct Summary {
+    int devices;
+    double fleetWritesPerMin;
+    double fleetKbPerMin;
+    uint64_t maxBytes;
+    uint64_t rejected;
+    double steadyWritesPerMin;
+    double steadyKbPerMin;
+    double steadyCpuUsPerMin;
+};
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours, double minutes) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    while (w.now() < end) {
+        loop();
+    }
+    const sim::Stats &s = w.stats();
+    Summary r;
+    r.devices = cfg.devices;
+    double fleetMin = (double)w.now() / 60000.0;
+    r.fleetWritesPerMin = (double)s.ledgerWrites / fleetMin;
+    r.fleetKbPerMin = (double)s.ledgerBytes / 1024.0 / fleetMin;
+
+    uint64_t writes0 = s.ledgerWrites, bytes0 = s.ledgerBytes;
+    std::vector<BleAddress> addrs;
+    for (const sim::Peripheral &p : w.peripherals()) {
+        if (p.smartstall) addrs.push_back(p.address);
+    }
+    const uint64_t steps = (uint64_t)(minutes * 60000.0) / STEADY_STEP_MS;
+    std::chrono::nanoseconds cpu(0);
+    for (uint64_t i = 0; i < steps; ++i) {
+        w.advance(STEADY_STEP_MS);
+        for (const BleAddress &a : addrs) {
+            registerOrUpdateDevice(a);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        writeLedgers(true);
+        cpu += std::chrono::steady_clock::now() - t0;
+    }
+    double steadyMin = (double)(steps * STEADY_STEP_MS) / 60000.0;
+    r.steadyWritesPerMin = (double)(s.ledgerWrites - writes0) / steadyMin;
+    r.steadyKbPerMin = (double)(s.ledgerBytes - bytes0) / 1024.0 / steadyMin;
+    r.steadyCpuUsPerMin = (double)cpu.count() / 1000.0 / steadyMin;
+    r.maxBytes = s.ledgerMaxBytes;
+    r.rejected = s.ledgerRejected;
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, double minutes, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours, minutes);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseSizes(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 1.0;
+    double minutes = 10.0;
+    std::vector<int> sizes = {12, 100, 500};
+    sim::FleetConfig base;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (!strcmp(argv[i], "--minutes") && i + 1 < argc) {
+            minutes = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,100,500] [--minutes M] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (hours <= 0 || minutes * 60000.0 < STEADY_STEP_MS) {
+        fprintf(stderr, "--hours must be > 0 and --minutes at least %.2f\n", STEADY_STEP_MS / 60000.0);
+        return 2;
+    }
+
+#if !defined(SMARTSTALL_LEDGER_SHARDED) || SMARTSTALL_LEDGER_SHARDED
+    printf("ledger layout: sharded (hub ledger + smartstall-devices-N)\n");
+#else
+    printf("ledger layout: unified (device-to-cloud only)\n");
+#endif
+    printf("%7s | %9s %9s %9s %8s | %9s %9s %11s\n", "devices", "writes/m", "KB/m", "max B", "rejected",
+           "writes/m", "KB/m", "cpu us/m");
+    for (int n : sizes) {
+        sim::FleetConfig cfg = base;
+        cfg.devices = n;
+        Summary s;
+        if (!runForked(cfg, hours, minutes, s)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        printf("%7d | %9.1f %9.1f %9llu %8llu | %9.1f %9.1f %11.0f\n", s.devices, s.fleetWritesPerMin,
+               s.fleetKbPerMin, (unsigned long long)s.maxBytes, (unsigned long long)s.rejected,
+               s.steadyWritesPerMin, s.steadyKbPerMin, s.steadyCpuUsPerMin);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Connection pool benchmark: polls/hour versus the number of concurrent poll links K. Runs the hub
+ * firmware built with SMARTSTALL_POLL_LINKS=3 against the simulated fleet, lowering pollLinkLimit to
+ * each K in turn (K=1 is the former one-device-at-a-time hub), and reports per fleet size and K:
+ *   - polls/hour and p50/p99 time-to-detect
+ *   - connect attempts and failures
+ *   - the most links the radio saw open at once
+ *   - the shortest gap from any link teardown to the next BLE.connect(), which must stay at or above
+ *     the hub's 2500 ms stack cooldown
+ *   - scans started while a link was open, which must be 0
+ * A run that breaks either rule makes the process exit non-zero.
+ *
+ * Each run is a forked child so the firmware's globals start fresh. Virtual time: every blocking BLE
+ * call costs its simulated latency, so K links overlap the waits between GATT operations (connect
+ * settle, retry gaps, the cooldown after a teardown) rather than the operations themselves.
+ *
+ *   link_bench [--hours H] [--sizes 12,50,100] [--links 1,2,3] [--seed N]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+extern int pollLinkLimit;
+
+namespace {
+
+const int64_t STACK_COOLDOWN_MS = 2500; // BLE_STACK_COOLDOWN_MS in the firmware
+
+struct Summary {
+    int devices;
+    int links;
+    double pollsPerHour;
+    double p50DetectS;
+    double p99DetectS;
+    uint64_t connects;
+    uint64_t connectFailures;
+    uint64_t maxLinksOpen;
+    int64_t minTeardownToConnectMs;
+    uint64_t scansWithLinks;
+};
+
+double percentile(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)] / 1000.0;
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, int links, double hours) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    pollLinkLimit = links;
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    while (w.now() < end) {
+        loop();
+    }
+    const sim::Stats &s = w.stats();
+    Summary r;
+    r.devices = cfg.devices;
+    r.links = links;
+    r.pollsPerHour = (double)s.statusReads / ((double)w.now() / 3600000.0);
+    r.p50DetectS = percentile(s.detectMs, 0.50);
+    r.p99DetectS = percentile(s.detectMs, 0.99);
+    r.connects = s.connectAttempts;
+    r.connectFailures = s.connectFailures;
+    r.maxLinksOpen = s.maxLinksOpen;
+    r.minTeardownToConnectMs = s.minTeardownToConnectMs;
+    r.scansWithLinks = s.scansWithLinks;
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, int links, double hours, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, links, hours);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseList(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 2.0;
+    std::vector<int> sizes = {12, 50, 100};
+    std::vector<int> links = {1, 2, 3};
+    sim::FleetConfig base;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--links") && i + 1 < argc) {
+            links = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50,100] [--links 1,2,3] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (int k : links) {
+        if (k > SMARTSTALL_POLL_LINKS) {
+            fprintf(stderr, "--links: at most %d (SMARTSTALL_POLL_LINKS of this build)\n", SMARTSTALL_POLL_LINKS);
+            return 2;
+        }
+    }
+
+    printf("%.1f virtual hours, seed %u\n", hours, base.seed);
+    printf("%7s %5s %9s %8s %8s %8s %9s %9s %13s %10s\n", "devices", "links", "polls/h", "p50 ttd", "p99 ttd",
+           "connects", "conn_fail", "max open", "teardown gap", "scan+link");
+    int violations = 0;
+    for (int n : sizes) {
+        for (int k : links) {
+            sim::FleetConfig cfg = base;
+            cfg.devices = n;
+            Summary s;
+            if (!runForked(cfg, k, hours, s)) {
+                fprintf(stderr, "simulation for %d devices, %d links failed\n", n, k);
+                return 1;
+            }
+            printf("%7d %5d %9.1f %7.1fs %7.1fs %8llu %9llu %9llu %11lldms %10llu\n", s.devices, s.links,
+                   s.pollsPerHour, s.p50DetectS, s.p99DetectS, (unsigned long long)s.connects,
+                   (unsigned long long)s.connectFailures, (unsigned long long)s.maxLinksOpen,
+                   (long long)s.minTeardownToConnectMs, (unsigned long long)s.scansWithLinks);
+            fflush(stdout);
+            if ((int)s.maxLinksOpen > k || (s.minTeardownToConnectMs >= 0 && s.minTeardownToConnectMs < STACK_COOLDOWN_MS)
+                    || s.scansWithLinks > 0) {
+                fprintf(stderr, "%d devices, %d links: stack rule broken\n", n, k);
+                violations++;
+            }
+        }
+    }
+    return violations ? 1 : 0;
+}
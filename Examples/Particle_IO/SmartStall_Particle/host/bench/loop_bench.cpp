@@ -0,0 +1,161 @@
+/*
+ * loop() latency benchmark. Runs setup()/loop() against the simulated fleet and reports, from the hub
+ * ledger metrics, the longest loop() iteration (idle delay excluded), the longest iteration that ran
+ * the discover/read/publish path and the number of iterations over 250 ms. It counts loop() passes
+ * (wakeups) per minute itself. Polls per hour and p50/p99 time-to-detect show that throughput holds up.
+ * A fleet of 0 devices is an idle hub (bystander adverts only).
+ *
+ * Each fleet size runs once per GATT read failure rate (retries are what used to be slept on), in a
+ * forked child so the firmware's globals start fresh. Virtual time: a blocking BLE call costs its
+ * simulated latency, a failed BLE.connect() its full timeout.
+ *
+ *   loop_bench [--hours H] [--sizes 0,12,50] [--read-fail 0.01,0.2] [--seed N]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+void writeLedgers(bool force);
+
+namespace {
+
+struct Summary {
+    int devices;
+    double readFailRate;
+    double pollsPerHour;
+    double passesPerMin;
+    int64_t loopMaxMs;
+    int64_t loopMaxPollMs;
+    int64_t loopSlow;
+    double p50DetectS;
+    double p99DetectS;
+};
+
+double percentile(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)] / 1000.0;
+}
+
+int64_t hubMetric(const char *name) {
+    return Particle.ledger("device-to-cloud").get().get("hub").get("metrics").get(name).toInt();
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    uint64_t passes = 0;
+    while (w.now() < end) {
+        loop();
+        passes++;
+    }
+    writeLedgers(true);
+    const sim::Stats &s = w.stats();
+    Summary r;
+    r.devices = cfg.devices;
+    r.readFailRate = cfg.readFailRate;
+    r.pollsPerHour = (double)s.statusReads / ((double)w.now() / 3600000.0);
+    r.passesPerMin = (double)passes / ((double)w.now() / 60000.0);
+    r.loopMaxMs = hubMetric("loop_max_ms");
+    r.loopMaxPollMs = hubMetric("loop_max_poll_ms");
+    r.loopSlow = hubMetric("loop_slow");
+    r.p50DetectS = percentile(s.detectMs, 0.50);
+    r.p99DetectS = percentile(s.detectMs, 0.99);
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+template <typename T>
+std::vector<T> parseList(const char *arg, T (*conv)(const char *)) {
+    std::vector<T> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        T v = conv(s.substr(pos, comma - pos).c_str());
+        if (v >= 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+int toInt(const char *s) { return atoi(s); }
+double toDouble(const char *s) { return atof(s); }
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 2.0;
+    std::vector<int> sizes = {0, 12, 50};
+    std::vector<double> readFail = {0.01, 0.2};
+    sim::FleetConfig base;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseList<int>(argv[++i], toInt);
+        } else if (!strcmp(argv[i], "--read-fail") && i + 1 < argc) {
+            readFail = parseList<double>(argv[++i], toDouble);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 0,12,50] [--read-fail 0.01,0.2] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%.1f virtual hours; loop times exclude loop()'s idle delay\n", hours);
+    printf("%7s %9s %8s %8s %9s %10s %6s %8s %8s\n", "devices", "read fail", "polls/h", "passes/m", "max ms",
+           "poll max", "slow", "p50 ttd", "p99 ttd");
+    for (int n : sizes) {
+        for (double rf : readFail) {
+            sim::FleetConfig cfg = base;
+            cfg.devices = n;
+            cfg.readFailRate = rf;
+            Summary s;
+            if (!runForked(cfg, hours, s)) {
+                fprintf(stderr, "simulation for %d devices failed\n", n);
+                return 1;
+            }
+            printf("%7d %8.0f%% %8.0f %8.0f %9lld %10lld %6lld %7.1fs %7.1fs\n", s.devices, 100 * s.readFailRate,
+                   s.pollsPerHour, s.passesPerMin, (long long)s.loopMaxMs, (long long)s.loopMaxPollMs, (long long)s.loopSlow,
+                   s.p50DetectS, s.p99DetectS);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,439 @@
+/*
+ * Hot-path microbenchmarks with a regression gate.
+ *
+ * Fixed workloads against the host build of the hub. For each fleet size, in a forked child so the
+ * firmware's globals start fresh, the simulated fleet runs for WARMUP_MIN virtual minutes to fill the
+ * registry, poll queue and ledgers; then, with the clock held:
+ *   find_hit          findDeviceIndex() for each registered device in turn
+ *   find_miss         findDeviceIndex() for addresses never seen
+ *   register_update   registerOrUpdateDevice() for each registered device (a re-sighting)
+ *   select_next       selectNextDeviceToPoll()
+ *   publish_data      publishSmartStallData() for each device, through the simulated cloud
+ *   ledger_hub        writeLedgers(true) with no device entry dirty: the hub ledger's Variant tree
+ *   ledger_shard      writeLedgers(true) for the shard of a device re-sighted a minute later
+ * and once, independent of the fleet:
+ *   format_data_json  the smartstall/data payload (SMARTSTALL_DATA_JSON_FIELDS into a stack buffer)
+ *   decode_reads      the three characteristic values of a poll (smartstall_data.h)
+ * Ledger timings include the simulated ledger's serialisation. Each is the fastest of REPEATS runs, in
+ * ns/op, with heap allocations per op. A fixed integer kernel (calibration) is timed the same way so
+ * results can be compared between hosts.
+ *
+ * --json writes the results. --baseline compares them with a results file: a benchmark regresses when
+ * its time relative to the calibration kernel exceeds the baseline's by more than --threshold (a ratio,
+ * default 1.30) and by more than one calibration op (timer noise on the few-ns lookups), or when it
+ * allocates more per op. A busy host slows a whole run, so a time regression must show again: the suite
+ * is rerun up to RECHECKS times and each benchmark keeps its fastest time. Benchmarks missing from the
+ * baseline are reported but do not fail. Exits 1 on a regression, 2 on errors.
+ *
+ *   micro_bench [--sizes 12,50,200] [--json OUT] [--baseline FILE] [--threshold R]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+#include "smartstall_data.h"
+
+void setup();
+void loop();
+int findDeviceIndex(const BleAddress &addr);
+int registerOrUpdateDevice(const BleAddress &addr);
+int selectNextDeviceToPoll();
+void publishSmartStallData(const SmartStallData &data, bool urgent);
+void writeLedgers(bool force);
+
+// Global allocation counters for this binary (covers String, Variant and std:: containers)
+static uint64_t g_allocs = 0;
+
+void *operator new(size_t n) {
+    g_allocs++;
+    void *p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+const int REPEATS = 7;
+const int RECHECKS = 2;
+const double WARMUP_MIN = 10.0;
+const int MAX_FLEET_RESULTS = 8;
+const uint64_t LEDGER_STEP_MS = 60000; // LEDGER_SEEN_RESOLUTION_MS: a re-sighting dirties the entry
+
+struct Result {
+    char name[24];
+    int devices;
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+struct FleetResults {
+    bool ok; // every timed ledger_shard call wrote a device shard
+    int count;
+    Result results[MAX_FLEET_RESULTS];
+};
+
+volatile uint64_t g_sink = 0;
+
+int64_t hubMetric(const char *name) {
+    return Particle.ledger("device-to-cloud").get().get("hub").get("metrics").get(name).toInt();
+}
+
+// Fastest of REPEATS runs of op(0..ops-1)
+template <typename F>
+Result measure(const char *name, int devices, uint64_t ops, F &&op) {
+    Result r = {};
+    snprintf(r.name, sizeof(r.name), "%s", name);
+    r.devices = devices;
+    r.nsPerOp = 1e300;
+    for (int rep = 0; rep < REPEATS; ++rep) {
+        uint64_t allocs0 = g_allocs;
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < ops; ++i) {
+            op(i);
+        }
+        auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0);
+        r.nsPerOp = std::min(r.nsPerOp, (double)dt.count() / (double)ops);
+        r.allocsPerOp = (double)(g_allocs - allocs0) / (double)ops;
+    }
+    return r;
+}
+
+// As measure(), timing op(i) only: prepare(i) runs untimed before each op
+template <typename P, typename F>
+Result measurePrepared(const char *name, int devices, uint64_t ops, P &&prepare, F &&op) {
+    Result r = {};
+    snprintf(r.name, sizeof(r.name), "%s", name);
+    r.devices = devices;
+    r.nsPerOp = 1e300;
+    for (int rep = 0; rep < REPEATS; ++rep) {
+        uint64_t allocs = 0;
+        std::chrono::nanoseconds dt(0);
+        for (uint64_t i = 0; i < ops; ++i) {
+            prepare(i);
+            uint64_t allocs0 = g_allocs;
+            auto t0 = std::chrono::steady_clock::now();
+            op(i);
+            dt += std::chrono::steady_clock::now() - t0;
+            allocs += g_allocs - allocs0;
+        }
+        r.nsPerOp = std::min(r.nsPerOp, (double)dt.count() / (double)ops);
+        r.allocsPerOp = (double)allocs / (double)ops;
+    }
+    return r;
+}
+
+// A dependent multiply/xorshift chain: a stand-in for the host's scalar speed
+Result calibrate() {
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    Result r = measure("calibration", 0, 1 << 22, [&](uint64_t) {
+        x ^= x >> 29;
+        x *= 0xBF58476D1CE4E5B9ull;
+    });
+    g_sink += x;
+    return r;
+}
+
+FleetResults runFleet(const sim::FleetConfig &cfg) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    setup();
+    const uint64_t end = (uint64_t)(WARMUP_MIN * 60000.0);
+    while (w.now() < end) {
+        loop();
+    }
+
+    std::vector<BleAddress> present, absent;
+    std::vector<SmartStallData> snapshots;
+    for (const sim::Peripheral &p : w.peripherals()) {
+        if (!p.smartstall) continue;
+        present.push_back(p.address);
+        SmartStallData d = {};
+        d.deviceAddress = p.address.toString();
+        d.stallStatus = p.status;
+        d.batteryVoltage = p.batteryMv;
+        d.sensorCounts = {p.counts[0], p.counts[1], p.counts[2]};
+        d.timestamp = (unsigned long)w.unixTime();
+        d.isValid = true;
+        snapshots.push_back(d);
+    }
+    std::mt19937_64 rng(cfg.seed);
+    for (size_t i = 0; i < present.size(); ++i) {
+        uint8_t a[BLE_SIG_ADDR_LEN];
+        for (uint8_t &b : a) b = (uint8_t)rng();
+        absent.push_back(BleAddress(a));
+    }
+    const size_t n = present.size();
+
+    FleetResults out = {};
+    auto add = [&](const Result &r) {
+        if (out.count < MAX_FLEET_RESULTS) out.results[out.count++] = r;
+    };
+    add(measure("find_hit", cfg.devices, 200000, [&](uint64_t i) { g_sink += findDeviceIndex(present[i % n]); }));
+    add(measure("find_miss", cfg.devices, 200000, [&](uint64_t i) { g_sink += findDeviceIndex(absent[i % n]); }));
+    add(measure("register_update", cfg.devices, 100000,
+                [&](uint64_t i) { g_sink += registerOrUpdateDevice(present[i % n]); }));
+    add(measure("select_next", cfg.devices, 100000, [&](uint64_t) { g_sink += selectNextDeviceToPoll(); }));
+    add(measure("publish_data", cfg.devices, 20000,
+                [&](uint64_t i) { publishSmartStallData(snapshots[i % n], false); }));
+    add(measure("ledger_hub", cfg.devices, 2000, [&](uint64_t) { writeLedgers(true); }));
+    // writeLedgers(true) alternates the hub ledger with dirty shards: the untimed call writes the hub (no
+    // shard is dirty), the timed one the shard the re-sighting dirtied
+    writeLedgers(true);
+    int64_t shardWrites0 = hubMetric("ledger_devices_writes");
+    const uint64_t shardOps = 500;
+    add(measurePrepared("ledger_shard", cfg.devices, shardOps, [&](uint64_t) { writeLedgers(true); },
+        [&](uint64_t i) {
+            w.advance(LEDGER_STEP_MS);
+            registerOrUpdateDevice(present[i % n]);
+            writeLedgers(true);
+        }));
+    writeLedgers(true); // the hub ledger carries the metric
+    int64_t shardWrites = hubMetric("ledger_devices_writes") - shardWrites0;
+    out.ok = shardWrites == (int64_t)(shardOps * REPEATS);
+    if (!out.ok) {
+        fprintf(stderr, "ledger_shard: %lld device shard writes in %llu timed calls\n", (long long)shardWrites,
+                (unsigned long long)(shardOps * REPEATS));
+    }
+    return out;
+}
+
+bool runForked(const sim::FleetConfig &cfg, FleetResults &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        FleetResults s = runFleet(cfg);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) && s.ok ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<Result> runStandalone() {
+    std::vector<Result> out;
+    SmartStallData d = {};
+    d.deviceAddress = "C4:7F:51:0A:3B:E2";
+    d.stallStatus = 2;
+    d.batteryVoltage = 3917;
+    d.sensorCounts = {182734, 9921, 40012};
+    d.timestamp = 1760000000;
+    d.isValid = true;
+    out.push_back(measure("format_data_json", 0, 200000, [&](uint64_t i) {
+        d.stallStatus = (uint16_t)(i % 6);
+        char payload[SMARTSTALL_DATA_JSON_MAX];
+        JsonWriter json(payload, sizeof(payload));
+        writeJsonFields(json, SMARTSTALL_DATA_JSON_FIELDS, d);
+        g_sink += (uint8_t)payload[20];
+    }));
+
+    // Status, battery and counts values as read from a poll, varied per op
+    uint8_t values[64][2 + 2 + SENSOR_COUNTS_VALUE_LEN];
+    std::mt19937 rng(3);
+    for (auto &v : values) {
+        for (uint8_t &b : v) b = (uint8_t)rng();
+    }
+    out.push_back(measure("decode_reads", 0, 1000000, [&](uint64_t i) {
+        const uint8_t *v = values[i % 64];
+        SensorCounts counts;
+        decodeSensorCounts(v + 4, counts);
+        g_sink += decodeUint16Value(v) + decodeUint16Value(v + 2) + counts.limit_switch_triggers
+            + counts.cap_touch_triggers + counts.hall_sensor_triggers;
+    }));
+    return out;
+}
+
+bool writeJson(const std::string &path, const Result &calibration, const std::vector<Result> &results) {
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "{\n  \"calibration_ns\": %.4f,\n  \"results\": [\n", calibration.nsPerOp);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"devices\": %d, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f}%s\n", r.name,
+                r.devices, r.nsPerOp, r.allocsPerOp, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// Reads a file written by writeJson (one result object per line)
+bool readJson(const std::string &path, double &calibrationNs, std::vector<Result> &results) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string s = text.str();
+    size_t at = s.find("\"calibration_ns\":");
+    if (at == std::string::npos) return false;
+    calibrationNs = strtod(s.c_str() + at + 17, nullptr);
+    results.clear();
+    std::istringstream lines(s);
+    std::string line;
+    while (std::getline(lines, line)) {
+        Result r = {};
+        if (sscanf(line.c_str(), " {\"name\": \"%23[^\"]\", \"devices\": %d, \"ns_per_op\": %lf, \"allocs_per_op\": %lf",
+                   r.name, &r.devices, &r.nsPerOp, &r.allocsPerOp) == 4) {
+            results.push_back(r);
+        }
+    }
+    return calibrationNs > 0 && !results.empty();
+}
+
+// The standalone benchmarks, then each fleet size's, in a fixed order. false when a simulation fails.
+bool runAll(const std::vector<int> &sizes, std::vector<Result> &results) {
+    results = runStandalone();
+    for (int n : sizes) {
+        sim::FleetConfig cfg;
+        cfg.devices = n;
+        cfg.seed = 1;
+        FleetResults fleet;
+        if (!runForked(cfg, fleet)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return false;
+        }
+        results.insert(results.end(), fleet.results, fleet.results + fleet.count);
+    }
+    return true;
+}
+
+struct Verdict {
+    const Result *baseline; // nullptr: not in the baseline
+    double ratio;           // time relative to the baseline's, on this host
+    bool slower;
+    bool allocs;
+};
+
+Verdict judge(const Result &r, const std::vector<Result> &baseline, double calibrationNs,
+              double baselineCalibrationNs, double threshold) {
+    Verdict v = {};
+    auto b = std::find_if(baseline.begin(), baseline.end(), [&](const Result &x) {
+        return x.devices == r.devices && !strcmp(x.name, r.name);
+    });
+    if (b == baseline.end()) return v;
+    double scaled = b->nsPerOp * calibrationNs / baselineCalibrationNs; // baseline on this host
+    v.baseline = &*b;
+    v.ratio = r.nsPerOp / scaled;
+    v.slower = v.ratio > threshold && r.nsPerOp - scaled > calibrationNs;
+    v.allocs = r.allocsPerOp > b->allocsPerOp + 0.005;
+    return v;
+}
+
+std::vector<int> parseSizes(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::vector<int> sizes = {12, 50, 200};
+    std::string jsonPath, baselinePath;
+    double threshold = 1.30;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--sizes 12,50,200] [--json OUT] [--baseline FILE] [--threshold R]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    double baselineCalibrationNs = 0;
+    std::vector<Result> baseline;
+    if (!baselinePath.empty() && !readJson(baselinePath, baselineCalibrationNs, baseline)) {
+        fprintf(stderr, "cannot read baseline %s\n", baselinePath.c_str());
+        return 2;
+    }
+
+    Result calibration = calibrate();
+    std::vector<Result> results;
+    if (!runAll(sizes, results)) return 2;
+    // Timings above are taken after the fleets' forks, so the calibration is repeated and the faster kept
+    Result again = calibrate();
+    calibration.nsPerOp = std::min(calibration.nsPerOp, again.nsPerOp);
+    int reruns = 0;
+    auto anySlower = [&] {
+        return std::any_of(results.begin(), results.end(), [&](const Result &r) {
+            return judge(r, baseline, calibration.nsPerOp, baselineCalibrationNs, threshold).slower;
+        });
+    };
+    while (!baseline.empty() && reruns < RECHECKS && anySlower()) {
+        std::vector<Result> rerun;
+        if (!runAll(sizes, rerun)) return 2;
+        for (size_t i = 0; i < results.size() && i < rerun.size(); ++i) {
+            results[i].nsPerOp = std::min(results[i].nsPerOp, rerun[i].nsPerOp);
+        }
+        calibration.nsPerOp = std::min(calibration.nsPerOp, calibrate().nsPerOp);
+        reruns++;
+    }
+
+    printf("calibration %.3f ns/op%s", calibration.nsPerOp, baseline.empty() ? "\n" : "");
+    if (!baseline.empty()) {
+        printf(" (baseline %.3f); regression above %.2fx the baseline, relative to calibration", baselineCalibrationNs,
+               threshold);
+        printf(reruns ? "; fastest of %d runs\n" : "\n", reruns + 1);
+    }
+    printf("%-17s %7s %11s %10s %11s %7s  %s\n", "benchmark", "devices", "ns/op", "allocs/op", "baseline", "ratio",
+           "");
+    bool regressed = false;
+    for (const Result &r : results) {
+        Verdict v = judge(r, baseline, calibration.nsPerOp, baselineCalibrationNs, threshold);
+        char base[16] = "-", ratio[16] = "-";
+        const char *verdict = baseline.empty() ? "" : "new";
+        if (v.baseline) {
+            snprintf(base, sizeof(base), "%.1f", v.baseline->nsPerOp);
+            snprintf(ratio, sizeof(ratio), "%.2f", v.ratio);
+            verdict = v.slower && v.allocs ? "REGRESSED (time, allocs)" : v.slower ? "REGRESSED (time)"
+                : v.allocs ? "REGRESSED (allocs)" : "ok";
+            regressed = regressed || v.slower || v.allocs;
+        }
+        printf("%-17s %7d %11.1f %10.2f %11s %7s  %s\n", r.name, r.devices, r.nsPerOp, r.allocsPerOp, base, ratio,
+               verdict);
+    }
+
+    if (!jsonPath.empty() && !writeJson(jsonPath, calibration, results)) {
+        fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+        return 2;
+    }
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Cloud event batching check: drives the firmware's PublishBatcher (publish_batch.h) with random
+ * snapshot streams under the hub's flush policy — flush before an item that does not fit, and once
+ * per loop iteration when due (urgent item or oldest item past the age limit) — then parses every
+ * event back and verifies:
+ *   - no event exceeds the 1024-byte publish limit
+ *   - the snapshots recovered from all events equal the snapshots submitted, in order
+ *     (nothing lost, nothing duplicated)
+ *   - non-urgent snapshots wait no longer than the age limit plus one loop iteration
+ * Exits non-zero on any failure, then reports events per snapshot and bytes versus the per-device
+ * smartstall/data format.
+ *
+ *   publish_bench [--snapshots N] [--devices N] [--urgent-pct P] [--seed N]
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "publish_batch.h"
+
+namespace {
+
+const size_t PUBLISH_MAX_DATA_LEN = 1024;
+const unsigned long MAX_AGE_MS = 30000;
+
+struct Snapshot {
+    char device[18];
+    unsigned long timestamp;
+    int status;
+    int batteryMv;
+    unsigned long counts[3];
+    unsigned long queuedMs;
+    bool urgent;
+};
+
+bool sameSnapshot(const Snapshot &a, const Snapshot &b) {
+    return strcmp(a.device, b.device) == 0 && a.timestamp == b.timestamp && a.status == b.status
+           && a.batteryMv == b.batteryMv && a.counts[0] == b.counts[0] && a.counts[1] == b.counts[1]
+           && a.counts[2] == b.counts[2];
+}
+
+// Same item layout as publishSmartStallData() in batched format
+int renderItem(const Snapshot &s, char *out, size_t len) {
+    return snprintf(out, len, "[\"%s\",%lu,%d,%d,%lu,%lu,%lu]", s.device, s.timestamp, s.status, s.batteryMv,
+                    s.counts[0], s.counts[1], s.counts[2]);
+}
+
+// Same payload as publishSmartStallData() in per-device format, for the byte comparison
+int renderPerDevice(const Snapshot &s, char *out, size_t len) {
+    static const char *const NAMES[] = {"UNKNOWN", "INIT", "LOCKED", "UNLOCKED", "SLEEP", "PRE_SLEEP"};
+    bool occupied = (s.status == 2 || s.status == 5);
+    return snprintf(out, len,
+                    "{\"device\":\"%s\",\"timestamp\":%lu,\"status\":%d,\"status_name\":\"%s\",\"occupied\":%s,"
+                    "\"battery_mv\":%d,\"battery_v\":%.2f,\"sensor_counts\":{\"limit_switch\":%lu,"
+                    "\"cap_touch\":%lu,\"hall_sensor\":%lu}}",
+                    s.device, s.timestamp, s.status, NAMES[s.status], occupied ? "true" : "false", s.batteryMv,
+                    s.batteryMv / 1000.0f, s.counts[0], s.counts[1], s.counts[2]);
+}
+
+bool parseBatch(const char *payload, std::vector<Snapshot> &out) {
+    const char *prefix = "{\"v\":1,\"d\":[";
+    size_t plen = strlen(prefix);
+    size_t len = strlen(payload);
+    if (len < plen + 2 || strncmp(payload, prefix, plen) != 0 || strcmp(payload + len - 2, "]}") != 0) {
+        return false;
+    }
+    const char *p = payload + plen;
+    const char *end = payload + len - 2;
+    while (p < end) {
+        Snapshot s = {};
+        int n = 0;
+        if (sscanf(p, "[\"%17[^\"]\",%lu,%d,%d,%lu,%lu,%lu]%n", s.device, &s.timestamp, &s.status, &s.batteryMv,
+                   &s.counts[0], &s.counts[1], &s.counts[2], &n) != 7 || n == 0) {
+            return false;
+        }
+        out.push_back(s);
+        p += n;
+        if (p < end) {
+            if (*p != ',') return false;
+            p++;
+        }
+    }
+    return p == end;
+}
+
+struct Result {
+    size_t snapshots = 0;
+    size_t events = 0;
+    size_t eventBytes = 0;
+    size_t maxEventBytes = 0;
+    size_t perDeviceBytes = 0;
+    unsigned long maxNonUrgentWaitMs = 0;
+    unsigned long maxLoopGapMs = 0;
+    int failures = 0;
+};
+
+Result run(size_t snapshots, int devices, double urgentPct, uint32_t seed) {
+    Result r;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> coin(0, 9999);
+    PublishBatcher<PUBLISH_MAX_DATA_LEN> batch(MAX_AGE_MS);
+
+    std::vector<Snapshot> submitted, published;
+    std::vector<size_t> pending; // indices into submitted, in the current batch
+    unsigned long now = 0;
+
+    auto flush = [&]() {
+        if (batch.empty()) return;
+        const char *payload = batch.finish();
+        size_t len = strlen(payload);
+        if (len != batch.finishedLength()) {
+            fprintf(stderr, "finishedLength() %zu != strlen %zu\n", batch.finishedLength(), len);
+            r.failures++;
+        }
+        if (len > PUBLISH_MAX_DATA_LEN) {
+            fprintf(stderr, "event of %zu bytes exceeds the publish limit\n", len);
+            r.failures++;
+        }
+        std::vector<Snapshot> items;
+        if (!parseBatch(payload, items) || items.size() != batch.count()) {
+            fprintf(stderr, "event does not parse: %s\n", payload);
+            r.failures++;
+        }
+        published.insert(published.end(), items.begin(), items.end());
+        for (size_t i : pending) {
+            if (!submitted[i].urgent) {
+                r.maxNonUrgentWaitMs = std::max(r.maxNonUrgentWaitMs, now - submitted[i].queuedMs);
+            }
+        }
+        pending.clear();
+        r.events++;
+        r.eventBytes += len;
+        r.maxEventBytes = std::max(r.maxEventBytes, len);
+        batch.clear();
+    };
+
+    while (submitted.size() < snapshots) {
+        // One loop iteration: either a GATT poll (one snapshot) or an advert drain (a burst)
+        int burst = coin(rng) < 2000 ? 1 + coin(rng) % 12 : 1;
+        for (int b = 0; b < burst && submitted.size() < snapshots; ++b) {
+            Snapshot s = {};
+            int dev = coin(rng) % devices;
+            snprintf(s.device, sizeof(s.device), "02:00:00:00:%02X:%02X", (dev >> 8) & 0xFF, dev & 0xFF);
+            s.timestamp = 1767254400UL + now / 1000;
+            s.status = coin(rng) % 6;
+            s.batteryMv = 3000 + coin(rng) % 1300;
+            // Mix of digit lengths up to the uint32 maximum so item sizes vary at the capacity edge
+            for (unsigned long &c : s.counts) {
+                int digits = 1 + coin(rng) % 10;
+                unsigned long v = (unsigned long)rng() % 4294967296UL;
+                for (int d = 10; d > digits; --d) v /= 10;
+                c = v;
+            }
+            s.queuedMs = now;
+            s.urgent = coin(rng) < (int)(urgentPct * 100.0);
+
+            char item[96];
+            int itemLen = renderItem(s, item, sizeof(item));
+            char full[320];
+            r.perDeviceBytes += (size_t)renderPerDevice(s, full, sizeof(full));
+            if (!batch.fits(itemLen)) {
+                flush();
+            }
+            if (!batch.add(item, itemLen, s.urgent, now)) {
+                fprintf(stderr, "item rejected by an empty batch: %s\n", item);
+                r.failures++;
+                continue;
+            }
+            pending.push_back(submitted.size());
+            submitted.push_back(s);
+        }
+        unsigned long gap = 100 + (unsigned long)(coin(rng) % 5000);
+        r.maxLoopGapMs = std::max(r.maxLoopGapMs, gap);
+        now += gap;
+        if (batch.due(now)) {
+            flush();
+        }
+    }
+    flush();
+
+    r.snapshots = submitted.size();
+    if (published.size() != submitted.size()) {
+        fprintf(stderr, "%zu snapshots submitted, %zu published\n", submitted.size(), published.size());
+        r.failures++;
+    }
+    for (size_t i = 0; i < std::min(published.size(), submitted.size()); ++i) {
+        if (!sameSnapshot(published[i], submitted[i])) {
+            fprintf(stderr, "snapshot %zu differs after the round trip\n", i);
+            r.failures++;
+            break;
+        }
+    }
+    if (r.maxNonUrgentWaitMs > MAX_AGE_MS + r.maxLoopGapMs) {
+        fprintf(stderr, "a snapshot waited %lu ms (age limit %lu ms)\n", r.maxNonUrgentWaitMs, MAX_AGE_MS);
+        r.failures++;
+    }
+    return r;
+}
+
+// Capacity edge cases independent of the random stream
+int checkEdges() {
+    int failures = 0;
+    PublishBatcher<32> small(1000);
+    char big[40];
+    memset(big, 'x', sizeof(big));
+    // 32 bytes = prefix (12) + item + suffix (2) + NUL: the largest item that fits is 17 bytes
+    if (!small.fits(17) || small.fits(18)) {
+        fprintf(stderr, "fits() disagrees with the capacity bound\n");
+        failures++;
+    }
+    if (small.add(big, 18, false, 0)) {
+        fprintf(stderr, "oversized item accepted\n");
+        failures++;
+    }
+    if (!small.add(big, 17, false, 0) || strlen(small.finish()) != 31) {
+        fprintf(stderr, "exact-fit item not accepted or payload length wrong\n");
+        failures++;
+    }
+    small.clear();
+    small.add(big, 8, false, 0);
+    if (small.fits(9) || !small.fits(8)) { // second item also needs its separator
+        fprintf(stderr, "fits() does not count the separator\n");
+        failures++;
+    }
+    if (small.due(999) || !small.due(1000)) {
+        fprintf(stderr, "age limit not honoured\n");
+        failures++;
+    }
+    small.add(big, 6, true, 10);
+    if (!small.due(10)) {
+        fprintf(stderr, "urgent item does not make the batch due\n");
+        failures++;
+    }
+    return failures;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t snapshots = 200000;
+    int devices = 50;
+    double urgentPct = 30.0;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--snapshots") && i + 1 < argc) {
+            snapshots = (size_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--devices") && i + 1 < argc) {
+            devices = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--urgent-pct") && i + 1 < argc) {
+            urgentPct = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--snapshots N] [--devices N] [--urgent-pct P] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (checkEdges()) {
+        return 1;
+    }
+    printf("publish_batch capacity/age checks: ok\n");
+
+    printf("%10s %8s %8s %10s %10s %10s %10s\n", "urgent", "events", "ev/snap", "bytes/ev", "max bytes",
+           "bytes/snap", "max wait");
+    const double urgentLevels[] = {0.0, urgentPct, 100.0};
+    for (double u : urgentLevels) {
+        Result r = run(snapshots, devices, u, seed);
+        if (r.failures) {
+            fprintf(stderr, "batch verification failed (%d) at %.0f%% urgent\n", r.failures, u);
+            return 1;
+        }
+        printf("%9.0f%% %8zu %8.3f %10.0f %10zu %10.1f %9.1fs\n", u, r.events, (double)r.events / r.snapshots,
+               (double)r.eventBytes / r.events, r.maxEventBytes, (double)r.eventBytes / r.snapshots,
+               r.maxNonUrgentWaitMs / 1000.0);
+        if (u == 0.0) {
+            printf("%10s %8zu %8.3f %10.0f %10s %10.1f %10s   (per-device smartstall/data)\n", "-", r.snapshots,
+                   1.0, (double)r.perDeviceBytes / r.snapshots, "-", (double)r.perDeviceBytes / r.snapshots, "-");
+        }
+    }
+    printf("%zu snapshots per run, %d devices: no loss, no duplication, all events <= %zu bytes\n", snapshots,
+           devices, PUBLISH_MAX_DATA_LEN);
+    return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * Store-and-forward benchmark. Built twice from the same source: queue_bench links the firmware with
+ * the persistent event queue (SMARTSTALL_EVENT_QUEUE=1, the default), queue_bench_noqueue with the
+ * former fire-and-forget publish.
+ *
+ * It first checks SnapshotQueue (src/event_queue.h) against an in-memory model on a scratch file:
+ * random pushes past capacity (overwrite oldest), pops, peeks, reopening (persistence), a torn record
+ * (checksum) and a corrupted header. It exits non-zero on any mismatch.
+ *
+ * Then, per fleet size, it runs setup()/loop() against the simulated fleet with the cloud unreachable
+ * for part of the run, and reports snapshots the cloud received (and how many arrived more than 60 s
+ * after their read), publishes that failed offline, queue drops and depth from the hub ledger metrics,
+ * and p50/p99 time-to-detect.
+ *
+ *   queue_bench [--hours H] [--sizes 12,50] [--outage-start H] [--outage-min M] [--seed N]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "event_queue.h"
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const uint16_t CHECK_CAPACITY = 16;
+
+QueuedSnapshot randomSnapshot(std::mt19937 &rng) {
+    QueuedSnapshot s;
+    for (uint8_t &b : s.fields.address) b = (uint8_t)rng();
+    s.fields.timestamp = rng();
+    s.fields.status = (uint16_t)(rng() % 6);
+    s.fields.batteryMv = (uint16_t)rng();
+    for (uint32_t &c : s.fields.counts) c = rng();
+    s.flags = (uint8_t)(rng() & QUEUED_SNAPSHOT_URGENT);
+    for (uint32_t &d : s.usage.delta) d = rng();
+    s.usage.intervalS = rng();
+    s.usage.flags = (uint8_t)(rng() & (COUNTER_USAGE_VALID | COUNTER_USAGE_RESET));
+    return s;
+}
+
+bool sameSnapshot(const QueuedSnapshot &a, const QueuedSnapshot &b) {
+    return memcmp(a.fields.address, b.fields.address, 6) == 0 && a.fields.timestamp == b.fields.timestamp &&
+           a.fields.status == b.fields.status && a.fields.batteryMv == b.fields.batteryMv &&
+           memcmp(a.fields.counts, b.fields.counts, sizeof(a.fields.counts)) == 0 && a.flags == b.flags &&
+           memcmp(a.usage.delta, b.usage.delta, sizeof(a.usage.delta)) == 0 &&
+           a.usage.intervalS == b.usage.intervalS && a.usage.flags == b.usage.flags;
+}
+
+// Flip one byte of the file at off
+void corruptByte(const char *path, off_t off) {
+    int fd = open(path, O_RDWR);
+    uint8_t b = 0;
+    if (fd < 0) return;
+    if (pread(fd, &b, 1, off) == 1) {
+        b ^= 0x5A;
+        if (pwrite(fd, &b, 1, off) != 1) fprintf(stderr, "corrupt write failed\n");
+    }
+    close(fd);
+}
+
+int checkQueue(const char *path, uint32_t seed) {
+    int failures = 0;
+    std::mt19937 rng(seed);
+    std::deque<QueuedSnapshot> model;
+    uint32_t modelDropped = 0;
+    remove(path);
+    SnapshotQueue<CHECK_CAPACITY> q;
+    if (!q.open(path)) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    auto compare = [&](const char *what) {
+        if (q.size() != model.size() || q.dropped() != modelDropped) {
+            if (failures++ < 5) {
+                fprintf(stderr, "%s: size %u/%zu dropped %u/%u\n", what, (unsigned)q.size(), model.size(),
+                        (unsigned)q.dropped(), (unsigned)modelDropped);
+            }
+            return;
+        }
+        for (uint16_t i = 0; i < q.size(); ++i) {
+            QueuedSnapshot s;
+            if (!q.peek(i, s) || !sameSnapshot(s, model[i])) {
+                if (failures++ < 5) fprintf(stderr, "%s: record %u differs\n", what, (unsigned)i);
+                return;
+            }
+        }
+    };
+
+    for (int op = 0; op < 20000 && failures == 0; ++op) {
+        uint32_t r = rng() % 100;
+        if (r < 50) {
+            QueuedSnapshot s = randomSnapshot(rng);
+            q.push(s);
+            model.push_back(s);
+            if (model.size() > CHECK_CAPACITY) {
+                model.pop_front();
+                modelDropped++;
+            }
+        } else if (r < 80) {
+            uint16_t n = (uint16_t)(rng() % 4);
+            q.pop(n);
+            for (uint16_t i = 0; i < n && !model.empty(); ++i) model.pop_front();
+        } else if (r < 95) {
+            q.close();
+            if (!q.open(path)) {
+                fprintf(stderr, "reopen failed\n");
+                return 1;
+            }
+            compare("reopen");
+        } else if (!model.empty()) {
+            // Torn write of the oldest record: its checksum must catch it
+            q.close();
+            uint16_t head = 0;
+            {
+                int fd = open(path, O_RDONLY);
+                uint8_t h[2];
+                if (fd < 0 || pread(fd, h, 2, 8) != 2) return 1; // head follows magic/version/size/capacity
+                head = (uint16_t)(h[0] | (h[1] << 8));
+                close(fd);
+            }
+            corruptByte(path, (off_t)(EVENT_QUEUE_HEADER_SIZE + head * EVENT_QUEUE_RECORD_SIZE + rng() % EVENT_QUEUE_RECORD_SIZE));
+            q.open(path);
+            QueuedSnapshot s;
+            if (q.peek(0, s)) {
+                if (failures++ < 5) fprintf(stderr, "torn record accepted\n");
+            }
+            q.discardOldest();
+            model.pop_front();
+            modelDropped++;
+        }
+        compare("op");
+    }
+
+    // A damaged header starts an empty queue rather than replaying garbage
+    q.close();
+    corruptByte(path, 10);
+    q.open(path);
+    if (!q.empty() || q.dropped() != 0) {
+        fprintf(stderr, "corrupted header not reset\n");
+        failures++;
+    }
+    q.close();
+    remove(path);
+    return failures;
+}
+
+struct Summary {
+    int devices;
+    uint64_t changes;
+    uint64_t delivered;
+    uint64_t late;
+    uint64_t offline;
+    int64_t dropped;
+    int64_t depth;
+    int64_t maxDepth;
+    double p50DetectS;
+    double p99DetectS;
+    uint64_t missed;
+};
+
+double percentile(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)] / 1000.0;
+}
+
+int64_t hubMetric(const char *name) {
+    return Particle.ledger("device-to-cloud").get().get("hub").get("metrics").get(name).toInt();
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours, double outageStartH, double outageMin) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    const uint64_t down = (uint64_t)(outageStartH * 3600000.0);
+    const uint64_t up = down + (uint64_t)(outageMin * 60000.0);
+    Summary r = {};
+    uint64_t nextSampleMs = 0;
+    while (w.now() < end) {
+        w.setCloudConnected(w.now() < down || w.now() >= up);
+        loop();
+        if (w.now() >= nextSampleMs) { // hub ledger, written at least once a minute
+            r.maxDepth = std::max(r.maxDepth, hubMetric("queue_depth"));
+            nextSampleMs = w.now() + 60000;
+        }
+    }
+    const sim::Stats &s = w.stats();
+    r.devices = cfg.devices;
+    r.changes = s.statusChanges;
+    r.delivered = s.snapshotsDelivered;
+    r.late = s.snapshotsLate;
+    r.offline = s.publishOffline;
+    r.dropped = hubMetric("queue_dropped");
+    r.depth = hubMetric("queue_depth");
+    r.p50DetectS = percentile(s.detectMs, 0.50);
+    r.p99DetectS = percentile(s.detectMs, 0.99);
+    r.missed = s.missedChanges;
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, double outageStartH, double outageMin, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours, outageStartH, outageMin);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseSizes(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 3.0;
+    double outageStartH = 1.0;
+    double outageMin = 30.0;
+    std::vector<int> sizes = {12, 50};
+    sim::FleetConfig base;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (!strcmp(argv[i], "--outage-start") && i + 1 < argc) {
+            outageStartH = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--outage-min") && i + 1 < argc) {
+            outageMin = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50] [--outage-start H] [--outage-min M] [--seed N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    std::string scratch = std::string(SMARTSTALL_EVENT_QUEUE_PATH) + ".check";
+    if (checkQueue(scratch.c_str(), base.seed)) {
+        return 1;
+    }
+    printf("SnapshotQueue matches its model (overwrite-oldest, reopen, torn record, bad header): ok\n");
+
+#if !defined(SMARTSTALL_EVENT_QUEUE) || SMARTSTALL_EVENT_QUEUE
+    printf("publish path: store-and-forward queue\n");
+#else
+    printf("publish path: fire-and-forget (no queue)\n");
+#endif
+    printf("%.1f virtual hours, cloud unreachable from %.2f h for %.0f min\n", hours, outageStartH, outageMin);
+    printf("%7s %8s %9s %6s %8s %8s %6s %9s %8s %8s %7s\n", "devices", "changes", "delivered", "late", "offline",
+           "dropped", "depth", "max depth", "p50 ttd", "p99 ttd", "missed");
+    for (int n : sizes) {
+        sim::FleetConfig cfg = base;
+        cfg.devices = n;
+        Summary s;
+        if (!runForked(cfg, hours, outageStartH, outageMin, s)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        printf("%7d %8llu %9llu %6llu %8llu %8lld %6lld %9lld %7.1fs %7.1fs %7llu\n", s.devices,
+               (unsigned long long)s.changes, (unsigned long long)s.delivered, (unsigned long long)s.late,
+               (unsigned long long)s.offline, (long long)s.dropped, (long long)s.depth, (long long)s.maxDepth,
+               s.p50DetectS, s.p99DetectS, (unsigned long long)s.missed);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Weak-link benchmark: the hub against a fleet spread over a range, with the simulator's distance/RSSI
+ * loss model on (log-distance path loss, slow shadowing, a logistic reception edge). Built twice:
+ * range_bench with the default link-aware polling (SMARTSTALL_LINK_AWARE=1) and range_bench_blind
+ * with the former deadline-only order (SMARTSTALL_LINK_AWARE=0). Reports per fleet size:
+ *   - polls/hour, stalls polled at least once, and p50/p99 time-to-detect
+ *   - connect attempts and failures
+ *   - wasted connect time: radio time in failed BLE.connect() calls, per hour
+ *   - the link_deferred hub metric (due polls put off for a weak link)
+ *
+ * Shadowing makes single runs noisy, so each row averages --runs seeds (seed, seed+1, ...). Each run
+ * is a forked child so the firmware's globals start fresh. Virtual time: a blocking BLE call costs its
+ * simulated latency, a failed BLE.connect() its full timeout.
+ *
+ *   range_bench [--hours H] [--sizes 12,50] [--max-distance M] [--runs N] [--seed N]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+void writeLedgers(bool force);
+
+namespace {
+
+struct Summary {
+    int devices;
+    double polled;
+    double pollsPerHour;
+    double p50DetectS;
+    double p99DetectS;
+    double connects;
+    double connectFailures;
+    double wastedSPerHour;
+    double linkDeferred;
+};
+
+double percentile(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)] / 1000.0;
+}
+
+int64_t hubMetric(const char *name) {
+    return Particle.ledger("device-to-cloud").get().get("hub").get("metrics").get(name).toInt();
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    while (w.now() < end) {
+        loop();
+    }
+    writeLedgers(true);
+    const sim::Stats &s = w.stats();
+    double h = (double)w.now() / 3600000.0;
+    Summary r;
+    r.devices = cfg.devices;
+    r.polled = w.distinctPolled();
+    r.pollsPerHour = (double)s.statusReads / h;
+    r.p50DetectS = percentile(s.detectMs, 0.50);
+    r.p99DetectS = percentile(s.detectMs, 0.99);
+    r.connects = (double)s.connectAttempts;
+    r.connectFailures = (double)s.connectFailures;
+    r.wastedSPerHour = (double)s.connectFailMs / 1000.0 / h;
+    r.linkDeferred = (double)hubMetric("link_deferred");
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseList(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 2.0;
+    std::vector<int> sizes = {12, 50};
+    int runs = 10;
+    sim::FleetConfig base;
+    base.rangeModel = true;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--max-distance") && i + 1 < argc) {
+            base.maxDistanceM = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50] [--max-distance M] [--runs N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+#if !defined(SMARTSTALL_LINK_AWARE) || SMARTSTALL_LINK_AWARE
+    const char *mode = "on";
+#else
+    const char *mode = "off";
+#endif
+    printf("%.1f virtual hours x %d seeds from %u, stalls at %.0f-%.0f m, link-aware polling %s\n", hours, runs,
+           base.seed, base.minDistanceM, base.maxDistanceM, mode);
+    printf("%7s %7s %9s %8s %8s %8s %9s %10s %9s\n", "devices", "polled", "polls/h", "p50 ttd", "p99 ttd",
+           "connects", "conn_fail", "wasted s/h", "deferred");
+    for (int n : sizes) {
+        Summary m = {};
+        for (int r = 0; r < runs; ++r) {
+            sim::FleetConfig cfg = base;
+            cfg.devices = n;
+            cfg.seed = base.seed + (uint32_t)r;
+            Summary s;
+            if (!runForked(cfg, hours, s)) {
+                fprintf(stderr, "simulation for %d devices, seed %u failed\n", n, cfg.seed);
+                return 1;
+            }
+            m.polled += s.polled / runs;
+            m.pollsPerHour += s.pollsPerHour / runs;
+            m.p50DetectS += s.p50DetectS / runs;
+            m.p99DetectS += s.p99DetectS / runs;
+            m.connects += s.connects / runs;
+            m.connectFailures += s.connectFailures / runs;
+            m.wastedSPerHour += s.wastedSPerHour / runs;
+            m.linkDeferred += s.linkDeferred / runs;
+        }
+        printf("%7d %7.1f %9.1f %7.1fs %7.1fs %8.0f %9.0f %10.0f %9.0f\n", n, m.polled, m.pollsPerHour, m.p50DetectS,
+               m.p99DetectS, m.connects, m.connectFailures, m.wastedSPerHour, m.linkDeferred);
+        fflush(stdout);
+    }
+    return 0;
+}
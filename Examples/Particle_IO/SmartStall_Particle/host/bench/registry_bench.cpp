@@ -0,0 +1,124 @@
+/*
+ * Registry lookup/insert microbenchmark: linear BleAddress scan (the pre-index findDeviceIndex)
+ * versus DeviceAddressIndex over packed 48-bit addresses, at 12, 100 and 500 devices.
+ *
+ *   registry_bench [--lookups N]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Particle.h"
+#include "device_registry.h"
+
+namespace {
+
+const size_t BENCH_CAPACITY = 512;
+
+struct Entry {
+    BleAddress address;
+    unsigned long lastSeen;
+};
+
+double nsSince(std::chrono::steady_clock::time_point t0, uint64_t ops) {
+    auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    return (double)dt / (double)ops;
+}
+
+uint64_t packAddress(const BleAddress &addr) {
+    uint8_t octets[BLE_SIG_ADDR_LEN];
+    for (uint8_t i = 0; i < BLE_SIG_ADDR_LEN; ++i) {
+        octets[i] = addr[i];
+    }
+    return DeviceAddressIndex<BENCH_CAPACITY>::pack(octets);
+}
+
+int linearFind(const Vector<Entry> &v, const BleAddress &addr) {
+    int total = v.size();
+    for (int i = 0; i < total; ++i) {
+        if (v.at(i).address == addr) return i;
+    }
+    return -1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    uint64_t lookups = 2000000;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--lookups") && i + 1 < argc) {
+            lookups = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--lookups N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::mt19937_64 rng(7);
+    static DeviceAddressIndex<BENCH_CAPACITY> index;
+    static FixedVector<Entry, BENCH_CAPACITY> arena;
+    volatile long sink = 0;
+
+    printf("%7s %14s %14s %14s %14s %14s %14s\n", "devices", "linear hit", "index hit", "linear miss", "index miss",
+           "Vector insert", "index insert");
+    for (int n : {12, 100, 500}) {
+        std::vector<BleAddress> present, absent;
+        for (int i = 0; i < n; ++i) {
+            uint8_t a[BLE_SIG_ADDR_LEN];
+            for (uint8_t &b : a) b = (uint8_t)rng();
+            present.push_back(BleAddress(a));
+            for (uint8_t &b : a) b = (uint8_t)rng();
+            absent.push_back(BleAddress(a));
+        }
+
+        // Insert (repeat the whole fill so timings are above clock resolution)
+        const int fills = 2000;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < fills; ++r) {
+            Vector<Entry> v;
+            for (const BleAddress &a : present) {
+                if (linearFind(v, a) < 0) v.append(Entry{a, 0});
+            }
+            sink += v.size();
+        }
+        double vecInsert = nsSince(t0, (uint64_t)fills * n);
+        t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < fills; ++r) {
+            index.clear();
+            arena.clear();
+            for (const BleAddress &a : present) {
+                uint64_t key = packAddress(a);
+                if (index.find(key) < 0) {
+                    index.insert(key, (uint16_t)arena.size());
+                    arena.append(Entry{a, 0});
+                }
+            }
+            sink += arena.size();
+        }
+        double idxInsert = nsSince(t0, (uint64_t)fills * n);
+
+        Vector<Entry> linear;
+        for (const BleAddress &a : present) linear.append(Entry{a, 0});
+
+        auto timeLookups = [&](const std::vector<BleAddress> &keys, bool useIndex) {
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < lookups; ++i) {
+                const BleAddress &a = keys[i % keys.size()];
+                sink += useIndex ? index.find(packAddress(a)) : linearFind(linear, a);
+            }
+            return nsSince(start, lookups);
+        };
+        double linHit = timeLookups(present, false);
+        double idxHit = timeLookups(present, true);
+        double linMiss = timeLookups(absent, false);
+        double idxMiss = timeLookups(absent, true);
+
+        printf("%7d %11.1f ns %11.1f ns %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n", n, linHit, idxHit, linMiss, idxMiss,
+               vecInsert, idxInsert);
+    }
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * Input capture and replay check.
+ *
+ * Built against the hub with SMARTSTALL_CAPTURE on. Per fleet size, in forked children so the
+ * firmware's globals start fresh:
+ *   live    setup()/loop() against the simulated fleet, with a cloud outage in the middle. Publishes,
+ *           delivered snapshots and ledger writes go to a stream; the capture is committed and kept, and
+ *           also fetched through the capture_dump cloud function into a serial log.
+ *   replay  the capture drives the simulated radio and cloud (sim/capture_replay.h) on an empty fleet;
+ *           the hub, still capturing, writes a second stream and records the capture again.
+ * The replayed stream must equal the live one line for line, every call must have been answered by the
+ * record made at its time, the recapture must equal the capture byte for byte, and the capture_dump log
+ * must reassemble into the same capture. Reports capture size per hour and the replay speed.
+ *
+ * Exits non-zero when any check fails.
+ *
+ *   replay_bench [--hours H] [--sizes 12,50] [--seed N] [--telemetry F]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "capture_replay.h"
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+void flushInputCapture();
+
+namespace {
+
+const std::string CAPTURE_FILE = SMARTSTALL_CAPTURE_PATH;
+const std::string LIVE_CAPTURE = CAPTURE_FILE + ".live";
+const std::string REPLAYED_CAPTURE = CAPTURE_FILE + ".replayed";
+const std::string DUMP_LOG = CAPTURE_FILE + ".dump.log";
+const std::string LIVE_STREAM = CAPTURE_FILE + ".live.stream";
+const std::string REPLAY_STREAM = CAPTURE_FILE + ".replay.stream";
+
+struct LiveSummary {
+    uint64_t polls;
+    uint64_t publishes;
+    uint64_t offlinePublishes;
+    int dumpEnd;
+};
+
+struct ReplaySummary {
+    bool loaded;
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t spanMs;
+    double wallMs;
+    uint64_t polls;
+    sim::CaptureMatchStats matches;
+};
+
+bool readFile(const std::string &path, std::vector<uint8_t> &out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool copyFile(const std::string &from, const std::string &to) {
+    std::vector<uint8_t> data;
+    if (!readFile(from, data)) return false;
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out.write((const char *)data.data(), (std::streamsize)data.size());
+    return (bool)out;
+}
+
+LiveSummary runLive(const sim::FleetConfig &cfg, double hours) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    w.stream = fopen(LIVE_STREAM.c_str(), "w");
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    // Cloud unreachable for a sixth of the run, from a third in
+    const uint64_t outageStart = end / 3;
+    const uint64_t outageEnd = outageStart + end / 6;
+    while (w.now() < end) {
+        w.setCloudConnected(w.now() < outageStart || w.now() >= outageEnd);
+        loop();
+    }
+    flushInputCapture();
+    fclose(w.stream);
+    w.stream = nullptr;
+    LiveSummary r = {};
+    r.polls = w.stats().statusReads;
+    r.publishes = w.stats().publishes;
+    r.offlinePublishes = w.stats().publishOffline;
+    copyFile(CAPTURE_FILE, LIVE_CAPTURE);
+
+    // The same capture as a serial log of capture_dump lines
+    fflush(stderr);
+    if (freopen(DUMP_LOG.c_str(), "w", stderr)) {
+        w.verbose = true;
+        int offset = 0;
+        for (;;) {
+            int next = Particle.callFunction("capture_dump", std::to_string(offset).c_str());
+            if (next <= offset) break;
+            offset = next;
+        }
+        w.verbose = false;
+        fflush(stderr);
+        r.dumpEnd = offset;
+    }
+    return r;
+}
+
+ReplaySummary runReplay() {
+    ReplaySummary r = {};
+    sim::CaptureReplay capture;
+    std::string error;
+    if (!capture.load(LIVE_CAPTURE, error)) {
+        fprintf(stderr, "%s: %s\n", LIVE_CAPTURE.c_str(), error.c_str());
+        return r;
+    }
+    r.loaded = true;
+    r.records = capture.records();
+    r.bytes = capture.bytes();
+    r.spanMs = capture.endMs() - capture.startMs();
+
+    remove(SMARTSTALL_EVENT_QUEUE_PATH);
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    sim::FleetConfig cfg;
+    cfg.devices = 0;
+    cfg.bystanders = 0;
+    w.reset(cfg);
+    w.startReplay(&capture);
+    w.stream = fopen(REPLAY_STREAM.c_str(), "w");
+    auto start = std::chrono::steady_clock::now();
+    w.advanceTo(capture.startMs());
+    setup();
+    while (w.now() < capture.endMs()) {
+        loop();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    flushInputCapture();
+    fclose(w.stream);
+    w.stream = nullptr;
+    r.wallMs = std::chrono::duration<double, std::milli>(stop - start).count();
+    r.polls = w.stats().statusReads;
+    r.matches = capture.stats();
+    copyFile(CAPTURE_FILE, REPLAYED_CAPTURE);
+    return r;
+}
+
+template <typename T>
+bool runForked(T (*fn)(), T &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        T s = fn();
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+sim::FleetConfig g_cfg;
+double g_hours;
+
+LiveSummary runLiveConfigured() { return runLive(g_cfg, g_hours); }
+
+// Line number (1-based) where two text files first differ, 0 when identical
+size_t firstDifferingLine(const std::string &a, const std::string &b) {
+    std::ifstream fa(a), fb(b);
+    std::string la, lb;
+    for (size_t line = 1;; ++line) {
+        bool ga = (bool)std::getline(fa, la);
+        bool gb = (bool)std::getline(fb, lb);
+        if (!ga && !gb) return 0;
+        if (ga != gb || la != lb) return line;
+    }
+}
+
+size_t countLines(const std::string &path) {
+    std::ifstream f(path);
+    std::string l;
+    size_t n = 0;
+    while (std::getline(f, l)) n++;
+    return n;
+}
+
+std::vector<int> parseList(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 2.0;
+    std::vector<int> sizes = {12, 50};
+    uint32_t seed = 1;
+    double telemetry = 0.25;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc) {
+            telemetry = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50] [--seed N] [--telemetry F]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%.1f virtual hours, seed %u, %.0f %% of stalls advertising status, cloud outage from %.0f to %.0f min\n",
+           hours, seed, telemetry * 100, hours * 20, hours * 30);
+    printf("%7s %7s %9s %9s %9s %9s %10s %8s %8s %8s %8s\n", "devices", "polls", "records", "capture", "KB/h",
+           "replay ms", "speed", "calls", "stream", "recapt.", "dump");
+    bool ok = true;
+    for (int n : sizes) {
+        g_cfg = sim::FleetConfig();
+        g_cfg.devices = n;
+        g_cfg.seed = seed;
+        g_cfg.advTelemetryFraction = telemetry;
+        g_hours = hours;
+        LiveSummary live;
+        ReplaySummary replay;
+        if (!runForked(runLiveConfigured, live) || !runForked(runReplay, replay) || !replay.loaded) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        const sim::CaptureMatchStats &m = replay.matches;
+        uint64_t calls = m.exact + m.near + m.reused + m.unrecorded;
+        bool callsOk = calls > 0 && m.exact == calls;
+        size_t differs = firstDifferingLine(LIVE_STREAM, REPLAY_STREAM);
+        bool streamOk = differs == 0 && replay.polls == live.polls;
+        std::vector<uint8_t> captured, recaptured;
+        bool recaptureOk = readFile(LIVE_CAPTURE, captured) && readFile(REPLAYED_CAPTURE, recaptured)
+            && captured == recaptured;
+        sim::CaptureReplay fromCapture, fromDump;
+        std::string error;
+        bool dumpOk = fromCapture.load(LIVE_CAPTURE, error) && fromDump.load(DUMP_LOG, error)
+            && live.dumpEnd == (int)captured.size() && fromDump.bytes() == fromCapture.bytes()
+            && fromDump.records() == fromCapture.records() && fromDump.endMs() == fromCapture.endMs();
+        ok = ok && callsOk && streamOk && recaptureOk && dumpOk;
+
+        char speed[16];
+        snprintf(speed, sizeof(speed), "%.0fx", replay.wallMs > 0 ? (double)replay.spanMs / replay.wallMs : 0.0);
+        printf("%7d %7llu %9llu %9llu %9.1f %9.0f %10s %8s %8s %8s %8s\n", n, (unsigned long long)live.polls,
+               (unsigned long long)replay.records, (unsigned long long)replay.bytes,
+               (double)replay.bytes / 1024.0 / hours, replay.wallMs, speed, callsOk ? "exact" : "FAILED",
+               streamOk ? "same" : "FAILED", recaptureOk ? "same" : "FAILED", dumpOk ? "ok" : "FAILED");
+        if (!callsOk) {
+            printf("  calls answered: %llu exact, %llu near, %llu reused, %llu unrecorded\n",
+                   (unsigned long long)m.exact, (unsigned long long)m.near, (unsigned long long)m.reused,
+                   (unsigned long long)m.unrecorded);
+        }
+        if (!streamOk) {
+            printf("  streams (%zu live lines, %zu replayed) differ from line %zu; polls %llu live, %llu replayed\n",
+                   countLines(LIVE_STREAM), countLines(REPLAY_STREAM), differs, (unsigned long long)live.polls,
+                   (unsigned long long)replay.polls);
+        }
+        if (!dumpOk && !error.empty()) {
+            printf("  capture_dump log: %s\n", error.c_str());
+        }
+        printf("  live: %llu publishes, %llu attempted during the outage; %zu stream lines\n",
+               (unsigned long long)live.publishes, (unsigned long long)live.offlinePublishes,
+               countLines(LIVE_STREAM));
+        fflush(stdout);
+    }
+    return ok ? 0 : 1;
+}
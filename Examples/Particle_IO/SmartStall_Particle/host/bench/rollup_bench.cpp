@@ -0,0 +1,424 @@
+/*
+ * Usage rollup check (usage_rollup.h). Built twice from the same source: rollup_bench links the firmware
+ * with rollups published alongside the per-change events (SMARTSTALL_ROLLUPS=1, the default),
+ * rollup_bench_instead with counts-only changes left to the rollups (SMARTSTALL_ROLLUPS=2).
+ *
+ *   synthetic  random read sequences (gaps past the hold limit, battery-less reads, counter resets,
+ *              clock steps back, window closes between reads) folded by rollupAddRead()/rollupCloseDue()
+ *              must give the same windows as a second-by-second reference: reads, transitions,
+ *              observed and occupied seconds, battery min/max/last, counter deltas and reset flag.
+ *   fleet      setup()/loop() against the simulated fleet, with a cloud outage in the middle and some
+ *              acknowledgements lost. Every smartstall/rollup item must be consistent (occupied <=
+ *              observed <= window, battery min <= last <= max), a re-sent item must equal the first
+ *              copy, a device's deltas must not add up to more than its stall counted, and every window
+ *              in which a device's counts were read must be published unless it closed while offline.
+ *              Reports event traffic next to the smartstall/data events.
+ *
+ * Exits non-zero when any check fails.
+ *
+ *   rollup_bench [--hours H] [--sizes 12,50] [--seed N] [--trials T]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+#include "smartstall_data.h"
+#include "usage_rollup.h"
+
+#ifndef SMARTSTALL_ROLLUPS
+#define SMARTSTALL_ROLLUPS 1 // the firmware's default
+#endif
+#ifndef SMARTSTALL_ROLLUP_WINDOW_S
+#define SMARTSTALL_ROLLUP_WINDOW_S 900
+#endif
+
+void setup();
+void loop();
+
+namespace {
+
+const uint32_t WINDOW_S = SMARTSTALL_ROLLUP_WINDOW_S;
+
+// ---- synthetic sequences ----
+
+struct Read {
+    uint32_t t;
+    uint16_t status;
+    uint16_t batteryMv;
+    uint32_t counts[3];
+    bool closeBefore; // call rollupCloseDue() at closeAt before folding this read
+    uint32_t closeAt;
+};
+
+bool sameRollup(const UsageRollup &a, const UsageRollup &b) {
+    return a.windowStart == b.windowStart && a.observedS == b.observedS && a.occupiedS == b.occupiedS &&
+           a.reads == b.reads && a.transitions == b.transitions && a.batteryMinMv == b.batteryMinMv &&
+           a.batteryMaxMv == b.batteryMaxMv && a.batteryLastMv == b.batteryLastMv &&
+           memcmp(a.delta, b.delta, sizeof(a.delta)) == 0 && a.flags == b.flags;
+}
+
+// Windows of one run of reads without a clock step back, second by second
+void referenceEpoch(const std::vector<Read> &reads, std::vector<UsageRollup> &out) {
+    std::vector<uint32_t> windows;
+    for (const Read &r : reads) {
+        uint32_t w = r.t - r.t % WINDOW_S;
+        if (windows.empty() || windows.back() != w) windows.push_back(w);
+    }
+    for (uint32_t w : windows) {
+        UsageRollup x = {};
+        x.windowStart = w;
+        for (uint32_t t = w; t < w + WINDOW_S; ++t) {
+            const Read *gov = nullptr; // the latest read at or before t
+            for (const Read &r : reads) {
+                if (r.t <= t) gov = &r;
+            }
+            if (gov && t < gov->t + ROLLUP_MAX_HOLD_S) {
+                x.observedS++;
+                if (isOccupiedStatus(gov->status)) x.occupiedS++;
+            }
+        }
+        for (size_t i = 0; i < reads.size(); ++i) {
+            const Read &r = reads[i];
+            if (r.t < w || r.t >= w + WINDOW_S) continue;
+            x.reads++;
+            if (i > 0) {
+                const Read &p = reads[i - 1];
+                if (r.status != p.status) x.transitions++;
+                bool reset = false;
+                for (int k = 0; k < 3; ++k) reset = reset || r.counts[k] < p.counts[k];
+                if (reset) x.flags |= ROLLUP_COUNTS_RESET;
+                for (int k = 0; k < 3; ++k) x.delta[k] += reset ? r.counts[k] : r.counts[k] - p.counts[k];
+            }
+            if (r.batteryMv) {
+                if (!x.batteryMinMv || r.batteryMv < x.batteryMinMv) x.batteryMinMv = r.batteryMv;
+                if (r.batteryMv > x.batteryMaxMv) x.batteryMaxMv = r.batteryMv;
+                x.batteryLastMv = r.batteryMv;
+            }
+        }
+        out.push_back(x);
+    }
+}
+
+std::vector<Read> randomReads(std::mt19937 &rng) {
+    std::vector<Read> reads;
+    uint32_t t = 1700000000 + rng() % WINDOW_S;
+    uint32_t counts[3] = {(uint32_t)(rng() % 1000), (uint32_t)(rng() % 1000), (uint32_t)(rng() % 1000)};
+    uint16_t status = 3;
+    int n = 5 + (int)(rng() % 40);
+    for (int i = 0; i < n; ++i) {
+        uint32_t r = rng() % 100;
+        if (r < 3 && t > 5000) {
+            t -= 1 + rng() % 3000;              // clock stepped back
+        } else if (r < 10) {
+            t += ROLLUP_MAX_HOLD_S + rng() % 4000; // past the hold limit, maybe windows without reads
+        } else if (r < 15) {
+            // same second as the previous read
+        } else {
+            t += 1 + rng() % 400;
+        }
+        if (rng() % 4 == 0) status = (uint16_t)(rng() % 6);
+        if (rng() % 30 == 0) {
+            memset(counts, 0, sizeof(counts)); // pin reset
+        }
+        for (uint32_t &c : counts) c += rng() % 3;
+        Read rd = {};
+        rd.t = t;
+        rd.status = status;
+        rd.batteryMv = rng() % 5 == 0 ? 0 : (uint16_t)(3300 + rng() % 900);
+        memcpy(rd.counts, counts, sizeof(counts));
+        if (!reads.empty() && rng() % 5 == 0 && t > reads.back().t) {
+            rd.closeBefore = true;
+            rd.closeAt = reads.back().t + rng() % (t - reads.back().t + 1);
+        }
+        reads.push_back(rd);
+    }
+    return reads;
+}
+
+bool checkSynthetic(int trials, uint32_t seed, uint64_t &windowsChecked) {
+    std::mt19937 rng(seed);
+    windowsChecked = 0;
+    for (int trial = 0; trial < trials; ++trial) {
+        std::vector<Read> reads = randomReads(rng);
+        RollupState s;
+        std::vector<UsageRollup> got;
+        UsageRollup closed;
+        for (const Read &r : reads) {
+            if (r.closeBefore && rollupCloseDue(s, r.closeAt, WINDOW_S, closed)) got.push_back(closed);
+            if (rollupAddRead(s, r.t, r.status, isOccupiedStatus(r.status), r.batteryMv, r.counts, WINDOW_S,
+                              closed)) {
+                got.push_back(closed);
+            }
+        }
+        if (rollupClose(s, WINDOW_S, closed)) got.push_back(closed);
+
+        std::vector<UsageRollup> want;
+        size_t start = 0;
+        for (size_t i = 1; i <= reads.size(); ++i) {
+            if (i == reads.size() || reads[i].t < reads[i - 1].t) {
+                referenceEpoch(std::vector<Read>(reads.begin() + start, reads.begin() + i), want);
+                start = i;
+            }
+        }
+        bool same = got.size() == want.size();
+        for (size_t i = 0; same && i < got.size(); ++i) same = sameRollup(got[i], want[i]);
+        if (!same) {
+            fprintf(stderr, "trial %d: %zu windows, reference %zu\n", trial, got.size(), want.size());
+            for (size_t i = 0; i < got.size() || i < want.size(); ++i) {
+                const UsageRollup *g = i < got.size() ? &got[i] : nullptr;
+                const UsageRollup *e = i < want.size() ? &want[i] : nullptr;
+                fprintf(stderr, "  %zu: got %u obs %u occ %u reads %u tr %u | want %u obs %u occ %u reads %u tr %u\n",
+                        i, g ? g->windowStart : 0, g ? g->observedS : 0, g ? g->occupiedS : 0, g ? g->reads : 0,
+                        g ? g->transitions : 0, e ? e->windowStart : 0, e ? e->observedS : 0,
+                        e ? e->occupiedS : 0, e ? e->reads : 0, e ? e->transitions : 0);
+            }
+            return false;
+        }
+        windowsChecked += got.size();
+    }
+    return true;
+}
+
+// ---- fleet ----
+
+struct Summary {
+    uint64_t rollupEvents;
+    uint64_t rollupBytes;
+    uint64_t dataEvents;
+    uint64_t dataBytes;
+    uint64_t items;        // rollup items delivered
+    uint64_t resent;       // ... identical to one delivered before
+    uint64_t conflicting;  // ... same device and window as another, different content
+    uint64_t inconsistent; // ... failing a bound
+    uint64_t overCounted;  // devices whose deltas add up to more than the stall counted
+    uint64_t expected;     // device windows with a counts read, closed while the cloud was up
+    uint64_t missing;      // ... not delivered
+    uint64_t offline;      // device windows with a counts read, closed while the cloud was down
+    uint64_t ackLost;
+    double occupiedPct;    // occupied share of observed time, over all delivered windows
+};
+
+struct Item {
+    uint32_t values[13]; // after the address: window_start ... reset
+};
+
+// ["AA:BB:CC:DD:EE:FF",n,n,...,n] items of a {"v":1,"d":[...]} payload
+bool parseItems(const char *data, std::vector<std::pair<std::string, Item>> &out) {
+    const char *p = strstr(data, "\"d\":[");
+    if (!p) return false;
+    while ((p = strstr(p, "[\"")) != nullptr) {
+        if (strlen(p) < 20) return false;
+        std::string device(p + 2, 17);
+        p += 20;
+        Item item;
+        for (uint32_t &v : item.values) {
+            if (*p != ',') return false;
+            char *endp;
+            v = (uint32_t)strtoul(p + 1, &endp, 10);
+            p = endp;
+        }
+        if (*p != ']') return false;
+        out.push_back({device, item});
+    }
+    return true;
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    w.stream = tmpfile();
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    // Cloud unreachable for a sixth of the run, from a third in
+    const uint64_t outageStart = end / 3;
+    const uint64_t outageEnd = outageStart + end / 6;
+    const uint32_t startUnix = (uint32_t)w.unixTime();
+    while (w.now() < end) {
+        w.setCloudConnected(w.now() < outageStart || w.now() >= outageEnd);
+        loop();
+    }
+    const uint32_t endUnix = (uint32_t)w.unixTime();
+
+    Summary r = {};
+    r.ackLost = w.stats().publishAckLost;
+    std::map<std::pair<std::string, uint32_t>, Item> windows;
+    uint64_t observed = 0, occupied = 0;
+    rewind(w.stream);
+    char line[2048];
+    while (fgets(line, sizeof(line), w.stream)) {
+        const char *rollup = strstr(line, " publish smartstall/rollup ");
+        if (!rollup) {
+            const char *data = strstr(line, " publish smartstall/data ");
+            if (data) {
+                r.dataEvents++;
+                r.dataBytes += strlen(data + 25) - 1;
+            }
+            continue;
+        }
+        const char *payload = rollup + 27;
+        r.rollupEvents++;
+        r.rollupBytes += strlen(payload) - 1;
+        std::vector<std::pair<std::string, Item>> items;
+        if (!parseItems(payload, items)) {
+            r.inconsistent++;
+            continue;
+        }
+        for (const auto &it : items) {
+            const uint32_t *v = it.second.values;
+            r.items++;
+            // window_start, window_s, reads, observed_s, occupied_s, transitions, battery min/max/last, deltas, reset
+            bool ok = v[1] == WINDOW_S && v[0] % WINDOW_S == 0 && v[2] > 0 && v[3] <= WINDOW_S && v[4] <= v[3] &&
+                      v[6] <= v[8] && v[8] <= v[7] && v[12] <= 1;
+            if (!ok) r.inconsistent++;
+            auto key = std::make_pair(it.first, v[0]);
+            auto found = windows.find(key);
+            if (found == windows.end()) {
+                windows[key] = it.second;
+                observed += v[3];
+                occupied += v[4];
+            } else if (memcmp(found->second.values, v, sizeof(it.second.values)) == 0) {
+                r.resent++;
+            } else {
+                r.conflicting++;
+            }
+        }
+    }
+    fclose(w.stream);
+    w.stream = nullptr;
+    r.occupiedPct = observed ? 100.0 * (double)occupied / (double)observed : 0.0;
+
+    const uint32_t offlineFrom = startUnix + (uint32_t)(outageStart / 1000);
+    const uint32_t offlineTo = startUnix + (uint32_t)(outageEnd / 1000);
+    for (const sim::Peripheral &p : w.peripherals()) {
+        if (!p.smartstall) continue;
+        std::string device = p.address.toString().c_str();
+        uint64_t deltas = 0;
+        for (const auto &entry : windows) {
+            if (entry.first.first != device) continue;
+            for (int k = 9; k < 12; ++k) deltas += entry.second.values[k];
+        }
+        if (deltas > p.used[0] + p.used[1] + p.used[2]) r.overCounted++;
+
+        uint32_t lastWindow = 0;
+        bool any = false;
+        for (const sim::CountsRead &c : p.countsReads) {
+            uint32_t window = c.unixTime - c.unixTime % WINDOW_S;
+            if (any && window == lastWindow) continue;
+            any = true;
+            lastWindow = window;
+            uint32_t closes = window + WINDOW_S;
+            if (closes + 60 > endUnix) continue; // still open, or closed too late to publish
+            if (closes >= offlineFrom && closes < offlineTo) {
+                r.offline++;
+                continue;
+            }
+            r.expected++;
+            if (windows.find(std::make_pair(device, window)) == windows.end()) r.missing++;
+        }
+    }
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseSizes(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 6.0;
+    std::vector<int> sizes = {12, 50};
+    int trials = 2000;
+    sim::FleetConfig base;
+    base.countResetRate = 0.02;
+    base.publishAckLossRate = 0.05;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--trials") && i + 1 < argc) {
+            trials = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50] [--seed N] [--trials T]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    uint64_t windows = 0;
+    bool ok = checkSynthetic(trials, base.seed, windows);
+    printf("rollups match the second-by-second reference (%d sequences, %llu windows of %u s): %s\n", trials,
+           (unsigned long long)windows, (unsigned)WINDOW_S, ok ? "ok" : "FAILED");
+    printf("%u bytes of rollup state per device (RollupState + pending window)\n",
+           (unsigned)(sizeof(RollupState) + sizeof(UsageRollup) + sizeof(bool)));
+
+    printf("rollups %s; %.1f virtual hours, seed %u, %.0f %% of acks lost, cloud outage from %.0f to %.0f min\n",
+           SMARTSTALL_ROLLUPS == 2 ? "instead of counts-only events" : "alongside per-change events", hours,
+           base.seed, base.publishAckLossRate * 100, hours * 20, hours * 30);
+    printf("%7s %9s %9s %7s %9s %9s %6s %8s %8s %8s %9s %8s\n", "devices", "data ev/h", "data KB/h", "roll/h",
+           "roll KB/h", "windows", "resent", "expected", "missing", "offline", "occupied", "result");
+    for (int n : sizes) {
+        sim::FleetConfig cfg = base;
+        cfg.devices = n;
+        Summary s;
+        if (!runForked(cfg, hours, s)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        bool good = s.items > 0 && s.conflicting == 0 && s.inconsistent == 0 && s.overCounted == 0 && s.missing == 0;
+        ok = ok && good;
+        printf("%7d %9.1f %9.1f %7.1f %9.1f %9llu %6llu %8llu %8llu %8llu %8.1f%% %8s\n", n,
+               (double)s.dataEvents / hours, (double)s.dataBytes / 1024.0 / hours, (double)s.rollupEvents / hours,
+               (double)s.rollupBytes / 1024.0 / hours, (unsigned long long)(s.items - s.resent),
+               (unsigned long long)s.resent, (unsigned long long)s.expected, (unsigned long long)s.missing,
+               (unsigned long long)s.offline, s.occupiedPct, good ? "ok" : "FAILED");
+        if (!good) {
+            printf("  %llu conflicting, %llu inconsistent items, %llu devices over-counted\n",
+                   (unsigned long long)s.conflicting, (unsigned long long)s.inconsistent,
+                   (unsigned long long)s.overCounted);
+        }
+        fflush(stdout);
+    }
+    return ok ? 0 : 1;
+}
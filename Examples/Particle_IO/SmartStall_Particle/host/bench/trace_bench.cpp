@@ -0,0 +1,237 @@
+/*
+ * Trace buffer benchmark and check.
+ *
+ * First the ring itself (trace_buffer.h): more records than it holds are pushed and the retained ones
+ * must be the newest, oldest first, with the overwritten count right; clear() must empty it.
+ *
+ * Then the cost of one hot-path line: a trace record against the former Log.info with an address
+ * toString(), formatted but not printed (what a SerialLogHandler costs on device), in ns and heap
+ * allocations per line.
+ *
+ * Then the hub: setup()/loop() run against the simulated fleet with log formatting on (a forked child
+ * per fleet size, so the firmware's globals start fresh). Reports log lines, heap allocations and host
+ * CPU per virtual hour and per poll, then calls the trace_dump cloud function: "5" must log 5 records
+ * plus a header, "clear" must empty the ring. Built twice: trace_bench with the default
+ * SMARTSTALL_TRACE_LEVEL (info) and trace_bench_off with tracing compiled out.
+ *
+ * Exits non-zero when any check fails.
+ *
+ *   trace_bench [--hours H] [--sizes 12,50] [--seed N] [--show]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+#include "trace_buffer.h"
+
+void setup();
+void loop();
+
+// Global allocation counters for this binary (covers String, Vector and std:: containers)
+static uint64_t g_allocs = 0;
+
+void *operator new(size_t n) {
+    g_allocs++;
+    void *p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+struct Summary {
+    int devices;
+    double polls;
+    double logLinesPerHour;
+    double allocsPerHour;
+    double cpuMsPerHour;
+    int dumpReturn;
+    int64_t dumpLines;
+    int clearReturn;
+    int afterClearReturn;
+};
+
+bool checkRing() {
+    TraceRing<256> ring;
+    bool ok = ring.size() == 0 && ring.overwritten() == 0;
+    for (int i = 0; i < 1000; ++i) {
+        ring.push((uint32_t)i, (uint16_t)(i % 7), (uint16_t)i, i, -i);
+    }
+    ok = ok && ring.size() == 256 && ring.written() == 1000 && ring.overwritten() == 744;
+    for (size_t i = 0; ok && i < ring.size(); ++i) {
+        const TraceRecord &r = ring.at(i);
+        int want = 744 + (int)i;
+        ok = r.ms == (uint32_t)want && r.event == want % 7 && r.device == (uint16_t)want && r.a == want && r.b == -want;
+    }
+    ring.clear();
+    ok = ok && ring.size() == 0 && ring.written() == 0;
+    ring.push(7, 1, TRACE_NO_DEVICE, 1, 2);
+    ok = ok && ring.size() == 1 && ring.at(0).ms == 7 && ring.at(0).device == TRACE_NO_DEVICE;
+    return ok;
+}
+
+struct LineCost {
+    double ns;
+    double allocs;
+};
+
+LineCost traceLineCost() {
+    static TraceRing<256> ring;
+    const int n = 2000000;
+    uint64_t a0 = g_allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        ring.push((uint32_t)millis(), 1, (uint16_t)(i & 63), -60 - (i & 15), 1);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return {std::chrono::duration<double, std::nano>(end - start).count() / n, (double)(g_allocs - a0) / n};
+}
+
+LineCost logLineCost() {
+    BleAddress addr("C0:FF:EE:00:12:34");
+    const int n = 200000;
+    uint64_t a0 = g_allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        String addrStr = addr.toString();
+        Log.info("SmartStall found by %s: %s, RSSI: %d", "name", addrStr.c_str(), -60 - (i & 15));
+    }
+    auto end = std::chrono::steady_clock::now();
+    return {std::chrono::duration<double, std::nano>(end - start).count() / n, (double)(g_allocs - a0) / n};
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours, bool show) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    w.formatLogs = true;
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    uint64_t a0 = g_allocs;
+    auto start = std::chrono::steady_clock::now();
+    while (w.now() < end) {
+        loop();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double h = (double)w.now() / 3600000.0;
+    Summary r = {};
+    r.devices = cfg.devices;
+    r.polls = (double)w.stats().statusReads;
+    r.logLinesPerHour = (double)w.stats().logLines / h;
+    r.allocsPerHour = (double)(g_allocs - a0) / h;
+    r.cpuMsPerHour = std::chrono::duration<double, std::milli>(stop - start).count() / h;
+
+    uint64_t lines0 = w.stats().logLines;
+    w.verbose = show;
+    r.dumpReturn = Particle.callFunction("trace_dump", "5");
+    w.verbose = false;
+    r.dumpLines = (int64_t)(w.stats().logLines - lines0);
+    r.clearReturn = Particle.callFunction("trace_dump", "clear");
+    r.afterClearReturn = Particle.callFunction("trace_dump", "");
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, bool show, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours, show);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseList(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 1.0;
+    std::vector<int> sizes = {12, 50};
+    uint32_t seed = 1;
+    bool show = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--show")) {
+            show = true;
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50] [--seed N] [--show]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool ok = checkRing();
+    printf("trace ring: %zu-byte records, order and overwrite check %s\n", sizeof(TraceRecord), ok ? "ok" : "FAILED");
+    sim::world().formatLogs = true;
+    LineCost traced = traceLineCost();
+    LineCost logged = logLineCost();
+    sim::world().formatLogs = false;
+    printf("one sighting line: trace record %.1f ns, %.2f allocs; Log.info + toString() %.1f ns, %.2f allocs\n",
+           traced.ns, traced.allocs, logged.ns, logged.allocs);
+
+#if defined(SMARTSTALL_TRACE_LEVEL) && SMARTSTALL_TRACE_LEVEL == 0
+    const bool traceOn = false;
+#else
+    const bool traceOn = true;
+#endif
+    printf("\n%.1f virtual hours, seed %u, tracing %s, log lines formatted\n", hours, seed, traceOn ? "on" : "off");
+    printf("%7s %9s %12s %12s %10s %10s %10s\n", "devices", "polls", "log lines/h", "allocs/h", "allocs/poll",
+           "cpu ms/h", "trace_dump");
+    for (int n : sizes) {
+        sim::FleetConfig cfg;
+        cfg.devices = n;
+        cfg.seed = seed;
+        Summary s;
+        if (!runForked(cfg, hours, show, s)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        bool dumpOk = traceOn ? (s.dumpReturn == 5 && s.dumpLines == 6 && s.clearReturn > 0 && s.afterClearReturn == 0)
+                              : s.dumpReturn == -1;
+        ok = ok && dumpOk;
+        printf("%7d %9.0f %12.0f %12.0f %10.1f %10.1f %10s\n", n, s.polls, s.logLinesPerHour, s.allocsPerHour,
+               s.polls > 0 ? s.allocsPerHour * hours / s.polls : 0.0, s.cpuMsPerHour, dumpOk ? "ok" : "FAILED");
+        fflush(stdout);
+    }
+    return ok ? 0 : 1;
+}
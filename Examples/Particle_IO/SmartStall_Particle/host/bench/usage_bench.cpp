@@ -0,0 +1,298 @@
+/*
+ * Counter usage check (counter_usage.h).
+ *
+ * Per fleet size, in a forked child so the firmware's globals start fresh, setup()/loop() run against a
+ * fleet whose stalls are now and then pin-reset (counts zeroed), whose counts reads sometimes fail, with
+ * a cloud outage in the middle and some delivered publishes reported to the hub as failed (so they are
+ * sent again). The smartstall/data events the cloud received are deduplicated by device and timestamp,
+ * as a receiver would, and each event's usage is checked against the true increments the simulated stall
+ * made between the reads behind the event and behind its base (the event at timestamp - interval_s):
+ *   - a re-sent event must equal the first copy;
+ *   - the deltas must never exceed the true increments (no double counting), and must equal them when
+ *     no reset happened in between;
+ *   - the reset flag must only be set when a reset happened.
+ * Also reports events whose base never arrived (gaps), resets the counts did not show (the counters
+ * climbed past their base again before the next read) and the share of all increments the deltas cover.
+ *
+ * Exits non-zero when any check fails.
+ *
+ *   usage_bench [--hours H] [--sizes 12,50] [--seed N] [--resets R] [--ack-loss L]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+
+namespace {
+
+struct Summary {
+    uint64_t events;        // smartstall/data events delivered
+    uint64_t resent;        // ... identical to one delivered before
+    uint64_t collisions;    // ... same device and timestamp as another, different content
+    uint64_t withUsage;     // distinct events carrying usage
+    uint64_t checked;       // ... whose base was delivered too
+    uint64_t gaps;          // ... whose base was not
+    uint64_t unmatched;     // events no counts read explains
+    uint64_t overCounted;   // delta above the true increments
+    uint64_t wrongDelta;    // delta not equal to the true increments, no reset between
+    uint64_t falseResets;   // reset flag without a reset
+    uint64_t resetsFlagged; // reset flag with a reset
+    uint64_t resetsMissed;  // a reset between base and event, no flag
+    uint64_t stallResets;   // resets the stalls made
+    uint64_t ackLost;
+    uint64_t trueUsed;      // increments between each device's first and last delivered event
+    uint64_t deltaUsed;     // sum of the checked deltas
+};
+
+struct Event {
+    uint32_t counts[3];
+    bool hasUsage;
+    uint32_t intervalS;
+    bool reset;
+    uint32_t delta[3];
+    std::string payload;
+};
+
+bool numberAfter(const std::string &s, const char *key, size_t from, uint32_t &out) {
+    size_t at = s.find(key, from);
+    if (at == std::string::npos) return false;
+    out = (uint32_t)strtoul(s.c_str() + at + strlen(key), nullptr, 10);
+    return true;
+}
+
+// {"device":"AA:..","timestamp":T,...,"sensor_counts":{...},"usage":{...}}
+bool parseEvent(const std::string &json, std::string &device, uint32_t &ts, Event &e) {
+    size_t dev = json.find("\"device\":\"");
+    if (dev == std::string::npos || json.size() < dev + 10 + 17) return false;
+    device = json.substr(dev + 10, 17);
+    size_t counts = json.find("\"sensor_counts\":");
+    if (!numberAfter(json, "\"timestamp\":", 0, ts) || counts == std::string::npos
+        || !numberAfter(json, "\"limit_switch\":", counts, e.counts[0])
+        || !numberAfter(json, "\"cap_touch\":", counts, e.counts[1])
+        || !numberAfter(json, "\"hall_sensor\":", counts, e.counts[2])) {
+        return false;
+    }
+    size_t usage = json.find("\"usage\":");
+    e.hasUsage = usage != std::string::npos;
+    if (e.hasUsage) {
+        size_t delta = json.find("\"delta\":", usage);
+        if (delta == std::string::npos || !numberAfter(json, "\"interval_s\":", usage, e.intervalS)
+            || !numberAfter(json, "\"limit_switch\":", delta, e.delta[0])
+            || !numberAfter(json, "\"cap_touch\":", delta, e.delta[1])
+            || !numberAfter(json, "\"hall_sensor\":", delta, e.delta[2])) {
+            return false;
+        }
+        e.reset = json.find("\"reset\":true", usage) != std::string::npos;
+    }
+    e.payload = json;
+    return true;
+}
+
+// The latest successful counts read at or before ts that returned the event's counts (a failed read
+// reuses the last value, so it may be older than the snapshot)
+const sim::CountsRead *readBehind(const sim::Peripheral &p, uint32_t ts, const uint32_t counts[3]) {
+    const sim::CountsRead *found = nullptr;
+    for (const sim::CountsRead &r : p.countsReads) {
+        if (r.unixTime > ts) break;
+        if (!memcmp(r.counts, counts, sizeof(r.counts))) found = &r;
+    }
+    return found;
+}
+
+Summary runFleet(const sim::FleetConfig &cfg, double hours) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    w.stream = tmpfile();
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    // Cloud unreachable for a sixth of the run, from a third in
+    const uint64_t outageStart = end / 3;
+    const uint64_t outageEnd = outageStart + end / 6;
+    while (w.now() < end) {
+        w.setCloudConnected(w.now() < outageStart || w.now() >= outageEnd);
+        loop();
+    }
+
+    Summary r = {};
+    r.ackLost = w.stats().publishAckLost;
+    std::map<std::string, std::map<uint32_t, Event>> byDevice;
+    rewind(w.stream);
+    char line[1024];
+    const char *marker = " publish smartstall/data ";
+    while (fgets(line, sizeof(line), w.stream)) {
+        const char *json = strstr(line, marker);
+        if (!json) continue;
+        std::string data(json + strlen(marker));
+        if (!data.empty() && data.back() == '\n') data.pop_back();
+        std::string device;
+        uint32_t ts;
+        Event e;
+        r.events++;
+        if (!parseEvent(data, device, ts, e)) {
+            r.unmatched++;
+            continue;
+        }
+        std::map<uint32_t, Event> &events = byDevice[device];
+        auto it = events.find(ts);
+        if (it == events.end()) {
+            events[ts] = e;
+        } else if (it->second.payload == e.payload) {
+            r.resent++;
+        } else {
+            r.collisions++;
+        }
+    }
+    fclose(w.stream);
+    w.stream = nullptr;
+
+    for (const sim::Peripheral &p : w.peripherals()) {
+        if (!p.smartstall) continue;
+        r.stallResets += p.resets;
+        auto dev = byDevice.find(p.address.toString().c_str());
+        if (dev == byDevice.end()) continue;
+        const std::map<uint32_t, Event> &events = dev->second;
+        const sim::CountsRead *first = nullptr, *last = nullptr;
+        for (const auto &entry : events) {
+            const Event &e = entry.second;
+            const sim::CountsRead *read = readBehind(p, entry.first, e.counts);
+            if (!read) {
+                r.unmatched++;
+                continue;
+            }
+            if (!first) first = read;
+            last = read;
+            if (!e.hasUsage) continue;
+            r.withUsage++;
+            auto base = e.intervalS ? events.find(entry.first - e.intervalS) : events.end();
+            const sim::CountsRead *baseRead = base == events.end()
+                ? nullptr : readBehind(p, base->first, base->second.counts);
+            if (!baseRead) {
+                r.gaps++;
+                continue;
+            }
+            r.checked++;
+            bool reset = read->resets != baseRead->resets;
+            for (int i = 0; i < 3; ++i) {
+                uint64_t used = read->used[i] - baseRead->used[i];
+                if (e.delta[i] > used) r.overCounted++;
+                if (!reset && e.delta[i] != used) r.wrongDelta++;
+                r.deltaUsed += e.delta[i];
+            }
+            if (e.reset && !reset) r.falseResets++;
+            if (e.reset && reset) r.resetsFlagged++;
+            if (!e.reset && reset) r.resetsMissed++;
+        }
+        if (first) {
+            for (int i = 0; i < 3; ++i) r.trueUsed += last->used[i] - first->used[i];
+        }
+    }
+    return r;
+}
+
+bool runForked(const sim::FleetConfig &cfg, double hours, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = runFleet(cfg, hours);
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseSizes(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 6.0;
+    std::vector<int> sizes = {12, 50};
+    sim::FleetConfig base;
+    base.readFailRate = 0.05;
+    base.countResetRate = 0.02;
+    base.publishAckLossRate = 0.05;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--resets") && i + 1 < argc) {
+            base.countResetRate = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--ack-loss") && i + 1 < argc) {
+            base.publishAckLossRate = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--sizes 12,50] [--seed N] [--resets R] [--ack-loss L]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%.1f virtual hours, seed %u, %.0f %% of visits reset, %.0f %% of counts reads fail, %.0f %% of acks "
+           "lost, cloud outage from %.0f to %.0f min\n",
+           hours, base.seed, base.countResetRate * 100, base.readFailRate * 100, base.publishAckLossRate * 100,
+           hours * 20, hours * 30);
+    printf("%7s %7s %7s %7s %8s %5s %7s %7s %7s %9s %8s\n", "devices", "events", "resent", "usage", "checked",
+           "gaps", "resets", "flagged", "missed", "coverage", "result");
+    bool ok = true;
+    for (int n : sizes) {
+        sim::FleetConfig cfg = base;
+        cfg.devices = n;
+        Summary s;
+        if (!runForked(cfg, hours, s)) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        bool good = s.checked > 0 && s.collisions == 0 && s.unmatched == 0 && s.overCounted == 0
+            && s.wrongDelta == 0 && s.falseResets == 0;
+        ok = ok && good;
+        printf("%7d %7llu %7llu %7llu %8llu %5llu %7llu %7llu %7llu %8.1f%% %8s\n", n,
+               (unsigned long long)s.events, (unsigned long long)s.resent, (unsigned long long)s.withUsage,
+               (unsigned long long)s.checked, (unsigned long long)s.gaps, (unsigned long long)s.stallResets,
+               (unsigned long long)s.resetsFlagged, (unsigned long long)s.resetsMissed,
+               s.trueUsed ? 100.0 * (double)s.deltaUsed / (double)s.trueUsed : 0.0, good ? "ok" : "FAILED");
+        if (!good) {
+            printf("  %llu collisions, %llu unexplained events, %llu over-counted, %llu wrong deltas, "
+                   "%llu false resets\n",
+                   (unsigned long long)s.collisions, (unsigned long long)s.unmatched,
+                   (unsigned long long)s.overCounted, (unsigned long long)s.wrongDelta,
+                   (unsigned long long)s.falseResets);
+        }
+        printf("  %llu publishes reported failed after delivery\n", (unsigned long long)s.ackLost);
+        fflush(stdout);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,525 @@
+/*
+ * Warm start after a hub restart (registry checkpoint, src/registry_checkpoint.h).
+ *
+ * It first checks RegistryCheckpoint against the records written to a scratch file: rewrites, commits and
+ * reopening (persistence), a torn record (checksum), a shorter commit and a corrupted header. It exits
+ * non-zero on any mismatch.
+ *
+ * Then, per fleet size, a forked child runs setup()/loop() against the simulated fleet for the warm-up,
+ * lets the fleet run on without the hub for the restart gap and saves it (World::saveFleet). Three more
+ * children boot a fresh hub on that fleet for the window: warm with the checkpoint the warm-up left; late,
+ * the same without a valid clock for the first --clock-s seconds (as after a power cycle); and cold without
+ * the checkpoint, which boots as before the checkpoint existed. All keep the warm-up's event queue. Per
+ * boot it reports:
+ *   - entries restored;
+ *   - time from boot to the first successful poll, to half of the stalls polled, and to 90% of the stalls
+ *     awake at boot polled (a sleeping stall advertises only after a door event, so one missed advert
+ *     can hold back the last);
+ *   - connect attempts;
+ *   - snapshots published, and repeats: those equal to the device's previous one the cloud received;
+ *   - p50 time-to-detect.
+ * For the warm-up it reports checkpoint records written per hour (flash wear).
+ *
+ * Exits non-zero when a warm or late boot restored fewer entries than the warm-up registry held, reached
+ * its first poll later than the cold boot (the late one is allowed --clock-s), or published more repeats,
+ * or when the late boot took more than LATE_AWAKE_FACTOR times as long as the warm one (plus --clock-s) to
+ * poll 90% of the stalls awake. A restore that takes the unset clock as 0 makes every stall due at once
+ * and the order arbitrary.
+ *
+ *   warmstart_bench [--warmup-h H] [--gap-s S] [--window-min M] [--clock-s S] [--sizes 12,50] [--seed N]
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fleet_sim.h"
+#include "registry_checkpoint.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const uint16_t CHECK_CAPACITY = 16;
+const double LATE_AWAKE_FACTOR = 1.5;
+
+RegistryRecord randomRecord(std::mt19937 &rng) {
+    RegistryRecord r;
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(&r);
+    for (size_t i = 0; i < sizeof(r); ++i) bytes[i] = (uint8_t)rng();
+    return r;
+}
+
+bool sameRecord(const RegistryRecord &a, const RegistryRecord &b) {
+    return !memcmp(a.address, b.address, 6) && a.addressType == b.addressType && a.flags == b.flags
+           && a.failureCount == b.failureCount && a.activity == b.activity && a.legacyRetryAt == b.legacyRetryAt
+           && a.publishedStatus == b.publishedStatus && !memcmp(a.publishedCounts, b.publishedCounts, 12)
+           && a.submittedStatus == b.submittedStatus && !memcmp(a.submittedCounts, b.submittedCounts, 12)
+           && a.submittedTimestamp == b.submittedTimestamp && a.observedStatus == b.observedStatus
+           && a.statusChangedAt == b.statusChangedAt && !memcmp(a.countsRead, b.countsRead, 12)
+           && a.countsDigest == b.countsDigest && a.countsReadAt == b.countsReadAt && a.lastSeenAt == b.lastSeenAt
+           && a.lastReadAt == b.lastReadAt && a.batteryMv == b.batteryMv && a.batteryReadAt == b.batteryReadAt
+           && a.rssiQ4 == b.rssiQ4 && a.sightings == b.sightings && a.connectHistory == b.connectHistory
+           && a.connectCount == b.connectCount;
+}
+
+// Flip one byte of the file at off
+void corruptByte(const char *path, off_t off) {
+    int fd = open(path, O_RDWR);
+    uint8_t b = 0;
+    if (fd < 0) return;
+    if (pread(fd, &b, 1, off) == 1) {
+        b ^= 0x5A;
+        if (pwrite(fd, &b, 1, off) != 1) fprintf(stderr, "corrupt write failed\n");
+    }
+    close(fd);
+}
+
+int checkCheckpoint(const char *path, uint32_t seed) {
+    int failures = 0;
+    std::mt19937 rng(seed);
+    std::vector<RegistryRecord> model;
+    uint16_t committed = 0;
+    uint32_t committedAt = 0;
+    remove(path);
+    RegistryCheckpoint<CHECK_CAPACITY> c;
+    if (!c.open(path) || c.size() != 0) {
+        fprintf(stderr, "cannot open %s empty\n", path);
+        return 1;
+    }
+    auto compare = [&](const char *what) {
+        if (c.size() != committed || c.committedAt() != committedAt) {
+            if (failures++ < 5) {
+                fprintf(stderr, "%s: size %u/%u, committed at %lu/%lu\n", what, (unsigned)c.size(),
+                        (unsigned)committed, (unsigned long)c.committedAt(), (unsigned long)committedAt);
+            }
+            return;
+        }
+        for (uint16_t i = 0; i < committed; ++i) {
+            RegistryRecord r;
+            if (!c.read(i, r) || !sameRecord(r, model[i])) {
+                if (failures++ < 5) fprintf(stderr, "%s: record %u differs\n", what, (unsigned)i);
+                return;
+            }
+        }
+    };
+
+    for (int op = 0; op < 5000 && failures == 0; ++op) {
+        uint32_t r = rng() % 100;
+        if (r < 60) {
+            // Rewrite a few slots, appending up to capacity, then commit
+            for (int k = (int)(rng() % 4); k >= 0; --k) {
+                uint16_t slot = (uint16_t)(rng() % (model.size() + 1));
+                if (slot >= CHECK_CAPACITY) continue;
+                RegistryRecord rec = randomRecord(rng);
+                if (!c.write(slot, rec)) {
+                    fprintf(stderr, "write failed\n");
+                    return 1;
+                }
+                if (slot == model.size()) {
+                    model.push_back(rec);
+                } else {
+                    model[slot] = rec;
+                }
+            }
+            committed = (uint16_t)model.size();
+            committedAt = rng();
+            c.commit(committed, committedAt);
+        } else if (r < 90) {
+            c.close();
+            if (!c.open(path)) {
+                fprintf(stderr, "reopen failed\n");
+                return 1;
+            }
+        } else if (committed > 0) {
+            // Torn write: the checksum must catch it; the owner rewrites the slot
+            uint16_t slot = (uint16_t)(rng() % committed);
+            c.close();
+            corruptByte(path, (off_t)(REGISTRY_HEADER_SIZE + slot * REGISTRY_RECORD_SIZE + rng() % REGISTRY_RECORD_SIZE));
+            c.open(path);
+            RegistryRecord rec;
+            if (c.read(slot, rec)) {
+                if (failures++ < 5) fprintf(stderr, "torn record accepted\n");
+            }
+            c.write(slot, model[slot]);
+            c.commit(committed, committedAt);
+        }
+        compare("op");
+    }
+
+    // A shorter commit hides the slots past it
+    if (committed > 1) {
+        committed--;
+        c.commit(committed, committedAt);
+        c.close();
+        c.open(path);
+        RegistryRecord rec;
+        if (c.read(committed, rec)) {
+            fprintf(stderr, "slot past the commit readable\n");
+            failures++;
+        }
+        compare("short commit");
+    }
+
+    // Another capacity (a build with a different registry size) starts empty
+    c.close();
+    {
+        RegistryCheckpoint<CHECK_CAPACITY + 1> other;
+        if (!other.open(path) || other.size() != 0) {
+            fprintf(stderr, "other capacity not reset\n");
+            failures++;
+        }
+    }
+    // A damaged header starts an empty checkpoint rather than restoring garbage
+    c.open(path);
+    c.commit(0, 0);
+    c.close();
+    corruptByte(path, 8);
+    c.open(path);
+    if (c.size() != 0) {
+        fprintf(stderr, "corrupted header not reset\n");
+        failures++;
+    }
+    c.close();
+    remove(path);
+    return failures;
+}
+
+int64_t hubMetric(const char *section, const char *name) {
+    return Particle.ledger("device-to-cloud").get().get("hub").get(section).get(name).toInt();
+}
+
+struct Snapshot {
+    int status;
+    uint32_t counts[3];
+    bool operator==(const Snapshot &o) const { return status == o.status && !memcmp(counts, o.counts, 12); }
+};
+
+bool numberAfter(const std::string &s, const char *key, size_t from, uint32_t &out) {
+    size_t at = s.find(key, from);
+    if (at == std::string::npos) return false;
+    out = (uint32_t)strtoul(s.c_str() + at + strlen(key), nullptr, 10);
+    return true;
+}
+
+// smartstall/data events in a World::stream file, in order: device, status, counts
+template <typename F>
+void forEachPublished(FILE *stream, F f) {
+    rewind(stream);
+    char line[1024];
+    const char *marker = " publish smartstall/data ";
+    while (fgets(line, sizeof(line), stream)) {
+        const char *at = strstr(line, marker);
+        if (!at) continue;
+        std::string json(at + strlen(marker));
+        size_t dev = json.find("\"device\":\"");
+        size_t counts = json.find("\"sensor_counts\":");
+        uint32_t status = 0;
+        Snapshot s;
+        if (dev == std::string::npos || counts == std::string::npos || !numberAfter(json, "\"status\":", 0, status)
+            || !numberAfter(json, "\"limit_switch\":", counts, s.counts[0])
+            || !numberAfter(json, "\"cap_touch\":", counts, s.counts[1])
+            || !numberAfter(json, "\"hall_sensor\":", counts, s.counts[2])) {
+            continue;
+        }
+        s.status = (int)status;
+        f(json.substr(dev + 10, 17), s);
+    }
+}
+
+std::string flashPath(const char *suffix) { return std::string(SMARTSTALL_REGISTRY_CHECKPOINT_PATH) + suffix; }
+
+bool copyFile(const std::string &from, const std::string &to) {
+    FILE *in = fopen(from.c_str(), "rb");
+    if (!in) {
+        remove(to.c_str());
+        return true; // nothing to copy
+    }
+    FILE *out = fopen(to.c_str(), "wb");
+    bool ok = out != nullptr;
+    char buf[4096];
+    size_t n;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        ok = fwrite(buf, 1, n, out) == n;
+    }
+    fclose(in);
+    if (out) ok = fclose(out) == 0 && ok;
+    return ok;
+}
+
+struct WarmupSummary {
+    int64_t tracked;           // registry entries at the restart
+    int64_t checkpointWrites;  // records written over the warm-up
+};
+
+// Warm-up on fresh flash, then the restart gap; leaves the fleet, the published events and the flash files
+WarmupSummary runWarmup(const sim::FleetConfig &cfg, double hours, double gapS) {
+    remove(SMARTSTALL_EVENT_QUEUE_PATH); // fresh flash
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    w.stream = fopen(flashPath(".warmup").c_str(), "w");
+    setup();
+    const uint64_t end = (uint64_t)(hours * 3600000.0);
+    while (w.now() < end) {
+        loop();
+    }
+    WarmupSummary r = {};
+    r.tracked = hubMetric("registry", "tracked_devices");
+    r.checkpointWrites = hubMetric("metrics", "checkpoint_writes");
+    fclose(w.stream);
+    w.stream = nullptr;
+    w.advance((uint64_t)(gapS * 1000.0));
+    FILE *fleet = fopen(flashPath(".fleet").c_str(), "wb");
+    if (!fleet || !w.saveFleet(fleet)) r.tracked = -1;
+    if (fleet) fclose(fleet);
+    return r;
+}
+
+struct BootSummary {
+    int64_t restored;
+    double firstPollS;   // -1: none
+    double halfPolledS;  // -1: fewer than half polled
+    double awakePolledS; // 90% of the stalls awake at boot polled; -1: not reached
+    int polled;
+    uint64_t connects;
+    uint64_t published;
+    uint64_t repeats;
+    double p50DetectS;
+};
+
+double percentile(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)] / 1000.0;
+}
+
+BootSummary runBoot(const sim::FleetConfig &cfg, double windowMin) {
+    BootSummary r = {};
+    sim::World &w = sim::world();
+    w.reset(cfg);
+    FILE *fleet = fopen(flashPath(".fleet").c_str(), "rb");
+    bool loaded = fleet && w.loadFleet(fleet);
+    if (fleet) fclose(fleet);
+    if (!loaded) {
+        r.restored = -1;
+        return r;
+    }
+    std::vector<bool> awake;
+    for (const sim::Peripheral &p : w.peripherals()) awake.push_back(p.smartstall && !p.asleep);
+    const uint64_t boot = w.now();
+    w.stream = tmpfile();
+    setup();
+    const uint64_t end = boot + (uint64_t)(windowMin * 60000.0);
+    while (w.now() < end) {
+        loop();
+    }
+
+    r.restored = hubMetric("metrics", "checkpoint_restored");
+    std::vector<uint64_t> firstPolls;
+    std::vector<uint64_t> awakePolls; // UINT64_MAX: never polled
+    const std::vector<sim::Peripheral> &periph = w.peripherals();
+    for (size_t i = 0; i < periph.size(); ++i) {
+        if (!periph[i].smartstall) continue;
+        if (periph[i].everPolled) {
+            firstPolls.push_back(periph[i].firstPollMs - boot);
+        }
+        if (awake[i]) {
+            awakePolls.push_back(periph[i].everPolled ? periph[i].firstPollMs - boot : UINT64_MAX);
+        }
+    }
+    std::sort(firstPolls.begin(), firstPolls.end());
+    size_t half = ((size_t)cfg.devices + 1) / 2;
+    r.polled = (int)firstPolls.size();
+    r.firstPollS = firstPolls.empty() ? -1 : firstPolls[0] / 1000.0;
+    r.halfPolledS = firstPolls.size() >= half && half > 0 ? firstPolls[half - 1] / 1000.0 : -1;
+    std::sort(awakePolls.begin(), awakePolls.end());
+    uint64_t awake90 = awakePolls.empty() ? UINT64_MAX
+                                          : awakePolls[(size_t)(0.9 * (double)(awakePolls.size() - 1) + 0.5)];
+    r.awakePolledS = awake90 == UINT64_MAX ? -1 : awake90 / 1000.0;
+    r.connects = w.stats().connectAttempts;
+    r.p50DetectS = percentile(w.stats().detectMs, 0.50);
+
+    // Repeats: equal to the device's previous snapshot the cloud received, before or after the restart
+    std::map<std::string, Snapshot> last;
+    FILE *warmup = fopen(flashPath(".warmup").c_str(), "r");
+    if (warmup) {
+        forEachPublished(warmup, [&](const std::string &device, const Snapshot &s) { last[device] = s; });
+        fclose(warmup);
+    }
+    forEachPublished(w.stream, [&](const std::string &device, const Snapshot &s) {
+        r.published++;
+        auto it = last.find(device);
+        if (it != last.end() && it->second == s) r.repeats++;
+        last[device] = s;
+    });
+    fclose(w.stream);
+    w.stream = nullptr;
+    return r;
+}
+
+template <typename Summary, typename Run>
+bool runForked(Run run, Summary &out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Summary s = run();
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+std::vector<int> parseSizes(const char *arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        int v = atoi(s.substr(pos, comma - pos).c_str());
+        if (v > 0) out.push_back(v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+void printSeconds(double s) {
+    if (s < 0) {
+        printf(" %8s", "-");
+    } else {
+        printf(" %7.1fs", s);
+    }
+}
+
+void printBoot(int devices, const char *kind, const BootSummary &b) {
+    printf("%7d %5s %8lld", devices, kind, (long long)b.restored);
+    printSeconds(b.firstPollS);
+    printSeconds(b.halfPolledS);
+    printSeconds(b.awakePolledS);
+    printf(" %6d %8llu %9llu %7llu %7.1fs\n", b.polled, (unsigned long long)b.connects,
+           (unsigned long long)b.published, (unsigned long long)b.repeats, b.p50DetectS);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double warmupH = 1.0;
+    double gapS = 30.0;
+    double windowMin = 30.0;
+    double clockS = 20.0;
+    std::vector<int> sizes = {12, 50};
+    sim::FleetConfig base;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--warmup-h") && i + 1 < argc) {
+            warmupH = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--gap-s") && i + 1 < argc) {
+            gapS = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--window-min") && i + 1 < argc) {
+            windowMin = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--clock-s") && i + 1 < argc) {
+            clockS = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            base.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--warmup-h H] [--gap-s S] [--window-min M] [--clock-s S] [--sizes 12,50] "
+                    "[--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (checkCheckpoint(flashPath(".check").c_str(), base.seed)) {
+        return 1;
+    }
+    printf("RegistryCheckpoint matches its writes (rewrite, commit, reopen, torn record, short commit, "
+           "bad header): ok\n");
+
+    printf("%.1f h warm-up, %.0f s restart gap, %.0f min after boot, late boot's clock set after %.0f s; %zu bytes "
+           "of flash per registry entry\n", warmupH, gapS, windowMin, clockS, REGISTRY_RECORD_SIZE);
+    printf("%7s %5s %8s %9s %9s %9s %6s %8s %9s %7s %8s\n", "devices", "boot", "restored", "1st poll", "half",
+           "awake 90", "polled", "connects", "published", "repeats", "p50 ttd");
+    int failures = 0;
+    std::vector<std::string> wear;
+    for (int n : sizes) {
+        sim::FleetConfig cfg = base;
+        cfg.devices = n;
+        WarmupSummary warmup;
+        BootSummary warm;
+        BootSummary late;
+        BootSummary cold;
+        bool ok = runForked([&] { return runWarmup(cfg, warmupH, gapS); }, warmup) && warmup.tracked >= 0
+                  && copyFile(SMARTSTALL_EVENT_QUEUE_PATH, flashPath(".queue"))
+                  && copyFile(SMARTSTALL_REGISTRY_CHECKPOINT_PATH, flashPath(".registry"));
+        ok = ok && runForked([&] { return runBoot(cfg, windowMin); }, warm) && warm.restored >= 0;
+        // Late: the same checkpoint and queue, no clock at first
+        sim::FleetConfig lateCfg = cfg;
+        lateCfg.timeSyncMs = (uint32_t)(clockS * 1000.0);
+        ok = ok && copyFile(flashPath(".queue"), SMARTSTALL_EVENT_QUEUE_PATH)
+             && copyFile(flashPath(".registry"), SMARTSTALL_REGISTRY_CHECKPOINT_PATH)
+             && runForked([&] { return runBoot(lateCfg, windowMin); }, late) && late.restored >= 0;
+        // Cold: the same event queue, no checkpoint
+        remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+        ok = ok && copyFile(flashPath(".queue"), SMARTSTALL_EVENT_QUEUE_PATH)
+             && runForked([&] { return runBoot(cfg, windowMin); }, cold) && cold.restored >= 0;
+        if (!ok) {
+            fprintf(stderr, "simulation for %d devices failed\n", n);
+            return 1;
+        }
+        printBoot(n, "warm", warm);
+        printBoot(n, "late", late);
+        printBoot(n, "cold", cold);
+        char line[128];
+        snprintf(line, sizeof(line), "%7d %9.0f %10.0f", n, warmup.checkpointWrites / warmupH,
+                 warmup.checkpointWrites * (double)REGISTRY_RECORD_SIZE / warmupH);
+        wear.push_back(line);
+        for (const auto &boot : {std::make_pair("warm", &warm), std::make_pair("late", &late)}) {
+            const BootSummary &b = *boot.second;
+            // Until its clock is set the late boot cannot tell how long it was off
+            const double graceS = boot.second == &late ? clockS : 0;
+            if (b.restored < warmup.tracked) {
+                fprintf(stderr, "%d devices: %s boot restored %lld of %lld registry entries\n", n, boot.first,
+                        (long long)b.restored, (long long)warmup.tracked);
+                failures++;
+            }
+            if (b.firstPollS < 0 || (cold.firstPollS >= 0 && b.firstPollS > cold.firstPollS + graceS)) {
+                fprintf(stderr, "%d devices: %s boot polled first at %.1f s, cold at %.1f s\n", n, boot.first,
+                        b.firstPollS, cold.firstPollS);
+                failures++;
+            }
+            if (b.repeats > cold.repeats) {
+                fprintf(stderr, "%d devices: %s boot published %llu repeats, cold %llu\n", n, boot.first,
+                        (unsigned long long)b.repeats, (unsigned long long)cold.repeats);
+                failures++;
+            }
+        }
+        if (warm.awakePolledS >= 0
+            && (late.awakePolledS < 0 || late.awakePolledS > warm.awakePolledS * LATE_AWAKE_FACTOR + clockS)) {
+            fprintf(stderr, "%d devices: late boot polled 90%% of the awake stalls at %.1f s, warm at %.1f s\n", n,
+                    late.awakePolledS, warm.awakePolledS);
+            failures++;
+        }
+    }
+    printf("\ncheckpoint writes during the warm-up\n%7s %9s %10s\n", "devices", "records/h", "bytes/h");
+    for (const std::string &line : wear) printf("%s\n", line.c_str());
+    for (const char *suffix : {".warmup", ".fleet", ".queue", ".registry"}) remove(flashPath(suffix).c_str());
+    return failures ? 1 : 0;
+}
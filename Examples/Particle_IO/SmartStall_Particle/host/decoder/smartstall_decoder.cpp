@@ -0,0 +1,83 @@
+#include "smartstall_decoder.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace smartstall {
+
+std::string DecodedSnapshot::address() const {
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", fields.address[0], fields.address[1],
+             fields.address[2], fields.address[3], fields.address[4], fields.address[5]);
+    return buf;
+}
+
+DecodeStatus DeltaDecoder::decodeEvent(const char *base64, DecodedSnapshot &out) {
+    uint8_t frame[DELTA_FRAME_MAX];
+    int n = base64Decode(base64, strlen(base64), frame, sizeof(frame));
+    if (n <= 0) return DecodeStatus::Malformed;
+    return decodeFrame(frame, (size_t)n, out);
+}
+
+DecodeStatus DeltaDecoder::decodeFrame(const uint8_t *frame, size_t len, DecodedSnapshot &out) {
+    const uint8_t *p = frame;
+    const uint8_t *end = frame + len;
+    if (p >= end) return DecodeStatus::Malformed;
+    uint8_t header = *p++;
+    if ((header >> 4) != DELTA_FORMAT_VERSION) return DecodeStatus::UnsupportedVersion;
+    uint8_t type = header & 0x0F;
+    if (type != DELTA_FRAME_KEY && type != DELTA_FRAME_DELTA) return DecodeStatus::Malformed;
+
+    uint32_t index, v[6];
+    if (!getVarint(p, end, index) || index > 0xFFFF || p >= end) return DecodeStatus::Malformed;
+    uint8_t sequence = *p++;
+    if (type == DELTA_FRAME_KEY) {
+        if (end - p < 6) return DecodeStatus::Malformed;
+        memcpy(out.fields.address, p, 6);
+        p += 6;
+    }
+    for (uint32_t &x : v) {
+        if (!getVarint(p, end, x)) return DecodeStatus::Malformed;
+    }
+    if (p != end || v[1] > 0xFFFF) return DecodeStatus::Malformed;
+
+    out.deviceIndex = (uint16_t)index;
+    out.sequence = sequence;
+    out.keyframe = (type == DELTA_FRAME_KEY);
+    if (out.keyframe) {
+        if (v[2] > 0xFFFF) return DecodeStatus::Malformed;
+        out.fields.timestamp = v[0];
+        out.fields.status = (uint16_t)v[1];
+        out.fields.batteryMv = (uint16_t)v[2];
+        for (int i = 0; i < 3; ++i) out.fields.counts[i] = v[3 + i];
+        keyframes_++;
+        if (index != DELTA_INDEX_UNTRACKED) {
+            DeviceState &st = devices_[(uint16_t)index];
+            st.sequence = sequence;
+            st.base = out.fields;
+        }
+        return DecodeStatus::Ok;
+    }
+
+    auto it = devices_.find((uint16_t)index);
+    if (it == devices_.end() || (uint8_t)(it->second.sequence + 1) != sequence) {
+        // Missed an event: this delta's base is unknown until the next keyframe
+        if (it != devices_.end()) devices_.erase(it);
+        needKeyframe_++;
+        return DecodeStatus::NeedKeyframe;
+    }
+    DeviceState &st = it->second;
+    int32_t battery = (int32_t)st.base.batteryMv + zigzagDecode(v[2]);
+    if (battery < 0 || battery > 0xFFFF) return DecodeStatus::Malformed;
+    out.fields = st.base;
+    out.fields.timestamp = st.base.timestamp + v[0];
+    out.fields.status = (uint16_t)v[1];
+    out.fields.batteryMv = (uint16_t)battery;
+    for (int i = 0; i < 3; ++i) out.fields.counts[i] = st.base.counts[i] + v[3 + i];
+    st.sequence = sequence;
+    st.base = out.fields;
+    deltas_++;
+    return DecodeStatus::Ok;
+}
+
+} // namespace smartstall
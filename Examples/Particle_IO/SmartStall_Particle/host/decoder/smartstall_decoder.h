@@ -0,0 +1,59 @@
+/*
+ * Receiver for smartstall/bin events (src/delta_codec.h): decodes base64 frames, keeps the
+ * per-device base that deltas apply to, and refuses deltas it cannot apply until the next
+ * keyframe arrives.
+ *
+ * Plain C++ with no Device OS dependency, so a cloud-side consumer can use it as is.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "delta_codec.h"
+
+namespace smartstall {
+
+enum class DecodeStatus {
+    Ok,
+    Malformed,          // bad base64, truncated frame or trailing bytes
+    UnsupportedVersion,
+    NeedKeyframe        // delta without a base, or after a sequence gap
+};
+
+struct DecodedSnapshot {
+    uint16_t deviceIndex = 0;
+    uint8_t sequence = 0;
+    bool keyframe = false;
+    SnapshotFields fields = {};
+
+    // "AA:BB:CC:DD:EE:FF", as in the smartstall/data "device" field
+    std::string address() const;
+};
+
+class DeltaDecoder {
+public:
+    // One smartstall/bin event payload
+    DecodeStatus decodeEvent(const char *base64, DecodedSnapshot &out);
+    DecodeStatus decodeFrame(const uint8_t *frame, size_t len, DecodedSnapshot &out);
+
+    void reset() { devices_.clear(); }
+
+    uint64_t keyframes() const { return keyframes_; }
+    uint64_t deltas() const { return deltas_; }
+    uint64_t needKeyframe() const { return needKeyframe_; } // deltas refused
+
+private:
+    struct DeviceState {
+        uint8_t sequence = 0;
+        SnapshotFields base = {};
+    };
+    std::unordered_map<uint16_t, DeviceState> devices_;
+    uint64_t keyframes_ = 0;
+    uint64_t deltas_ = 0;
+    uint64_t needKeyframe_ = 0;
+};
+
+} // namespace smartstall
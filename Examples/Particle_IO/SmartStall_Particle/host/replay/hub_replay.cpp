@@ -0,0 +1,241 @@
+/*
+ * Replay a hub input capture (src/input_capture.h) through the host build of the firmware.
+ *
+ * The capture, a file or a serial log holding capture_dump lines, drives the simulated radio and cloud
+ * in replay mode (sim/capture_replay.h) while setup()/loop() run on an empty fleet from the capture's
+ * first record to its last, as fast as the host allows. Publishes, delivered snapshots and ledger writes
+ * form the output stream (--stream). With --expect it is compared with the stream of another run: the
+ * first differing line, line counts, and per device the statuses each delivered, matched in order, with
+ * how far in time the matched snapshots moved.
+ *
+ * Built against the default firmware (hub_replay) and the former deadline-only poll order
+ * (hub_replay_blind), so one capture shows what a configuration change does to the same inputs. A build
+ * that makes other calls at other times gets each answered by the nearest unused record of its kind;
+ * the match counts show how far the replay strayed from what was recorded.
+ *
+ * Exits 0 when the streams match (or there is nothing to compare), 1 when they differ, 2 on errors.
+ *
+ *   hub_replay CAPTURE [--stream OUT] [--expect STREAM] [--show]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "capture_replay.h"
+#include "fleet_sim.h"
+
+void setup();
+void loop();
+
+namespace {
+
+bool readLines(FILE *f, std::vector<std::string> &out) {
+    out.clear();
+    std::string line;
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        if (c == '\n') {
+            out.push_back(line);
+            line.clear();
+        } else {
+            line += (char)c;
+        }
+    }
+    if (!line.empty()) out.push_back(line);
+    return !ferror(f);
+}
+
+// "<ms> <kind> ..." -> kind
+std::string kindOf(const std::string &line) {
+    size_t a = line.find(' ');
+    if (a == std::string::npos) return std::string();
+    size_t b = line.find(' ', a + 1);
+    return line.substr(a + 1, b == std::string::npos ? std::string::npos : b - a - 1);
+}
+
+struct Snapshot {
+    uint64_t ms;
+    int status;
+};
+
+std::map<std::string, std::vector<Snapshot>> snapshotsByDevice(const std::vector<std::string> &lines) {
+    std::map<std::string, std::vector<Snapshot>> out;
+    for (const std::string &l : lines) {
+        unsigned long long ms;
+        char addr[18];
+        int status;
+        if (sscanf(l.c_str(), "%llu snapshot %17s %d", &ms, addr, &status) == 3) {
+            out[addr].push_back({ms, status});
+        }
+    }
+    return out;
+}
+
+void printCounts(const char *label, const std::vector<std::string> &lines) {
+    std::map<std::string, size_t> counts;
+    for (const std::string &l : lines) counts[kindOf(l)]++;
+    printf("  %-9s %zu lines:", label, lines.size());
+    for (const auto &c : counts) printf(" %s %zu", c.first.c_str(), c.second);
+    printf("\n");
+}
+
+std::string clip(const std::string &s) {
+    return s.size() > 160 ? s.substr(0, 157) + "..." : s;
+}
+
+uint64_t percentile(std::vector<uint64_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5))];
+}
+
+// true when identical
+bool compareStreams(const std::vector<std::string> &replayed, const std::vector<std::string> &expected) {
+    size_t i = 0;
+    while (i < replayed.size() && i < expected.size() && replayed[i] == expected[i]) ++i;
+    if (i == replayed.size() && i == expected.size()) {
+        printf("streams identical (%zu lines)\n", replayed.size());
+        return true;
+    }
+    printf("streams differ from line %zu\n", i + 1);
+    printf("  replayed: %s\n", i < replayed.size() ? clip(replayed[i]).c_str() : "(end)");
+    printf("  expected: %s\n", i < expected.size() ? clip(expected[i]).c_str() : "(end)");
+    printCounts("replayed", replayed);
+    printCounts("expected", expected);
+
+    // Per device: the expected statuses in order, each matched to the next replayed snapshot with the same
+    // status (skipping replayed ones in between)
+    auto a = snapshotsByDevice(expected);
+    auto b = snapshotsByDevice(replayed);
+    size_t matched = 0, missing = 0, extra = 0, devicesDiffering = 0;
+    std::vector<uint64_t> shifts;
+    for (const auto &dev : a) {
+        const std::vector<Snapshot> &want = dev.second;
+        auto it = b.find(dev.first);
+        std::vector<Snapshot> none;
+        const std::vector<Snapshot> &got = it == b.end() ? none : it->second;
+        size_t j = 0, devMatched = 0;
+        for (const Snapshot &s : want) {
+            size_t k = j;
+            while (k < got.size() && got[k].status != s.status) ++k;
+            if (k == got.size()) {
+                missing++;
+                continue;
+            }
+            shifts.push_back(got[k].ms > s.ms ? got[k].ms - s.ms : s.ms - got[k].ms);
+            devMatched++;
+            j = k + 1;
+        }
+        matched += devMatched;
+        extra += got.size() - devMatched;
+        if (devMatched != want.size() || got.size() != want.size()) devicesDiffering++;
+    }
+    for (const auto &dev : b) {
+        if (a.find(dev.first) == a.end()) {
+            extra += dev.second.size();
+            devicesDiffering++;
+        }
+    }
+    printf("snapshots: %zu matched, %zu expected but not replayed, %zu replayed in addition; %zu devices differ\n",
+           matched, missing, extra, devicesDiffering);
+    printf("matched snapshot time shift: p50 %llu ms, p90 %llu ms, max %llu ms\n",
+           (unsigned long long)percentile(shifts, 0.5), (unsigned long long)percentile(shifts, 0.9),
+           (unsigned long long)percentile(shifts, 1.0));
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *capturePath = nullptr;
+    const char *streamPath = nullptr;
+    const char *expectPath = nullptr;
+    bool show = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--stream") && i + 1 < argc) {
+            streamPath = argv[++i];
+        } else if (!strcmp(argv[i], "--expect") && i + 1 < argc) {
+            expectPath = argv[++i];
+        } else if (!strcmp(argv[i], "--show")) {
+            show = true;
+        } else if (argv[i][0] != '-' && !capturePath) {
+            capturePath = argv[i];
+        } else {
+            capturePath = nullptr;
+            break;
+        }
+    }
+    if (!capturePath) {
+        fprintf(stderr, "usage: %s CAPTURE [--stream OUT] [--expect STREAM] [--show]\n", argv[0]);
+        return 2;
+    }
+
+    sim::CaptureReplay capture;
+    std::string error;
+    if (!capture.load(capturePath, error)) {
+        fprintf(stderr, "%s: %s\n", capturePath, error.c_str());
+        return 2;
+    }
+    FILE *stream = streamPath ? fopen(streamPath, "w+") : tmpfile();
+    if (!stream) {
+        fprintf(stderr, "cannot create the output stream%s%s\n", streamPath ? " " : "", streamPath ? streamPath : "");
+        return 2;
+    }
+    double spanMin = (double)(capture.endMs() - capture.startMs()) / 60000.0;
+    printf("capture: %zu records, %zu bytes, %zu devices, %.1f min of hub time\n", capture.records(),
+           capture.bytes(), capture.devices(), spanMin);
+
+    // The capture starts at boot; the queue and registry checkpoint files are not part of it
+    remove(SMARTSTALL_EVENT_QUEUE_PATH);
+    remove(SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+
+    sim::World &w = sim::world();
+    sim::FleetConfig cfg;
+    cfg.devices = 0;
+    cfg.bystanders = 0;
+    w.reset(cfg);
+    w.startReplay(&capture);
+    w.stream = stream;
+    w.verbose = show;
+    auto start = std::chrono::steady_clock::now();
+    w.advanceTo(capture.startMs());
+    setup();
+    while (w.now() < capture.endMs()) {
+        loop();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    w.stream = nullptr;
+    w.verbose = false;
+
+    double wallMs = std::chrono::duration<double, std::milli>(stop - start).count();
+    const sim::CaptureMatchStats &m = capture.stats();
+    printf("replayed in %.0f ms (%.0fx real time): %llu polls, %llu publishes, %llu ledger writes\n", wallMs,
+           wallMs > 0 ? spanMin * 60000.0 / wallMs : 0.0, (unsigned long long)w.stats().statusReads,
+           (unsigned long long)w.stats().publishes, (unsigned long long)w.stats().ledgerWrites);
+    printf("calls answered: %llu exact, %llu by a record at another time, %llu reused, %llu unrecorded\n",
+           (unsigned long long)m.exact, (unsigned long long)m.near, (unsigned long long)m.reused,
+           (unsigned long long)m.unrecorded);
+
+    if (!expectPath) {
+        fclose(stream);
+        return 0;
+    }
+    std::vector<std::string> replayed, expected;
+    fflush(stream);
+    rewind(stream);
+    bool readOk = readLines(stream, replayed);
+    fclose(stream);
+    FILE *e = fopen(expectPath, "r");
+    if (!readOk || !e || !readLines(e, expected)) {
+        fprintf(stderr, "cannot read %s\n", readOk ? expectPath : "the output stream");
+        if (e) fclose(e);
+        return 2;
+    }
+    fclose(e);
+    return compareStreams(replayed, expected) ? 0 : 1;
+}
@@ -0,0 +1,491 @@
+/*
+ * Host stand-in for the Particle Device OS API surface used by the SmartStall hub.
+ *
+ * Only the calls the hub firmware actually makes are modelled. Everything that touches the
+ * radio, the clock or the cloud is forwarded to the simulated world in fleet_sim.h, so the
+ * unmodified src/SmartStall_Particle.cpp can run on Linux in accelerated virtual time.
+ *
+ * Semantics follow Device OS 6.x where it matters for timing:
+ * - BLE.scan(), BLE.connect() and GATT discovery/reads block and advance the virtual clock.
+ * - BLE.setScanTimeout() is in units of 10 ms (as on device).
+ * - BLE.connect(addr) discovers all services and characteristics before returning (automatic = true).
+ * - millis()/micros() read the virtual clock since the hub booted; delay() advances it.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+using std::max;
+using std::min;
+
+// ---- Application macros (no-ops on host) ----
+#define PRODUCT_VERSION(x)
+#define SYSTEM_MODE(x)
+#define SYSTEM_THREAD(x)
+#define STARTUP(code)
+
+#define SYSTEM_ERROR_NONE 0
+#define SYSTEM_ERROR_UNKNOWN (-100)
+#define SYSTEM_ERROR_TOO_LARGE (-270)
+
+typedef uint32_t system_tick_t;
+
+// ---- Clock ----
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// ---- Semaphores (concurrent_hal.h subset) ----
+// The host has no other threads: a take() that finds nothing to take waits out its timeout on the
+// virtual clock. Callbacks that give() run inside the blocking BLE calls, as on device they may
+// run while loop() is between passes.
+typedef void *os_semaphore_t;
+int os_semaphore_create(os_semaphore_t *semaphore, unsigned max, unsigned initial);
+int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool reserved);
+int os_semaphore_give(os_semaphore_t semaphore, bool reserved);
+
+// ---- String ----
+class String {
+public:
+    String() {}
+    String(const char *s) : s_(s ? s : "") {}
+    String(const std::string &s) : s_(s) {}
+    String(int v) : s_(std::to_string(v)) {}
+    String(unsigned v) : s_(std::to_string(v)) {}
+    String(long v) : s_(std::to_string(v)) {}
+    String(unsigned long v) : s_(std::to_string(v)) {}
+
+    static String format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+    const char *c_str() const { return s_.c_str(); }
+    unsigned length() const { return (unsigned)s_.size(); }
+    long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+    bool equals(const String &o) const { return s_ == o.s_; }
+    bool operator==(const String &o) const { return s_ == o.s_; }
+    bool operator==(const char *o) const { return s_ == (o ? o : ""); }
+    bool operator!=(const String &o) const { return s_ != o.s_; }
+    bool operator!=(const char *o) const { return !(*this == o); }
+    bool operator<(const String &o) const { return s_ < o.s_; }
+    String &operator+=(const String &o) { s_ += o.s_; return *this; }
+    String &operator+=(const char *o) { s_ += (o ? o : ""); return *this; }
+    String &operator+=(char c) { s_ += c; return *this; }
+    String operator+(const String &o) const { return String(s_ + o.s_); }
+    char operator[](unsigned i) const { return i < s_.size() ? s_[i] : 0; }
+    int indexOf(const char *needle) const {
+        size_t p = s_.find(needle);
+        return p == std::string::npos ? -1 : (int)p;
+    }
+    int indexOf(char c) const {
+        size_t p = s_.find(c);
+        return p == std::string::npos ? -1 : (int)p;
+    }
+    String substring(unsigned from) const { return from >= s_.size() ? String() : String(s_.substr(from)); }
+    String substring(unsigned from, unsigned to) const {
+        if (from >= s_.size() || to <= from) return String();
+        return String(s_.substr(from, to - from));
+    }
+    bool startsWith(const char *p) const { return s_.rfind(p, 0) == 0; }
+    const std::string &str() const { return s_; }
+
+private:
+    std::string s_;
+};
+
+// ---- Vector (spark_wiring_vector.h subset) ----
+template <typename T>
+class Vector {
+public:
+    Vector() {}
+    Vector(std::initializer_list<T> il) : v_(il) {}
+    int size() const { return (int)v_.size(); }
+    bool isEmpty() const { return v_.empty(); }
+    bool append(const T &x) { v_.push_back(x); return true; }
+    bool prepend(const T &x) { v_.insert(v_.begin(), x); return true; }
+    bool insert(int i, const T &x) { v_.insert(v_.begin() + i, x); return true; }
+    void removeAt(int i) { v_.erase(v_.begin() + i); }
+    T takeAt(int i) { T x = v_[i]; removeAt(i); return x; }
+    T takeLast() { T x = v_.back(); v_.pop_back(); return x; }
+    void clear() { v_.clear(); }
+    bool reserve(int n) { v_.reserve(n); return true; }
+    bool resize(int n) { v_.resize(n); return true; }
+    int capacity() const { return (int)v_.capacity(); }
+    T &at(int i) { return v_[i]; }
+    const T &at(int i) const { return v_[i]; }
+    T &operator[](int i) { return v_[i]; }
+    const T &operator[](int i) const { return v_[i]; }
+    T &first() { return v_.front(); }
+    T &last() { return v_.back(); }
+    T *data() { return v_.data(); }
+    const T *data() const { return v_.data(); }
+    typename std::vector<T>::iterator begin() { return v_.begin(); }
+    typename std::vector<T>::iterator end() { return v_.end(); }
+    typename std::vector<T>::const_iterator begin() const { return v_.begin(); }
+    typename std::vector<T>::const_iterator end() const { return v_.end(); }
+
+private:
+    std::vector<T> v_;
+};
+
+// ---- Logging ----
+enum LogLevel {
+    LOG_LEVEL_ALL = 1,
+    LOG_LEVEL_TRACE = 1,
+    LOG_LEVEL_INFO = 30,
+    LOG_LEVEL_WARN = 40,
+    LOG_LEVEL_ERROR = 50,
+    LOG_LEVEL_NONE = 70
+};
+
+class Logger {
+public:
+    void trace(const char *fmt, ...) const __attribute__((format(printf, 2, 3)));
+    void info(const char *fmt, ...) const __attribute__((format(printf, 2, 3)));
+    void warn(const char *fmt, ...) const __attribute__((format(printf, 2, 3)));
+    void error(const char *fmt, ...) const __attribute__((format(printf, 2, 3)));
+    void print(const char *s) const;
+};
+
+extern const Logger Log;
+
+class SerialLogHandler {
+public:
+    explicit SerialLogHandler(LogLevel level = LOG_LEVEL_INFO) { (void)level; }
+};
+
+// ---- Variant / Ledger ----
+class Variant {
+public:
+    enum Type { NULL_, BOOL, INT, DOUBLE, STRING, ARRAY, MAP };
+
+    Variant() {}
+    Variant(bool v) : type_(BOOL), i_(v ? 1 : 0) {}
+    Variant(int v) : type_(INT), i_(v) {}
+    Variant(unsigned v) : type_(INT), i_(v) {}
+    Variant(long v) : type_(INT), i_(v) {}
+    Variant(unsigned long v) : type_(INT), i_((int64_t)v) {}
+    Variant(long long v) : type_(INT), i_(v) {}
+    Variant(unsigned long long v) : type_(INT), i_((int64_t)v) {}
+    Variant(double v) : type_(DOUBLE), d_(v) {}
+    Variant(const char *v) : type_(STRING), s_(v ? v : "") {}
+    Variant(const String &v) : type_(STRING), s_(v.str()) {}
+
+    Type type() const { return type_; }
+    bool isMap() const { return type_ == MAP; }
+    bool isArray() const { return type_ == ARRAY; }
+    int size() const { return (int)children_.size(); }
+
+    // Map entries are kept sorted by key, as VariantMap does on device.
+    bool set(const char *key, const Variant &v);
+    bool append(const Variant &v);
+    bool has(const char *key) const;
+    Variant get(const char *key) const;
+    Variant at(int i) const { return (i >= 0 && i < size()) ? children_[i].second : Variant(); }
+    const char *keyAt(int i) const { return (i >= 0 && i < size()) ? children_[i].first.c_str() : ""; }
+
+    int64_t toInt() const { return type_ == DOUBLE ? (int64_t)d_ : i_; }
+    double toDouble() const { return type_ == DOUBLE ? d_ : (double)i_; }
+    bool toBool() const { return i_ != 0; }
+    String toString() const { return String(s_); }
+    String toJSON() const;
+
+private:
+    void appendJson(std::string &out) const;
+
+    Type type_ = NULL_;
+    int64_t i_ = 0;
+    double d_ = 0;
+    std::string s_;
+    std::vector<std::pair<std::string, Variant>> children_;
+};
+
+class Ledger {
+public:
+    Ledger() {}
+    explicit Ledger(const char *name) : name_(name) {}
+    bool isValid() const { return !name_.empty(); }
+    const char *name() const { return name_.c_str(); }
+    int set(const Variant &data);
+    Variant get() const;
+
+private:
+    std::string name_;
+};
+
+// ---- Time ----
+#define TIME_FORMAT_DEFAULT "asctime"
+#define TIME_FORMAT_ISO8601_FULL "%Y-%m-%dT%H:%M:%S%z"
+
+typedef int32_t time32_t;
+
+class TimeClass {
+public:
+    bool isValid() const;
+    time32_t now() const;
+    int hour() const; // UTC; Time.zone() is not modelled
+    int hour(time32_t t) const;
+    String format(const char *fmt) const;
+    String format(time32_t t, const char *fmt) const;
+};
+
+extern TimeClass Time;
+
+// ---- Cloud ----
+enum PublishFlag { PUBLIC = 0, PRIVATE = 1, NO_ACK = 2, WITH_ACK = 8 };
+
+class CloudClass {
+public:
+    bool connected() const;
+    bool publish(const char *name, const char *data, int flags = PRIVATE);
+    bool publish(const char *name, const String &data, int flags = PRIVATE) { return publish(name, data.c_str(), flags); }
+    bool function(const char *name, int (*fn)(String));
+    Ledger ledger(const char *name);
+    void process() {}
+
+    // Host only: invoke a registered cloud function as the Console would; -1 when none is registered
+    int callFunction(const char *name, const char *arg);
+};
+
+extern CloudClass Particle;
+
+// ---- BLE ----
+#define BLE_SIG_ADDR_LEN 6
+#define BLE_SIG_UUID_128BIT_LEN 16
+#define BLE_MAX_ADV_DATA_LEN 31
+
+enum class BlePhy : uint8_t {
+    BLE_PHYS_AUTO = 0x00,
+    BLE_PHYS_1MBPS = 0x01,
+    BLE_PHYS_2MBPS = 0x02,
+    BLE_PHYS_CODED = 0x04
+};
+
+enum class BleAddressType : uint8_t {
+    PUBLIC = 0,
+    RANDOM_STATIC = 1,
+    RANDOM_PRIVATE_RESOLVABLE = 2,
+    RANDOM_PRIVATE_NON_RESOLVABLE = 3
+};
+
+enum class BleCharacteristicProperty : uint8_t {
+    NONE = 0x00,
+    BROADCAST = 0x01,
+    READ = 0x02,
+    WRITE_WO_RSP = 0x04,
+    WRITE = 0x08,
+    NOTIFY = 0x10,
+    INDICATE = 0x20,
+    AUTH_SIGN_WRITES = 0x40,
+    EXTENDED_PROP = 0x80
+};
+
+enum class BleAdvertisingDataType : uint8_t {
+    FLAGS = 0x01,
+    SERVICE_UUID_16BIT_MORE_AVAILABLE = 0x02,
+    SERVICE_UUID_16BIT_COMPLETE = 0x03,
+    SERVICE_UUID_128BIT_MORE_AVAILABLE = 0x06,
+    SERVICE_UUID_128BIT_COMPLETE = 0x07,
+    SHORT_LOCAL_NAME = 0x08,
+    COMPLETE_LOCAL_NAME = 0x09,
+    SERVICE_DATA_16BIT_UUID = 0x16,
+    SERVICE_DATA_128BIT_UUID = 0x21,
+    MANUFACTURER_SPECIFIC_DATA = 0xFF
+};
+
+enum class BleUuidType { SHORT = 0, LONG = 1 };
+
+class BleUuid {
+public:
+    BleUuid() {}
+    explicit BleUuid(uint16_t uuid16);
+    BleUuid(const uint8_t uuid128[BLE_SIG_UUID_128BIT_LEN]);
+    BleUuid(const char *uuid);
+    BleUuidType type() const { return type_; }
+    bool isValid() const { return valid_; }
+    uint16_t shorted() const { return short_; }
+    // Little-endian (over-the-air) byte order, as in Device OS.
+    const uint8_t *rawBytes() const { return full_; }
+    String toString(bool stripped = false) const;
+    bool operator==(const BleUuid &o) const;
+    bool operator!=(const BleUuid &o) const { return !(*this == o); }
+
+private:
+    BleUuidType type_ = BleUuidType::LONG;
+    bool valid_ = false;
+    uint16_t short_ = 0;
+    uint8_t full_[BLE_SIG_UUID_128BIT_LEN] = {0};
+};
+
+class BleAddress {
+public:
+    BleAddress() {}
+    BleAddress(const uint8_t addr[BLE_SIG_ADDR_LEN], BleAddressType type = BleAddressType::PUBLIC) : type_(type) {
+        memcpy(addr_, addr, BLE_SIG_ADDR_LEN);
+    }
+    BleAddress(const char *str);
+    uint8_t operator[](uint8_t i) const { return i < BLE_SIG_ADDR_LEN ? addr_[i] : 0; }
+    BleAddressType type() const { return type_; }
+    void octets(uint8_t addr[BLE_SIG_ADDR_LEN]) const { memcpy(addr, addr_, BLE_SIG_ADDR_LEN); }
+    String toString(bool stripped = false) const;
+    bool isValid() const;
+    bool operator==(const BleAddress &o) const { return memcmp(addr_, o.addr_, BLE_SIG_ADDR_LEN) == 0; }
+    bool operator!=(const BleAddress &o) const { return !(*this == o); }
+
+private:
+    uint8_t addr_[BLE_SIG_ADDR_LEN] = {0};
+    BleAddressType type_ = BleAddressType::PUBLIC;
+};
+
+class BleAdvertisingData {
+public:
+    BleAdvertisingData() {}
+    BleAdvertisingData(const uint8_t *buf, size_t len);
+    const uint8_t *data() const { return buf_; }
+    size_t length() const { return len_; }
+    size_t get(BleAdvertisingDataType type, uint8_t *buf, size_t len) const;
+    bool contains(BleAdvertisingDataType type) const;
+    String deviceName() const;
+    size_t deviceName(char *buf, size_t len) const;
+    Vector<BleUuid> serviceUUID() const;
+    size_t serviceUUID(BleUuid *uuids, size_t count) const;
+    size_t customData(uint8_t *buf, size_t len) const;
+
+private:
+    const uint8_t *find(uint8_t type, size_t *len) const;
+
+    uint8_t buf_[BLE_MAX_ADV_DATA_LEN] = {0};
+    size_t len_ = 0;
+};
+
+class BleScanResult {
+public:
+    BleScanResult() {}
+    BleScanResult(const BleAddress &addr, const BleAdvertisingData &adv, const BleAdvertisingData &sr, int8_t rssi)
+        : address_(addr), adv_(adv), sr_(sr), rssi_(rssi) {}
+    const BleAddress &address() const { return address_; }
+    const BleAdvertisingData &advertisingData() const { return adv_; }
+    const BleAdvertisingData &scanResponse() const { return sr_; }
+    int8_t rssi() const { return rssi_; }
+
+private:
+    BleAddress address_;
+    BleAdvertisingData adv_;
+    BleAdvertisingData sr_;
+    int8_t rssi_ = -127;
+};
+
+class BleService {
+public:
+    BleService() {}
+    explicit BleService(const BleUuid &uuid) : uuid_(uuid) {}
+    const BleUuid &UUID() const { return uuid_; }
+
+private:
+    BleUuid uuid_;
+};
+
+class BleCharacteristic {
+public:
+    BleCharacteristic() {}
+    bool isValid() const { return impl_ != nullptr; }
+    BleUuid UUID() const { return impl_ ? impl_->uuid : BleUuid(); }
+    BleCharacteristicProperty properties() const { return impl_ ? impl_->props : BleCharacteristicProperty::NONE; }
+    ssize_t getValue(uint8_t *buf, size_t len) const;
+
+    // Host-only: simulated attribute binding (connection, peripheral, attribute kind).
+    struct Impl {
+        int connHandle;
+        int attr;
+        BleUuid uuid;
+        BleCharacteristicProperty props;
+    };
+    explicit BleCharacteristic(std::shared_ptr<Impl> impl) : impl_(std::move(impl)) {}
+
+private:
+    std::shared_ptr<Impl> impl_;
+};
+
+class BlePeerDevice {
+public:
+    BlePeerDevice() {}
+    BlePeerDevice(int connHandle, const BleAddress &addr) : conn_(connHandle), address_(addr) {}
+    bool connected() const;
+    int disconnect() const;
+    const BleAddress &address() const { return address_; }
+    Vector<BleService> discoverAllServices();
+    ssize_t discoverAllServices(BleService *services, size_t count);
+    Vector<BleCharacteristic> discoverCharacteristicsOfService(const BleService &service);
+    ssize_t discoverCharacteristicsOfService(const BleService &service, BleCharacteristic *chars, size_t count);
+    Vector<BleCharacteristic> discoverAllCharacteristics();
+    bool getCharacteristicByUUID(BleCharacteristic &characteristic, const BleUuid &uuid) const;
+    int connHandle() const { return conn_; }
+    bool operator==(const BlePeerDevice &o) const { return conn_ == o.conn_ && address_ == o.address_; }
+
+private:
+    int conn_ = -1;
+    BleAddress address_;
+    std::shared_ptr<Vector<BleCharacteristic>> discovered_;
+};
+
+// Stack-level scan filter (Device OS 3.0+). Different criteria are ANDed; several values of the
+// same criterion are ORed. Name and UUID criteria look at the advert and the scan response.
+class BleScanFilter {
+public:
+    BleScanFilter &deviceName(const char *name) { names_.push_back(name ? name : ""); return *this; }
+    BleScanFilter &serviceUUID(const BleUuid &uuid) { uuids_.push_back(uuid); return *this; }
+    BleScanFilter &minRssi(int8_t rssi) { minRssi_ = rssi; return *this; }
+    BleScanFilter &allowDuplicates(bool allow) { (void)allow; return *this; }
+
+    // Host-only: what the stack would do with one report.
+    bool matches(const BleScanResult &result) const;
+
+private:
+    std::vector<std::string> names_;
+    std::vector<BleUuid> uuids_;
+    int8_t minRssi_ = -128;
+};
+
+typedef void (*BleOnScanResultCallback)(const BleScanResult &result);
+typedef void (*BleOnConnectedCallback)(const BlePeerDevice &peer);
+typedef void (*BleOnDisconnectedCallback)(const BlePeerDevice &peer);
+
+class BleLocalDevice {
+public:
+    int on() { return SYSTEM_ERROR_NONE; }
+    int off() { return SYSTEM_ERROR_NONE; }
+    int setTxPower(int8_t txPower) { (void)txPower; return SYSTEM_ERROR_NONE; }
+    int setScanPhy(BlePhy phy) { (void)phy; return SYSTEM_ERROR_NONE; }
+    // Units of 10 ms, as on device.
+    int setScanTimeout(uint16_t timeout) { scanTimeout_ = timeout; return SYSTEM_ERROR_NONE; }
+    uint16_t scanTimeout() const { return scanTimeout_; }
+    int scan(BleOnScanResultCallback callback);
+    int scanWithFilter(const BleScanFilter &filter, BleOnScanResultCallback callback);
+    int stopScanning();
+    bool scanning() const;
+    BlePeerDevice connect(const BleAddress &addr, bool automatic = true);
+    bool connected() const;
+    void onConnected(BleOnConnectedCallback cb) { connectedCb_ = cb; }
+    void onDisconnected(BleOnDisconnectedCallback cb) { disconnectedCb_ = cb; }
+
+    // Host-only accessors for the simulator.
+    BleOnConnectedCallback connectedCallback() const { return connectedCb_; }
+    BleOnDisconnectedCallback disconnectedCallback() const { return disconnectedCb_; }
+
+private:
+    uint16_t scanTimeout_ = 500;
+    BleOnConnectedCallback connectedCb_ = nullptr;
+    BleOnDisconnectedCallback disconnectedCb_ = nullptr;
+};
+
+extern BleLocalDevice BLE;
@@ -0,0 +1,254 @@
+#include "capture_replay.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "input_capture.h"
+
+namespace sim {
+
+// How far match() looks either side of a call's time for an unused record
+static const size_t MATCH_WINDOW = 256;
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Reassemble "CAP <offset> <hex>" lines (any log prefix) into the file they were dumped from
+static bool parseDump(const std::vector<uint8_t> &text, std::vector<uint8_t> &out, std::string &error) {
+    std::vector<bool> have;
+    std::istringstream in(std::string(text.begin(), text.end()));
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(in, line)) {
+        size_t at = line.find("CAP ");
+        if (at == std::string::npos) continue;
+        char *end = nullptr;
+        unsigned long offset = strtoul(line.c_str() + at + 4, &end, 16);
+        if (!end || *end != ' ') continue;
+        const char *hex = end + 1;
+        size_t n = 0;
+        while (hexNibble(hex[2 * n]) >= 0 && hexNibble(hex[2 * n + 1]) >= 0) n++;
+        if (offset + n > out.size()) {
+            out.resize(offset + n);
+            have.resize(offset + n, false);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            out[offset + i] = (uint8_t)(hexNibble(hex[2 * i]) << 4 | hexNibble(hex[2 * i + 1]));
+            have[offset + i] = true;
+        }
+        lines++;
+    }
+    if (lines == 0) {
+        error = "neither a capture nor a log with capture_dump lines";
+        return false;
+    }
+    auto gap = std::find(have.begin(), have.end(), false);
+    if (gap != have.end()) {
+        error = "capture_dump lines are missing bytes from offset " + std::to_string(gap - have.begin());
+        return false;
+    }
+    return true;
+}
+
+bool CaptureReplay::load(const std::string &path, std::string &error) {
+    std::vector<uint8_t> data;
+    if (!readFile(path, data)) {
+        error = "cannot read " + path;
+        return false;
+    }
+    if (data.size() < 4 || memcmp(data.data(), "SSC1", 4) != 0) {
+        std::vector<uint8_t> dumped;
+        if (!parseDump(data, dumped, error)) return false;
+        data.swap(dumped);
+    }
+    return loadBytes(data, error);
+}
+
+uint64_t CaptureReplay::key(const BleAddress &address) {
+    uint64_t k = 0;
+    for (uint8_t i = 0; i < BLE_SIG_ADDR_LEN; ++i) k |= (uint64_t)address[i] << (8 * i);
+    return k;
+}
+
+CaptureReplay::Device *CaptureReplay::device(const BleAddress &address) {
+    auto it = devices_.find(key(address));
+    return it == devices_.end() ? nullptr : &it->second;
+}
+
+bool CaptureReplay::loadBytes(const std::vector<uint8_t> &bytes, std::string &error) {
+    *this = CaptureReplay();
+    InputCaptureReader reader;
+    if (!reader.open(bytes.data(), bytes.size())) {
+        error = "not a version " + std::to_string(INPUT_CAPTURE_VERSION) + " capture";
+        return false;
+    }
+    bytes_ = bytes.size();
+    CaptureRecord r;
+    uint64_t ms = 0;
+    uint32_t lastMs = 0;
+    bool first = true;
+    while (reader.next(r)) {
+        // millis() wraps after 49 days; records are close together, so a large step back is a wrap
+        if (first) {
+            ms = r.ms;
+            startMs_ = ms;
+            first = false;
+        } else {
+            ms += (uint64_t)(int64_t)(int32_t)(r.ms - lastMs);
+        }
+        lastMs = r.ms;
+        endMs_ = std::max(endMs_, ms);
+        records_++;
+        BleAddress address(r.address);
+        switch (r.type) {
+            case CAPTURE_CLOCK:
+                clockSteps_.push_back({ms, r.unixTime, r.flags != 0});
+                break;
+            case CAPTURE_CLOUD:
+                cloudSteps_.push_back({ms, r.connected});
+                break;
+            case CAPTURE_SCAN:
+                scans_.push_back({ms, false, r.durationMs, r.count, {}});
+                break;
+            case CAPTURE_SIGHTING: {
+                // The scan whose window holds the callback's time; sightings follow their scan
+                for (auto it = scans_.rbegin(); it != scans_.rend(); ++it) {
+                    if (it->ms <= ms && ms <= it->ms + it->durationMs) {
+                        it->sightings.push_back({(uint32_t)(ms - it->ms), address, r.rssi, r.match, r.hasAdvStatus,
+                                                 r.advStatus});
+                        break;
+                    }
+                    if (it->ms + it->durationMs < ms) break;
+                }
+                break;
+            }
+            case CAPTURE_CONNECT:
+                devices_[key(address)].connects.push_back({ms, false, r.durationMs, r.connected, r.flags, -1});
+                break;
+            case CAPTURE_DISCONNECT: {
+                // Link loss ends the device's latest connect
+                Device *d = device(address);
+                if (d && !d->connects.empty() && d->connects.back().dropAfterMs < 0 && d->connects.back().ms <= ms) {
+                    d->connects.back().dropAfterMs = (int64_t)(ms - d->connects.back().ms);
+                }
+                break;
+            }
+            case CAPTURE_SERVICES:
+                devices_[key(address)].services.push_back({ms, false, r.durationMs, r.count, r.flags != 0});
+                break;
+            case CAPTURE_CHARS: {
+                Characteristics c = {ms, false, r.durationMs, r.count, {r.props[0], r.props[1], r.props[2]}};
+                devices_[key(address)].characteristics.push_back(c);
+                break;
+            }
+            case CAPTURE_READ:
+                if (r.attr < CAPTURE_ATTRS) {
+                    Read rd = {ms, false, r.durationMs, r.result, {}};
+                    memcpy(rd.value, r.value, sizeof(rd.value));
+                    devices_[key(address)].reads[r.attr].push_back(rd);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    if (reader.malformed()) {
+        error = "malformed record after " + std::to_string(records_) + " records";
+        return false;
+    }
+    if (records_ == 0) {
+        error = "the capture holds no records";
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+T *CaptureReplay::match(std::vector<T> &records, uint64_t t) {
+    if (records.empty()) {
+        stats_.unrecorded++;
+        return nullptr;
+    }
+    auto byMs = [](const T &r, uint64_t v) { return r.ms < v; };
+    size_t at = (size_t)(std::lower_bound(records.begin(), records.end(), t, byMs) - records.begin());
+    T *best = nullptr;
+    uint64_t bestDistance = UINT64_MAX;
+    for (size_t i = at, n = 0; i < records.size() && n < MATCH_WINDOW; ++i, ++n) {
+        if (records[i].ms - t >= bestDistance) break;
+        if (!records[i].used) {
+            best = &records[i];
+            bestDistance = records[i].ms - t;
+            break;
+        }
+    }
+    for (size_t i = at, n = 0; i > 0 && n < MATCH_WINDOW; --i, ++n) {
+        if (t - records[i - 1].ms >= bestDistance) break;
+        if (!records[i - 1].used) {
+            best = &records[i - 1];
+            break;
+        }
+    }
+    if (best) {
+        (best->ms == t ? stats_.exact : stats_.near)++;
+        best->used = true;
+        return best;
+    }
+    // All used: answer as the nearest one did
+    stats_.reused++;
+    if (at == records.size() || (at > 0 && t - records[at - 1].ms <= records[at].ms - t)) at--;
+    return &records[at];
+}
+
+const CaptureReplay::Scan *CaptureReplay::scan(uint64_t t) { return match(scans_, t); }
+
+const CaptureReplay::Connect *CaptureReplay::connect(const BleAddress &address, uint64_t t) {
+    Device *d = device(address);
+    if (!d) {
+        stats_.unrecorded++;
+        return nullptr;
+    }
+    return match(d->connects, t);
+}
+
+const CaptureReplay::Services *CaptureReplay::services(const BleAddress &address, uint64_t t) {
+    Device *d = device(address);
+    if (!d) {
+        stats_.unrecorded++;
+        return nullptr;
+    }
+    return match(d->services, t);
+}
+
+const CaptureReplay::Characteristics *CaptureReplay::characteristics(const BleAddress &address, uint64_t t) {
+    Device *d = device(address);
+    if (!d) {
+        stats_.unrecorded++;
+        return nullptr;
+    }
+    return match(d->characteristics, t);
+}
+
+const CaptureReplay::Read *CaptureReplay::read(const BleAddress &address, int attr, uint64_t t) {
+    Device *d = device(address);
+    if (!d || attr < 0 || attr >= CAPTURE_ATTRS) {
+        stats_.unrecorded++;
+        return nullptr;
+    }
+    return match(d->reads[attr], t);
+}
+
+} // namespace sim
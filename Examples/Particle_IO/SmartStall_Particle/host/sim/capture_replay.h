@@ -0,0 +1,133 @@
+/*
+ * A hub input capture (src/input_capture.h) loaded for replay through the simulated radio and cloud.
+ *
+ * The records are grouped by what asks for them: scans with the SmartStall sightings their callback
+ * delivered, and per device the connects (each with the link loss that followed it, if any), service and
+ * characteristic discoveries and reads of each characteristic. The World in replay mode asks for the
+ * record that answers a call at a given time: the nearest one not used yet, else the nearest one again
+ * (reused), else none (unrecorded). A hub built and run as it was when capturing makes the same calls at
+ * the same times, so every match is exact.
+ *
+ * Cloud connectivity and clock records are kept in order for the World to apply as its clock passes them.
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Particle.h"
+#include "adv_status.h"
+
+namespace sim {
+
+struct CaptureMatchStats {
+    uint64_t exact = 0;      // unused record at the call's time
+    uint64_t near = 0;       // unused record at another time
+    uint64_t reused = 0;     // every record of its kind already used
+    uint64_t unrecorded = 0; // nothing recorded of its kind
+};
+
+class CaptureReplay {
+public:
+    struct Sighting {
+        uint32_t offsetMs;   // from the start of the scan
+        BleAddress address;
+        int8_t rssi;
+        uint8_t match;       // ADV_MATCH_*
+        bool hasAdvStatus;
+        AdvStatus advStatus;
+    };
+    struct Scan {
+        uint64_t ms;
+        bool used;
+        uint32_t durationMs;
+        uint32_t reports;    // every report the callback saw, SmartStall or not
+        std::vector<Sighting> sightings;
+    };
+    struct Connect {
+        uint64_t ms;
+        bool used;
+        uint32_t durationMs;
+        bool connected;
+        uint8_t chars;       // CaptureAttr bits found in the connect-time discovery table
+        int64_t dropAfterMs; // link lost this long after the call started (-1: closed by the hub)
+    };
+    struct Services {
+        uint64_t ms;
+        bool used;
+        uint32_t durationMs;
+        uint32_t count;
+        bool smartstall;
+    };
+    struct Characteristics {
+        uint64_t ms;
+        bool used;
+        uint32_t durationMs;
+        uint32_t count;
+        uint8_t props[3];    // per CaptureAttr, 0 when absent
+    };
+    struct Read {
+        uint64_t ms;
+        bool used;
+        uint32_t durationMs;
+        int32_t result;
+        uint8_t value[12];
+    };
+    struct CloudStep {
+        uint64_t ms;
+        bool up;
+    };
+    struct ClockStep {
+        uint64_t ms;
+        uint32_t unixTime;
+        bool valid;
+    };
+
+    // A binary capture, or a serial log holding capture_dump "CAP <offset> <hex>" lines. false with
+    // error set when the file is unreadable, a dump has gaps or the capture is malformed.
+    bool load(const std::string &path, std::string &error);
+    bool loadBytes(const std::vector<uint8_t> &bytes, std::string &error);
+
+    uint64_t startMs() const { return startMs_; }
+    uint64_t endMs() const { return endMs_; }
+    size_t records() const { return records_; }
+    size_t bytes() const { return bytes_; }
+    size_t devices() const { return devices_.size(); }
+    const std::vector<CloudStep> &cloudSteps() const { return cloudSteps_; }
+    const std::vector<ClockStep> &clockSteps() const { return clockSteps_; }
+    const CaptureMatchStats &stats() const { return stats_; }
+
+    // The record answering a call at t (null: unrecorded); marks it used
+    const Scan *scan(uint64_t t);
+    const Connect *connect(const BleAddress &address, uint64_t t);
+    const Services *services(const BleAddress &address, uint64_t t);
+    const Characteristics *characteristics(const BleAddress &address, uint64_t t);
+    const Read *read(const BleAddress &address, int attr, uint64_t t);
+
+private:
+    struct Device {
+        std::vector<Connect> connects;
+        std::vector<Services> services;
+        std::vector<Characteristics> characteristics;
+        std::vector<Read> reads[3];
+    };
+
+    static uint64_t key(const BleAddress &address);
+    Device *device(const BleAddress &address);
+    template <typename T>
+    T *match(std::vector<T> &records, uint64_t t);
+
+    std::vector<Scan> scans_;
+    std::map<uint64_t, Device> devices_;
+    std::vector<CloudStep> cloudSteps_;
+    std::vector<ClockStep> clockSteps_;
+    CaptureMatchStats stats_;
+    uint64_t startMs_ = 0;
+    uint64_t endMs_ = 0;
+    size_t records_ = 0;
+    size_t bytes_ = 0;
+};
+
+} // namespace sim
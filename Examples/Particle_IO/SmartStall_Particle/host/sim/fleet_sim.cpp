@@ -0,0 +1,800 @@
+#include "fleet_sim.h"
+
+#include "adv_filter.h"
+#include "adv_status.h"
+#include "capture_replay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+namespace sim {
+
+// 2026-01-01T08:00:00Z; the virtual clock starts here (a working day, outside the hub's quiet hours).
+static const time32_t SIM_EPOCH = 1767254400;
+
+static const char *SMARTSTALL_NAME = "SmartStall";
+static const BleUuid SMARTSTALL_SERVICE("c56a1b98-6c1e-413a-b138-0e9f320c7e8b");
+static const BleUuid ATTR_UUIDS[ATTR_COUNT] = {
+    BleUuid("47d80a44-c552-422b-aa3b-d250ed04be37"),
+    BleUuid("7d108dc9-4aaf-4a38-93e3-d9f8ff139f11"),
+    BleUuid("3e4a9f12-7b5c-4d8e-a1b2-9c8d7e6f5a4b"),
+};
+
+World &world() {
+    static World w;
+    return w;
+}
+
+static size_t putAd(uint8_t *buf, size_t at, uint8_t type, const void *data, size_t len) {
+    if (at + 2 + len > BLE_MAX_ADV_DATA_LEN) return at;
+    buf[at] = (uint8_t)(len + 1);
+    buf[at + 1] = type;
+    memcpy(buf + at + 2, data, len);
+    return at + 2 + len;
+}
+
+void World::reset(const FleetConfig &cfg) {
+    cfg_ = cfg;
+    stats_ = Stats();
+    binDecoder_.reset();
+    periph_.clear();
+    links_.clear();
+    rng_.seed(cfg.seed);
+    nowMs_ = 0;
+    bootMs_ = 0;
+    nextAnyEventMs_ = 0;
+    scanning_ = false;
+    stopScan_ = false;
+    hadTeardown_ = false;
+    lastTeardownMs_ = 0;
+    cloudUp_ = true;
+    replay_ = nullptr;
+    replayCloudAt_ = 0;
+    replayDrops_.clear();
+
+    const uint8_t flags = 0x06;
+    std::exponential_distribution<double> firstVisit(cfg.visitsPerHour / 3600000.0);
+    for (int i = 0; i < cfg.devices + cfg.bystanders; ++i) {
+        Peripheral p;
+        bool stall = i < cfg.devices;
+        uint8_t a[BLE_SIG_ADDR_LEN] = {(uint8_t)(i & 0xFF), (uint8_t)(i >> 8), 0x5A, 0x57,
+                                       (uint8_t)(stall ? 0x31 : 0x7E), 0xC0};
+        p.address = BleAddress(a);
+        p.smartstall = stall;
+        p.advLen = putAd(p.adv, 0, (uint8_t)BleAdvertisingDataType::FLAGS, &flags, 1);
+        if (stall) {
+            // Zephyr USE_NAME puts the name in the advert; the 128-bit service UUID rides in the scan response.
+            p.advLen = putAd(p.adv, p.advLen, (uint8_t)BleAdvertisingDataType::COMPLETE_LOCAL_NAME,
+                             SMARTSTALL_NAME, strlen(SMARTSTALL_NAME));
+            p.srLen = putAd(p.sr, 0, (uint8_t)BleAdvertisingDataType::SERVICE_UUID_128BIT_COMPLETE,
+                            SMARTSTALL_SERVICE.rawBytes(), BLE_SIG_UUID_128BIT_LEN);
+            p.advIntervalMs = cfg.advIntervalMs;
+            p.status = 3;
+            p.hubStatus = 3;
+            p.batteryMv = (uint16_t)(3900 + jitter(200, 200) - 200);
+            p.advBaseLen = p.advLen;
+            p.advTelemetry = cfg.advTelemetryFraction > 0 && chance(cfg.advTelemetryFraction);
+            refreshAdvTelemetry(p);
+            p.nextVisitMs = (uint64_t)firstVisit(rng_) + 1;
+            if (cfg.rangeModel) {
+                double frac = cfg.devices > 1 ? (double)i / (cfg.devices - 1) : 0.0;
+                double d = cfg.minDistanceM + frac * (cfg.maxDistanceM - cfg.minDistanceM);
+                p.rssiMeanDbm = cfg.rssiAt1m - 10.0 * cfg.pathLossExponent * std::log10(d);
+            }
+        } else {
+            // Phones and beacons: manufacturer data only, slower and more varied intervals.
+            uint8_t mfg[20];
+            for (size_t k = 0; k < sizeof(mfg); ++k) mfg[k] = (uint8_t)rng_();
+            mfg[0] = 0x4C;
+            mfg[1] = 0x00;
+            p.advLen = putAd(p.adv, p.advLen, (uint8_t)BleAdvertisingDataType::MANUFACTURER_SPECIFIC_DATA, mfg,
+                             sizeof(mfg));
+            p.advIntervalMs = 100 + (uint32_t)(rng_() % 900);
+            p.nextVisitMs = UINT64_MAX;
+        }
+        periph_.push_back(p);
+    }
+    recomputeNextEvent();
+}
+
+uint32_t World::jitter(uint32_t base, uint32_t spread) {
+    if (spread == 0) return base;
+    return base + (uint32_t)(rng_() % (spread + 1));
+}
+
+// Slow linear drain, roughly 6 mV per hour.
+uint16_t World::batteryNow(const Peripheral &p) const {
+    return (uint16_t)std::max<int64_t>(3300, (int64_t)p.batteryMv - (int64_t)(nowMs_ / 600000));
+}
+
+double World::linkRssi(Peripheral &p) {
+    if (nowMs_ >= p.shadowUntilMs) {
+        std::normal_distribution<double> shadow(0.0, cfg_.shadowingDb);
+        p.shadowDb = shadow(rng_);
+        p.shadowUntilMs = nowMs_ + cfg_.shadowingPeriodMs;
+    }
+    std::normal_distribution<double> fast(0.0, cfg_.rssiSpread / 2.0);
+    return std::max(-100.0, std::min(-30.0, p.rssiMeanDbm + p.shadowDb + fast(rng_)));
+}
+
+double World::edgeProb(double rssi) {
+    return 1.0 / (1.0 + std::exp(-(rssi - cfg_.sensitivityDbm) / cfg_.edgeWidthDb));
+}
+
+bool World::chance(double p) {
+    if (p <= 0) return false;
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    return u(rng_) < p;
+}
+
+uint64_t World::nextEventOf(const Peripheral &p) const {
+    if (!p.smartstall) return UINT64_MAX;
+    if (p.occupied) return p.visitEndMs;
+    uint64_t t = p.nextVisitMs;
+    if (cfg_.sleepEnabled && !p.asleep) {
+        t = std::min<uint64_t>(t, p.lastDoorEventMs + cfg_.sleepAfterIdleMs);
+    }
+    return t;
+}
+
+void World::recomputeNextEvent() {
+    nextAnyEventMs_ = UINT64_MAX;
+    for (const Peripheral &p : periph_) {
+        nextAnyEventMs_ = std::min(nextAnyEventMs_, nextEventOf(p));
+    }
+}
+
+void World::advance(uint64_t ms) { advanceTo(nowMs_ + ms); }
+
+template <typename T>
+static bool putRaw(FILE *f, const T &v) {
+    return fwrite(&v, sizeof(v), 1, f) == 1;
+}
+
+template <typename T>
+static bool getRaw(FILE *f, T &v) {
+    return fread(&v, sizeof(v), 1, f) == 1;
+}
+
+bool World::saveFleet(FILE *f) const {
+    std::ostringstream rng;
+    rng << rng_;
+    std::string state = rng.str();
+    bool ok = putRaw(f, nowMs_) && putRaw(f, cloudUp_) && putRaw(f, state.size())
+              && fwrite(state.data(), 1, state.size(), f) == state.size() && putRaw(f, periph_.size());
+    for (const Peripheral &p : periph_) {
+        ok = ok && putRaw(f, p.adv) && putRaw(f, p.advLen) && putRaw(f, p.shadowDb) && putRaw(f, p.shadowUntilMs)
+             && putRaw(f, p.status) && putRaw(f, p.counts) && putRaw(f, p.used) && putRaw(f, p.resets)
+             && putRaw(f, p.advSequence) && putRaw(f, p.asleep) && putRaw(f, p.occupied) && putRaw(f, p.nextVisitMs)
+             && putRaw(f, p.visitEndMs) && putRaw(f, p.lastDoorEventMs) && putRaw(f, p.hubStatus)
+             && putRaw(f, p.divergedAtMs);
+    }
+    return ok && fflush(f) == 0;
+}
+
+bool World::loadFleet(FILE *f) {
+    size_t stateLen = 0;
+    size_t count = 0;
+    if (!getRaw(f, nowMs_) || !getRaw(f, cloudUp_) || !getRaw(f, stateLen)) return false;
+    std::string state(stateLen, '\0');
+    if (fread(&state[0], 1, stateLen, f) != stateLen || !getRaw(f, count) || count != periph_.size()) return false;
+    std::istringstream rng(state);
+    rng >> rng_;
+    for (Peripheral &p : periph_) {
+        if (!getRaw(f, p.adv) || !getRaw(f, p.advLen) || !getRaw(f, p.shadowDb) || !getRaw(f, p.shadowUntilMs)
+            || !getRaw(f, p.status) || !getRaw(f, p.counts) || !getRaw(f, p.used) || !getRaw(f, p.resets)
+            || !getRaw(f, p.advSequence) || !getRaw(f, p.asleep) || !getRaw(f, p.occupied)
+            || !getRaw(f, p.nextVisitMs) || !getRaw(f, p.visitEndMs) || !getRaw(f, p.lastDoorEventMs)
+            || !getRaw(f, p.hubStatus) || !getRaw(f, p.divergedAtMs)) {
+            return false;
+        }
+    }
+    bootMs_ = nowMs_;
+    recomputeNextEvent();
+    return true;
+}
+
+void World::advanceTo(uint64_t t) {
+    for (;;) {
+        uint64_t drop = replayDrops_.empty() ? UINT64_MAX : replayDrops_.begin()->first;
+        if (drop <= t && drop <= nextAnyEventMs_) {
+            nowMs_ = std::max(nowMs_, drop);
+            int conn = replayDrops_.begin()->second;
+            replayDrops_.erase(replayDrops_.begin());
+            if (linkAlive(conn)) dropLink(conn);
+            continue;
+        }
+        if (nextAnyEventMs_ > t) break;
+        nowMs_ = std::max(nowMs_, nextAnyEventMs_);
+        for (size_t i = 0; i < periph_.size(); ++i) {
+            if (nextEventOf(periph_[i]) <= nowMs_) stepPeripheral((int)i);
+        }
+        recomputeNextEvent();
+    }
+    if (t > nowMs_) nowMs_ = t;
+}
+
+time32_t World::unixTime() const {
+    if (!replay_) return SIM_EPOCH + (time32_t)(nowMs_ / 1000);
+    // Latest clock record at or before now, running on from there
+    const CaptureReplay::ClockStep *clock = nullptr;
+    for (const CaptureReplay::ClockStep &s : replay_->clockSteps()) {
+        if (s.ms > nowMs_) break;
+        clock = &s;
+    }
+    if (!clock) return SIM_EPOCH + (time32_t)(nowMs_ / 1000);
+    return (time32_t)(clock->unixTime + (nowMs_ - clock->ms) / 1000);
+}
+
+bool World::timeValid() const {
+    if (!replay_) return sinceBoot() >= cfg_.timeSyncMs;
+    bool valid = true;
+    for (const CaptureReplay::ClockStep &s : replay_->clockSteps()) {
+        if (s.ms > nowMs_) break;
+        valid = s.valid;
+    }
+    return valid;
+}
+
+bool World::cloudConnected() {
+    if (replay_) {
+        const std::vector<CaptureReplay::CloudStep> &steps = replay_->cloudSteps();
+        for (; replayCloudAt_ < steps.size() && steps[replayCloudAt_].ms <= nowMs_; ++replayCloudAt_) {
+            cloudUp_ = steps[replayCloudAt_].up;
+        }
+    }
+    return cloudUp_;
+}
+
+void World::startReplay(CaptureReplay *replay) {
+    replay_ = replay;
+    replayCloudAt_ = 0;
+    replayDrops_.clear();
+}
+
+void World::stepPeripheral(int idx) {
+    Peripheral &p = periph_[idx];
+    std::exponential_distribution<double> gap(cfg_.visitsPerHour / 3600000.0);
+    if (p.occupied) {
+        // Visitor leaves: door opens, stall unlocks.
+        p.occupied = false;
+        p.counts[0]++;
+        p.counts[2]++;
+        p.used[0]++;
+        p.used[2]++;
+        p.lastDoorEventMs = nowMs_;
+        p.nextVisitMs = nowMs_ + (uint64_t)gap(rng_) + 1;
+        setStatus(p, 3);
+    } else if (p.nextVisitMs <= nowMs_) {
+        // Visitor arrives: hall interrupt wakes a sleeping stall, then it locks.
+        p.asleep = false;
+        p.occupied = true;
+        if (cfg_.countResetRate > 0 && chance(cfg_.countResetRate)) {
+            memset(p.counts, 0, sizeof(p.counts));
+            p.resets++;
+        }
+        p.counts[0]++;
+        p.counts[1] += 2;
+        p.counts[2]++;
+        p.used[0]++;
+        p.used[1] += 2;
+        p.used[2]++;
+        p.lastDoorEventMs = nowMs_;
+        p.visitEndMs = nowMs_ + jitter(cfg_.dwellMinMs, cfg_.dwellMaxMs - cfg_.dwellMinMs);
+        setStatus(p, 2);
+    } else {
+        // Idle timeout: SYSTEMOFF, advertising stops and any link drops.
+        p.asleep = true;
+        setStatus(p, 4);
+        for (size_t c = 0; c < links_.size(); ++c) {
+            if (links_[c].alive && links_[c].peripheral == idx) dropLink((int)c);
+        }
+    }
+}
+
+// Telemetry field in the advert (manufacturer data), rebuilt on every status/counts change
+void World::refreshAdvTelemetry(Peripheral &p) {
+    if (!p.advTelemetry) return;
+    AdvStatus s;
+    s.status = (uint8_t)p.status;
+    s.batteryMv = batteryNow(p);
+    s.countsDigest = sensorCountsDigest(p.counts[0], p.counts[1], p.counts[2]);
+    s.sequence = ++p.advSequence;
+    uint8_t field[2 + ADV_STATUS_PAYLOAD_LEN] = {(uint8_t)(ADV_STATUS_COMPANY_ID & 0xFF),
+                                                 (uint8_t)(ADV_STATUS_COMPANY_ID >> 8)};
+    encodeAdvStatusPayload(s, field + 2);
+    p.advLen = putAd(p.adv, p.advBaseLen, AD_TYPE_MANUFACTURER_DATA, field, sizeof(field));
+}
+
+void World::setStatus(Peripheral &p, uint16_t status) {
+    p.status = status;
+    refreshAdvTelemetry(p);
+    // SLEEP is never observable over BLE; the hub keeps the last awake status.
+    if (status == 4) return;
+    stats_.statusChanges++;
+    if (p.divergedAtMs == 0) {
+        if ((int)status != p.hubStatus) p.divergedAtMs = nowMs_;
+    } else if ((int)status == p.hubStatus) {
+        stats_.missedChanges++;
+        p.divergedAtMs = 0;
+    }
+}
+
+int World::findPeripheral(const BleAddress &addr) const {
+    for (size_t i = 0; i < periph_.size(); ++i) {
+        if (periph_[i].address == addr) return (int)i;
+    }
+    return -1;
+}
+
+int World::distinctPolled() const {
+    int n = 0;
+    for (const Peripheral &p : periph_) n += p.everPolled ? 1 : 0;
+    return n;
+}
+
+int World::scan(uint32_t durationMs, BleOnScanResultCallback cb, const BleScanFilter *filter) {
+    struct Heard {
+        uint64_t t;
+        int idx;
+    };
+    if (replay_) return replayScan(durationMs, cb);
+    std::vector<Heard> heard;
+    uint64_t start = nowMs_;
+    uint64_t end = start + durationMs;
+    for (size_t i = 0; i < periph_.size(); ++i) {
+        const Peripheral &p = periph_[i];
+        uint64_t t = start + rng_() % p.advIntervalMs;
+        for (; t < end; t += jitter(p.advIntervalMs, 10)) {
+            if (chance(cfg_.advReceiveProb)) heard.push_back({t, (int)i});
+        }
+    }
+    std::sort(heard.begin(), heard.end(), [](const Heard &a, const Heard &b) { return a.t < b.t; });
+
+    stats_.scans++;
+    if (anyLinkAlive() >= 0) stats_.scansWithLinks++;
+    scanning_ = true;
+    stopScan_ = false;
+    int reported = 0;
+    std::normal_distribution<double> rssi(cfg_.rssiMean, cfg_.rssiSpread / 2.0);
+    for (const Heard &h : heard) {
+        if (stopScan_) break;
+        advanceTo(h.t);
+        Peripheral &p = periph_[h.idx];
+        if (p.asleep) continue;
+        double level;
+        if (cfg_.rangeModel && p.smartstall) {
+            level = linkRssi(p);
+            if (!chance(edgeProb(level))) continue;
+        } else {
+            level = std::max(-100.0, std::min(-30.0, rssi(rng_)));
+        }
+        BleScanResult r(p.address, BleAdvertisingData(p.adv, p.advLen), BleAdvertisingData(p.sr, p.srLen),
+                        (int8_t)level);
+        if (filter && !filter->matches(r)) {
+            stats_.scanFiltered++;
+            continue;
+        }
+        stats_.scanCallbacks++;
+        reported++;
+        if (cb) cb(r);
+    }
+    if (!stopScan_) advanceTo(end);
+    scanning_ = false;
+    stats_.scanAirMs += nowMs_ - start;
+    return reported;
+}
+
+int World::connect(const BleAddress &addr, bool automatic) {
+    if (replay_) return replayConnect(addr, automatic);
+    stats_.connectAttempts++;
+    uint64_t start = nowMs_;
+    if (hadTeardown_) {
+        int64_t gap = (int64_t)(start - lastTeardownMs_);
+        if (stats_.minTeardownToConnectMs < 0 || gap < stats_.minTeardownToConnectMs) {
+            stats_.minTeardownToConnectMs = gap;
+        }
+    }
+    int idx = findPeripheral(addr);
+    bool outOfRange = idx >= 0 && cfg_.rangeModel && periph_[idx].smartstall
+        && !chance(edgeProb(linkRssi(periph_[idx]) - cfg_.connectMarginDb));
+    if (idx < 0 || !periph_[idx].smartstall || periph_[idx].asleep || outOfRange || chance(cfg_.connectFailRate)) {
+        advance(cfg_.connectTimeoutMs);
+        stats_.connectFailures++;
+        stats_.connectFailMs += nowMs_ - start;
+        stats_.linkAirMs += nowMs_ - start;
+        return -1;
+    }
+    advance(jitter(cfg_.connectLatencyMs, cfg_.connectJitterMs));
+    if (periph_[idx].asleep) {
+        stats_.connectFailures++;
+        stats_.connectFailMs += nowMs_ - start;
+        stats_.linkAirMs += nowMs_ - start;
+        return -1;
+    }
+    Link l;
+    l.peripheral = idx;
+    l.address = addr;
+    l.alive = true;
+    l.openedAtMs = start;
+    links_.push_back(l);
+    int conn = (int)links_.size() - 1;
+    uint64_t open = 0;
+    for (const Link &k : links_) open += k.alive ? 1 : 0;
+    stats_.maxLinksOpen = std::max(stats_.maxLinksOpen, open);
+    if (automatic) {
+        // Device OS discovers every service and its characteristics before connect() returns
+        std::vector<BleUuid> services;
+        std::vector<BleCharacteristic> chars;
+        if (discoverServices(conn, services)) {
+            for (const BleUuid &s : services) {
+                if (!discoverCharacteristics(conn, s, chars)) break;
+                links_[conn].discovered.insert(links_[conn].discovered.end(), chars.begin(), chars.end());
+            }
+        }
+    }
+    return conn;
+}
+
+bool World::discoveredCharacteristic(int conn, const BleUuid &uuid, BleCharacteristic &out) const {
+    if (conn < 0 || conn >= (int)links_.size()) return false;
+    for (const BleCharacteristic &c : links_[conn].discovered) {
+        if (c.UUID() == uuid) {
+            out = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool World::linkAlive(int conn) const {
+    return conn >= 0 && conn < (int)links_.size() && links_[conn].alive;
+}
+
+int World::anyLinkAlive() const {
+    for (size_t c = 0; c < links_.size(); ++c) {
+        if (links_[c].alive) return (int)c;
+    }
+    return -1;
+}
+
+void World::disconnect(int conn, bool local) {
+    (void)local;
+    if (!linkAlive(conn)) return;
+    Link &l = links_[conn];
+    l.alive = false;
+    stats_.linkAirMs += nowMs_ - l.openedAtMs;
+    hadTeardown_ = true;
+    lastTeardownMs_ = nowMs_;
+    BleOnDisconnectedCallback cb = BLE.disconnectedCallback();
+    if (cb) cb(BlePeerDevice(conn, l.address));
+}
+
+void World::dropLink(int conn) {
+    stats_.linkDrops++;
+    disconnect(conn, false);
+}
+
+bool World::gattOp(int conn, uint32_t costMs) {
+    if (!linkAlive(conn)) return false;
+    advance(costMs);
+    if (!linkAlive(conn)) return false;
+    if (chance(cfg_.linkDropRate)) {
+        dropLink(conn);
+        return false;
+    }
+    return true;
+}
+
+bool World::discoverServices(int conn, std::vector<BleUuid> &out) {
+    if (replay_) return replayDiscoverServices(conn, out);
+    out.clear();
+    if (!gattOp(conn, cfg_.serviceDiscoveryMs)) return false;
+    out.push_back(BleUuid((uint16_t)0x1800));
+    out.push_back(BleUuid((uint16_t)0x1801));
+    out.push_back(SMARTSTALL_SERVICE);
+    return true;
+}
+
+bool World::discoverCharacteristics(int conn, const BleUuid &service, std::vector<BleCharacteristic> &out) {
+    if (replay_) return replayDiscoverCharacteristics(conn, service, out);
+    out.clear();
+    if (!gattOp(conn, cfg_.charDiscoveryMs)) return false;
+    // GAP/GATT services cost the same round trips but expose nothing the hub reads.
+    if (service != SMARTSTALL_SERVICE) return true;
+    for (int a = 0; a < ATTR_COUNT; ++a) {
+        auto impl = std::make_shared<BleCharacteristic::Impl>();
+        impl->connHandle = conn;
+        impl->attr = a;
+        impl->uuid = ATTR_UUIDS[a];
+        impl->props = BleCharacteristicProperty::READ;
+        out.push_back(BleCharacteristic(impl));
+    }
+    return true;
+}
+
+ssize_t World::read(int conn, int attr, uint8_t *buf, size_t len) {
+    if (replay_) return replayRead(conn, attr, buf, len);
+    if (!gattOp(conn, cfg_.readLatencyMs)) return SYSTEM_ERROR_UNKNOWN;
+    if (chance(cfg_.readFailRate)) return SYSTEM_ERROR_UNKNOWN;
+    Peripheral &p = periph_[links_[conn].peripheral];
+    uint8_t v[12];
+    size_t n = 0;
+    switch (attr) {
+        case ATTR_STATUS:
+            v[0] = (uint8_t)(p.status & 0xFF);
+            v[1] = (uint8_t)(p.status >> 8);
+            n = 2;
+            break;
+        case ATTR_BATTERY: {
+            uint16_t mv = batteryNow(p);
+            v[0] = (uint8_t)(mv & 0xFF);
+            v[1] = (uint8_t)(mv >> 8);
+            n = 2;
+            break;
+        }
+        case ATTR_COUNTS:
+            for (int k = 0; k < 3; ++k) {
+                for (int b = 0; b < 4; ++b) v[k * 4 + b] = (uint8_t)(p.counts[k] >> (8 * b));
+            }
+            n = 12;
+            break;
+        default:
+            return SYSTEM_ERROR_UNKNOWN;
+    }
+    n = std::min(n, len);
+    memcpy(buf, v, n);
+    if (attr == ATTR_STATUS) {
+        stats_.statusReads++;
+        if (!p.everPolled) p.firstPollMs = nowMs_;
+        p.everPolled = true;
+    }
+    if (attr == ATTR_COUNTS && n == 12) {
+        CountsRead r = {(uint32_t)unixTime(), {p.counts[0], p.counts[1], p.counts[2]},
+                        {p.used[0], p.used[1], p.used[2]}, p.resets};
+        p.countsReads.push_back(r);
+    }
+    return (ssize_t)n;
+}
+
+// ---- Replay ----
+
+int World::replayScan(uint32_t durationMs, BleOnScanResultCallback cb) {
+    uint64_t start = nowMs_;
+    stats_.scans++;
+    if (anyLinkAlive() >= 0) stats_.scansWithLinks++;
+    const CaptureReplay::Scan *rec = replay_->scan(start);
+    if (!rec) {
+        advance(durationMs);
+        stats_.scanAirMs += nowMs_ - start;
+        return 0;
+    }
+    // The recorded SmartStall reports as the callback matched them (advert: name and telemetry, scan
+    // response: service UUID), then bystander reports up to the recorded count. The stack filter passed
+    // them once already.
+    scanning_ = true;
+    stopScan_ = false;
+    const uint8_t flags = 0x06;
+    const uint8_t filler[4] = {0x4C, 0x00, 0x02, 0x15};
+    uint32_t reported = 0;
+    for (const CaptureReplay::Sighting &s : rec->sightings) {
+        if (stopScan_) break;
+        advanceTo(start + std::min(s.offsetMs, rec->durationMs));
+        uint8_t adv[BLE_MAX_ADV_DATA_LEN];
+        uint8_t sr[BLE_MAX_ADV_DATA_LEN];
+        size_t advLen = putAd(adv, 0, (uint8_t)BleAdvertisingDataType::FLAGS, &flags, 1);
+        size_t srLen = 0;
+        if (s.match & ADV_MATCH_NAME) {
+            advLen = putAd(adv, advLen, (uint8_t)BleAdvertisingDataType::COMPLETE_LOCAL_NAME, SMARTSTALL_NAME,
+                           strlen(SMARTSTALL_NAME));
+        }
+        if (s.hasAdvStatus) {
+            uint8_t field[2 + ADV_STATUS_PAYLOAD_LEN] = {(uint8_t)(ADV_STATUS_COMPANY_ID & 0xFF),
+                                                         (uint8_t)(ADV_STATUS_COMPANY_ID >> 8)};
+            encodeAdvStatusPayload(s.advStatus, field + 2);
+            advLen = putAd(adv, advLen, AD_TYPE_MANUFACTURER_DATA, field, sizeof(field));
+        }
+        if (s.match & ADV_MATCH_SERVICE) {
+            srLen = putAd(sr, 0, (uint8_t)BleAdvertisingDataType::SERVICE_UUID_128BIT_COMPLETE,
+                          SMARTSTALL_SERVICE.rawBytes(), BLE_SIG_UUID_128BIT_LEN);
+        }
+        BleScanResult r(s.address, BleAdvertisingData(adv, advLen), BleAdvertisingData(sr, srLen), s.rssi);
+        stats_.scanCallbacks++;
+        reported++;
+        if (cb) cb(r);
+    }
+    for (; reported < rec->reports && !stopScan_; ++reported) {
+        uint8_t a[BLE_SIG_ADDR_LEN] = {(uint8_t)reported, (uint8_t)(reported >> 8), 0x5A, 0x57, 0x7E, 0xC0};
+        uint8_t adv[BLE_MAX_ADV_DATA_LEN];
+        size_t advLen = putAd(adv, 0, (uint8_t)BleAdvertisingDataType::FLAGS, &flags, 1);
+        advLen = putAd(adv, advLen, (uint8_t)BleAdvertisingDataType::MANUFACTURER_SPECIFIC_DATA, filler,
+                       sizeof(filler));
+        stats_.scanCallbacks++;
+        if (cb) cb(BleScanResult(BleAddress(a), BleAdvertisingData(adv, advLen), BleAdvertisingData(), -90));
+    }
+    if (!stopScan_) advanceTo(start + rec->durationMs);
+    scanning_ = false;
+    stats_.scanAirMs += nowMs_ - start;
+    return (int)reported;
+}
+
+int World::replayConnect(const BleAddress &addr, bool automatic) {
+    (void)automatic; // the recorded table is what automatic discovery found
+    stats_.connectAttempts++;
+    uint64_t start = nowMs_;
+    if (hadTeardown_) {
+        int64_t gap = (int64_t)(start - lastTeardownMs_);
+        if (stats_.minTeardownToConnectMs < 0 || gap < stats_.minTeardownToConnectMs) {
+            stats_.minTeardownToConnectMs = gap;
+        }
+    }
+    const CaptureReplay::Connect *rec = replay_->connect(addr, start);
+    int conn = -1;
+    // A link that was lost during the call was made: the hub saw its disconnect
+    if (rec && (rec->connected || rec->dropAfterMs >= 0)) {
+        Link l;
+        l.address = addr;
+        l.alive = true;
+        l.openedAtMs = start;
+        links_.push_back(l);
+        conn = (int)links_.size() - 1;
+        for (int a = 0; a < ATTR_COUNT; ++a) {
+            if (!(rec->chars & (1 << a))) continue;
+            auto impl = std::make_shared<BleCharacteristic::Impl>();
+            impl->connHandle = conn;
+            impl->attr = a;
+            impl->uuid = ATTR_UUIDS[a];
+            impl->props = BleCharacteristicProperty::READ;
+            links_[conn].discovered.push_back(BleCharacteristic(impl));
+        }
+        if (rec->dropAfterMs >= 0) replayDrops_.insert({start + (uint64_t)rec->dropAfterMs, conn});
+        uint64_t open = 0;
+        for (const Link &k : links_) open += k.alive ? 1 : 0;
+        stats_.maxLinksOpen = std::max(stats_.maxLinksOpen, open);
+    }
+    advance(rec ? rec->durationMs : cfg_.connectTimeoutMs);
+    if (conn < 0) {
+        stats_.connectFailures++;
+        stats_.connectFailMs += nowMs_ - start;
+        stats_.linkAirMs += nowMs_ - start;
+    }
+    return conn;
+}
+
+bool World::replayDiscoverServices(int conn, std::vector<BleUuid> &out) {
+    out.clear();
+    if (!linkAlive(conn)) return false;
+    const CaptureReplay::Services *rec = replay_->services(links_[conn].address, nowMs_);
+    advance(rec ? rec->durationMs : cfg_.serviceDiscoveryMs);
+    if (!linkAlive(conn) || !rec || rec->count == 0) return false;
+    uint32_t others = rec->count - (rec->smartstall ? 1 : 0);
+    for (uint32_t i = 0; i < others; ++i) out.push_back(BleUuid((uint16_t)(0x1800 + i)));
+    if (rec->smartstall) out.push_back(SMARTSTALL_SERVICE);
+    return true;
+}
+
+bool World::replayDiscoverCharacteristics(int conn, const BleUuid &service, std::vector<BleCharacteristic> &out) {
+    out.clear();
+    if (!linkAlive(conn)) return false;
+    const CaptureReplay::Characteristics *rec = replay_->characteristics(links_[conn].address, nowMs_);
+    advance(rec ? rec->durationMs : cfg_.charDiscoveryMs);
+    if (!linkAlive(conn) || !rec) return false;
+    (void)service;
+    uint32_t found = 0;
+    for (int a = 0; a < ATTR_COUNT; ++a) {
+        if (rec->props[a] == 0) continue;
+        auto impl = std::make_shared<BleCharacteristic::Impl>();
+        impl->connHandle = conn;
+        impl->attr = a;
+        impl->uuid = ATTR_UUIDS[a];
+        impl->props = (BleCharacteristicProperty)rec->props[a];
+        out.push_back(BleCharacteristic(impl));
+        found++;
+    }
+    // Characteristics the hub does not use, so the count matches
+    for (; found < rec->count; ++found) {
+        auto impl = std::make_shared<BleCharacteristic::Impl>();
+        impl->connHandle = conn;
+        impl->attr = -1;
+        impl->uuid = BleUuid((uint16_t)(0x2A00 + found));
+        impl->props = BleCharacteristicProperty::READ;
+        out.push_back(BleCharacteristic(impl));
+    }
+    return true;
+}
+
+ssize_t World::replayRead(int conn, int attr, uint8_t *buf, size_t len) {
+    if (!linkAlive(conn)) return SYSTEM_ERROR_UNKNOWN;
+    const CaptureReplay::Read *rec = replay_->read(links_[conn].address, attr, nowMs_);
+    advance(rec ? rec->durationMs : cfg_.readLatencyMs);
+    if (!linkAlive(conn) || !rec) return SYSTEM_ERROR_UNKNOWN;
+    if (rec->result <= 0) return rec->result;
+    size_t n = std::min<size_t>({(size_t)rec->result, len, sizeof(rec->value)});
+    memcpy(buf, rec->value, n);
+    if (attr == ATTR_STATUS) stats_.statusReads++;
+    return (ssize_t)n;
+}
+
+void World::notePublishedStatus(const char *addr, int status, uint32_t readTs) {
+    stats_.snapshotsDelivered++;
+    if (stream) fprintf(stream, "%llu snapshot %.17s %d\n", (unsigned long long)nowMs_, addr, status);
+    if ((uint32_t)unixTime() > readTs + SNAPSHOT_LATE_S) {
+        stats_.snapshotsLate++;
+    }
+    char addrStr[18] = {0};
+    memcpy(addrStr, addr, 17);
+    int idx = findPeripheral(BleAddress(addrStr));
+    if (idx < 0) return;
+    Peripheral &p = periph_[idx];
+    if (p.divergedAtMs != 0 && status == (int)p.status) {
+        stats_.detectMs.push_back((uint32_t)(nowMs_ - p.divergedAtMs));
+        p.divergedAtMs = 0;
+    }
+    p.hubStatus = status;
+}
+
+void World::notePublish(const char *name, const char *data) {
+    stats_.publishes++;
+    if (stream) fprintf(stream, "%llu publish %s %s\n", (unsigned long long)nowMs_, name, data);
+    stats_.publishBytes += strlen(data);
+    if (strcmp(name, "smartstall/batch") == 0) {
+        // {"v":1,"d":[["AA:BB:CC:DD:EE:FF",ts,status,...],...]}
+        const char *item = strstr(data, "\"d\":[");
+        while (item && (item = strstr(item, "[\"")) != nullptr) {
+            const char *addr = item + 2;
+            const char *ts = strchr(addr, ',');                    // after the address
+            const char *field = ts ? strchr(ts + 1, ',') : nullptr; // after the timestamp
+            if (!field || strlen(addr) < 17) return;
+            notePublishedStatus(addr, atoi(field + 1), (uint32_t)strtoul(ts + 1, nullptr, 10));
+            item = field;
+        }
+        return;
+    }
+    if (strcmp(name, "smartstall/bin") == 0) {
+        smartstall::DecodedSnapshot snap;
+        if (binDecoder_.decodeEvent(data, snap) == smartstall::DecodeStatus::Ok) {
+            notePublishedStatus(snap.address().c_str(), snap.fields.status, snap.fields.timestamp);
+        }
+        return;
+    }
+    const char *dev = strstr(data, "\"device\":\"");
+    const char *st = strstr(data, "\"status\":");
+    const char *ts = strstr(data, "\"timestamp\":");
+    if (!dev || !st || !ts) return;
+    notePublishedStatus(dev + 10, atoi(st + 9), (uint32_t)strtoul(ts + 12, nullptr, 10));
+}
+
+bool World::publishAckLost() {
+    if (cfg_.publishAckLossRate <= 0 || !chance(cfg_.publishAckLossRate)) return false;
+    stats_.publishAckLost++;
+    return true;
+}
+
+void World::notePublishRejected(const char *name, size_t bytes) {
+    stats_.publishRejected++;
+    if (verbose) {
+        fprintf(stderr, "%010llu [sim] publish %s rejected: %zu bytes over limit\n",
+                (unsigned long long)nowMs_, name, bytes);
+    }
+}
+
+void World::noteLedgerWrite(const char *name, const char *json, size_t bytes) {
+    stats_.ledgerWrites++;
+    if (stream) fprintf(stream, "%llu ledger %s %s\n", (unsigned long long)nowMs_, name, json);
+    stats_.ledgerBytes += bytes;
+    stats_.ledgerMaxBytes = std::max<uint64_t>(stats_.ledgerMaxBytes, bytes);
+}
+
+void World::noteLedgerRejected(const char *name, size_t bytes) {
+    stats_.ledgerRejected++;
+    stats_.ledgerMaxBytes = std::max<uint64_t>(stats_.ledgerMaxBytes, bytes);
+    if (verbose) {
+        fprintf(stderr, "%010llu [sim] ledger %s rejected: %zu bytes over limit\n",
+                (unsigned long long)nowMs_, name, bytes);
+    }
+}
+
+} // namespace sim
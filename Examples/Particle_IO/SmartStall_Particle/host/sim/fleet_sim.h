@@ -0,0 +1,284 @@
+/*
+ * Simulated SmartStall fleet for host builds of the hub.
+ *
+ * A World owns the virtual clock, N SmartStall peripherals plus some non-SmartStall
+ * bystanders (phones, beacons), the hub's radio and the cloud endpoint. The Particle.h
+ * stand-ins forward every blocking BLE/cloud call here so that the time a call would take
+ * on the radio is charged to the virtual clock.
+ *
+ * Peripheral behaviour follows BLUETOOTH_API.md: a visit locks the stall (status 2) and
+ * bumps the counters, leaving unlocks it (status 3); a long idle stall goes to SLEEP (4),
+ * stops advertising and refuses connections until the next door event wakes it.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Particle.h"
+#include "smartstall_decoder.h"
+
+namespace sim {
+
+class CaptureReplay;
+
+struct FleetConfig {
+    int devices = 12;
+    int bystanders = 8;                    // non-SmartStall advertisers in range
+    uint32_t seed = 1;
+
+    // Advertising / scanning
+    uint32_t advIntervalMs = 45;           // 40-50 ms per BLUETOOTH_API.md
+    double advTelemetryFraction = 0.0;     // share of stalls advertising status telemetry (adv_status.h)
+    double advReceiveProb = 0.6;           // chance one advert is heard while scanning
+    int8_t rssiMean = -72;
+    int8_t rssiSpread = 10;                // fast fading: per-advert / per-connect spread
+
+    // Range model (off: every stall is heard at rssiMean and connects fail at connectFailRate only).
+    // Stalls sit at distances spread evenly over [minDistanceM, maxDistanceM]; their mean RSSI follows
+    // log-distance path loss, a slow shadowing term (people, doors) is re-drawn every shadowingPeriodMs,
+    // and adverts and connects fail with a logistic edge around sensitivityDbm. A connect needs
+    // connectMarginDb more than an advert.
+    bool rangeModel = false;
+    double minDistanceM = 2;
+    double maxDistanceM = 50;
+    double rssiAt1m = -50;
+    double pathLossExponent = 2.0;
+    double shadowingDb = 5;
+    uint32_t shadowingPeriodMs = 60000;
+    double sensitivityDbm = -90;
+    double edgeWidthDb = 2;
+    double connectMarginDb = 3;
+
+    // Link establishment
+    uint32_t connectLatencyMs = 180;
+    uint32_t connectJitterMs = 120;
+    uint32_t connectTimeoutMs = 5000;      // cost of a failed BLE.connect()
+    double connectFailRate = 0.05;
+
+    // GATT
+    uint32_t serviceDiscoveryMs = 240;
+    uint32_t charDiscoveryMs = 300;
+    uint32_t readLatencyMs = 45;
+    double readFailRate = 0.01;
+    double linkDropRate = 0.003;           // per GATT operation
+
+    // Stall usage
+    double visitsPerHour = 4.0;
+    uint32_t dwellMinMs = 60000;
+    uint32_t dwellMaxMs = 600000;
+    bool sleepEnabled = true;
+    uint32_t sleepAfterIdleMs = 20 * 60000;
+    double countResetRate = 0.0;           // chance a visit finds the stall pin-reset (counts zeroed)
+
+    // Cloud
+    double publishAckLossRate = 0.0;       // delivered publishes reported to the hub as failed
+    uint32_t timeSyncMs = 0;               // Time.isValid() from this long after the hub boots (cloud time sync)
+};
+
+// A Sensor Counts value a peripheral returned, with its true usage at the time
+struct CountsRead {
+    uint32_t unixTime;
+    uint32_t counts[3];
+    uint64_t used[3];                      // increments since the start, not zeroed by resets
+    uint32_t resets;
+};
+
+// Attribute identifiers used by simulated characteristics.
+enum Attr { ATTR_STATUS = 0, ATTR_BATTERY = 1, ATTR_COUNTS = 2, ATTR_COUNT };
+
+struct Peripheral {
+    BleAddress address;
+    bool smartstall = true;
+    uint8_t adv[BLE_MAX_ADV_DATA_LEN] = {0};
+    size_t advLen = 0;
+    uint8_t sr[BLE_MAX_ADV_DATA_LEN] = {0};
+    size_t srLen = 0;
+
+    // Range model
+    double rssiMeanDbm = -72;
+    double shadowDb = 0;
+    uint64_t shadowUntilMs = 0;
+
+    uint16_t status = 3;
+    uint16_t batteryMv = 4100;
+    uint32_t counts[3] = {0, 0, 0};
+    uint64_t used[3] = {0, 0, 0};
+    uint32_t resets = 0;
+    std::vector<CountsRead> countsReads;   // every successful Sensor Counts read
+    uint32_t advIntervalMs = 45;
+    bool advTelemetry = false;
+    size_t advBaseLen = 0;                 // flags + name; telemetry field is appended after
+    uint8_t advSequence = 0;
+    bool asleep = false;
+    bool occupied = false;
+    uint64_t nextVisitMs = 0;
+    uint64_t visitEndMs = 0;
+    uint64_t lastDoorEventMs = 0;
+
+    // Time-to-detect bookkeeping: status as last published by the hub, and when the
+    // peripheral first diverged from it.
+    int hubStatus = -1;
+    uint64_t divergedAtMs = 0;
+    bool everPolled = false;
+    uint64_t firstPollMs = 0;              // virtual time of the first status read (everPolled)
+};
+
+// A delivered snapshot read this long before it reached the cloud counts as late (replayed)
+const uint32_t SNAPSHOT_LATE_S = 60;
+
+struct Stats {
+    uint64_t statusReads = 0;          // successful status characteristic reads (polls)
+    uint64_t connectAttempts = 0;
+    uint64_t connectFailures = 0;
+    uint64_t connectFailMs = 0;        // radio time spent in connects that failed
+    uint64_t linkDrops = 0;
+    uint64_t scans = 0;
+    uint64_t scanCallbacks = 0;
+    uint64_t scanFiltered = 0;         // reports dropped by a stack-level BleScanFilter
+    uint64_t publishes = 0;
+    uint64_t publishBytes = 0;
+    uint64_t publishRejected = 0;      // over the event data limit
+    uint64_t publishOffline = 0;       // attempted while the cloud was unreachable (failed)
+    uint64_t publishAckLost = 0;       // delivered, but reported to the hub as failed
+    uint64_t snapshotsDelivered = 0;   // device snapshots received by the cloud, any format
+    uint64_t snapshotsLate = 0;        // ... more than SNAPSHOT_LATE_S after their read timestamp
+    uint64_t ledgerWrites = 0;
+    uint64_t ledgerBytes = 0;
+    uint64_t ledgerRejected = 0;       // over the ledger size limit
+    uint64_t ledgerMaxBytes = 0;       // largest document offered, written or rejected
+    uint64_t scanAirMs = 0;            // radio time spent scanning
+    uint64_t linkAirMs = 0;            // radio time spent connecting or connected (summed over links)
+    uint64_t maxLinksOpen = 0;         // most links alive at once
+    int64_t minTeardownToConnectMs = -1; // shortest gap from any link teardown to the next connect (-1: none)
+    uint64_t scansWithLinks = 0;       // scans started while a link was alive
+    uint64_t statusChanges = 0;
+    uint64_t missedChanges = 0;        // reverted before the hub published the new status
+    uint64_t logLines = 0;             // Log calls at any level, printed or not
+    std::vector<uint32_t> detectMs;    // per detected change: peripheral change -> hub publish
+};
+
+class World {
+public:
+    void reset(const FleetConfig &cfg);
+
+    uint64_t now() const { return nowMs_; }
+    void advance(uint64_t ms);
+    void advanceTo(uint64_t t);
+    // Time.now() / Time.isValid(): SIM_EPOCH plus the virtual clock, or the replayed clock records
+    time32_t unixTime() const;
+    bool timeValid() const;
+
+    // Hub restart: the firmware's globals only start fresh in a new process, so saveFleet() writes the clock,
+    // random state, cloud connectivity and each peripheral's state (not its read log), and loadFleet(), after
+    // reset() with the same config in the new process, carries on from there with no links open and the
+    // hub's millis() starting again from zero
+    bool saveFleet(FILE *f) const;
+    bool loadFleet(FILE *f);
+    // millis(): virtual time since the hub booted
+    uint64_t sinceBoot() const { return nowMs_ - bootMs_; }
+
+    // Replay mode (after reset() with an empty fleet; reset() ends it): scans, connects, discoveries,
+    // reads, link losses, cloud connectivity and the clock come from a capture (capture_replay.h)
+    // instead of the peripheral models
+    void startReplay(CaptureReplay *replay);
+
+    const FleetConfig &config() const { return cfg_; }
+    Stats &stats() { return stats_; }
+    std::vector<Peripheral> &peripherals() { return periph_; }
+    int smartstallCount() const { return cfg_.devices; }
+    int distinctPolled() const;
+
+    // Radio (called from the BleLocalDevice / BlePeerDevice stand-ins)
+    int scan(uint32_t durationMs, BleOnScanResultCallback cb, const BleScanFilter *filter);
+    void stopScanning() { stopScan_ = true; }
+    bool scanning() const { return scanning_; }
+    // automatic: discover all services/characteristics as part of connecting (BLE.connect default)
+    int connect(const BleAddress &addr, bool automatic);
+    bool linkAlive(int conn) const;
+    int anyLinkAlive() const;
+    // Characteristic from the link's connect-time discovery table (no radio traffic)
+    bool discoveredCharacteristic(int conn, const BleUuid &uuid, BleCharacteristic &out) const;
+    void disconnect(int conn, bool local);
+    bool discoverServices(int conn, std::vector<BleUuid> &out);
+    bool discoverCharacteristics(int conn, const BleUuid &service, std::vector<BleCharacteristic> &out);
+    ssize_t read(int conn, int attr, uint8_t *buf, size_t len);
+
+    // Cloud. cloudConnected() is Particle.connected(): when replaying, a recorded change takes effect at
+    // the first call at or after its time, as the capture saw it; publishes use cloudUp().
+    bool cloudConnected();
+    bool cloudUp() const { return cloudUp_; }
+    void setCloudConnected(bool up) { cloudUp_ = up; }
+    // smartstall/data (one device), smartstall/batch (array items) or smartstall/bin (decoded frame)
+    // feed time-to-detect
+    void notePublish(const char *name, const char *data);
+    void notePublishRejected(const char *name, size_t bytes);
+    void notePublishOffline() { stats_.publishOffline++; }
+    // Whether a delivered publish is reported as failed (publishAckLossRate)
+    bool publishAckLost();
+    void noteLogLine() { stats_.logLines++; }
+    void noteLedgerWrite(const char *name, const char *json, size_t bytes);
+    void noteLedgerRejected(const char *name, size_t bytes);
+
+    bool verbose = false;
+    bool formatLogs = false;           // format log lines even when not printing (SerialLogHandler cost)
+    // When set, every successful publish, delivered snapshot and ledger write is written here as a line:
+    // "<ms> publish <name> <data>", "<ms> snapshot <address> <status>", "<ms> ledger <name> <json>"
+    FILE *stream = nullptr;
+
+private:
+    struct Link {
+        int peripheral = -1;
+        BleAddress address;
+        bool alive = false;
+        uint64_t openedAtMs = 0;
+        std::vector<BleCharacteristic> discovered; // from automatic discovery at connect time
+    };
+
+    int findPeripheral(const BleAddress &addr) const;
+    void notePublishedStatus(const char *addr, int status, uint32_t readTs);
+    uint64_t nextEventOf(const Peripheral &p) const;
+    void recomputeNextEvent();
+    void stepPeripheral(int idx);
+    void setStatus(Peripheral &p, uint16_t status);
+    void refreshAdvTelemetry(Peripheral &p);
+    bool gattOp(int conn, uint32_t costMs);
+    int replayScan(uint32_t durationMs, BleOnScanResultCallback cb);
+    int replayConnect(const BleAddress &addr, bool automatic);
+    bool replayDiscoverServices(int conn, std::vector<BleUuid> &out);
+    bool replayDiscoverCharacteristics(int conn, const BleUuid &service, std::vector<BleCharacteristic> &out);
+    ssize_t replayRead(int conn, int attr, uint8_t *buf, size_t len);
+    void dropLink(int conn);
+    uint32_t jitter(uint32_t base, uint32_t spread);
+    bool chance(double p);
+    uint16_t batteryNow(const Peripheral &p) const;
+    double linkRssi(Peripheral &p);    // range model: mean + shadowing + fast fading
+    double edgeProb(double rssi);      // range model: chance a packet at rssi gets through
+
+    FleetConfig cfg_;
+    Stats stats_;
+    std::vector<Peripheral> periph_;
+    std::vector<Link> links_;
+    std::mt19937_64 rng_;
+    uint64_t nowMs_ = 0;
+    uint64_t bootMs_ = 0;
+    uint64_t nextAnyEventMs_ = 0;
+    bool scanning_ = false;
+    bool stopScan_ = false;
+    bool hadTeardown_ = false;
+    uint64_t lastTeardownMs_ = 0;
+    bool cloudUp_ = true;
+    smartstall::DeltaDecoder binDecoder_; // cloud-side receiver for smartstall/bin
+
+    CaptureReplay *replay_ = nullptr;
+    size_t replayCloudAt_ = 0;            // next of replay_->cloudSteps() to apply
+    std::multimap<uint64_t, int> replayDrops_; // recorded link losses due: time -> link
+};
+
+World &world();
+
+} // namespace sim
@@ -0,0 +1,556 @@
+// Host implementations of the Particle.h stand-ins. Radio, clock and cloud calls go to sim::world().
+#include "Particle.h"
+
+#include <cctype>
+#include <ctime>
+#include <map>
+
+#include "fleet_sim.h"
+
+const Logger Log;
+TimeClass Time;
+CloudClass Particle;
+BleLocalDevice BLE;
+
+// Device OS event data limit; longer publishes fail on device, so they fail here too.
+static const size_t PUBLISH_DATA_LIMIT = 1024;
+// Device OS ledger size limit; measured here on the JSON form, which is larger than the stored CBOR.
+static const size_t LEDGER_DATA_LIMIT = 16384;
+
+// ---- Clock ----
+unsigned long millis() { return (unsigned long)sim::world().sinceBoot(); }
+unsigned long micros() { return (unsigned long)(sim::world().sinceBoot() * 1000); }
+void delay(unsigned long ms) { sim::world().advance(ms); }
+
+// ---- Semaphores ----
+namespace {
+struct SimSemaphore {
+    unsigned count;
+    unsigned max;
+};
+} // namespace
+
+int os_semaphore_create(os_semaphore_t *semaphore, unsigned max, unsigned initial) {
+    *semaphore = new SimSemaphore{initial, max};
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool) {
+    SimSemaphore *s = static_cast<SimSemaphore *>(semaphore);
+    if (s->count == 0) {
+        sim::world().advance(timeout);
+        return 1; // timed out
+    }
+    s->count--;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t semaphore, bool) {
+    SimSemaphore *s = static_cast<SimSemaphore *>(semaphore);
+    if (s->count < s->max) s->count++;
+    return 0;
+}
+
+// ---- String ----
+String String::format(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    va_list ap2;
+    va_copy(ap2, ap);
+    int n = vsnprintf(nullptr, 0, fmt, ap);
+    va_end(ap);
+    std::string s;
+    if (n > 0) {
+        s.resize((size_t)n + 1);
+        vsnprintf(&s[0], s.size(), fmt, ap2);
+        s.resize((size_t)n);
+    }
+    va_end(ap2);
+    return String(s);
+}
+
+// ---- Logging ----
+static void logv(const char *level, const char *fmt, va_list ap) {
+    sim::World &w = sim::world();
+    w.noteLogLine();
+    if (!w.verbose && !w.formatLogs) return;
+    char buf[512];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    if (w.verbose) fprintf(stderr, "%010lu [app] %s: %s\n", millis(), level, buf);
+}
+
+#define SIM_LOG_IMPL(name, level)                  \
+    void Logger::name(const char *fmt, ...) const { \
+        va_list ap;                                \
+        va_start(ap, fmt);                         \
+        logv(level, fmt, ap);                      \
+        va_end(ap);                                \
+    }
+SIM_LOG_IMPL(trace, "TRACE")
+SIM_LOG_IMPL(info, "INFO")
+SIM_LOG_IMPL(warn, "WARN")
+SIM_LOG_IMPL(error, "ERROR")
+#undef SIM_LOG_IMPL
+
+void Logger::print(const char *s) const {
+    if (sim::world().verbose) fputs(s, stderr);
+}
+
+// ---- Variant ----
+bool Variant::set(const char *key, const Variant &v) {
+    if (type_ != MAP) {
+        *this = Variant();
+        type_ = MAP;
+    }
+    auto it = std::lower_bound(children_.begin(), children_.end(), key,
+                               [](const std::pair<std::string, Variant> &e, const char *k) { return e.first < k; });
+    if (it != children_.end() && it->first == key) {
+        it->second = v;
+    } else {
+        children_.insert(it, std::make_pair(std::string(key), v));
+    }
+    return true;
+}
+
+bool Variant::append(const Variant &v) {
+    if (type_ != ARRAY) {
+        *this = Variant();
+        type_ = ARRAY;
+    }
+    children_.push_back(std::make_pair(std::string(), v));
+    return true;
+}
+
+bool Variant::has(const char *key) const {
+    for (const auto &e : children_) {
+        if (e.first == key) return true;
+    }
+    return false;
+}
+
+Variant Variant::get(const char *key) const {
+    for (const auto &e : children_) {
+        if (e.first == key) return e.second;
+    }
+    return Variant();
+}
+
+static void appendJsonString(std::string &out, const std::string &s) {
+    out += '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void Variant::appendJson(std::string &out) const {
+    switch (type_) {
+        case NULL_: out += "null"; break;
+        case BOOL: out += i_ ? "true" : "false"; break;
+        case INT: out += std::to_string(i_); break;
+        case DOUBLE: {
+            char b[32];
+            snprintf(b, sizeof(b), "%g", d_);
+            out += b;
+            break;
+        }
+        case STRING: appendJsonString(out, s_); break;
+        case ARRAY:
+        case MAP: {
+            out += type_ == MAP ? '{' : '[';
+            for (size_t i = 0; i < children_.size(); ++i) {
+                if (i) out += ',';
+                if (type_ == MAP) {
+                    appendJsonString(out, children_[i].first);
+                    out += ':';
+                }
+                children_[i].second.appendJson(out);
+            }
+            out += type_ == MAP ? '}' : ']';
+            break;
+        }
+    }
+}
+
+String Variant::toJSON() const {
+    std::string out;
+    appendJson(out);
+    return String(out);
+}
+
+// ---- Ledger ----
+static std::map<std::string, Variant> &ledgerStore() {
+    static std::map<std::string, Variant> store;
+    return store;
+}
+
+int Ledger::set(const Variant &data) {
+    if (name_.empty()) return SYSTEM_ERROR_UNKNOWN;
+    String json = data.toJSON();
+    size_t bytes = json.length();
+    if (bytes > LEDGER_DATA_LIMIT) {
+        sim::world().noteLedgerRejected(name_.c_str(), bytes);
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    ledgerStore()[name_] = data;
+    sim::world().noteLedgerWrite(name_.c_str(), json.c_str(), bytes);
+    return SYSTEM_ERROR_NONE;
+}
+
+Variant Ledger::get() const {
+    auto it = ledgerStore().find(name_);
+    return it == ledgerStore().end() ? Variant() : it->second;
+}
+
+// ---- Time ----
+bool TimeClass::isValid() const { return sim::world().timeValid(); }
+
+time32_t TimeClass::now() const { return sim::world().unixTime(); }
+
+int TimeClass::hour() const { return hour(now()); }
+
+int TimeClass::hour(time32_t t) const { return (int)((t % 86400) / 3600); }
+
+String TimeClass::format(const char *fmt) const { return format(now(), fmt); }
+
+String TimeClass::format(time32_t t, const char *fmt) const {
+    time_t tt = (time_t)t;
+    struct tm tmv;
+    gmtime_r(&tt, &tmv);
+    char buf[64];
+    strftime(buf, sizeof(buf), strcmp(fmt, TIME_FORMAT_DEFAULT) == 0 ? "%a %b %e %H:%M:%S %Y" : fmt, &tmv);
+    return String(buf);
+}
+
+// ---- Cloud ----
+bool CloudClass::connected() const { return sim::world().cloudConnected(); }
+
+bool CloudClass::publish(const char *name, const char *data, int flags) {
+    (void)flags;
+    if (!sim::world().cloudUp()) {
+        sim::world().notePublishOffline();
+        return false;
+    }
+    if (strlen(data) > PUBLISH_DATA_LIMIT) {
+        sim::world().notePublishRejected(name, strlen(data));
+        return false;
+    }
+    sim::world().notePublish(name, data);
+    return !sim::world().publishAckLost();
+}
+
+// Registered cloud functions; re-registering a name replaces it (each forked run calls setup() again)
+static std::map<std::string, int (*)(String)> &cloudFunctions() {
+    static std::map<std::string, int (*)(String)> fns;
+    return fns;
+}
+
+bool CloudClass::function(const char *name, int (*fn)(String)) {
+    cloudFunctions()[name] = fn;
+    return true;
+}
+
+int CloudClass::callFunction(const char *name, const char *arg) {
+    auto it = cloudFunctions().find(name);
+    if (it == cloudFunctions().end()) return -1;
+    return it->second(String(arg));
+}
+
+Ledger CloudClass::ledger(const char *name) { return Ledger(name); }
+
+// ---- BleUuid ----
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = (char)tolower((unsigned char)c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+BleUuid::BleUuid(uint16_t uuid16) : type_(BleUuidType::SHORT), valid_(true), short_(uuid16) {
+    full_[0] = (uint8_t)(uuid16 & 0xFF);
+    full_[1] = (uint8_t)(uuid16 >> 8);
+}
+
+BleUuid::BleUuid(const uint8_t uuid128[BLE_SIG_UUID_128BIT_LEN]) : type_(BleUuidType::LONG), valid_(true) {
+    memcpy(full_, uuid128, BLE_SIG_UUID_128BIT_LEN);
+}
+
+BleUuid::BleUuid(const char *uuid) {
+    uint8_t be[BLE_SIG_UUID_128BIT_LEN] = {0};
+    int nibbles = 0;
+    for (const char *p = uuid; p && *p && nibbles < 32; ++p) {
+        int v = hexNibble(*p);
+        if (v < 0) continue;
+        be[nibbles / 2] = (uint8_t)((be[nibbles / 2] << 4) | v);
+        nibbles++;
+    }
+    if (nibbles == 4) {
+        *this = BleUuid((uint16_t)((be[0] << 8) | be[1]));
+    } else if (nibbles == 32) {
+        type_ = BleUuidType::LONG;
+        valid_ = true;
+        for (int i = 0; i < BLE_SIG_UUID_128BIT_LEN; ++i) full_[i] = be[BLE_SIG_UUID_128BIT_LEN - 1 - i];
+    }
+}
+
+String BleUuid::toString(bool stripped) const {
+    if (type_ == BleUuidType::SHORT) return String::format("%04X", short_);
+    std::string s;
+    char b[3];
+    for (int i = BLE_SIG_UUID_128BIT_LEN - 1; i >= 0; --i) {
+        snprintf(b, sizeof(b), "%02x", full_[i]);
+        s += b;
+        int printed = BLE_SIG_UUID_128BIT_LEN - i;
+        if (!stripped && (printed == 4 || printed == 6 || printed == 8 || printed == 10)) s += '-';
+    }
+    return String(s);
+}
+
+bool BleUuid::operator==(const BleUuid &o) const {
+    if (valid_ != o.valid_ || type_ != o.type_) return false;
+    if (type_ == BleUuidType::SHORT) return short_ == o.short_;
+    return memcmp(full_, o.full_, BLE_SIG_UUID_128BIT_LEN) == 0;
+}
+
+// ---- BleAddress ----
+BleAddress::BleAddress(const char *str) {
+    int byte = BLE_SIG_ADDR_LEN - 1;
+    int nib = 0;
+    uint8_t cur = 0;
+    for (const char *p = str; p && *p && byte >= 0; ++p) {
+        int v = hexNibble(*p);
+        if (v < 0) continue;
+        cur = (uint8_t)((cur << 4) | v);
+        if (++nib == 2) {
+            addr_[byte--] = cur;
+            nib = 0;
+            cur = 0;
+        }
+    }
+}
+
+String BleAddress::toString(bool stripped) const {
+    return String::format(stripped ? "%02X%02X%02X%02X%02X%02X" : "%02X:%02X:%02X:%02X:%02X:%02X", addr_[5],
+                          addr_[4], addr_[3], addr_[2], addr_[1], addr_[0]);
+}
+
+bool BleAddress::isValid() const {
+    for (uint8_t b : addr_) {
+        if (b) return true;
+    }
+    return false;
+}
+
+// ---- BleAdvertisingData ----
+BleAdvertisingData::BleAdvertisingData(const uint8_t *buf, size_t len) {
+    len_ = std::min<size_t>(len, BLE_MAX_ADV_DATA_LEN);
+    if (len_) memcpy(buf_, buf, len_);
+}
+
+const uint8_t *BleAdvertisingData::find(uint8_t type, size_t *len) const {
+    size_t i = 0;
+    while (i + 1 < len_) {
+        uint8_t l = buf_[i];
+        if (l == 0 || i + 1 + l > len_) break;
+        if (buf_[i + 1] == type) {
+            *len = l - 1;
+            return buf_ + i + 2;
+        }
+        i += 1 + l;
+    }
+    return nullptr;
+}
+
+size_t BleAdvertisingData::get(BleAdvertisingDataType type, uint8_t *buf, size_t len) const {
+    size_t n = 0;
+    const uint8_t *p = find((uint8_t)type, &n);
+    if (!p) return 0;
+    n = std::min(n, len);
+    memcpy(buf, p, n);
+    return n;
+}
+
+bool BleAdvertisingData::contains(BleAdvertisingDataType type) const {
+    size_t n = 0;
+    return find((uint8_t)type, &n) != nullptr;
+}
+
+size_t BleAdvertisingData::deviceName(char *buf, size_t len) const {
+    size_t n = 0;
+    const uint8_t *p = find((uint8_t)BleAdvertisingDataType::COMPLETE_LOCAL_NAME, &n);
+    if (!p) p = find((uint8_t)BleAdvertisingDataType::SHORT_LOCAL_NAME, &n);
+    if (!p || len == 0) return 0;
+    n = std::min(n, len - 1);
+    memcpy(buf, p, n);
+    buf[n] = '\0';
+    return n;
+}
+
+String BleAdvertisingData::deviceName() const {
+    char name[BLE_MAX_ADV_DATA_LEN + 1];
+    return deviceName(name, sizeof(name)) ? String(name) : String();
+}
+
+size_t BleAdvertisingData::serviceUUID(BleUuid *uuids, size_t count) const {
+    size_t found = 0;
+    size_t i = 0;
+    while (i + 1 < len_ && found < count) {
+        uint8_t l = buf_[i];
+        if (l == 0 || i + 1 + l > len_) break;
+        uint8_t t = buf_[i + 1];
+        const uint8_t *p = buf_ + i + 2;
+        size_t n = l - 1;
+        if (t == (uint8_t)BleAdvertisingDataType::SERVICE_UUID_16BIT_COMPLETE
+                || t == (uint8_t)BleAdvertisingDataType::SERVICE_UUID_16BIT_MORE_AVAILABLE) {
+            for (size_t k = 0; k + 2 <= n && found < count; k += 2) {
+                uuids[found++] = BleUuid((uint16_t)(p[k] | (p[k + 1] << 8)));
+            }
+        } else if (t == (uint8_t)BleAdvertisingDataType::SERVICE_UUID_128BIT_COMPLETE
+                || t == (uint8_t)BleAdvertisingDataType::SERVICE_UUID_128BIT_MORE_AVAILABLE) {
+            for (size_t k = 0; k + BLE_SIG_UUID_128BIT_LEN <= n && found < count; k += BLE_SIG_UUID_128BIT_LEN) {
+                uuids[found++] = BleUuid(p + k);
+            }
+        }
+        i += 1 + l;
+    }
+    return found;
+}
+
+Vector<BleUuid> BleAdvertisingData::serviceUUID() const {
+    BleUuid tmp[BLE_MAX_ADV_DATA_LEN / 2];
+    size_t n = serviceUUID(tmp, sizeof(tmp) / sizeof(tmp[0]));
+    Vector<BleUuid> out;
+    for (size_t i = 0; i < n; ++i) out.append(tmp[i]);
+    return out;
+}
+
+size_t BleAdvertisingData::customData(uint8_t *buf, size_t len) const {
+    return get(BleAdvertisingDataType::MANUFACTURER_SPECIFIC_DATA, buf, len);
+}
+
+// ---- GATT client ----
+ssize_t BleCharacteristic::getValue(uint8_t *buf, size_t len) const {
+    if (!impl_) return SYSTEM_ERROR_UNKNOWN;
+    return sim::world().read(impl_->connHandle, impl_->attr, buf, len);
+}
+
+bool BlePeerDevice::connected() const { return sim::world().linkAlive(conn_); }
+
+int BlePeerDevice::disconnect() const {
+    sim::world().disconnect(conn_, true);
+    return SYSTEM_ERROR_NONE;
+}
+
+Vector<BleService> BlePeerDevice::discoverAllServices() {
+    BleService tmp[8];
+    ssize_t n = discoverAllServices(tmp, 8);
+    Vector<BleService> out;
+    for (ssize_t i = 0; i < n; ++i) out.append(tmp[i]);
+    return out;
+}
+
+ssize_t BlePeerDevice::discoverAllServices(BleService *services, size_t count) {
+    std::vector<BleUuid> uuids;
+    if (!sim::world().discoverServices(conn_, uuids)) return 0;
+    size_t n = std::min(count, uuids.size());
+    for (size_t i = 0; i < n; ++i) services[i] = BleService(uuids[i]);
+    return (ssize_t)n;
+}
+
+ssize_t BlePeerDevice::discoverCharacteristicsOfService(const BleService &service, BleCharacteristic *chars,
+                                                        size_t count) {
+    std::vector<BleCharacteristic> found;
+    if (!sim::world().discoverCharacteristics(conn_, service.UUID(), found)) return 0;
+    if (!discovered_) discovered_ = std::make_shared<Vector<BleCharacteristic>>();
+    size_t n = std::min(count, found.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        discovered_->append(found[i]);
+        if (i < n) chars[i] = found[i];
+    }
+    return (ssize_t)n;
+}
+
+Vector<BleCharacteristic> BlePeerDevice::discoverCharacteristicsOfService(const BleService &service) {
+    BleCharacteristic tmp[8];
+    ssize_t n = discoverCharacteristicsOfService(service, tmp, 8);
+    Vector<BleCharacteristic> out;
+    for (ssize_t i = 0; i < n; ++i) out.append(tmp[i]);
+    return out;
+}
+
+Vector<BleCharacteristic> BlePeerDevice::discoverAllCharacteristics() {
+    Vector<BleCharacteristic> out;
+    Vector<BleService> services = discoverAllServices();
+    for (const BleService &s : services) {
+        Vector<BleCharacteristic> c = discoverCharacteristicsOfService(s);
+        for (const BleCharacteristic &ch : c) out.append(ch);
+    }
+    return out;
+}
+
+bool BlePeerDevice::getCharacteristicByUUID(BleCharacteristic &characteristic, const BleUuid &uuid) const {
+    if (discovered_) {
+        for (const BleCharacteristic &c : *discovered_) {
+            if (c.UUID() == uuid) {
+                characteristic = c;
+                return true;
+            }
+        }
+    }
+    return sim::world().discoveredCharacteristic(conn_, uuid, characteristic);
+}
+
+// ---- Local device ----
+int BleLocalDevice::scan(BleOnScanResultCallback callback) {
+    return sim::world().scan((uint32_t)scanTimeout_ * 10, callback, nullptr);
+}
+
+int BleLocalDevice::scanWithFilter(const BleScanFilter &filter, BleOnScanResultCallback callback) {
+    return sim::world().scan((uint32_t)scanTimeout_ * 10, callback, &filter);
+}
+
+bool BleScanFilter::matches(const BleScanResult &result) const {
+    if (result.rssi() < minRssi_) return false;
+    if (!names_.empty()) {
+        String a = result.advertisingData().deviceName();
+        String b = result.scanResponse().deviceName();
+        bool any = false;
+        for (const std::string &n : names_) {
+            any = any || a == n.c_str() || b == n.c_str();
+        }
+        if (!any) return false;
+    }
+    if (!uuids_.empty()) {
+        Vector<BleUuid> a = result.advertisingData().serviceUUID();
+        Vector<BleUuid> b = result.scanResponse().serviceUUID();
+        bool any = false;
+        for (const BleUuid &u : uuids_) {
+            for (const BleUuid &x : a) any = any || x == u;
+            for (const BleUuid &x : b) any = any || x == u;
+        }
+        if (!any) return false;
+    }
+    return true;
+}
+
+int BleLocalDevice::stopScanning() {
+    sim::world().stopScanning();
+    return SYSTEM_ERROR_NONE;
+}
+
+bool BleLocalDevice::scanning() const { return sim::world().scanning(); }
+
+BlePeerDevice BleLocalDevice::connect(const BleAddress &addr, bool automatic) {
+    return BlePeerDevice(sim::world().connect(addr, automatic), addr);
+}
+
+bool BleLocalDevice::connected() const { return sim::world().anyLinkAlive() >= 0; }
@@ -11,6 +11,22 @@
 
 // Include Particle Device OS APIs
 #include "Particle.h"
+#include "adv_filter.h"
+#include "adv_status.h"
+#include "delta_codec.h"
+#include "device_registry.h"
+#include "event_queue.h"
+#include "input_capture.h"
+#include "latency_histogram.h"
+#include "link_quality.h"
+#include "loop_deadline.h"
+#include "poll_scheduler.h"
+#include "publish_batch.h"
+#include "registry_checkpoint.h"
+#include "smartstall_data.h"
+#include "spsc_ring.h"
+#include "trace_buffer.h"
+#include "usage_rollup.h"
 
 PRODUCT_VERSION(5);
 
@@ -50,6 +66,12 @@ STARTUP([] {
 });
 #endif
 
+// Longest loop() sleeps between passes when no timer is due sooner. Larger values mean fewer idle
+// wakeups (battery-powered hubs); loop() still returns at least this often for Device OS.
+#ifndef SMARTSTALL_LOOP_MAX_SLEEP_MS
+#define SMARTSTALL_LOOP_MAX_SLEEP_MS 1000
+#endif
+
 // Show system, cloud connectivity, and application logs over USB
 SerialLogHandler logHandler(LOG_LEVEL_INFO);
 // Note: SYSTEM_THREAD() is enabled by default on Device OS >= 6.2.0 (warning avoided by not calling macro)
@@ -61,26 +83,203 @@ SerialLogHandler logHandler(LOG_LEVEL_INFO);
 Ledger deviceToCloudLedger;
 bool ledgersInitialized = false;
 
-// Single Device -> Cloud ledger name (must exist in your Product)
+// Hub Device -> Cloud ledger name (must exist in your Product)
 const char *DEVICE_TO_CLOUD_LEDGER_NAME = "device-to-cloud";
 
-unsigned long lastUnifiedLedgerWriteMs = 0;
+// Sharded device ledgers: the hub ledger carries only the hub section and the last read. The device
+// registry is paged across "smartstall-devices-0", "-1", ... (LEDGER_DEVICES_PER_SHARD registry slots
+// each; create as many as the fleet needs in the Product). Only entries whose exported fields changed
+// are re-serialized, and only their shards are written. Set to 0 for the former single ledger holding
+// everything, rebuilt in full on every write.
+#ifndef SMARTSTALL_LEDGER_SHARDED
+#define SMARTSTALL_LEDGER_SHARDED 1
+#endif
+
+unsigned long lastUnifiedLedgerWriteMs = 0;              // any ledger write (min gap applies to all)
 unsigned long lastHubLedgerWriteMs = 0;
 const unsigned long HUB_LEDGER_PERIOD_MS = 60000;        // 1 minute
 const unsigned long LEDGER_MIN_GAP_MS = 5000;            // 5 seconds (rate-limit all writes)
+#if !SMARTSTALL_LEDGER_SHARDED
 volatile bool devicesLedgerDirty = true;                 // set when registry/read state changes
+#endif
 
 // SmartStall BLE Service and Characteristic UUIDs
 const BleUuid SMARTSTALL_SERVICE_UUID("c56a1b98-6c1e-413a-b138-0e9f320c7e8b");
 const BleUuid STALL_STATUS_CHAR_UUID("47d80a44-c552-422b-aa3b-d250ed04be37");
 const BleUuid BATTERY_VOLTAGE_CHAR_UUID("7d108dc9-4aaf-4a38-93e3-d9f8ff139f11");
 const BleUuid SENSOR_COUNTS_CHAR_UUID("3e4a9f12-7b5c-4d8e-a1b2-9c8d7e6f5a4b");
+const char *SMARTSTALL_DEVICE_NAME = "SmartStall";
+
+// Ask the BLE stack to drop non-SmartStall advertisers before they reach onScanResultReceived
+// (Device OS 3.0+ BleScanFilter). Filters are ANDed by the stack, so this matches on the advertised
+// name only; set to 0 for fleets whose peripherals advertise the service UUID without the name.
+#ifndef SMARTSTALL_STACK_SCAN_FILTER
+#define SMARTSTALL_STACK_SCAN_FILTER 1
+#endif
+
+// Cached-GATT mode: once a device has passed full discovery and profile validation, later polls bind
+// the characteristics from the table BLE.connect() already discovered instead of re-running
+// discoverAllServices()/discoverCharacteristicsOfService(). Any bind or read failure drops the cache
+// and the next poll does full discovery again.
+#ifndef SMARTSTALL_GATT_CACHE
+#define SMARTSTALL_GATT_CACHE 1
+#endif
+
+// Tiered reads: every poll reads status; battery and sensor counts are read only when their own interval
+// (BATTERY_READ_INTERVAL_MS, COUNTS_READ_INTERVAL_MS) has expired, and counts also when the status
+// changed. A battery or counts read that fails keeps that field's last value and the poll still counts;
+// only a failed status read fails the poll. Set to 0 to read counts on every poll and fail the poll on
+// any failed read.
+#ifndef SMARTSTALL_TIERED_READS
+#define SMARTSTALL_TIERED_READS 1
+#endif
+
+// Cloud event format. Per-device (default) publishes one smartstall/data event per changed device.
+// Batched packs compact snapshots from several devices into one smartstall/batch event, flushed when the
+// next snapshot would not fit, when the oldest one reaches PUBLISH_BATCH_MAX_AGE_MS, or right after a
+// status change (urgent) — snapshots produced in the same loop iteration still share one event.
+// Binary delta publishes one base64 smartstall/bin frame per changed device (delta_codec.h): counters
+// as varint deltas against the last published values, with a keyframe every BIN_KEYFRAME_INTERVAL frames.
+#define PUBLISH_FORMAT_PER_DEVICE 0
+#define PUBLISH_FORMAT_BATCHED 1
+#define PUBLISH_FORMAT_BINARY_DELTA 2
+#ifndef SMARTSTALL_PUBLISH_FORMAT
+#define SMARTSTALL_PUBLISH_FORMAT PUBLISH_FORMAT_PER_DEVICE
+#endif
+
+const size_t PUBLISH_MAX_DATA_LEN = 1024;               // Device OS event data limit (bytes)
+const unsigned long PUBLISH_BATCH_MAX_AGE_MS = 30000;   // counts-only snapshots wait at most this long
+const uint8_t BIN_KEYFRAME_INTERVAL = 8;                // frames per device between keyframes
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+// Capacity includes the NUL, so a finished batch is at most PUBLISH_MAX_DATA_LEN - 1 characters
+PublishBatcher<PUBLISH_MAX_DATA_LEN> publishBatch(PUBLISH_BATCH_MAX_AGE_MS);
+// Shortest item is about 40 characters, so a full batch holds fewer than this many snapshots
+const size_t PUBLISH_BATCH_MAX_ITEMS = 32;
+QueuedSnapshot publishBatchSnapshots[PUBLISH_BATCH_MAX_ITEMS]; // what publishBatch holds, in order
+#endif
+
+// Store-and-forward: a snapshot whose publish is not acknowledged (cloud unreachable) goes to a
+// persistent ring (event_queue.h) and is replayed in order, at most one event per
+// EVENT_QUEUE_DRAIN_INTERVAL_MS, once Particle.connected(). New snapshots queue behind a backlog. The
+// last published status/counts of a device move only when the cloud acknowledges. Set to 0 for the
+// former fire-and-forget publish.
+#ifndef SMARTSTALL_EVENT_QUEUE
+#define SMARTSTALL_EVENT_QUEUE 1
+#endif
+#ifndef SMARTSTALL_EVENT_QUEUE_PATH
+#define SMARTSTALL_EVENT_QUEUE_PATH "/usr/smartstall-events.bin"
+#endif
+#if SMARTSTALL_EVENT_QUEUE
+const uint16_t EVENT_QUEUE_CAPACITY = 512;                // 46 bytes per snapshot in flash
+const unsigned long EVENT_QUEUE_DRAIN_INTERVAL_MS = 1000; // Device OS publish rate limit: 1 per second
+SnapshotQueue<EVENT_QUEUE_CAPACITY> eventQueue;
+unsigned long lastEventQueueDrainMs = 0;
+#endif
+
+// Per-device rollups over wall-clock windows of SMARTSTALL_ROLLUP_WINDOW_S (usage_rollup.h), folded from
+// every successful read and published as smartstall/rollup batches once the window closes. A closed
+// window waits in its device's slot until published; offline, the next window replaces it. ROLLUPS_OFF
+// (0) leaves them out, ROLLUPS_ALONGSIDE (1) publishes them beside the per-change events, ROLLUPS_INSTEAD
+// (2) also stops publishing counts-only changes (status changes still go out at once, with the counter
+// usage since the last published snapshot). About 90 bytes of RAM per registry slot.
+#define ROLLUPS_OFF 0
+#define ROLLUPS_ALONGSIDE 1
+#define ROLLUPS_INSTEAD 2
+#ifndef SMARTSTALL_ROLLUPS
+#define SMARTSTALL_ROLLUPS ROLLUPS_ALONGSIDE
+#endif
+#ifndef SMARTSTALL_ROLLUP_WINDOW_S
+#define SMARTSTALL_ROLLUP_WINDOW_S 900 // 15 min
+#endif
+static_assert(SMARTSTALL_ROLLUP_WINDOW_S > 0 && SMARTSTALL_ROLLUP_WINDOW_S <= ROLLUP_WINDOW_MAX_S,
+    "SMARTSTALL_ROLLUP_WINDOW_S out of range");
+// Registry checkpoint (registry_checkpoint.h): the device registry is kept in a flash file and restored in
+// setup(), so after a reboot or OTA update the known devices are polled without waiting for a scan, keep
+// their backoff, legacy-profile blocks and link estimates, and an unchanged stall is not published again.
+// A pass every REGISTRY_CHECKPOINT_INTERVAL_MS rewrites only entries whose durable fields changed (not
+// times, battery or radio alone, which ride along) or that went stale or were heard again, at most
+// REGISTRY_CHECKPOINT_MAX_RECORDS of them, with one fsync. Passes wait for a valid clock. Without one at
+// boot (as after a power cycle), restored times are taken as of the last commit, the earliest the reset can
+// have been, and moved back once Time.isValid(). 95 bytes of flash per entry. Set to 0 for the former cold
+// start.
+#ifndef SMARTSTALL_REGISTRY_CHECKPOINT
+#define SMARTSTALL_REGISTRY_CHECKPOINT 1
+#endif
+#ifndef SMARTSTALL_REGISTRY_CHECKPOINT_PATH
+#define SMARTSTALL_REGISTRY_CHECKPOINT_PATH "/usr/smartstall-registry.bin"
+#endif
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+const unsigned long REGISTRY_CHECKPOINT_INTERVAL_MS = 60000;
+const int REGISTRY_CHECKPOINT_MAX_RECORDS = 64;            // per pass; the rest wait for the next one
+unsigned long lastCheckpointMs = 0;
+unsigned long registryRestoredMs = 0;  // millis() at the restore
+uint32_t registryRestoredAsOfS = 0;    // unix time the restore assumed, until the clock is valid (0 = none)
+#endif
+
+#if SMARTSTALL_ROLLUPS
+const unsigned long ROLLUP_PUBLISH_INTERVAL_MS = 1000;  // Device OS publish rate limit: 1 per second
+PublishBatcher<PUBLISH_MAX_DATA_LEN> rollupBatch(0);
+uint32_t rollupNextCloseS = 0;          // Time.now() at which the current windows end
+uint16_t rollupsPendingCount = 0;       // devices holding a closed, unpublished window
+unsigned long lastRollupPublishMs = 0;
+#endif
+
+// Concurrent polls: up to SMARTSTALL_POLL_LINKS devices are connected and polled at once, each on its own
+// PollLink (Device OS allows up to 3 central links). The links share the stack-stability rules below: at
+// most one BLE.connect() per loop() pass, and none during the cooldown after any link's teardown. Scans
+// only run while every link is free. 1 is the former one-device-at-a-time hub.
+#ifndef SMARTSTALL_POLL_LINKS
+#define SMARTSTALL_POLL_LINKS 1
+#endif
+static_assert(SMARTSTALL_POLL_LINKS >= 1, "SMARTSTALL_POLL_LINKS must be at least 1");
+
+// Link-aware polling: each device keeps an RSSI average and its recent connect outcomes (link_quality.h).
+// A due device with a weak link is deferred until it is heard strongly (or for at most
+// LINK_WEAK_MAX_DEFER_MS, then given a single connect attempt), and among due devices the scheduler
+// prefers the likelier connects. Set to 0 for the former deadline-only order with full connect attempts.
+#ifndef SMARTSTALL_LINK_AWARE
+#define SMARTSTALL_LINK_AWARE 1
+#endif
+
+// Per-phase latency histograms of the poll cycle (latency_histogram.h), summarized in the hub ledger's
+// "latency" section and cleared by the latency_reset cloud function. About 2.5 KB of RAM; set to 0 to
+// leave them out.
+#ifndef SMARTSTALL_LATENCY_HISTOGRAMS
+#define SMARTSTALL_LATENCY_HISTOGRAMS 1
+#endif
 
-// BLE objects
-BlePeerDevice peer;
-BleCharacteristic stallStatusChar;
-BleCharacteristic batteryVoltageChar;
-BleCharacteristic sensorCountsChar;
+// Scan and poll-step progress goes to a RAM ring of 16-byte binary records (trace_buffer.h) instead of
+// Log.info lines; the trace_dump cloud function formats them over serial. Records above the level are
+// compiled out, arguments included: TRACE_LEVEL_OFF (0), TRACE_LEVEL_WARN (1) or TRACE_LEVEL_INFO (2).
+// Warnings that end a poll or a connect, and publishes, still go to the log.
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_WARN 1
+#define TRACE_LEVEL_INFO 2
+#ifndef SMARTSTALL_TRACE_LEVEL
+#define SMARTSTALL_TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+#ifndef SMARTSTALL_TRACE_RECORDS
+#define SMARTSTALL_TRACE_RECORDS 256 // power of two; 16 bytes each
+#endif
+// Set to 1 to also format each record to the log as it is written (the former serial verbosity)
+#ifndef SMARTSTALL_TRACE_ECHO
+#define SMARTSTALL_TRACE_ECHO 0
+#endif
+
+// Record every BLE and cloud input from setup() on (input_capture.h): scans and their SmartStall
+// sightings, connects, unrequested disconnects, discoveries, characteristic reads, cloud connectivity and
+// clock steps, to a file capped at SMARTSTALL_CAPTURE_MAX_BYTES. The previous boot's capture is kept
+// beside it (".prev"); the capture_dump cloud function logs either over serial and host/replay runs the
+// hub against it. Off by default; set to 1 to capture.
+#ifndef SMARTSTALL_CAPTURE
+#define SMARTSTALL_CAPTURE 0
+#endif
+#ifndef SMARTSTALL_CAPTURE_PATH
+#define SMARTSTALL_CAPTURE_PATH "/usr/smartstall-capture.bin"
+#endif
+#ifndef SMARTSTALL_CAPTURE_MAX_BYTES
+#define SMARTSTALL_CAPTURE_MAX_BYTES (512UL * 1024)
+#endif
 
 // Deferred connection handling (avoid calling BLE.connect inside scan callback which may cause instability)
 bool hasPendingAddress = false;
@@ -89,19 +288,106 @@ unsigned long pendingAddressTimestamp = 0;
 const unsigned long PENDING_CONNECT_DEBOUNCE_MS = 50; // shorter debounce for faster connect
 
 // One BLE.connect per loop iteration — rapid back-to-back connects can assert/crash the Device OS BLE stack
-BleAddress connectTargetAddress;
-int connectAttemptIndex = 0; // 1..MAX_CONNECT_ATTEMPTS while in HUB_CONNECTING
-unsigned long nextConnectAttemptAt = 0;
 const int MAX_BLE_CONNECT_ATTEMPTS = 3;
 const unsigned long POST_STOP_SCAN_SETTLE_MS = 120;
 const unsigned long CONNECT_RETRY_GAP_MS = 800;
+const unsigned long CONNECT_WINDOW_MS = 20000; // settle + all attempts, then the poll counts as failed
 // Minimum idle time after any link teardown before starting a new scan or connect (Particle BLE stack)
 const unsigned long BLE_STACK_COOLDOWN_MS = 2500;
 unsigned long bleQuietUntil = 0;
-// Set true only around peer.disconnect() after a successful poll — avoids counting that as a connect failure
-volatile bool expectingUserInitiatedDisconnect = false;
+bool cooldownGapOpen = false;          // a teardown armed the cooldown since the last BLE.connect()
+unsigned long cooldownGapStartMs = 0;  // ... at this time (latency cooldown_ms)
+
+// State of one poll link. A link in HUB_SCANNING is free; the hub is scanning/idle while all of them are.
+enum HubState {
+    HUB_SCANNING,
+    HUB_CONNECTING,
+    HUB_CONNECTED,
+    HUB_DISCOVERING,
+    HUB_READING_DATA,
+    HUB_DISCONNECTED
+};
+
+// One poll of a connected device, advanced by loop() one GATT operation per tick (HUB_DISCOVERING, then
+// HUB_READING_DATA). Retry gaps are deadlines checked each tick rather than delay()s in the poll path.
+enum PollStep {
+    POLL_DISCOVER_SERVICES,         // skipped when the cached GATT handles bind
+    POLL_DISCOVER_CHARACTERISTICS,
+    POLL_READ_STATUS,
+    POLL_READ_BATTERY,              // no ATT traffic while the cached value is fresh
+    POLL_READ_COUNTS,
+    POLL_FINISH                     // publish on change, update the registry, disconnect
+};
+
+// One in-flight poll: its link, GATT handles and the data read so far
+struct PollLink {
+    HubState state = HUB_SCANNING;
+    BleAddress target;                      // device polled; kept after teardown to match its disconnect
+    BlePeerDevice peer;
+    int connectAttemptIndex = 0;            // 1..connectAttemptLimit while in HUB_CONNECTING
+    int connectAttemptLimit = MAX_BLE_CONNECT_ATTEMPTS;
+    unsigned long nextConnectAttemptAt = 0;
+    unsigned long connectionStartTime = 0;
+    unsigned long scheduledAtMs = 0;        // poll scheduled (pendingAddressTimestamp), for latency_*
+    unsigned long phaseStartMs = 0;         // current discovery or reads phase began
+    // Set true only around peer.disconnect() after a poll — avoids counting that as a connect failure
+    bool expectingUserInitiatedDisconnect = false;
+    PollStep pollStep = POLL_DISCOVER_SERVICES;
+    int pollStepAttempt = 0;                // failed attempts of pollStep so far
+    unsigned long nextPollStepAt = 0;       // pollStep runs on the first tick at or after this
+    BleService pollService;                 // SmartStall service found by POLL_DISCOVER_SERVICES
+    BleCharacteristic stallStatusChar;
+    BleCharacteristic batteryVoltageChar;
+    BleCharacteristic sensorCountsChar;
+    SmartStallData data;
+    bool statusRead = false;                // data.stallStatus was read this poll
+    bool readPartial = false;               // a battery or counts read failed; its last value stands in
+    bool readMissing = false;               // ... and there was none, so data cannot be published
+};
+
+PollLink pollLinks[SMARTSTALL_POLL_LINKS];
+// Links in use, at most SMARTSTALL_POLL_LINKS (the host benchmark lowers it to compare pool sizes)
+int pollLinkLimit = SMARTSTALL_POLL_LINKS;
+
+static PollLink *freePollLink() {
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        if (pollLinks[i].state == HUB_SCANNING) return &pollLinks[i];
+    }
+    return nullptr;
+}
+
+static bool pollLinksIdle() {
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        if (pollLinks[i].state != HUB_SCANNING) return false;
+    }
+    return true;
+}
+
+// The link polling addr, else a freed link that still expects addr's disconnect, else null
+static PollLink *pollLinkFor(const BleAddress &addr) {
+    PollLink *freed = nullptr;
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        PollLink &link = pollLinks[i];
+        if (link.target != addr) continue;
+        if (link.state != HUB_SCANNING) return &link;
+        if (link.expectingUserInitiatedDisconnect) freed = &link;
+    }
+    return freed;
+}
+
+// Reported in the hub ledger: the first busy link's state, or HUB_SCANNING
+static HubState hubState() {
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        if (pollLinks[i].state != HUB_SCANNING) return pollLinks[i].state;
+    }
+    return HUB_SCANNING;
+}
 
 static void armBleCooldown() {
+    if (!cooldownGapOpen) {
+        cooldownGapOpen = true;
+        cooldownGapStartMs = millis();
+    }
     unsigned long until = millis() + BLE_STACK_COOLDOWN_MS;
     if (until > bleQuietUntil) {
         bleQuietUntil = until;
@@ -111,63 +397,482 @@ static void armBleCooldown() {
 // Hub health metrics (persisted to ledger)
 struct HubMetrics {
     uint32_t scansStarted = 0;
-    uint32_t scanResultsSeen = 0;
     uint32_t smartstallSeen = 0;
     uint32_t connectsAttempted = 0;
     uint32_t connectsSucceeded = 0;
+    uint32_t connectFailMs = 0;       // time spent in BLE.connect() calls that did not connect
+    uint32_t linkDeferred = 0;        // due polls put off for a weak link
     uint32_t unexpectedDisconnects = 0;
-    uint32_t pollCyclesSucceeded = 0; // full readAllCharacteristics succeeded
+    uint32_t pollCyclesSucceeded = 0; // status read (battery/counts read or kept from an earlier poll)
     uint32_t pollCyclesFailed = 0;
+    uint32_t pollPartial = 0;     // succeeded polls where a battery or counts read failed (last value kept)
     uint32_t profileRejected = 0; // pre-v1.2 NOTIFY profile or invalid GATT (skipped reads)
+    uint32_t gattCacheHits = 0;   // polls that skipped explicit discovery
+    uint32_t gattCacheMisses = 0; // polls that ran full discovery (first poll or invalidated cache)
+    uint32_t advStatusSeen = 0;   // adverts carrying the status telemetry field
+    uint32_t advPollsAvoided = 0; // adaptive-interval polls replaced by an advertised observation
     uint32_t ledgerWritesHub = 0;
     uint32_t ledgerWritesDevices = 0;
+    uint32_t eventsQueued = 0;      // snapshots deferred to the store-and-forward queue
+    uint32_t eventsReplayed = 0;    // queued snapshots delivered later
+    uint32_t eventQueueDropped = 0; // overwritten while full, unreadable or not storable (persists)
+    uint32_t rollupsPublished = 0;  // device windows acknowledged by the cloud
+    uint32_t rollupsDropped = 0;    // closed windows replaced by a newer one before publishing
+    uint32_t checkpointWrites = 0;  // registry checkpoint records written since boot
+    uint16_t checkpointRestored = 0; // registry entries restored from the checkpoint at boot
+    uint16_t eventQueueDepth = 0;
+    uint32_t loopMaxMs = 0;         // longest loop() iteration, excluding its idle delay
+    uint32_t loopMaxPollMs = 0;     // ... among iterations that ran the discover/read/publish path
+    uint32_t loopSlow = 0;          // iterations longer than LOOP_SLOW_MS
+    uint32_t loopPasses = 0;        // loop() iterations (wakeups)
 };
 
 HubMetrics hubMetrics;
 
+// Poll cycle phases timed by the latency histograms (hub ledger "latency" section, in this order)
+enum LatencyPhase {
+    LATENCY_SCAN_TO_CONNECT, // poll scheduled -> its first BLE.connect() call
+    LATENCY_CONNECT,         // each BLE.connect() call, connected or not
+    LATENCY_DISCOVERY,       // connected -> characteristics bound (cached handles or full discovery)
+    LATENCY_READS,           // characteristic reads -> poll finished
+    LATENCY_PUBLISH,         // submitting one changed snapshot (publish, batch or queue), in µs
+    LATENCY_COOLDOWN,        // link teardown -> next BLE.connect() by any link (stack cooldown + idle)
+    LATENCY_CYCLE,           // poll scheduled -> its link reset
+    LATENCY_DETECT,          // first advert since the device's last read or observation -> publish
+    LATENCY_PHASES
+};
+const char *const LATENCY_PHASE_NAMES[LATENCY_PHASES] = {
+    "scan_to_connect_ms", "connect_ms", "discovery_ms", "reads_ms", "publish_us", "cooldown_ms", "cycle_ms",
+    "detect_ms"
+};
+
+#if SMARTSTALL_LATENCY_HISTOGRAMS
+LatencyHistogram latencyHistograms[LATENCY_PHASES];
+#endif
+
+static inline void noteLatency(LatencyPhase phase, unsigned long value) {
+#if SMARTSTALL_LATENCY_HISTOGRAMS
+    latencyHistograms[phase].record((uint32_t)value);
+#else
+    (void)phase;
+    (void)value;
+#endif
+}
+
+// Trace events. Each format takes the record's two arguments as longs (it may use fewer); the device
+// address, when there is one, is printed ahead of it.
+enum TraceEvent : uint16_t {
+    TRACE_SCAN_STARTED,
+    TRACE_SIGHTED,
+    TRACE_SIGHTED_QUEUED,
+    TRACE_SIGHTED_LEGACY,
+    TRACE_SIGHTED_ROTATION,
+    TRACE_POLL_SELECTED,
+    TRACE_POLL_STALE,
+    TRACE_POLL_WEAK_DEFERRED,
+    TRACE_POLL_REPROBE,
+    TRACE_CONNECT_START,
+    TRACE_CONNECT_ATTEMPT,
+    TRACE_CONNECT_RESULT,
+    TRACE_CONNECTED,
+    TRACE_DISCONNECTED,
+    TRACE_DISCOVERY_START,
+    TRACE_DISCOVERY_EMPTY,
+    TRACE_DISCOVERY_SERVICE,
+    TRACE_DISCOVERY_CHARS,
+    TRACE_PROFILE_OK,
+    TRACE_READ_STATUS,
+    TRACE_READ_BATTERY,
+    TRACE_READ_COUNTS,
+    TRACE_READ_COUNTS_HALL,
+    TRACE_COUNTS_CACHED,
+    TRACE_READ_INVALID_CHAR,
+    TRACE_READ_FAILED,
+    TRACE_READ_KEPT_LAST,
+    TRACE_CHANGE_DETECTED,
+    TRACE_UNCHANGED,
+    TRACE_COUNTS_RESET,
+    TRACE_COUNTS_ROLLED_UP,
+    TRACE_ADV_STATUS,
+    TRACE_POLL_COMPLETE,
+    TRACE_LINK_RESET,
+    TRACE_EVENTS
+};
+const char *const TRACE_FORMATS[TRACE_EVENTS] = {
+    "scan started (global=%ld)",
+    "sighted rssi=%ld match=%ld",
+    "queued for poll on sighting",
+    "in legacy-profile cooldown; not queued",
+    "not due; polled in rotation",
+    "selected for poll (overdue %ld ms)",
+    "stale (unseen %ld ms); parked until sighted",
+    "weak link (rssi %ld dBm); deferred for %ld ms",
+    "legacy retry window reached; reprobing",
+    "connecting (%ld attempts allowed)",
+    "connect attempt %ld/%ld",
+    "connect connected=%ld in %ld ms",
+    "connected",
+    "disconnected in state %ld",
+    "full GATT discovery",
+    "discovery returned no services (attempt %ld)",
+    "%ld services, SmartStall service found=%ld",
+    "%ld characteristics, valid status|battery<<1|counts<<2=%ld",
+    "GATT profile ok (cached=%ld)",
+    "status=%ld (%ld bytes)",
+    "battery=%ld mV (cached=%ld)",
+    "counts limit=%ld cap_touch=%ld",
+    "counts hall=%ld",
+    "counts unchanged, read %ld ms ago (cached)",
+    "read step %ld: characteristic invalid",
+    "read step %ld attempt %ld failed",
+    "read step %ld failed; last value kept=%ld",
+    "changed (status=%ld counts=%ld)",
+    "status and counts unchanged; not published",
+    "counts reset (limit switch %ld -> %ld)",
+    "counts changed; left to the rollup",
+    "advertised status %ld",
+    "poll complete (status read=%ld, valid=%ld)",
+    "link reset from state %ld"
+};
+
+#if SMARTSTALL_TRACE_LEVEL > TRACE_LEVEL_OFF
+TraceRing<SMARTSTALL_TRACE_RECORDS> traceRing;
+#if SMARTSTALL_TRACE_ECHO
+static void echoTraceRecord(const TraceRecord &r);
+#endif
+
+static void traceHub(TraceEvent event, int device, int32_t a, int32_t b) {
+    uint16_t dev = (device >= 0) ? (uint16_t)device : TRACE_NO_DEVICE;
+    traceRing.push((uint32_t)millis(), (uint16_t)event, dev, a, b);
+#if SMARTSTALL_TRACE_ECHO
+    echoTraceRecord(traceRing.at(traceRing.size() - 1));
+#endif
+}
+#else
+static inline void traceHub(TraceEvent, int, int32_t, int32_t) {}
+#endif
+
+// Arguments are only evaluated when the level is compiled in
+#define HUB_TRACE(level, event, device, a, b) \
+    do { \
+        if ((level) <= SMARTSTALL_TRACE_LEVEL) traceHub((event), (device), (int32_t)(a), (int32_t)(b)); \
+    } while (0)
+#define TRACE_INFO(event, device, a, b) HUB_TRACE(TRACE_LEVEL_INFO, event, device, a, b)
+#define TRACE_WARN(event, device, a, b) HUB_TRACE(TRACE_LEVEL_WARN, event, device, a, b)
+
+// BLE callbacks run on the Device OS BLE thread. They only match adverts and push one of these into
+// bleEvents; processBleEvents() applies them to the registry and hub state on the application thread.
+enum BleEventType : uint8_t {
+    BLE_EVENT_SCAN_RESULT,
+    BLE_EVENT_CONNECTED,
+    BLE_EVENT_DISCONNECTED
+};
+struct BleEvent {
+    BleEventType type;
+    uint8_t match;                  // ADV_MATCH_* (scan results)
+    int8_t rssi;
+    bool hasAdvStatus;              // advStatus was parsed from the advert or scan response
+    BleAddress address;
+    AdvStatus advStatus;
+#if SMARTSTALL_CAPTURE
+    uint32_t ms;                    // millis() in the callback
+#endif
+};
+const uint32_t BLE_EVENT_RING_CAPACITY = 256; // a 50 ms scan hears each advertiser about once
+SpscRing<BleEvent, BLE_EVENT_RING_CAPACITY> bleEvents;
+std::atomic<uint32_t> scanResultsSeen{0};     // every scan report, counted on the BLE thread
+const unsigned long LOOP_SLOW_MS = 250; // loop() iterations above this count as slow (loop_slow)
+// Given by BLE callbacks so a sleeping loop() resumes before its deadline
+os_semaphore_t loopWakeSemaphore = nullptr;
+
 // Device registry to track multiple known devices and poll them in a loop
 struct DeviceInfo {
     BleAddress address;
     unsigned long lastSeen;   // last time seen in a scan
     unsigned long lastRead;   // last time we successfully read data
     uint8_t failureCount;     // consecutive failures
-    bool hasLastStatus;       // whether we have published a status before
-    uint16_t lastStatusPublished; // last status value we published
-    bool hasLastCounts = false; // whether we have published counts before
+    bool hasLastStatus;       // whether the cloud has acknowledged a status before
+    uint16_t lastStatusPublished; // last status value the cloud acknowledged
+    bool hasLastCounts = false; // whether the cloud has acknowledged counts before
     uint32_t lastLimitSwitchPublished = 0;
     uint32_t lastCapTouchPublished = 0;
     uint32_t lastHallPublished = 0;
+    // Last snapshot handed to the publish path (sent or queued); change detection compares against it
+    bool hasLastSubmitted = false;
+    uint16_t lastStatusSubmitted = 0;
+    uint32_t lastCountsSubmitted[3] = {0, 0, 0};
+    uint32_t lastTimestampSubmitted = 0;
+    // last*Submitted came from the registry checkpoint, which may lag: compared against, but no usage base
+    bool lastSubmittedRestored = false;
+    // Counter usage (counter_usage.h) of the last submitted snapshot, and counter resets since boot
+    CounterUsage lastUsage = {};
+    uint16_t countResets = 0;
     // Older SmartStall firmware (pre-v1.2) may advertise NOTIFY; hub is read-only — skip to avoid stack asserts
     bool legacyProfileBlocked = false;
     unsigned long legacyProfileRetryAfterMs = 0;
+    // v1.2 read-only profile validated by a full discovery; cleared on any bind/read failure
+    bool gattCacheValid = false;
+    // Adaptive poll policy inputs (see pollIntervalFor)
+    bool hasObservedStatus = false;
+    uint16_t observedStatus = 0;         // last status read over GATT (published or not)
+    unsigned long statusChangedAtMs = 0; // when observedStatus last changed
+    uint8_t activity = 0;                // status changes, halved every ACTIVITY_HALF_LIFE_MS
+    unsigned long pollIntervalMs = 0;    // effective interval from the last reschedule (ledger)
+    uint16_t batteryMv = 0;              // cached between battery reads (0 = never read)
+    unsigned long batteryReadAtMs = 0;
+    // Advertised status telemetry (adv_status.h); devices without it keep the connect-per-poll path
+    bool advTelemetry = false;           // field seen at least once
+    bool hasCountsRead = false;          // countsRead/countsDigest valid
+    uint32_t countsRead[3] = {0, 0, 0};  // Sensor Counts from the last GATT read (limit, cap touch, hall)
+    uint32_t countsDigest = 0;
+    unsigned long countsReadAtMs = 0;    // last successful Sensor Counts read
+    // Radio link estimate (link_quality.h) and the current weak-link deferral
+    LinkQuality radio;
+    unsigned long linkDeferredSinceMs = 0; // first deferral of the pending poll (0 = not deferred)
+    unsigned long lastObservedMs = 0;    // last GATT read or credited advert observation
+    bool detectPending = false;          // heard since its last read or observation (latency detect_ms)
+    unsigned long detectFromMs = 0;      // ... first at this time
+    bool advPublishPending = false;      // advert-only status change waiting for loop() to publish
+    // Device ledger entry: re-serialized only when one of its exported fields changed
+    bool ledgerDirty = true;
+    unsigned long ledgerLastSeen = 0;    // last_seen_ms as last written
+    int ledgerRssi = 0;                  // rssi as last written
+    // smartstall/bin encoder state; counts base is last*Published above
+    bool binHasBase = false;             // a frame was sent since boot
+    uint8_t binSequence = 0;             // sequence of the next frame
+    uint8_t binSinceKeyframe = 0;        // deltas sent since the last keyframe
+    uint32_t binLastTimestamp = 0;
+    uint16_t binLastBatteryMv = 0;
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+    // Checkpoint slot (same index) holds this entry, with durable fields of this digest
+    bool checkpointed = false;
+    uint32_t checkpointDigest = 0;
+#endif
+#if SMARTSTALL_ROLLUPS
+    RollupState rollup;                  // window being filled (usage_rollup.h)
+    bool rollupPending = false;          // pendingRollup holds a closed window not yet published
+    UsageRollup pendingRollup = {};
+#endif
 };
 
-Vector<DeviceInfo> knownDevices;
-size_t currentDeviceIdx = 0; // round-robin index
-
 // Configuration constants (tune as needed)
 const unsigned long GLOBAL_SCAN_INTERVAL_MS      = 60000;  // perform a discovery scan every 60s
+const unsigned long SCAN_REFRESH_INTERVAL_MS     = 15000;  // opportunistic scan while idle in HUB_SCANNING
 const unsigned long DEVICE_POLL_INTERVAL_MS      = 30000;  // minimum delay between reads per device
 const unsigned long DEVICE_FAILURE_BACKOFF_MS    = 45000;  // additional backoff when failures occurred
 const uint8_t       MAX_FAILURES_BEFORE_BACKOFF  = 3;
-const int           MAX_TRACKED_DEVICES          = 12;     // limit to prevent memory overuse
+const int           MAX_TRACKED_DEVICES          = 512;    // limit to prevent memory overuse
 const unsigned long DEVICE_STALE_MS              = 120000; // if not seen in 2 minutes, skip polling
 const unsigned long LEGACY_PROFILE_RETRY_MS      = 86400000UL; // 24h — re-probe after peripheral FW upgrade
 
+// Adaptive poll policy: interval by last observed status, recent activity and time of day.
+// DEVICE_POLL_INTERVAL_MS remains the interval for never-read devices and busy idle stalls.
+const unsigned long POLL_INTERVAL_ACTIVE_MS      = 15000;  // LOCKED, or within ACTIVE_WINDOW_MS of a transition
+const unsigned long POLL_INTERVAL_IDLE_MS        = 45000;  // UNLOCKED/INIT with no recent activity
+const unsigned long POLL_INTERVAL_SLEEP_MS       = 300000; // SLEEP/PRE_SLEEP; a wake is caught by re-sighting
+const unsigned long ACTIVE_WINDOW_MS             = 120000;
+const unsigned long ACTIVITY_HALF_LIFE_MS        = 1800000; // 30 min
+const uint8_t       ACTIVITY_BUSY_THRESHOLD      = 3;
+const int           QUIET_HOURS_START            = 22;     // Time.hour(); idle/sleep intervals doubled in
+const int           QUIET_HOURS_END              = 6;      // [start, end). Equal values disable quiet hours.
+const unsigned long BATTERY_READ_INTERVAL_MS     = 600000; // battery re-read cadence (10 min)
+const unsigned long COUNTS_READ_INTERVAL_MS      = 60000;  // counts re-read cadence while status is unchanged
+// Devices advertising status telemetry are only connected for counts changes and this periodic full read
+const unsigned long ADV_FULL_READ_INTERVAL_MS    = 600000; // 10 min
+
+// Link-aware polling (SMARTSTALL_LINK_AWARE)
+const unsigned long LINK_STRONG_RECENT_MS        = 30000;  // a strong sighting this recent clears a weak device
+const unsigned long LINK_WEAK_RECHECK_MS         = 30000;  // a deferred weak device comes due again after this
+const unsigned long LINK_WEAK_MAX_DEFER_MS       = 120000; // then polled anyway, with one connect attempt
+const size_t        LINK_ORDER_WINDOW            = 15;     // heap slots bestDue() compares (top four levels)
+const unsigned long LINK_ORDER_AGING_S           = 60;     // overdue seconds added before weighting by success
+const int           LINK_LEDGER_RSSI_STEP_DB     = 3;      // rssi change that re-dirties a ledger entry
+
+// Registry lives in a static arena (no heap growth during BLE callbacks) with an O(1) address index
+FixedVector<DeviceInfo, MAX_TRACKED_DEVICES> knownDevices;
+DeviceAddressIndex<MAX_TRACKED_DEVICES> deviceIndex;
+
+// Poll queue: registry indices ordered by next eligible poll time. Updated on sighting, poll
+// completion and failure, so loop() only ever looks at the earliest deadline.
+PollScheduler<MAX_TRACKED_DEVICES> pollQueue;
+
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+RegistryCheckpoint<MAX_TRACKED_DEVICES> registryCheckpoint;
+#endif
+
+#if SMARTSTALL_CAPTURE
+// Input capture (SMARTSTALL_CAPTURE); committed to flash with a CAPTURE_MARK every interval
+const unsigned long CAPTURE_FLUSH_INTERVAL_MS = 10000;
+const size_t CAPTURE_DUMP_CHUNK = 4096;       // file bytes per capture_dump call
+InputCaptureWriter<MAX_TRACKED_DEVICES, 512> inputCapture;
+unsigned long captureLastFlushMs = 0;
+bool captureCloudUp = false;
+bool captureClockValid = false;
+uint32_t captureClockMs = 0;                  // last CAPTURE_CLOCK: millis() and Time.now() at the time
+uint32_t captureClockUnix = 0;
+#endif
+
+// Particle.connected(), recording transitions when capturing
+static bool cloudConnected() {
+    bool up = Particle.connected();
+#if SMARTSTALL_CAPTURE
+    if (up != captureCloudUp) {
+        inputCapture.cloud((uint32_t)millis(), up);
+        captureCloudUp = up;
+    }
+#endif
+    return up;
+}
+
+// Devices with advPublishPending set. Only loop() touches it: set as processBleEvents() ingests adverts,
+// cleared by the publish and poll paths.
+int advPublishPendingCount = 0;
+
+#if SMARTSTALL_LEDGER_SHARDED
+// ~190 bytes of entry JSON per device keeps a full shard well under the 16 KB ledger size limit
+const int LEDGER_DEVICES_PER_SHARD = 64;
+const int LEDGER_DEVICE_SHARDS = (MAX_TRACKED_DEVICES + LEDGER_DEVICES_PER_SHARD - 1) / LEDGER_DEVICES_PER_SHARD;
+static_assert(LEDGER_DEVICE_SHARDS <= 32, "ledgerDirtyShards is a 32-bit mask");
+const char *DEVICE_SHARD_LEDGER_PREFIX = "smartstall-devices-";
+// A sighting alone (last_seen_ms) re-dirties an entry at most this often
+const unsigned long LEDGER_SEEN_RESOLUTION_MS = 60000;
+
+Ledger deviceShardLedgers[LEDGER_DEVICE_SHARDS];
+Variant deviceShardData[LEDGER_DEVICE_SHARDS];    // shard content as last written, updated entry by entry
+volatile uint32_t ledgerDirtyShards = 0;          // bit per shard holding a dirty entry
+int nextLedgerShard = 0;                          // round-robin start among dirty shards
+bool hubLedgerPending = true;                     // hub ledger period due or a read completed since
+bool lastLedgerWriteWasShard = false;
+#endif
+
 unsigned long lastGlobalScan = 0; // timestamp of last broad scan
 
-// Ledger helpers are implemented later, after `currentState` and `currentData` exist.
+// Ledger helpers are implemented later, after `lastReadData` exists.
 static void maybeInitLedgers();
-static void writeUnifiedLedger(bool force);
+void writeLedgers(bool force);
+
+// A registry entry's exported ledger fields changed (last read, failures, interval, status, legacy)
+static void markDeviceLedgerDirty(int idx) {
+    if (idx < 0) return;
+#if SMARTSTALL_LEDGER_SHARDED
+    knownDevices.at(idx).ledgerDirty = true;
+    ledgerDirtyShards |= (1u << (idx / LEDGER_DEVICES_PER_SHARD));
+#else
+    devicesLedgerDirty = true;
+#endif
+}
+
+static inline uint64_t packAddress(const BleAddress &addr) {
+    uint8_t octets[BLE_SIG_ADDR_LEN];
+    for (uint8_t i = 0; i < BLE_SIG_ADDR_LEN; ++i) {
+        octets[i] = addr[i];
+    }
+    return DeviceAddressIndex<MAX_TRACKED_DEVICES>::pack(octets);
+}
 
 int findDeviceIndex(const BleAddress &addr) {
-    int total = knownDevices.size();
-    for (int i = 0; i < total; ++i) {
-        if (knownDevices.at(i).address == addr) {
-            return i;
+    return deviceIndex.find(packAddress(addr));
+}
+
+static bool isQuietHour() {
+    if (QUIET_HOURS_START == QUIET_HOURS_END || !Time.isValid()) return false;
+    int h = Time.hour();
+    if (QUIET_HOURS_START < QUIET_HOURS_END) {
+        return h >= QUIET_HOURS_START && h < QUIET_HOURS_END;
+    }
+    return h >= QUIET_HOURS_START || h < QUIET_HOURS_END;
+}
+
+// Status changes seen recently, halved once per ACTIVITY_HALF_LIFE_MS since the last change
+static uint8_t activityNow(const DeviceInfo &d) {
+    unsigned long halvings = (millis() - d.statusChangedAtMs) / ACTIVITY_HALF_LIFE_MS;
+    return halvings >= 8 ? 0 : (uint8_t)(d.activity >> halvings);
+}
+
+// Record a GATT status read: a transition stamps the change time and bumps the activity score
+static void noteObservedStatus(DeviceInfo &d, uint16_t status) {
+    if (d.hasObservedStatus && d.observedStatus == status) return;
+    if (d.hasObservedStatus) {
+        d.activity = (uint8_t)min<int>(activityNow(d) + 1, 16);
+        d.statusChangedAtMs = millis();
+    }
+    d.observedStatus = status;
+    d.hasObservedStatus = true;
+}
+
+// Poll interval for a device: state-adaptive base plus failure backoff
+static unsigned long pollIntervalFor(const DeviceInfo &d) {
+    unsigned long neededInterval = DEVICE_POLL_INTERVAL_MS;
+    if (d.hasObservedStatus) {
+        bool recentChange = d.activity > 0 && (millis() - d.statusChangedAtMs) < ACTIVE_WINDOW_MS;
+        switch (d.observedStatus) {
+            case 2: // LOCKED: the unlock is the next event worth catching
+                neededInterval = POLL_INTERVAL_ACTIVE_MS;
+                break;
+            case 4: // SLEEP
+            case 5: // PRE_SLEEP
+                neededInterval = POLL_INTERVAL_SLEEP_MS;
+                break;
+            default:
+                if (recentChange) {
+                    neededInterval = POLL_INTERVAL_ACTIVE_MS;
+                } else if (activityNow(d) >= ACTIVITY_BUSY_THRESHOLD) {
+                    neededInterval = DEVICE_POLL_INTERVAL_MS;
+                } else {
+                    neededInterval = POLL_INTERVAL_IDLE_MS;
+                }
+                break;
+        }
+        if (neededInterval > POLL_INTERVAL_ACTIVE_MS && isQuietHour()) {
+            neededInterval *= 2;
         }
     }
-    return -1;
+    if (d.failureCount >= MAX_FAILURES_BEFORE_BACKOFF) {
+        neededInterval += DEVICE_FAILURE_BACKOFF_MS * (d.failureCount - (MAX_FAILURES_BEFORE_BACKOFF - 1));
+    }
+    return neededInterval;
+}
+
+// Recompute a device's deadline from its registry state. Legacy-blocked devices come due at the
+// end of their retry window; never-read devices are due immediately.
+static void reschedulePoll(int idx) {
+    if (idx < 0) return;
+    DeviceInfo &d = knownDevices.at(idx);
+    d.pollIntervalMs = pollIntervalFor(d);
+    unsigned long due;
+    if (d.legacyProfileBlocked) {
+        due = d.legacyProfileRetryAfterMs;
+    } else if (d.lastRead == 0) {
+        due = millis();
+    } else if (d.advTelemetry && d.hasCountsRead && d.failureCount == 0) {
+        // Status arrives in adverts; only the periodic full read needs a connection
+        d.pollIntervalMs = ADV_FULL_READ_INTERVAL_MS;
+        due = d.countsReadAtMs + ADV_FULL_READ_INTERVAL_MS;
+        // A poll whose counts read failed retries counts at the normal interval rather than at once
+        if (PollScheduler<MAX_TRACKED_DEVICES>::before(due, d.lastRead + DEVICE_POLL_INTERVAL_MS)) {
+            due = d.lastRead + DEVICE_POLL_INTERVAL_MS;
+        }
+    } else {
+        due = d.lastRead + d.pollIntervalMs;
+    }
+    pollQueue.schedule((uint16_t)idx, due);
+    markDeviceLedgerDirty(idx);
+}
+
+// Take a device out of the due set while its poll is in flight; completion or failure reschedules it.
+static void claimForPoll(int idx, unsigned long now) {
+    if (idx < 0) return;
+    pollQueue.schedule((uint16_t)idx, now + DEVICE_POLL_INTERVAL_MS);
+}
+
+static void notePollFailure(int idx, bool stampRead) {
+    if (idx < 0) return;
+    DeviceInfo &d = knownDevices.at(idx);
+    d.failureCount = (uint8_t)min<int>(d.failureCount + 1, 10);
+    if (stampRead) {
+        d.lastRead = millis();
+    }
+    reschedulePoll(idx);
 }
 
 static inline bool blePropHas(uint32_t propBits, BleCharacteristicProperty bit) {
@@ -175,11 +880,11 @@ static inline bool blePropHas(uint32_t propBits, BleCharacteristicProperty bit)
 }
 
 // Hub targets SmartStall v1.2+ (READ-only GATT, no NOTIFY/CCCD). See BLUETOOTH_API.md.
-static const char *validateV12ReadOnlyProfile() {
-    if (!stallStatusChar.isValid() || !batteryVoltageChar.isValid() || !sensorCountsChar.isValid()) {
+static const char *validateV12ReadOnlyProfile(const PollLink &link) {
+    if (!link.stallStatusChar.isValid() || !link.batteryVoltageChar.isValid() || !link.sensorCountsChar.isValid()) {
         return "missing required characteristics (status/battery/sensor_counts)";
     }
-    const BleCharacteristic *chars[] = { &stallStatusChar, &batteryVoltageChar, &sensorCountsChar };
+    const BleCharacteristic *chars[] = { &link.stallStatusChar, &link.batteryVoltageChar, &link.sensorCountsChar };
     for (const BleCharacteristic *ch : chars) {
         uint32_t pr = (uint32_t)ch->properties();
         if (blePropHas(pr, BleCharacteristicProperty::NOTIFY)) {
@@ -200,26 +905,59 @@ static void markLegacyProfileRejected(const BleAddress &addr) {
     DeviceInfo &d = knownDevices.at(idx);
     d.legacyProfileBlocked = true;
     d.legacyProfileRetryAfterMs = millis() + LEGACY_PROFILE_RETRY_MS;
+    d.gattCacheValid = false;
     d.lastRead = millis();
     d.failureCount = (uint8_t)min<int>(d.failureCount + 1, 10);
-    devicesLedgerDirty = true;
+    reschedulePoll(idx);
     armBleCooldown();
 }
 
-void registerOrUpdateDevice(const BleAddress &addr) {
+// Cached-GATT bind: look the three characteristics up in the connect-time discovery table.
+// No ATT traffic; false means the cache is missing or stale and full discovery must run.
+static bool bindCachedCharacteristics(PollLink &link, int idx) {
+    if (idx < 0 || !knownDevices.at(idx).gattCacheValid) return false;
+    return link.peer.getCharacteristicByUUID(link.stallStatusChar, STALL_STATUS_CHAR_UUID)
+        && link.peer.getCharacteristicByUUID(link.batteryVoltageChar, BATTERY_VOLTAGE_CHAR_UUID)
+        && link.peer.getCharacteristicByUUID(link.sensorCountsChar, SENSOR_COUNTS_CHAR_UUID);
+}
+
+// Returns the registry index for addr, or -1 when the registry is full.
+int registerOrUpdateDevice(const BleAddress &addr) {
     int idx = findDeviceIndex(addr);
     if (idx >= 0) {
         DeviceInfo &d = knownDevices.at(idx);
+        bool reappeared = (millis() - d.lastSeen) > DEVICE_STALE_MS;
         d.lastSeen = millis();
+        if (reappeared) {
+            d.detectPending = false; // time-to-detect restarts from this advert, not one before the gap
+        }
+#if SMARTSTALL_LEDGER_SHARDED
+        if ((d.lastSeen - d.ledgerLastSeen) >= LEDGER_SEEN_RESOLUTION_MS) {
+            markDeviceLedgerDirty(idx);
+        }
+#else
         devicesLedgerDirty = true;
+#endif
         // If we previously had many failures and now see it again, we can gently decay failures
+        bool decayed = false;
         if (d.failureCount > 0 && (millis() - d.lastRead) > (DEVICE_POLL_INTERVAL_MS * 2)) {
             d.failureCount--;
+            decayed = true;
+        }
+        // A sleeping stall only advertises again after a door event: poll it now rather than
+        // at the end of its sleep interval. Otherwise re-sighting un-parks a stale device and a
+        // failure decay shortens its backoff.
+        bool wasAsleep = d.hasObservedStatus && (d.observedStatus == 4 || d.observedStatus == 5);
+        if (reappeared && wasAsleep && !d.legacyProfileBlocked) {
+            pollQueue.schedule((uint16_t)idx, millis());
+        } else if (decayed || !pollQueue.contains((uint16_t)idx)) {
+            reschedulePoll(idx);
         }
+        return idx;
     } else {
         if (knownDevices.size() >= MAX_TRACKED_DEVICES) {
             Log.warn("Device registry full (%d). Ignoring new device %s", knownDevices.size(), addr.toString().c_str());
-            return;
+            return -1;
         }
         DeviceInfo d;
         d.address = addr;
@@ -232,218 +970,693 @@ void registerOrUpdateDevice(const BleAddress &addr) {
         d.lastLimitSwitchPublished = 0;
         d.lastCapTouchPublished = 0;
         d.lastHallPublished = 0;
+        idx = knownDevices.size();
         knownDevices.append(d);
-        devicesLedgerDirty = true;
+        deviceIndex.insert(packAddress(addr), (uint16_t)idx);
+        reschedulePoll(idx);
         Log.info("Added new SmartStall device to registry (%d total): %s", knownDevices.size(), addr.toString().c_str());
+        return idx;
+    }
+}
+
+// Apply an advertised status observation. Unchanged counts: take status/battery in place and let
+// loop() publish a status change; changed counts or a due full read: make the device due now.
+static void ingestAdvStatus(int idx, const AdvStatus &s) {
+    DeviceInfo &d = knownDevices.at(idx);
+    unsigned long now = millis();
+    hubMetrics.advStatusSeen++;
+    if (!d.advTelemetry) {
+        d.advTelemetry = true;
+        reschedulePoll(idx);
+    }
+    if (d.legacyProfileBlocked) return;
+    AdvIngestAction action = decideAdvIngest(s, d.hasCountsRead, d.countsDigest, d.countsReadAtMs, now,
+                                             ADV_FULL_READ_INTERVAL_MS);
+    if (action == ADV_INGEST_FULL_READ) {
+        if (!pollQueue.isDue((uint16_t)idx, now)) {
+            pollQueue.schedule((uint16_t)idx, now);
+        }
+        return;
+    }
+    noteObservedStatus(d, s.status);
+    d.batteryMv = s.batteryMv;
+    d.batteryReadAtMs = now;
+    if (d.hasLastSubmitted && d.lastStatusSubmitted == s.status) {
+        d.detectPending = false; // observed, and nothing to publish
+    }
+    // Credit one avoided connection per adaptive interval the device would otherwise have been polled at
+    if ((now - d.lastObservedMs) >= pollIntervalFor(d)) {
+        hubMetrics.advPollsAvoided++;
+        d.lastObservedMs = now;
+    }
+    if ((!d.hasLastSubmitted || d.lastStatusSubmitted != s.status) && !d.advPublishPending) {
+        d.advPublishPending = true;
+        advPublishPendingCount++;
+    }
+}
+
+#if SMARTSTALL_LINK_AWARE
+// Weak link and not heard strongly of late: a connect now would likely burn its timeout
+static bool linkWeakNow(const DeviceInfo &d, unsigned long now) {
+    return linkIsWeak(d.radio) && !linkStrongSince(d.radio, now, LINK_STRONG_RECENT_MS);
+}
+#endif
+
+// Earliest-deadline due device, or with SMARTSTALL_LINK_AWARE the best among the earliest due:
+// predicted connect success weighted by how overdue the device is, so a weak link is passed over
+// while it is fresh but not starved
+static int nextDueDevice(unsigned long now) {
+#if SMARTSTALL_LINK_AWARE
+    uint16_t id = pollQueue.bestDue(now, LINK_ORDER_WINDOW, [now](uint16_t i, unsigned long dueAt) {
+        uint32_t overdueS = (uint32_t)((now - dueAt) / 1000);
+        return (uint32_t)predictedConnectPermille(knownDevices.at(i).radio) * (overdueS + LINK_ORDER_AGING_S);
+    });
+    return id == PollScheduler<MAX_TRACKED_DEVICES>::NONE ? -1 : (int)id;
+#else
+    if (pollQueue.empty() || PollScheduler<MAX_TRACKED_DEVICES>::before(now, pollQueue.topDueAt())) {
+        return -1;
+    }
+    return pollQueue.top();
+#endif
+}
+
+// Fold a sighting's RSSI into the device's link estimate. A strong sighting of a device deferred for
+// its weak link makes it due now.
+static void noteDeviceRssi(int idx, int8_t rssi) {
+    DeviceInfo &d = knownDevices.at(idx);
+    unsigned long now = millis();
+    noteLinkSighting(d.radio, rssi, now);
+#if SMARTSTALL_LEDGER_SHARDED
+    int avg = linkRssiDbm(d.radio);
+    if (avg - d.ledgerRssi >= LINK_LEDGER_RSSI_STEP_DB || d.ledgerRssi - avg >= LINK_LEDGER_RSSI_STEP_DB) {
+        markDeviceLedgerDirty(idx);
+    }
+#endif
+#if SMARTSTALL_LINK_AWARE
+    if (d.linkDeferredSinceMs != 0 && rssi >= LINK_RSSI_STRONG_DBM && !pollQueue.isDue((uint16_t)idx, now)) {
+        pollQueue.schedule((uint16_t)idx, now);
     }
+#endif
 }
 
 int selectNextDeviceToPoll() {
-    int total = knownDevices.size();
-    if (total == 0) return -1;
-    int attempts = 0;
-    int startIdx = (int)(currentDeviceIdx % (size_t)total);
-    int idx = startIdx;
     unsigned long now = millis();
-    do {
+    for (;;) {
+        int idx = nextDueDevice(now);
+        if (idx < 0) {
+            return -1; // none ready
+        }
         DeviceInfo &d = knownDevices.at(idx);
-        // Skip if stale (not seen recently) to avoid repeated timeouts on absent devices
+        // Stale (not seen recently): park until the next sighting re-schedules it
         if ((now - d.lastSeen) > DEVICE_STALE_MS) {
-            idx = (idx + 1) % total;
-            attempts++;
+            TRACE_INFO(TRACE_POLL_STALE, idx, now - d.lastSeen, 0);
+            pollQueue.remove((uint16_t)idx);
             continue;
         }
-        // Pre-v1.2 NOTIFY profile: skip polling until retry window (then reprobe once)
-        if (d.legacyProfileBlocked) {
-            if (now >= d.legacyProfileRetryAfterMs) {
-                d.legacyProfileBlocked = false;
-                devicesLedgerDirty = true;
-                {
-                    String addrStr = d.address.toString();
-                    Log.info("Legacy profile retry window reached; will reprobe %s", addrStr.c_str());
-                }
-            } else {
-                idx = (idx + 1) % total;
-                attempts++;
+        // Already being polled on another link (an advert made it due again): wait for that poll
+        PollLink *busy = pollLinkFor(d.address);
+        if (busy && busy->state != HUB_SCANNING) {
+            claimForPoll(idx, now);
+            continue;
+        }
+#if SMARTSTALL_LINK_AWARE
+        // Weak link: wait for a strong sighting (handleScanResult makes it due again) or the deferral cap
+        if (!d.legacyProfileBlocked && linkWeakNow(d, now)) {
+            if (d.linkDeferredSinceMs == 0) {
+                d.linkDeferredSinceMs = now;
+            }
+            if (now - d.linkDeferredSinceMs < LINK_WEAK_MAX_DEFER_MS) {
+                TRACE_INFO(TRACE_POLL_WEAK_DEFERRED, idx, linkRssiDbm(d.radio), now - d.linkDeferredSinceMs);
+                hubMetrics.linkDeferred++;
+                pollQueue.schedule((uint16_t)idx, now + LINK_WEAK_RECHECK_MS);
                 continue;
             }
         }
-        unsigned long sinceLastRead = (d.lastRead == 0) ? (unsigned long)0 : (now - d.lastRead);
-        unsigned long neededInterval = DEVICE_POLL_INTERVAL_MS;
-        if (d.failureCount >= MAX_FAILURES_BEFORE_BACKOFF) {
-            neededInterval += DEVICE_FAILURE_BACKOFF_MS * (d.failureCount - (MAX_FAILURES_BEFORE_BACKOFF - 1));
-        }
-        if (d.lastRead == 0 || sinceLastRead >= neededInterval) {
-            currentDeviceIdx = (idx + 1) % total;
-            return idx;
+        d.linkDeferredSinceMs = 0;
+#endif
+        // Pre-v1.2 NOTIFY profile: deadline was the retry window, so reaching it means reprobe once
+        if (d.legacyProfileBlocked) {
+            d.legacyProfileBlocked = false;
+            markDeviceLedgerDirty(idx);
+            TRACE_INFO(TRACE_POLL_REPROBE, idx, 0, 0);
         }
-        idx = (idx + 1) % total;
-        attempts++;
-    } while (attempts < total);
-    return -1; // none ready
+        TRACE_INFO(TRACE_POLL_SELECTED, idx, now - pollQueue.dueAt((uint16_t)idx), 0);
+        claimForPoll(idx, now);
+        return idx;
+    }
 }
 
-// State management
-enum HubState {
-    HUB_SCANNING,
-    HUB_CONNECTING,
-    HUB_CONNECTED,
-    HUB_DISCOVERING,
-    HUB_READING_DATA,
-    HUB_DISCONNECTED
-};
+// Connect attempts for a poll of addr: one when its link is weak and it has not been heard strongly
+// (the deferral cap ran out), else MAX_BLE_CONNECT_ATTEMPTS
+static int connectAttemptsFor(const BleAddress &addr) {
+#if SMARTSTALL_LINK_AWARE
+    int idx = findDeviceIndex(addr);
+    if (idx >= 0 && linkWeakNow(knownDevices.at(idx), millis())) {
+        return 1;
+    }
+#else
+    (void)addr;
+#endif
+    return MAX_BLE_CONNECT_ATTEMPTS;
+}
 
-HubState currentState = HUB_SCANNING;
+// State management
 unsigned long lastScanTime = 0;
 unsigned long lastDataRead = 0;
-unsigned long connectionStartTime = 0;
-String connectedDeviceAddress = "";
+
+const int MAX_SERVICE_DISCOVERY_ATTEMPTS = 3;
+const unsigned long SERVICE_DISCOVERY_RETRY_MS = 200;
+const int MAX_CHARACTERISTIC_READ_ATTEMPTS = 3;
+const unsigned long CHARACTERISTIC_READ_RETRY_MS = 150;
 
 // Debug mode - set to true to connect to first device found (for testing)
 bool debugMode = false;
 int devicesScanned = 0;
 
-// Data structures matching SmartStall API
-struct SensorCounts {
-    uint32_t limit_switch_triggers;
-    uint32_t cap_touch_triggers; // was ir_sensor_triggers; matches peripheral / BLUETOOTH_API.md
-    uint32_t hall_sensor_triggers;
-};
-
-struct SmartStallData {
-    String deviceAddress;
-    uint16_t stallStatus;
-    uint16_t batteryVoltage;
-    SensorCounts sensorCounts;
-    unsigned long timestamp;
-    bool isValid;
-};
-
-SmartStallData currentData;
+// Last poll's data for the ledger's last_read section (invalid again once its link resets)
+SmartStallData lastReadData;
 
-// ---- Ledger helper implementations (must be after currentState/currentData declarations) ----
+// ---- Ledger helper implementations (must be after lastReadData) ----
 static void maybeInitLedgers() {
     if (ledgersInitialized) return;
-    if (!Particle.connected()) return;
+    if (!cloudConnected()) return;
     // Device -> Cloud ledgers must already exist in the Product.
     deviceToCloudLedger = Particle.ledger(DEVICE_TO_CLOUD_LEDGER_NAME);
     ledgersInitialized = true;
+#if SMARTSTALL_LEDGER_SHARDED
+    for (int s = 0; s < LEDGER_DEVICE_SHARDS; ++s) {
+        String name = String::format("%s%d", DEVICE_SHARD_LEDGER_PREFIX, s);
+        deviceShardLedgers[s] = Particle.ledger(name.c_str());
+    }
+    for (int i = 0; i < (int)knownDevices.size(); ++i) {
+        markDeviceLedgerDirty(i);
+    }
+    Log.info("Ledgers initialized: %s, %s0..%d", DEVICE_TO_CLOUD_LEDGER_NAME, DEVICE_SHARD_LEDGER_PREFIX,
+             LEDGER_DEVICE_SHARDS - 1);
+#else
     devicesLedgerDirty = true;
     Log.info("Ledger initialized: %s", DEVICE_TO_CLOUD_LEDGER_NAME);
+#endif
 }
 
-static void writeUnifiedLedger(bool force) {
-    if (!ledgersInitialized) return;
-    unsigned long now = millis();
-    bool hubDue = ((now - lastHubLedgerWriteMs) >= HUB_LEDGER_PERIOD_MS);
-    bool okGap = ((now - lastUnifiedLedgerWriteMs) >= LEDGER_MIN_GAP_MS);
-    if (!force && !hubDue && !devicesLedgerDirty) return;
-    if (!force && !okGap) return;
-
-    Variant root;
-    root.set("ts_ms", (int64_t)now);
-    if (Time.isValid()) {
-        root.set("time", Time.format(TIME_FORMAT_ISO8601_FULL));
-    }
-
-    // Hub section
+static Variant hubLedgerSection(unsigned long now) {
     Variant hub;
-    hub.set("state", (int)currentState);
+    hub.set("state", (int)hubState());
     Variant ble;
     ble.set("cooldown_ms", (int64_t)((now >= bleQuietUntil) ? 0 : (bleQuietUntil - now)));
-    ble.set("connected", peer.connected());
+    ble.set("connected", BLE.connected());
+#if SMARTSTALL_POLL_LINKS > 1
+    int busyLinks = 0;
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        busyLinks += pollLinks[i].state != HUB_SCANNING ? 1 : 0;
+    }
+    ble.set("links_busy", busyLinks);
+#endif
     hub.set("ble", ble);
 
     Variant metrics;
     metrics.set("scans_started", (int64_t)hubMetrics.scansStarted);
-    metrics.set("scan_results_seen", (int64_t)hubMetrics.scanResultsSeen);
+    metrics.set("scan_results_seen", (int64_t)scanResultsSeen.load(std::memory_order_relaxed));
+    metrics.set("ble_events_dropped", (int64_t)bleEvents.dropped());
     metrics.set("smartstall_seen", (int64_t)hubMetrics.smartstallSeen);
     metrics.set("connects_attempted", (int64_t)hubMetrics.connectsAttempted);
     metrics.set("connects_succeeded", (int64_t)hubMetrics.connectsSucceeded);
+    metrics.set("connect_fail_ms", (int64_t)hubMetrics.connectFailMs);
+    metrics.set("link_deferred", (int64_t)hubMetrics.linkDeferred);
     metrics.set("unexpected_disconnects", (int64_t)hubMetrics.unexpectedDisconnects);
     metrics.set("poll_ok", (int64_t)hubMetrics.pollCyclesSucceeded);
     metrics.set("poll_fail", (int64_t)hubMetrics.pollCyclesFailed);
+    metrics.set("poll_partial", (int64_t)hubMetrics.pollPartial);
     metrics.set("profile_reject", (int64_t)hubMetrics.profileRejected);
+    metrics.set("gatt_cache_hit", (int64_t)hubMetrics.gattCacheHits);
+    metrics.set("gatt_cache_miss", (int64_t)hubMetrics.gattCacheMisses);
+    metrics.set("adv_status_seen", (int64_t)hubMetrics.advStatusSeen);
+    metrics.set("adv_polls_avoided", (int64_t)hubMetrics.advPollsAvoided);
     metrics.set("ledger_hub_writes", (int64_t)hubMetrics.ledgerWritesHub);
     metrics.set("ledger_devices_writes", (int64_t)hubMetrics.ledgerWritesDevices);
+    metrics.set("queue_depth", (int)hubMetrics.eventQueueDepth);
+    metrics.set("queue_dropped", (int64_t)hubMetrics.eventQueueDropped);
+    metrics.set("queue_deferred", (int64_t)hubMetrics.eventsQueued);
+    metrics.set("queue_replayed", (int64_t)hubMetrics.eventsReplayed);
+#if SMARTSTALL_ROLLUPS
+    metrics.set("rollups_published", (int64_t)hubMetrics.rollupsPublished);
+    metrics.set("rollups_dropped", (int64_t)hubMetrics.rollupsDropped);
+#endif
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+    metrics.set("checkpoint_writes", (int64_t)hubMetrics.checkpointWrites);
+    metrics.set("checkpoint_restored", (int)hubMetrics.checkpointRestored);
+#endif
+    metrics.set("loop_max_ms", (int64_t)hubMetrics.loopMaxMs);
+    metrics.set("loop_max_poll_ms", (int64_t)hubMetrics.loopMaxPollMs);
+    metrics.set("loop_slow", (int64_t)hubMetrics.loopSlow);
+    metrics.set("loop_passes", (int64_t)hubMetrics.loopPasses);
     hub.set("metrics", metrics);
 
+#if SMARTSTALL_LATENCY_HISTOGRAMS
+    Variant latency;
+    for (int p = 0; p < LATENCY_PHASES; ++p) {
+        const LatencyHistogram &h = latencyHistograms[p];
+        Variant phase;
+        phase.set("n", (int64_t)h.count());
+        phase.set("p50", (int64_t)h.percentile(500));
+        phase.set("p90", (int64_t)h.percentile(900));
+        phase.set("p99", (int64_t)h.percentile(990));
+        phase.set("max", (int64_t)h.max());
+        latency.set(LATENCY_PHASE_NAMES[p], phase);
+    }
+    hub.set("latency", latency);
+#endif
+
     Variant registry;
     registry.set("tracked_devices", (int)knownDevices.size());
+#if SMARTSTALL_LEDGER_SHARDED
+    registry.set("device_shards",
+                 (int)((knownDevices.size() + LEDGER_DEVICES_PER_SHARD - 1) / LEDGER_DEVICES_PER_SHARD));
+#endif
     hub.set("registry", registry);
-    root.set("hub", hub);
+    return hub;
+}
 
-    // Devices section
-    Variant devicesObj;
-    int total = knownDevices.size();
-    for (int i = 0; i < total; ++i) {
-        const DeviceInfo &d = knownDevices.at(i);
-        String key = d.address.toString();
-        Variant dv;
-        dv.set("last_seen_ms", (int64_t)d.lastSeen);
-        dv.set("last_read_ms", (int64_t)d.lastRead);
-        dv.set("failures", (int)d.failureCount);
-        if (d.hasLastStatus) {
-            dv.set("last_status", (int)d.lastStatusPublished);
-        }
-        dv.set("legacy_blocked", d.legacyProfileBlocked);
-        dv.set("legacy_retry_after_ms", (int64_t)d.legacyProfileRetryAfterMs);
-        devicesObj.set(key.c_str(), dv);
+// {"interval_s":600,"reset":false,"delta":[3,4,3],"per_hour":[18,24,18]}, counters in payload order
+static Variant counterUsageEntry(const CounterUsage &u) {
+    Variant usage;
+    usage.set("interval_s", (int64_t)u.intervalS);
+    usage.set("reset", (u.flags & COUNTER_USAGE_RESET) != 0);
+    Variant delta;
+    Variant perHour;
+    for (int i = 0; i < 3; ++i) {
+        delta.append((int64_t)u.delta[i]);
+        perHour.append((double)counterRatePerHourCenti(u.delta[i], u.intervalS) / 100.0);
     }
-    Variant devicesSection;
-    devicesSection.set("registry", devicesObj);
+    usage.set("delta", delta);
+    usage.set("per_hour", perHour);
+    return usage;
+}
 
-    // Also include last successful read payload (if any) for quick inspection
-    if (currentData.isValid) {
-        Variant last;
-        last.set("device", currentData.deviceAddress);
-        last.set("status", (int)currentData.stallStatus);
-        last.set("battery_mv", (int)currentData.batteryVoltage);
-        Variant counts;
-        counts.set("limit_switch", (int64_t)currentData.sensorCounts.limit_switch_triggers);
-        counts.set("cap_touch", (int64_t)currentData.sensorCounts.cap_touch_triggers);
-        counts.set("hall_sensor", (int64_t)currentData.sensorCounts.hall_sensor_triggers);
-        last.set("sensor_counts", counts);
-        last.set("read_ts", (int64_t)currentData.timestamp);
-        devicesSection.set("last_read", last);
+// Per-device form, kept short so a full shard stays under the ledger limit:
+// [interval_s,limit_switch,cap_touch,hall_sensor]; resets show in counts_resets
+static Variant counterUsageLedgerEntry(const CounterUsage &u) {
+    Variant usage;
+    usage.append((int64_t)u.intervalS);
+    for (int i = 0; i < 3; ++i) {
+        usage.append((int64_t)u.delta[i]);
     }
+    return usage;
+}
 
-    root.set("devices", devicesSection);
-
-    deviceToCloudLedger.set(root);
-    lastUnifiedLedgerWriteMs = now;
-    if (hubDue || force) {
-        hubMetrics.ledgerWritesHub++;
-        lastHubLedgerWriteMs = now;
+static Variant deviceLedgerEntry(const DeviceInfo &d) {
+    Variant dv;
+    dv.set("last_seen_ms", (int64_t)d.lastSeen);
+    dv.set("last_read_ms", (int64_t)d.lastRead);
+    dv.set("failures", (int)d.failureCount);
+    if (d.radio.sightings > 0) {
+        dv.set("rssi", linkRssiDbm(d.radio));
+    }
+    int connectOk = linkConnectOkPercent(d.radio);
+    if (connectOk >= 0) {
+        dv.set("connect_ok_pct", connectOk);
+    }
+    dv.set("interval_ms", (int64_t)d.pollIntervalMs);
+    if (d.hasLastStatus) {
+        dv.set("last_status", (int)d.lastStatusPublished);
+    }
+    if (d.lastUsage.flags & COUNTER_USAGE_VALID) {
+        dv.set("usage", counterUsageLedgerEntry(d.lastUsage));
+    }
+    if (d.countResets > 0) {
+        dv.set("counts_resets", (int)d.countResets);
+    }
+    dv.set("legacy_blocked", d.legacyProfileBlocked);
+    dv.set("legacy_retry_after_ms", (int64_t)d.legacyProfileRetryAfterMs);
+    return dv;
+}
+
+// Last successful read payload (if any) for quick inspection
+static void setLastReadSection(Variant &section) {
+    if (!lastReadData.isValid) return;
+    Variant last;
+    last.set("device", lastReadData.deviceAddress);
+    last.set("status", (int)lastReadData.stallStatus);
+    last.set("battery_mv", (int)lastReadData.batteryVoltage);
+    Variant counts;
+    counts.set("limit_switch", (int64_t)lastReadData.sensorCounts.limit_switch_triggers);
+    counts.set("cap_touch", (int64_t)lastReadData.sensorCounts.cap_touch_triggers);
+    counts.set("hall_sensor", (int64_t)lastReadData.sensorCounts.hall_sensor_triggers);
+    last.set("sensor_counts", counts);
+    last.set("read_ts", (int64_t)lastReadData.timestamp);
+    if (lastReadData.usage.flags & COUNTER_USAGE_VALID) {
+        last.set("usage", counterUsageEntry(lastReadData.usage));
+    }
+    section.set("last_read", last);
+}
+
+static Variant ledgerRoot(unsigned long now) {
+    Variant root;
+    root.set("ts_ms", (int64_t)now);
+    if (Time.isValid()) {
+        root.set("time", Time.format(TIME_FORMAT_ISO8601_FULL));
+    }
+    root.set("hub", hubLedgerSection(now));
+    return root;
+}
+
+#if SMARTSTALL_LEDGER_SHARDED
+// Re-serialize the shard's dirty entries into its cached Variant and write the shard ledger
+static void writeDeviceShard(int shard, unsigned long now) {
+    ledgerDirtyShards &= ~(1u << shard);
+    Variant &devicesObj = deviceShardData[shard];
+    int first = shard * LEDGER_DEVICES_PER_SHARD;
+    int last = min((int)knownDevices.size(), first + LEDGER_DEVICES_PER_SHARD);
+    for (int i = first; i < last; ++i) {
+        DeviceInfo &d = knownDevices.at(i);
+        if (!d.ledgerDirty) continue;
+        d.ledgerDirty = false;
+        d.ledgerLastSeen = d.lastSeen;
+        d.ledgerRssi = linkRssiDbm(d.radio);
+        devicesObj.set(d.address.toString().c_str(), deviceLedgerEntry(d));
+    }
+    Variant root;
+    root.set("ts_ms", (int64_t)now);
+    root.set("shard", shard);
+    root.set("registry", devicesObj);
+    int err = deviceShardLedgers[shard].set(root);
+    if (err < 0) {
+        Log.warn("Ledger %s%d write failed (%d)", DEVICE_SHARD_LEDGER_PREFIX, shard, err);
+    }
+    hubMetrics.ledgerWritesDevices++;
+}
+
+// One ledger write per LEDGER_MIN_GAP_MS. The hub ledger is pending when its period is due or a read
+// completed (force, which also skips the gap); it alternates with dirty shards (round-robin) so a
+// steady stream of reads cannot starve the device entries.
+void writeLedgers(bool force) {
+    if (!ledgersInitialized) return;
+    unsigned long now = millis();
+    if (force || (now - lastHubLedgerWriteMs) >= HUB_LEDGER_PERIOD_MS) {
+        hubLedgerPending = true;
+    }
+    bool okGap = ((now - lastUnifiedLedgerWriteMs) >= LEDGER_MIN_GAP_MS);
+    if (!hubLedgerPending && !ledgerDirtyShards) return;
+    if (!force && !okGap) return;
+    lastUnifiedLedgerWriteMs = now;
+
+    uint32_t dirty = ledgerDirtyShards;
+    if (hubLedgerPending && (!dirty || lastLedgerWriteWasShard)) {
+        Variant root = ledgerRoot(now);
+        Variant devicesSection;
+        setLastReadSection(devicesSection);
+        root.set("devices", devicesSection);
+        deviceToCloudLedger.set(root);
+        hubMetrics.ledgerWritesHub++;
+        lastHubLedgerWriteMs = now;
+        hubLedgerPending = false;
+        lastLedgerWriteWasShard = false;
+        return;
+    }
+    for (int n = 0; n < LEDGER_DEVICE_SHARDS; ++n) {
+        int shard = (nextLedgerShard + n) % LEDGER_DEVICE_SHARDS;
+        if (dirty & (1u << shard)) {
+            writeDeviceShard(shard, now);
+            nextLedgerShard = (shard + 1) % LEDGER_DEVICE_SHARDS;
+            lastLedgerWriteWasShard = true;
+            return;
+        }
+    }
+}
+#else
+void writeLedgers(bool force) {
+    if (!ledgersInitialized) return;
+    unsigned long now = millis();
+    bool hubDue = ((now - lastHubLedgerWriteMs) >= HUB_LEDGER_PERIOD_MS);
+    bool okGap = ((now - lastUnifiedLedgerWriteMs) >= LEDGER_MIN_GAP_MS);
+    if (!force && !hubDue && !devicesLedgerDirty) return;
+    if (!force && !okGap) return;
+
+    Variant root = ledgerRoot(now);
+
+    // Devices section
+    Variant devicesObj;
+    int total = knownDevices.size();
+    for (int i = 0; i < total; ++i) {
+        const DeviceInfo &d = knownDevices.at(i);
+        String key = d.address.toString();
+        devicesObj.set(key.c_str(), deviceLedgerEntry(d));
+    }
+    Variant devicesSection;
+    devicesSection.set("registry", devicesObj);
+    setLastReadSection(devicesSection);
+    root.set("devices", devicesSection);
+
+    deviceToCloudLedger.set(root);
+    lastUnifiedLedgerWriteMs = now;
+    if (hubDue || force) {
+        hubMetrics.ledgerWritesHub++;
+        lastHubLedgerWriteMs = now;
     }
     if (devicesLedgerDirty || force) {
         hubMetrics.ledgerWritesDevices++;
         devicesLedgerDirty = false;
     }
 }
+#endif
 
-// Status value definitions
-const char* getStatusString(uint16_t status) {
-    switch(status) {
-        case 0: return "UNKNOWN";             // Initial/undefined state
-        case 1: return "INIT";                // System initializing or idle
-        case 2: return "LOCKED";              // Active locking sequence
-        case 3: return "UNLOCKED";            // Active unlocking sequence
-        case 4: return "SLEEP";               // Entering deep sleep mode
-        case 5: return "PRE_SLEEP";           // 20-min idle; peripheral disconnecting before sleep (see BLUETOOTH_API.md)
-        default: return "INVALID";
+// When writeLedgers(false) next has something to write
+static void addLedgerDeadline(LoopDeadline &next) {
+    if (!ledgersInitialized) {
+        return; // maybeInitLedgers() waits for the cloud, which has no callback: rechecked each capped sleep
     }
+#if SMARTSTALL_LEDGER_SHARDED
+    bool pending = hubLedgerPending || ledgerDirtyShards;
+#else
+    bool pending = devicesLedgerDirty;
+#endif
+    unsigned long gapEnds = lastUnifiedLedgerWriteMs + LEDGER_MIN_GAP_MS;
+    next.at(pending ? gapEnds : LoopDeadline::later(lastHubLedgerWriteMs + HUB_LEDGER_PERIOD_MS, gapEnds));
 }
 
 // Function declarations
 void onScanResultReceived(const BleScanResult &scanResult);
 void onConnected(const BlePeerDevice &peer);
 void onDisconnected(const BlePeerDevice &peer);
+void processBleEvents();
+static void handleConnected(PollLink &link, const BlePeerDevice &connectedPeer);
 // Notifications are not used in the simplified cycle-through design (single read per connection)
-void discoverSmartStallServices();
-void readAllCharacteristics();
-void publishSmartStallData();
-void resetConnection();
+static void discoverSmartStallServices(PollLink &link); // one HUB_DISCOVERING step
+static void readAllCharacteristics(PollLink &link);     // one HUB_READING_DATA step
+void publishSmartStallData(const SmartStallData &data, bool urgent);
+static void publishPendingAdvUpdates();
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+static void flushPublishBatch();
+#endif
+#if SMARTSTALL_EVENT_QUEUE
+static void openEventQueue();
+static void drainEventQueue(unsigned long now);
+#endif
+#if SMARTSTALL_ROLLUPS
+static void closeDueRollups();
+static void publishRollups(unsigned long now);
+#endif
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+static void openRegistryCheckpoint();
+static void checkpointRegistry(unsigned long now);
+#endif
+static void resetConnection(PollLink &link);
+
+// Blocking scan (BLE.setScanTimeout) delivering results to onScanResultReceived
+static void startSmartStallScan() {
+    hubMetrics.scansStarted++;
+#if SMARTSTALL_CAPTURE
+    unsigned long scanStart = millis();
+    uint32_t reportsBefore = scanResultsSeen.load(std::memory_order_relaxed);
+#endif
+#if SMARTSTALL_STACK_SCAN_FILTER
+    BleScanFilter filter;
+    filter.deviceName(SMARTSTALL_DEVICE_NAME);
+    BLE.scanWithFilter(filter, onScanResultReceived);
+#else
+    BLE.scan(onScanResultReceived);
+#endif
+#if SMARTSTALL_CAPTURE
+    inputCapture.scan((uint32_t)scanStart, (uint32_t)(millis() - scanStart),
+                      scanResultsSeen.load(std::memory_order_relaxed) - reportsBefore);
+#endif
+}
+
+#if SMARTSTALL_LATENCY_HISTOGRAMS
+// Cloud function latency_reset: clear every latency histogram (the argument is ignored); returns the
+// number of samples dropped
+static int latencyResetCommand(String arg) {
+    (void)arg;
+    int64_t dropped = 0;
+    for (LatencyHistogram &h : latencyHistograms) {
+        dropped += h.count();
+        h.reset();
+    }
+    Log.info("Latency histograms reset (%ld samples)", (long)dropped);
+    return dropped > 0x7FFFFFFF ? 0x7FFFFFFF : (int)dropped;
+}
+#endif
+
+#if SMARTSTALL_TRACE_LEVEL > TRACE_LEVEL_OFF
+// One trace record as a log line: "<ms> <address or -> <message>"
+static void formatTraceRecord(const TraceRecord &r, char *out, size_t size) {
+    char addr[18] = "-";
+    if (r.device != TRACE_NO_DEVICE && r.device < knownDevices.size()) {
+        String a = knownDevices.at(r.device).address.toString();
+        snprintf(addr, sizeof(addr), "%s", a.c_str());
+    }
+    int n = snprintf(out, size, "%10lu %s ", (unsigned long)r.ms, addr);
+    if (n < 0 || (size_t)n >= size) return;
+    if (r.event < TRACE_EVENTS) {
+        snprintf(out + n, size - n, TRACE_FORMATS[r.event], (long)r.a, (long)r.b);
+    } else {
+        snprintf(out + n, size - n, "event %u (%ld, %ld)", (unsigned)r.event, (long)r.a, (long)r.b);
+    }
+}
+
+#if SMARTSTALL_TRACE_ECHO
+static void echoTraceRecord(const TraceRecord &r) {
+    char line[128];
+    formatTraceRecord(r, line, sizeof(line));
+    Log.info("%s", line);
+}
+#endif
+
+// Cloud function trace_dump: log the newest N records ("" or 0 = all), oldest first; "clear" empties the
+// ring. Returns the number of records logged (or cleared).
+static int traceDumpCommand(String arg) {
+    if (arg == "clear") {
+        int n = (int)traceRing.size();
+        traceRing.clear();
+        return n;
+    }
+    size_t total = traceRing.size();
+    long want = arg.toInt();
+    size_t n = (want > 0 && (size_t)want < total) ? (size_t)want : total;
+    Log.info("Trace: %u of %u records (%lu overwritten)", (unsigned)n, (unsigned)total,
+             (unsigned long)traceRing.overwritten());
+    char line[128];
+    for (size_t i = total - n; i < total; ++i) {
+        formatTraceRecord(traceRing.at(i), line, sizeof(line));
+        Log.info("%s", line);
+    }
+    return (int)n;
+}
+#endif
+
+#if SMARTSTALL_CAPTURE
+// Start this boot's capture (the last one becomes ".prev") with the clock and cloud state it starts from
+static void openInputCapture() {
+    if (!inputCapture.open(SMARTSTALL_CAPTURE_PATH, SMARTSTALL_CAPTURE_PATH ".prev", SMARTSTALL_CAPTURE_MAX_BYTES)) {
+        Log.warn("Input capture: cannot create %s", SMARTSTALL_CAPTURE_PATH);
+        return;
+    }
+    unsigned long now = millis();
+    captureClockValid = Time.isValid();
+    captureClockMs = (uint32_t)now;
+    captureClockUnix = captureClockValid ? (uint32_t)Time.now() : 0;
+    inputCapture.clock(captureClockMs, captureClockUnix, captureClockValid);
+    captureCloudUp = Particle.connected();
+    inputCapture.cloud((uint32_t)now, captureCloudUp);
+    captureLastFlushMs = now;
+    Log.info("Input capture: recording to %s", SMARTSTALL_CAPTURE_PATH);
+}
+
+// Commit everything captured so far, marking how far the capture covers
+void flushInputCapture() {
+    inputCapture.mark((uint32_t)millis());
+    inputCapture.flush(true);
+}
+
+// Once per loop() pass: record cloud connectivity changes and Time being set or stepped (more than a
+// second off the running clock), and commit the capture every CAPTURE_FLUSH_INTERVAL_MS
+static void captureTick(unsigned long now) {
+    cloudConnected();
+    bool valid = Time.isValid();
+    uint32_t unixTime = valid ? (uint32_t)Time.now() : 0;
+    uint32_t expected = captureClockUnix + ((uint32_t)now - captureClockMs) / 1000;
+    if (valid != captureClockValid || (valid && (unixTime > expected + 1 || unixTime + 1 < expected))) {
+        captureClockValid = valid;
+        captureClockMs = (uint32_t)now;
+        captureClockUnix = unixTime;
+        inputCapture.clock(captureClockMs, captureClockUnix, captureClockValid);
+    }
+    if (now - captureLastFlushMs >= CAPTURE_FLUSH_INTERVAL_MS) {
+        captureLastFlushMs = now;
+        flushInputCapture();
+    }
+}
+
+// The SmartStall characteristics in the table BLE.connect() discovered, as CaptureAttr bits
+static uint8_t captureConnectTable(BlePeerDevice &peer) {
+    BleCharacteristic ch;
+    return (peer.getCharacteristicByUUID(ch, STALL_STATUS_CHAR_UUID) ? 1 << CAPTURE_ATTR_STATUS : 0)
+        | (peer.getCharacteristicByUUID(ch, BATTERY_VOLTAGE_CHAR_UUID) ? 1 << CAPTURE_ATTR_BATTERY : 0)
+        | (peer.getCharacteristicByUUID(ch, SENSOR_COUNTS_CHAR_UUID) ? 1 << CAPTURE_ATTR_COUNTS : 0);
+}
+
+static void captureServices(BlePeerDevice &peer, unsigned long startMs, const Vector<BleService> &services) {
+    bool smartstall = false;
+    for (const BleService &service : services) {
+        smartstall = smartstall || service.UUID() == SMARTSTALL_SERVICE_UUID;
+    }
+    BleAddress addr = peer.address();
+    inputCapture.services((uint32_t)startMs, findDeviceIndex(addr), addr, (uint32_t)(millis() - startMs),
+                          services.size(), smartstall);
+}
+
+static void captureCharacteristics(BlePeerDevice &peer, unsigned long startMs,
+                                   const Vector<BleCharacteristic> &characteristics) {
+    uint8_t props[CAPTURE_ATTRS] = {0, 0, 0};
+    for (const BleCharacteristic &characteristic : characteristics) {
+        BleUuid cu = characteristic.UUID();
+        uint8_t pr = (uint8_t)characteristic.properties();
+        if (cu == STALL_STATUS_CHAR_UUID) { props[CAPTURE_ATTR_STATUS] = pr; }
+        else if (cu == BATTERY_VOLTAGE_CHAR_UUID) { props[CAPTURE_ATTR_BATTERY] = pr; }
+        else if (cu == SENSOR_COUNTS_CHAR_UUID) { props[CAPTURE_ATTR_COUNTS] = pr; }
+    }
+    BleAddress addr = peer.address();
+    inputCapture.characteristics((uint32_t)startMs, findDeviceIndex(addr), addr, (uint32_t)(millis() - startMs),
+                                 characteristics.size(), props);
+}
+
+// Cloud function capture_dump: log up to CAPTURE_DUMP_CHUNK bytes of the capture from a byte offset
+// ("" = 0; "prev <offset>" for the previous boot's) as "CAP <offset> <hex>" lines, which host/replay
+// reassembles. The current capture is committed first. Returns the offset after the last byte logged
+// (the file size once done), -1 if unreadable.
+static int captureDumpCommand(String arg) {
+    const char *path = SMARTSTALL_CAPTURE_PATH;
+    if (arg.startsWith("prev")) {
+        path = SMARTSTALL_CAPTURE_PATH ".prev";
+        arg = arg.substring(4);
+    } else {
+        inputCapture.flush(true);
+    }
+    long offset = arg.toInt();
+    if (offset < 0) offset = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (lseek(fd, offset, SEEK_SET) != (off_t)offset) {
+        close(fd);
+        return -1;
+    }
+    uint8_t chunk[48];
+    char hex[sizeof(chunk) * 2 + 1];
+    size_t logged = 0;
+    while (logged < CAPTURE_DUMP_CHUNK) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; ++i) {
+            snprintf(hex + 2 * i, 3, "%02x", chunk[i]);
+        }
+        Log.info("CAP %08lx %s", (unsigned long)offset, hex);
+        offset += n;
+        logged += (size_t)n;
+    }
+    close(fd);
+    return (int)offset;
+}
+#endif
 
 // setup() runs once, when the device is first turned on
 void setup() {
@@ -471,566 +1684,1659 @@ void setup() {
     // Set up connection callbacks
     BLE.onConnected(onConnected);
     BLE.onDisconnected(onDisconnected);
+#if SMARTSTALL_LATENCY_HISTOGRAMS
+    Particle.function("latency_reset", latencyResetCommand);
+#endif
+#if SMARTSTALL_TRACE_LEVEL > TRACE_LEVEL_OFF
+    Particle.function("trace_dump", traceDumpCommand);
+#endif
+#if SMARTSTALL_CAPTURE
+    Particle.function("capture_dump", captureDumpCommand);
+#endif
+    if (!loopWakeSemaphore && os_semaphore_create(&loopWakeSemaphore, 1, 0) != 0) {
+        loopWakeSemaphore = nullptr; // loop() falls back to delay() until its deadline
+    }
     
-    // Initialize data structure
-    currentData.isValid = false;
-    currentData.timestamp = 0;
-    currentData.stallStatus = 0;
-    currentData.batteryVoltage = 0;
-    currentData.sensorCounts.limit_switch_triggers = 0;
-    currentData.sensorCounts.cap_touch_triggers = 0;
-    currentData.sensorCounts.hall_sensor_triggers = 0;
+    // Initialize data structures
+    for (PollLink &link : pollLinks) {
+        link.data.isValid = false;
+    }
+    lastReadData.isValid = false;
+
+#if SMARTSTALL_EVENT_QUEUE
+    openEventQueue();
+#endif
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+    openRegistryCheckpoint();
+#endif
+#if SMARTSTALL_CAPTURE
+    openInputCapture();
+#endif
     
     Log.info("Starting BLE scan for SmartStall devices...");
-    currentState = HUB_SCANNING;
     lastScanTime = millis();
 }
 
-// loop() runs over and over again, as quickly as it can execute.
-void loop() {
-    unsigned long now = millis();
+// Iteration time of loop() without its idle delay. pollPath: the iteration ran discovery/reads.
+static void noteLoopTime(unsigned long startMs, bool pollPath) {
+    uint32_t ms = (uint32_t)(millis() - startMs);
+    if (ms > hubMetrics.loopMaxMs) hubMetrics.loopMaxMs = ms;
+    if (pollPath && ms > hubMetrics.loopMaxPollMs) hubMetrics.loopMaxPollMs = ms;
+    if (ms > LOOP_SLOW_MS) hubMetrics.loopSlow++;
+}
 
-    maybeInitLedgers();
-    writeUnifiedLedger(false);
+// How long loop() may sleep: until the earliest timer the next pass compares against millis(), capped
+static unsigned long nextLoopSleepMs() {
+    LoopDeadline next(millis(), SMARTSTALL_LOOP_MAX_SLEEP_MS);
+    if (!bleEvents.empty()) {
+        next.dueNow(); // e.g. results of the scan this pass ran
+    }
+    addLedgerDeadline(next);
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+    if (!publishBatch.empty()) {
+        next.at(publishBatch.dueAt());
+    }
+#endif
+    bool idle = pollLinksIdle();
+    if (idle) {
+        if (advPublishPendingCount > 0) {
+            next.dueNow();
+        }
+#if SMARTSTALL_EVENT_QUEUE
+        // Offline the queue waits for the cloud, which has no callback: rechecked each capped sleep
+        if (!eventQueue.empty() && cloudConnected()) {
+            next.after(lastEventQueueDrainMs, EVENT_QUEUE_DRAIN_INTERVAL_MS);
+        }
+#endif
+#if SMARTSTALL_ROLLUPS
+        // Window ends follow the wall clock and are caught by the capped sleep
+        if (rollupsPendingCount > 0 && cloudConnected()) {
+            next.after(lastRollupPublishMs, ROLLUP_PUBLISH_INTERVAL_MS);
+        }
+#endif
+    }
+    if (freePollLink()) {
+        if (hasPendingAddress) {
+            next.at(LoopDeadline::later(pendingAddressTimestamp + PENDING_CONNECT_DEBOUNCE_MS, bleQuietUntil));
+        } else {
+            if (idle) {
+                next.at(LoopDeadline::later(lastGlobalScan + GLOBAL_SCAN_INTERVAL_MS, bleQuietUntil));
+                next.at(LoopDeadline::later(lastScanTime + SCAN_REFRESH_INTERVAL_MS + 1, bleQuietUntil));
+            }
+            if (!pollQueue.empty()) {
+                next.at(LoopDeadline::later(pollQueue.topDueAt(), bleQuietUntil));
+            }
+        }
+    }
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        const PollLink &link = pollLinks[i];
+        switch (link.state) {
+            case HUB_SCANNING:
+                break;
+            case HUB_CONNECTING:
+                next.at(LoopDeadline::later(link.nextConnectAttemptAt, bleQuietUntil));
+                next.at(link.connectionStartTime + CONNECT_WINDOW_MS + 1);
+                break;
+            case HUB_DISCOVERING:
+            case HUB_READING_DATA:
+                next.at(link.nextPollStepAt);
+                break;
+            default:
+                next.dueNow();
+                break;
+        }
+    }
+    return next.sleepMs();
+}
 
-    // Periodic global scan to discover new devices while idle or even during polling cycle
-    if (now - lastGlobalScan >= GLOBAL_SCAN_INTERVAL_MS && currentState == HUB_SCANNING && !hasPendingAddress
-            && now >= bleQuietUntil) {
-        Log.info("Periodic global scan starting (interval %lu ms)", GLOBAL_SCAN_INTERVAL_MS);
-        BLE.scan(onScanResultReceived);
-        hubMetrics.scansStarted++;
-        lastGlobalScan = now;
+// Sleep until the next deadline; a BLE callback (loopWakeSemaphore) ends the sleep early
+static void sleepUntilNextPass() {
+    unsigned long ms = nextLoopSleepMs();
+    if (ms == 0) {
+        return;
+    }
+    if (loopWakeSemaphore) {
+        os_semaphore_take(loopWakeSemaphore, (system_tick_t)ms, false);
+    } else {
+        delay(ms);
     }
+}
 
-    // In base scanning/idle state select next device to poll if none pending
-    if (currentState == HUB_SCANNING && !hasPendingAddress && now >= bleQuietUntil) {
-        int nextIdx = selectNextDeviceToPoll();
-        if (nextIdx >= 0) {
-            const DeviceInfo &d = knownDevices.at(nextIdx);
-            pendingAddress = d.address;
-            hasPendingAddress = true;
-            pendingAddressTimestamp = now; // will debounce then connect
-            Log.info("Scheduled poll of device %s", d.address.toString().c_str());
-        }
+static void wakeLoop() {
+    if (loopWakeSemaphore) {
+        os_semaphore_give(loopWakeSemaphore, false);
     }
+}
 
-    switch(currentState) {
+// Advance one poll link. connectIssued: a link already called BLE.connect() this pass.
+static void servicePollLink(PollLink &link, bool &connectIssued) {
+    switch (link.state) {
         case HUB_SCANNING:
-            // Avoid overlapping scan with pending connect or post-disconnect stack cooldown (assert risk)
-            if (!hasPendingAddress && millis() >= bleQuietUntil && millis() - lastScanTime > 15000) {
-                Log.info("Opportunistic scan tick (light refresh)");
-                BLE.scan(onScanResultReceived);
-                hubMetrics.scansStarted++;
-                lastScanTime = millis();
-            }
-            // If we have a pending address from registry or scan callback, attempt connection after short debounce
-            if (hasPendingAddress && (millis() - pendingAddressTimestamp >= PENDING_CONNECT_DEBOUNCE_MS)
-                    && millis() >= bleQuietUntil) {
-                String pendingStr = pendingAddress.toString();
-                Log.info("Initiating deferred connection to %s", pendingStr.c_str());
-                hasPendingAddress = false; // consume it
-                expectingUserInitiatedDisconnect = false;
-                BLE.stopScanning();
-                connectTargetAddress = pendingAddress;
-                connectAttemptIndex = 0;
-                nextConnectAttemptAt = millis() + POST_STOP_SCAN_SETTLE_MS;
-                currentState = HUB_CONNECTING;
-                connectionStartTime = millis();
-            }
             break;
-            
+
         case HUB_CONNECTING: {
             // Manual detection in case callback not fired
-            if (peer.connected() && currentState == HUB_CONNECTING) {
+            if (link.peer.connected()) {
                 Log.warn("Connected detected without callback; proceeding to discovery");
-                onConnected(peer);
-            }
-            if (currentState != HUB_CONNECTING) {
+                handleConnected(link, link.peer);
                 break;
             }
             // Total window for settle + staggered retries (do not hammer BLE.connect in one loop tick)
-            if (millis() - connectionStartTime > 20000) {
+            if (millis() - link.connectionStartTime > CONNECT_WINDOW_MS) {
                 Log.warn("Connection timeout (20s), marking failure and returning to scan");
-                int idx = findDeviceIndex(connectTargetAddress);
-                if (idx >= 0) {
-                    knownDevices.at(idx).failureCount = (uint8_t)min<int>(knownDevices.at(idx).failureCount + 1, 10);
-                    knownDevices.at(idx).lastRead = millis();
-                }
-                resetConnection();
+                notePollFailure(findDeviceIndex(link.target), true);
+                resetConnection(link);
                 break;
             }
-            if (millis() < nextConnectAttemptAt) {
+            if (millis() < link.nextConnectAttemptAt) {
                 break;
             }
-            if (connectAttemptIndex >= MAX_BLE_CONNECT_ATTEMPTS) {
-                String failStr = connectTargetAddress.toString();
+            if (link.connectAttemptIndex >= link.connectAttemptLimit) {
+                String failStr = link.target.toString();
                 Log.error("All connect attempts failed for %s", failStr.c_str());
-                int idx = findDeviceIndex(connectTargetAddress);
-                if (idx >= 0) {
-                    knownDevices.at(idx).failureCount = (uint8_t)min<int>(knownDevices.at(idx).failureCount + 1, 10);
-                    knownDevices.at(idx).lastRead = millis();
-                }
-                resetConnection();
+                notePollFailure(findDeviceIndex(link.target), true);
+                resetConnection(link);
                 break;
             }
-            connectAttemptIndex++;
-            {
-                String tgtStr = connectTargetAddress.toString();
-                Log.info("Connect attempt %d/%d to %s", connectAttemptIndex, MAX_BLE_CONNECT_ATTEMPTS, tgtStr.c_str());
+            // Shared with the other links: one connect per pass, none while another link's teardown cools down
+            // (including a drop earlier in this pass, whose event arms the cooldown)
+            processBleEvents();
+            if (link.state != HUB_CONNECTING || connectIssued || millis() < bleQuietUntil) {
+                break;
             }
+            connectIssued = true;
+            link.connectAttemptIndex++;
+            TRACE_INFO(TRACE_CONNECT_ATTEMPT, findDeviceIndex(link.target), link.connectAttemptIndex,
+                       link.connectAttemptLimit);
             hubMetrics.connectsAttempted++;
-            peer = BLE.connect(connectTargetAddress);
-            // onDisconnected can run during connect and clear HUB_CONNECTING — do not assert stack further
-            if (currentState != HUB_CONNECTING) {
-                String tgtStr = connectTargetAddress.toString();
+            unsigned long connectStart = millis();
+            if (link.connectAttemptIndex == 1) {
+                noteLatency(LATENCY_SCAN_TO_CONNECT, connectStart - link.scheduledAtMs);
+            }
+            if (cooldownGapOpen) {
+                noteLatency(LATENCY_COOLDOWN, connectStart - cooldownGapStartMs);
+                cooldownGapOpen = false;
+            }
+            link.peer = BLE.connect(link.target);
+            {
+                noteLatency(LATENCY_CONNECT, millis() - connectStart);
+                bool connected = link.peer.connected();
+                if (!connected) {
+                    hubMetrics.connectFailMs += millis() - connectStart;
+                }
+                int targetIdx = findDeviceIndex(link.target);
+                TRACE_INFO(TRACE_CONNECT_RESULT, targetIdx, connected, millis() - connectStart);
+#if SMARTSTALL_CAPTURE
+                inputCapture.connect((uint32_t)connectStart, targetIdx, link.target, (uint32_t)(millis() - connectStart),
+                                     connected, connected ? captureConnectTable(link.peer) : 0);
+#endif
+                if (targetIdx >= 0) {
+                    noteLinkConnect(knownDevices.at(targetIdx).radio, connected);
+                }
+            }
+            // Apply the callbacks that ran during connect: a disconnect ends HUB_CONNECTING — do not assert stack further
+            processBleEvents();
+            if (link.state == HUB_DISCONNECTED) {
+                String tgtStr = link.target.toString();
                 Log.warn("Connect superseded by disconnect for %s; backing off", tgtStr.c_str());
                 armBleCooldown();
                 break;
             }
-            if (peer.connected()) {
-                connectedDeviceAddress = connectTargetAddress.toString();
+            if (link.peer.connected()) {
                 hubMetrics.connectsSucceeded++;
-                onConnected(peer);
+                if (link.state == HUB_CONNECTING) {
+                    handleConnected(link, link.peer);
+                }
             } else {
-                nextConnectAttemptAt = millis() + CONNECT_RETRY_GAP_MS;
+                link.nextConnectAttemptAt = millis() + CONNECT_RETRY_GAP_MS;
             }
             break; }
-            
+
         case HUB_DISCOVERING:
-            // Discover services/characteristics, read once, publish, disconnect
-            if (peer.connected()) {
-                Log.info("Discovering SmartStall services and reading data (single-shot)...");
-                discoverSmartStallServices(); // This will perform read & disconnect
-            } else {
-                Log.warn("Lost connection during discovery");
-                resetConnection();
+        case HUB_READING_DATA:
+            // One poll step per tick: discovery, then each read, then publish and disconnect
+            if (!link.peer.connected()) {
+                Log.warn("Lost connection during %s", link.state == HUB_DISCOVERING ? "discovery" : "reads");
+                resetConnection(link);
+            } else if (millis() >= link.nextPollStepAt) {
+                if (link.state == HUB_DISCOVERING) {
+                    discoverSmartStallServices(link);
+                } else {
+                    readAllCharacteristics(link);
+                }
             }
             break;
-        
+
         case HUB_CONNECTED: // Not used in single-shot mode; fall through to disconnect
-        case HUB_READING_DATA: // Legacy state not used
-            currentState = HUB_DISCONNECTED;
+            link.state = HUB_DISCONNECTED;
             break;
-            
+
         case HUB_DISCONNECTED:
-            Log.info("Device disconnected, returning to scan mode");
-            resetConnection();
+            resetConnection(link);
             break;
     }
-    
-    delay(100); // Small delay to prevent overwhelming the system
 }
 
-// Callback when a BLE device is found during scanning
-void onScanResultReceived(const BleScanResult &scanResult) {
-    String deviceName = scanResult.advertisingData().deviceName();
-    hubMetrics.scanResultsSeen++;
-    
-    Log.info("Found device - Name: '%s', Address: %s, RSSI: %d", 
-             deviceName.c_str(), 
-             scanResult.address().toString().c_str(), 
-             scanResult.rssi());
-    
-    // Check if this device advertises the SmartStall service UUID
-    bool hasSmartStallService = false;
-    Vector<BleUuid> serviceUuids = scanResult.advertisingData().serviceUUID();
-    if (serviceUuids.size() > 0) {
-        Log.info("Device has %d advertised service UUIDs:", serviceUuids.size());
-        int svcCount = serviceUuids.size();
-        for (int i = 0; i < svcCount; i++) {
-            BleUuid serviceUuid = serviceUuids.at(i);
-            Log.info("  Service UUID %d: %s", i, serviceUuid.toString().c_str());
-            if (serviceUuid == SMARTSTALL_SERVICE_UUID) {
-                hasSmartStallService = true;
-                Log.info("  ✓ Found SmartStall service UUID!");
-            }
-        }
+// loop() runs once per deadline (sleepUntilNextPass), not on a fixed tick
+void loop() {
+    unsigned long now = millis();
+    bool pollPath = false;
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        pollPath = pollPath || pollLinks[i].state == HUB_DISCOVERING || pollLinks[i].state == HUB_READING_DATA;
     }
-    
-    // Log advertising data length for debugging
-    Log.info("Advertising data length: %d bytes", scanResult.advertisingData().length());
-    
-    // Check if this is a SmartStall device by name or service UUID
-    bool isSmartStall = false;
-    if (deviceName == "SmartStall") {
-        Log.info("SmartStall device found by name!");
-        isSmartStall = true;
-    } else if (hasSmartStallService) {
-        Log.info("SmartStall device found by service UUID!");
-        isSmartStall = true;
-    } else if (deviceName.length() == 0 && serviceUuids.size() > 0) {
-        // If no name but has services, log for debugging
-        Log.info("Unnamed device with services - might be SmartStall in different mode");
+    hubMetrics.loopPasses++;
+#if SMARTSTALL_CAPTURE
+    captureTick(now);
+#endif
+    processBleEvents();
+
+    maybeInitLedgers();
+    bool idle = pollLinksIdle();
+    if (advPublishPendingCount > 0 && idle) {
+        publishPendingAdvUpdates();
     }
-    
-    if (isSmartStall) {
-        hubMetrics.smartstallSeen++;
-        // Register or update device in registry
-        registerOrUpdateDevice(scanResult.address());
-        // If we currently have no devices pending and none connected, schedule this immediately
-        int regIdx = findDeviceIndex(scanResult.address());
-        bool legacyCooling = (regIdx >= 0 && knownDevices.at(regIdx).legacyProfileBlocked
-            && millis() < knownDevices.at(regIdx).legacyProfileRetryAfterMs);
-        if (!hasPendingAddress && currentState == HUB_SCANNING && !legacyCooling) {
-            Log.info("Queuing newly discovered SmartStall device for polling: %s", scanResult.address().toString().c_str());
-            pendingAddress = scanResult.address();
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+    if (publishBatch.due(now)) {
+        flushPublishBatch();
+    }
+#endif
+#if SMARTSTALL_EVENT_QUEUE
+    if (!eventQueue.empty() && idle) {
+        drainEventQueue(now);
+    }
+#endif
+#if SMARTSTALL_ROLLUPS
+    closeDueRollups();
+    if (rollupsPendingCount > 0 && idle) {
+        publishRollups(now);
+    }
+#endif
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+    if (idle) {
+        checkpointRegistry(now);
+    }
+#endif
+    writeLedgers(false);
+
+    // Periodic global scan to discover new devices while idle or even during polling cycle
+    if (now - lastGlobalScan >= GLOBAL_SCAN_INTERVAL_MS && idle && !hasPendingAddress
+            && now >= bleQuietUntil) {
+        TRACE_INFO(TRACE_SCAN_STARTED, -1, 1, 0);
+        startSmartStallScan();
+        lastGlobalScan = now;
+    }
+
+    // While a link is free, select the next device to poll if none pending
+    PollLink *freeLink = freePollLink();
+    if (freeLink && !hasPendingAddress && now >= bleQuietUntil) {
+        int nextIdx = selectNextDeviceToPoll();
+        if (nextIdx >= 0) {
+            const DeviceInfo &d = knownDevices.at(nextIdx);
+            pendingAddress = d.address;
             hasPendingAddress = true;
-            pendingAddressTimestamp = millis();
-        } else if (legacyCooling) {
-            Log.info("SmartStall %s in legacy-profile cooldown; not auto-queuing", scanResult.address().toString().c_str());
-        } else {
-            Log.info("Device %s registered; will be polled in rotation", scanResult.address().toString().c_str());
+            pendingAddressTimestamp = now; // will debounce then connect
         }
     }
+
+    // Avoid overlapping scan with pending connect, open links or post-disconnect stack cooldown (assert risk)
+    if (idle && !hasPendingAddress && millis() >= bleQuietUntil && millis() - lastScanTime > SCAN_REFRESH_INTERVAL_MS) {
+        TRACE_INFO(TRACE_SCAN_STARTED, -1, 0, 0);
+        startSmartStallScan();
+        lastScanTime = millis();
+    }
+    // If we have a pending address from registry or scan callback, hand it to the free link after short debounce
+    if (freeLink && hasPendingAddress && (millis() - pendingAddressTimestamp >= PENDING_CONNECT_DEBOUNCE_MS)
+            && millis() >= bleQuietUntil) {
+        hasPendingAddress = false; // consume it
+        BLE.stopScanning();
+        freeLink->state = HUB_CONNECTING;
+        freeLink->target = pendingAddress;
+        freeLink->peer = BlePeerDevice();
+        freeLink->expectingUserInitiatedDisconnect = false;
+        freeLink->connectAttemptIndex = 0;
+        freeLink->connectAttemptLimit = connectAttemptsFor(pendingAddress);
+        TRACE_INFO(TRACE_CONNECT_START, findDeviceIndex(pendingAddress), freeLink->connectAttemptLimit, 0);
+        freeLink->nextConnectAttemptAt = millis() + POST_STOP_SCAN_SETTLE_MS;
+        freeLink->connectionStartTime = millis();
+        freeLink->scheduledAtMs = pendingAddressTimestamp;
+    }
+
+    bool connectIssued = false;
+    for (int i = 0; i < pollLinkLimit; ++i) {
+        servicePollLink(pollLinks[i], connectIssued);
+    }
+    
+    noteLoopTime(now, pollPath);
+    sleepUntilNextPass();
+}
+
+// Callback when a BLE device is found during scanning (BLE thread: match and enqueue only)
+void onScanResultReceived(const BleScanResult &scanResult) {
+    scanResultsSeen.fetch_add(1, std::memory_order_relaxed);
+
+    // Fast path: match name / service UUID directly in the raw AD bytes (advert and scan response).
+    // Nothing is allocated or logged for phones, beacons and other non-SmartStall advertisers.
+    static const size_t nameLen = strlen(SMARTSTALL_DEVICE_NAME);
+    const BleAdvertisingData &adv = scanResult.advertisingData();
+    const BleAdvertisingData &sr = scanResult.scanResponse();
+    const uint8_t *svc = SMARTSTALL_SERVICE_UUID.rawBytes();
+    uint8_t match = matchSmartStallAdvertisement(adv.data(), adv.length(), svc, SMARTSTALL_DEVICE_NAME, nameLen)
+        | matchSmartStallAdvertisement(sr.data(), sr.length(), svc, SMARTSTALL_DEVICE_NAME, nameLen);
+    if (match == ADV_MATCH_NONE) {
+        return;
+    }
+    BleEvent e;
+    e.type = BLE_EVENT_SCAN_RESULT;
+    e.match = match;
+    e.rssi = scanResult.rssi();
+    e.address = scanResult.address();
+    // Optional status telemetry in the advert or scan response: may satisfy this poll without connecting
+    e.hasAdvStatus = parseSmartStallAdvStatus(adv.data(), adv.length(), svc, e.advStatus)
+        || parseSmartStallAdvStatus(sr.data(), sr.length(), svc, e.advStatus);
+#if SMARTSTALL_CAPTURE
+    e.ms = (uint32_t)millis();
+#endif
+    bleEvents.push(e);
 }
 
-// Callback when connected to a BLE device
+// Callback when connected to a BLE device (BLE thread)
 void onConnected(const BlePeerDevice &connectedPeer) {
+    BleEvent e = {};
+    e.type = BLE_EVENT_CONNECTED;
+    e.address = connectedPeer.address();
+    bleEvents.push(e);
+    wakeLoop();
+}
+
+// Callback when disconnected from a BLE device (BLE thread)
+void onDisconnected(const BlePeerDevice &disconnectedPeer) {
+    BleEvent e = {};
+    e.type = BLE_EVENT_DISCONNECTED;
+    e.address = disconnectedPeer.address();
+#if SMARTSTALL_CAPTURE
+    e.ms = (uint32_t)millis();
+#endif
+    bleEvents.push(e);
+    wakeLoop();
+}
+
+static void handleScanResult(const BleEvent &e) {
+    hubMetrics.smartstallSeen++;
+    // Register or update device in registry
+    int regIdx = registerOrUpdateDevice(e.address);
+    TRACE_INFO(TRACE_SIGHTED, regIdx, e.rssi, e.match);
+    if (regIdx >= 0) {
+        noteDeviceRssi(regIdx, e.rssi);
+        DeviceInfo &d = knownDevices.at(regIdx);
+        if (!d.detectPending) {
+            d.detectPending = true;
+            d.detectFromMs = millis();
+        }
+    }
+    if (regIdx >= 0 && e.hasAdvStatus) {
+        ingestAdvStatus(regIdx, e.advStatus);
+    }
+    // If we currently have no devices pending and none connected, schedule this immediately
+    bool legacyCooling = (regIdx >= 0 && knownDevices.at(regIdx).legacyProfileBlocked
+        && millis() < knownDevices.at(regIdx).legacyProfileRetryAfterMs);
+    // Only jump the queue when the scheduler already considers this device due (new or overdue).
+    // Others, including the rest of a burst of new devices, are served from pollQueue.
+    bool pollDue = (regIdx >= 0 && pollQueue.isDue((uint16_t)regIdx, millis()));
+#if SMARTSTALL_LINK_AWARE
+    // A weak link only jumps the queue on a strong sighting; the scheduler defers it otherwise
+    pollDue = pollDue && !linkWeakNow(knownDevices.at(regIdx), millis());
+#endif
+    PollLink *busy = pollLinkFor(e.address);
+    bool inFlight = (busy && busy->state != HUB_SCANNING);
+    if (!hasPendingAddress && freePollLink() && !legacyCooling && pollDue && !inFlight) {
+        TRACE_INFO(TRACE_SIGHTED_QUEUED, regIdx, 0, 0);
+        claimForPoll(regIdx, millis());
+        knownDevices.at(regIdx).linkDeferredSinceMs = 0;
+        pendingAddress = e.address;
+        hasPendingAddress = true;
+        pendingAddressTimestamp = millis();
+    } else if (legacyCooling) {
+        TRACE_INFO(TRACE_SIGHTED_LEGACY, regIdx, 0, 0);
+    } else {
+        TRACE_INFO(TRACE_SIGHTED_ROTATION, regIdx, 0, 0);
+    }
+}
+
+// Link to peer is up: start the poll's discovery step
+static void handleConnected(PollLink &link, const BlePeerDevice &connectedPeer) {
     String connAddr = connectedPeer.address().toString();
-    Log.info("Connected to SmartStall device: %s", connAddr.c_str());
+    TRACE_INFO(TRACE_CONNECTED, findDeviceIndex(connectedPeer.address()), 0, 0);
     
     // Store the peer for later use
-    peer = connectedPeer;
+    link.peer = connectedPeer;
     
     // Move to discovery state
-    currentState = HUB_DISCOVERING;
+    link.state = HUB_DISCOVERING;
+    link.pollStep = POLL_DISCOVER_SERVICES;
+    link.pollStepAttempt = 0;
+    link.nextPollStepAt = millis();
+    link.phaseStartMs = millis();
     
     // Initialize data structure for this device
-    currentData.deviceAddress = connectedPeer.address().toString();
-    currentData.timestamp = Time.now();
-    currentData.isValid = false;
-    currentData.stallStatus = 0;
-    currentData.batteryVoltage = 0;
-    currentData.sensorCounts.limit_switch_triggers = 0;
-    currentData.sensorCounts.cap_touch_triggers = 0;
-    currentData.sensorCounts.hall_sensor_triggers = 0;
+    SmartStallData &data = link.data;
+    data.deviceAddress = connAddr;
+    data.timestamp = Time.now();
+    data.isValid = false;
+    data.stallStatus = 0;
+    data.batteryVoltage = 0;
+    data.sensorCounts.limit_switch_triggers = 0;
+    data.sensorCounts.cap_touch_triggers = 0;
+    data.sensorCounts.hall_sensor_triggers = 0;
+    data.usage = CounterUsage();
+    link.statusRead = false;
+    link.readPartial = false;
+    link.readMissing = false;
 }
 
-// Callback when disconnected from a BLE device
-void onDisconnected(const BlePeerDevice &disconnectedPeer) {
-    String discAddr = disconnectedPeer.address().toString();
-    Log.info("Disconnected from SmartStall device: %s", discAddr.c_str());
-
-    if (expectingUserInitiatedDisconnect) {
-        expectingUserInitiatedDisconnect = false;
-    } else {
-        // Abrupt teardown: apply registry backoff so we don't BLE.connect again in ~100 ms (stack assert)
-        HubState st = currentState;
-        hubMetrics.unexpectedDisconnects++;
-        int idx = findDeviceIndex(disconnectedPeer.address());
-        if (idx < 0) {
-            idx = findDeviceIndex(connectTargetAddress);
-        }
-        if (idx >= 0 && (st == HUB_CONNECTING || st == HUB_DISCOVERING)) {
-            knownDevices.at(idx).failureCount = (uint8_t)min<int>(knownDevices.at(idx).failureCount + 1, 10);
-            knownDevices.at(idx).lastRead = millis();
-            Log.warn("Unexpected disconnect in state %d; registry backoff for %s", (int)st, discAddr.c_str());
-        }
-        armBleCooldown();
+static void handleDisconnected(const BleAddress &addr) {
+    PollLink *link = pollLinkFor(addr);
+    TRACE_INFO(TRACE_DISCONNECTED, findDeviceIndex(addr), link ? (int)link->state : -1, 0);
+    if (link && link->expectingUserInitiatedDisconnect) {
+        // The application thread disconnected and has already moved on (HUB_DISCONNECTED or free)
+        link->expectingUserInitiatedDisconnect = false;
+        return;
     }
-    currentState = HUB_DISCONNECTED;
-}
-
+    // Abrupt teardown: apply registry backoff so we don't BLE.connect again in ~100 ms (stack assert)
+    HubState st = link ? link->state : HUB_SCANNING;
+    hubMetrics.unexpectedDisconnects++;
+    int idx = findDeviceIndex(addr);
+    bool linkState = (st == HUB_CONNECTING || st == HUB_CONNECTED || st == HUB_DISCOVERING || st == HUB_READING_DATA);
+    if (idx >= 0 && linkState && st != HUB_CONNECTED) {
+        notePollFailure(idx, true);
+        String discAddr = addr.toString();
+        Log.warn("Unexpected disconnect in state %d; registry backoff for %s", (int)st, discAddr.c_str());
+    }
+    armBleCooldown();
+    if (linkState) {
+        link->state = HUB_DISCONNECTED;
+    }
+}
+
+#if SMARTSTALL_CAPTURE
+// A queued callback as a capture input: SmartStall sightings, and disconnects the hub did not ask for
+static void captureBleEvent(const BleEvent &e) {
+    if (e.type == BLE_EVENT_SCAN_RESULT) {
+        inputCapture.sighting(e.ms, findDeviceIndex(e.address), e.address, e.rssi, e.match,
+                              e.hasAdvStatus ? &e.advStatus : nullptr);
+    } else if (e.type == BLE_EVENT_DISCONNECTED) {
+        PollLink *link = pollLinkFor(e.address);
+        if (!link || !link->expectingUserInitiatedDisconnect) {
+            inputCapture.disconnect(e.ms, findDeviceIndex(e.address), e.address);
+        }
+    }
+}
+#endif
+
+// Apply everything the BLE callbacks queued, in order. Application thread only.
+void processBleEvents() {
+    BleEvent e;
+    while (bleEvents.pop(e)) {
+#if SMARTSTALL_CAPTURE
+        captureBleEvent(e);
+#endif
+        switch (e.type) {
+            case BLE_EVENT_SCAN_RESULT:
+                handleScanResult(e);
+                break;
+            case BLE_EVENT_CONNECTED: {
+                // BLE.connect() returns the peer on this thread; the event only matters if it raced ahead
+                PollLink *link = pollLinkFor(e.address);
+                if (link && link->state == HUB_CONNECTING && link->peer.connected() && link->peer.address() == e.address) {
+                    handleConnected(*link, link->peer);
+                }
+                break; }
+            case BLE_EVENT_DISCONNECTED:
+                handleDisconnected(e.address);
+                break;
+        }
+    }
+}
+
 // onDataReceived removed: notifications are no longer subscribed/used.
 
-// Discover SmartStall services and characteristics
-void discoverSmartStallServices() {
-    if (!peer.connected()) {
-        Log.warn("Not connected to device, cannot discover services");
+#if SMARTSTALL_ROLLUPS
+// Keep a closed window for publishing; one still unpublished is replaced and counted dropped
+static void stashRollup(DeviceInfo &d, const UsageRollup &closed) {
+    if (d.rollupPending) {
+        hubMetrics.rollupsDropped++;
+    } else {
+        rollupsPendingCount++;
+    }
+    d.pendingRollup = closed;
+    d.rollupPending = true;
+}
+
+// Fold a successful read (or advertised status change) into the device's rollup window
+static void noteRollupRead(int idx, const SmartStallData &data) {
+    if (idx < 0 || !Time.isValid()) return;
+    DeviceInfo &d = knownDevices.at(idx);
+    uint32_t counts[3] = {data.sensorCounts.limit_switch_triggers, data.sensorCounts.cap_touch_triggers,
+                          data.sensorCounts.hall_sensor_triggers};
+    UsageRollup closed;
+    if (rollupAddRead(d.rollup, (uint32_t)data.timestamp, data.stallStatus, isOccupiedStatus(data.stallStatus),
+            data.batteryVoltage, counts, SMARTSTALL_ROLLUP_WINDOW_S, closed)) {
+        stashRollup(d, closed);
+    }
+}
+
+// Once the wall clock passes the shared window end, close every device's window
+static void closeDueRollups() {
+    if (!Time.isValid()) return;
+    uint32_t now = (uint32_t)Time.now();
+    if (now < rollupNextCloseS) return;
+    rollupNextCloseS = rollupWindowStart(now, SMARTSTALL_ROLLUP_WINDOW_S) + SMARTSTALL_ROLLUP_WINDOW_S;
+    int total = knownDevices.size();
+    for (int i = 0; i < total; ++i) {
+        DeviceInfo &d = knownDevices.at(i);
+        UsageRollup closed;
+        if (rollupCloseDue(d.rollup, now, SMARTSTALL_ROLLUP_WINDOW_S, closed)) {
+            stashRollup(d, closed);
+        }
+    }
+}
+
+// Publish pending windows in registry order, as many as fit in one smartstall/rollup event, at most one
+// event per ROLLUP_PUBLISH_INTERVAL_MS. Unacknowledged ones are sent again with the next event.
+static void publishRollups(unsigned long now) {
+    if (!cloudConnected() || (now - lastRollupPublishMs) < ROLLUP_PUBLISH_INTERVAL_MS) {
         return;
     }
-    // Reset characteristic handles from previous device to avoid accidental reuse
-    stallStatusChar = BleCharacteristic();
-    batteryVoltageChar = BleCharacteristic();
-    sensorCountsChar = BleCharacteristic();
-    
-    Log.info("Discovering SmartStall services and characteristics...");
-    
-    // Discover all services (retry limited times if empty)
-    const int MAX_SERVICE_DISCOVERY_RETRIES = 2;
-    Vector<BleService> services;
-    for (int attempt = 0; attempt <= MAX_SERVICE_DISCOVERY_RETRIES; ++attempt) {
-        services = peer.discoverAllServices();
-        if (services.size() > 0) break;
-        Log.warn("Service discovery returned zero services (attempt %d)", attempt + 1);
-        delay(200);
-    }
-    Log.info("Found %d services total", services.size());
-    
-    bool serviceFound = false;
-    for (const BleService& service : services) {
-        if (service.UUID() == SMARTSTALL_SERVICE_UUID) {
-            Log.info("Found SmartStall service (%s)", service.UUID().toString().c_str());
-            serviceFound = true;
-            // Discover its characteristics
-            Vector<BleCharacteristic> characteristics = peer.discoverCharacteristicsOfService(service);
-            Log.info("Found %d characteristics in SmartStall service", characteristics.size());
-            for (const BleCharacteristic& characteristic : characteristics) {
-                BleUuid cu = characteristic.UUID();
-                if (cu == STALL_STATUS_CHAR_UUID) { stallStatusChar = characteristic; Log.info("✓ Stall status characteristic"); }
-                else if (cu == BATTERY_VOLTAGE_CHAR_UUID) { batteryVoltageChar = characteristic; Log.info("✓ Battery voltage characteristic"); }
-                else if (cu == SENSOR_COUNTS_CHAR_UUID) { sensorCountsChar = characteristic; Log.info("✓ Sensor counts characteristic"); }
-                else { Log.info("Other characteristic: %s", cu.toString().c_str()); }
-            }
+    lastRollupPublishMs = now;
+    rollupBatch.clear();
+    int total = knownDevices.size();
+    int end = 0;
+    for (; end < total; ++end) {
+        const DeviceInfo &d = knownDevices.at(end);
+        if (!d.rollupPending) continue;
+        String addr = d.address.toString();
+        RollupItem item = {addr.c_str(), SMARTSTALL_ROLLUP_WINDOW_S, d.pendingRollup};
+        char text[ROLLUP_ITEM_MAX];
+        JsonWriter json(text, sizeof(text));
+        writeJsonFields(json, ROLLUP_ITEM_FIELDS, item);
+        if (!rollupBatch.add(text, json.length(), false, now)) {
             break;
         }
     }
-    if (!serviceFound) {
-        Log.warn("SmartStall service UUID not found in discovered services");
+    if (rollupBatch.empty()) {
+        return;
     }
+    const char *payload = rollupBatch.finish();
+    Log.info("Publishing SmartStall rollups (%u devices, %u bytes)",
+        (unsigned)rollupBatch.count(), (unsigned)rollupBatch.finishedLength());
+    if (!Particle.publish("smartstall/rollup", payload, PRIVATE)) {
+        return;
+    }
+    for (int i = 0; i < end; ++i) {
+        DeviceInfo &d = knownDevices.at(i);
+        if (!d.rollupPending) continue;
+        d.rollupPending = false;
+        rollupsPendingCount--;
+        hubMetrics.rollupsPublished++;
+    }
+}
+#endif
 
-    // Verify what we found
-    Log.info("Discovery summary:");
-    Log.info("- Stall Status Char Valid: %s", stallStatusChar.isValid() ? "YES" : "NO");
-    Log.info("- Battery Voltage Char Valid: %s", batteryVoltageChar.isValid() ? "YES" : "NO");
-    Log.info("- Sensor Counts Char Valid: %s", sensorCountsChar.isValid() ? "YES" : "NO");
-
-    const char *profileRejectReason = nullptr;
-    bool didRead = false;
+// Publish data when status or counts differ from what was last published for device idx
+// (always publishes when the device is not in the registry). A published snapshot gets its counter
+// usage since the device's previous one.
+static void publishDataIfChanged(int idx, SmartStallData &data) {
+    bool urgent = true;
+    if (idx >= 0) {
+        DeviceInfo &d = knownDevices.at(idx);
+        bool statusChanged = (!d.hasLastSubmitted || d.lastStatusSubmitted != data.stallStatus);
+        bool countsChanged = (!d.hasLastSubmitted
+            || d.lastCountsSubmitted[0] != data.sensorCounts.limit_switch_triggers
+            || d.lastCountsSubmitted[1] != data.sensorCounts.cap_touch_triggers
+            || d.lastCountsSubmitted[2] != data.sensorCounts.hall_sensor_triggers);
+        if (!statusChanged && !countsChanged) {
+            TRACE_INFO(TRACE_UNCHANGED, idx, 0, 0);
+            return;
+        }
+#if SMARTSTALL_ROLLUPS == ROLLUPS_INSTEAD
+        if (!statusChanged) {
+            TRACE_INFO(TRACE_COUNTS_ROLLED_UP, idx, 0, 0);
+            return;
+        }
+#endif
+        TRACE_INFO(TRACE_CHANGE_DETECTED, idx, statusChanged, countsChanged);
+        urgent = statusChanged;
+    }
 
-    if (!serviceFound) {
-        profileRejectReason = "smartstall service uuid not found";
-    } else {
-        profileRejectReason = validateV12ReadOnlyProfile();
-        if (profileRejectReason) {
-            Log.warn("SmartStall GATT rejected (hub: no NOTIFY/INDICATE on status/battery/counts): %s", profileRejectReason);
+    if (idx >= 0) {
+        DeviceInfo &d = knownDevices.at(idx);
+        uint32_t counts[3] = {data.sensorCounts.limit_switch_triggers, data.sensorCounts.cap_touch_triggers,
+                              data.sensorCounts.hall_sensor_triggers};
+        data.usage = CounterUsage();
+        if (d.hasLastSubmitted && !d.lastSubmittedRestored) {
+            data.usage = counterUsageSince(d.lastCountsSubmitted, d.lastTimestampSubmitted, counts,
+                                           (uint32_t)data.timestamp);
+        }
+        if (data.usage.flags & COUNTER_USAGE_RESET) {
+            TRACE_WARN(TRACE_COUNTS_RESET, idx, d.lastCountsSubmitted[0], counts[0]);
+            d.countResets++;
         }
+        d.lastUsage = data.usage;
+        d.lastTimestampSubmitted = (uint32_t)data.timestamp;
+        markDeviceLedgerDirty(idx);
+        d.hasLastSubmitted = true;
+        d.lastSubmittedRestored = false;
+        d.lastStatusSubmitted = data.stallStatus;
+        d.lastCountsSubmitted[0] = data.sensorCounts.limit_switch_triggers;
+        d.lastCountsSubmitted[1] = data.sensorCounts.cap_touch_triggers;
+        d.lastCountsSubmitted[2] = data.sensorCounts.hall_sensor_triggers;
+        if (d.detectPending) {
+            noteLatency(LATENCY_DETECT, millis() - d.detectFromMs);
+            d.detectPending = false;
+        }
+    }
+    unsigned long publishStartUs = micros();
+    publishSmartStallData(data, urgent);
+    noteLatency(LATENCY_PUBLISH, micros() - publishStartUs);
+}
+
+// Publish status changes learned from adverts (no connection). Counts are the last GATT read,
+// which the advertised digest confirmed are still current.
+static void publishPendingAdvUpdates() {
+    int total = knownDevices.size();
+    for (int i = 0; i < total && advPublishPendingCount > 0; ++i) {
+        DeviceInfo &d = knownDevices.at(i);
+        if (!d.advPublishPending) continue;
+        d.advPublishPending = false;
+        advPublishPendingCount--;
+        SmartStallData data;
+        data.deviceAddress = d.address.toString();
+        data.timestamp = Time.now();
+        data.stallStatus = d.observedStatus;
+        data.batteryVoltage = d.batteryMv;
+        data.sensorCounts.limit_switch_triggers = d.countsRead[0];
+        data.sensorCounts.cap_touch_triggers = d.countsRead[1];
+        data.sensorCounts.hall_sensor_triggers = d.countsRead[2];
+        data.isValid = true;
+        TRACE_INFO(TRACE_ADV_STATUS, i, d.observedStatus, 0);
+#if SMARTSTALL_ROLLUPS
+        noteRollupRead(i, data);
+#endif
+        publishDataIfChanged(i, data);
     }
+}
 
-    if (!serviceFound || profileRejectReason) {
-        hubMetrics.pollCyclesFailed++;
-        currentData.isValid = false;
-        BleAddress addr = peer.address();
-        int idx = findDeviceIndex(addr);
-        if (profileRejectReason && serviceFound) {
-            String rs(profileRejectReason);
-            if (rs.indexOf("NOTIFY") >= 0 || rs.indexOf("INDICATE") >= 0) {
-                hubMetrics.profileRejected++;
-                markLegacyProfileRejected(addr);
-            } else {
-                if (idx >= 0) {
-                    knownDevices.at(idx).failureCount = (uint8_t)min<int>(knownDevices.at(idx).failureCount + 1, 10);
-                    knownDevices.at(idx).lastRead = millis();
-                }
+static void startPollReads(PollLink &link);
+static void finishPollRejected(PollLink &link, const char *reason);
+static void finishPoll(PollLink &link, bool didRead);
+
+static void advancePollStep(PollLink &link, PollStep next) {
+    link.pollStep = next;
+    link.pollStepAttempt = 0;
+    link.nextPollStepAt = millis();
+}
+
+// HUB_DISCOVERING: one discovery step per call (service list, then the service's characteristics).
+// An empty service list is retried on a later tick; HUB_READING_DATA follows once the profile checks out.
+static void discoverSmartStallServices(PollLink &link) {
+    BlePeerDevice &peer = link.peer;
+    if (!peer.connected()) {
+        Log.warn("Not connected to device, cannot discover services");
+        return;
+    }
+
+    if (link.pollStep == POLL_DISCOVER_SERVICES) {
+        if (link.pollStepAttempt == 0) {
+            // Reset characteristic handles from previous device to avoid accidental reuse
+            link.stallStatusChar = BleCharacteristic();
+            link.batteryVoltageChar = BleCharacteristic();
+            link.sensorCountsChar = BleCharacteristic();
+#if SMARTSTALL_GATT_CACHE
+            int cacheIdx = findDeviceIndex(peer.address());
+            if (bindCachedCharacteristics(link, cacheIdx)) {
+                hubMetrics.gattCacheHits++;
+                startPollReads(link);
+                return;
             }
-        } else {
-            if (idx >= 0) {
-                knownDevices.at(idx).failureCount = (uint8_t)min<int>(knownDevices.at(idx).failureCount + 1, 10);
-                knownDevices.at(idx).lastRead = millis();
+            hubMetrics.gattCacheMisses++;
+            if (cacheIdx >= 0 && knownDevices.at(cacheIdx).gattCacheValid) {
+                Log.warn("Cached GATT bind failed for %s; running full discovery", link.data.deviceAddress.c_str());
+                knownDevices.at(cacheIdx).gattCacheValid = false;
+                link.stallStatusChar = BleCharacteristic();
+                link.batteryVoltageChar = BleCharacteristic();
+                link.sensorCountsChar = BleCharacteristic();
             }
+#endif
+            TRACE_INFO(TRACE_DISCOVERY_START, findDeviceIndex(peer.address()), 0, 0);
         }
-    } else {
-        BleAddress addr = peer.address();
-        int idxProbe = findDeviceIndex(addr);
-        if (idxProbe >= 0 && knownDevices.at(idxProbe).legacyProfileBlocked) {
-            knownDevices.at(idxProbe).legacyProfileBlocked = false;
-            knownDevices.at(idxProbe).legacyProfileRetryAfterMs = 0;
-            devicesLedgerDirty = true;
-            Log.info("GATT probe passed; cleared legacy-profile block for %s", currentData.deviceAddress.c_str());
+
+#if SMARTSTALL_CAPTURE
+        unsigned long discoverStart = millis();
+#endif
+        Vector<BleService> services = peer.discoverAllServices();
+#if SMARTSTALL_CAPTURE
+        captureServices(peer, discoverStart, services);
+#endif
+        if (services.size() == 0 && peer.connected()
+                && ++link.pollStepAttempt < MAX_SERVICE_DISCOVERY_ATTEMPTS) {
+            TRACE_WARN(TRACE_DISCOVERY_EMPTY, findDeviceIndex(peer.address()), link.pollStepAttempt, 0);
+            link.nextPollStepAt = millis() + SERVICE_DISCOVERY_RETRY_MS;
+            return;
+        }
+        for (const BleService& service : services) {
+            if (service.UUID() == SMARTSTALL_SERVICE_UUID) {
+                TRACE_INFO(TRACE_DISCOVERY_SERVICE, findDeviceIndex(peer.address()), services.size(), 1);
+                link.pollService = service;
+                advancePollStep(link, POLL_DISCOVER_CHARACTERISTICS);
+                return;
+            }
         }
-        Log.info("GATT profile OK; performing single-shot characteristic reads (with retries)...");
-        readAllCharacteristics();
-        didRead = true;
+        Log.warn("SmartStall service UUID not found in %d discovered services", services.size());
+        finishPollRejected(link, nullptr);
+        return;
+    }
+
+    // POLL_DISCOVER_CHARACTERISTICS
+#if SMARTSTALL_CAPTURE
+    unsigned long discoverStart = millis();
+#endif
+    Vector<BleCharacteristic> characteristics = peer.discoverCharacteristicsOfService(link.pollService);
+#if SMARTSTALL_CAPTURE
+    captureCharacteristics(peer, discoverStart, characteristics);
+#endif
+    for (const BleCharacteristic& characteristic : characteristics) {
+        BleUuid cu = characteristic.UUID();
+        if (cu == STALL_STATUS_CHAR_UUID) { link.stallStatusChar = characteristic; }
+        else if (cu == BATTERY_VOLTAGE_CHAR_UUID) { link.batteryVoltageChar = characteristic; }
+        else if (cu == SENSOR_COUNTS_CHAR_UUID) { link.sensorCountsChar = characteristic; }
+    }
+    TRACE_INFO(TRACE_DISCOVERY_CHARS, findDeviceIndex(peer.address()), characteristics.size(),
+               (link.stallStatusChar.isValid() ? 1 : 0) | (link.batteryVoltageChar.isValid() ? 2 : 0)
+               | (link.sensorCountsChar.isValid() ? 4 : 0));
+
+    const char *profileRejectReason = validateV12ReadOnlyProfile(link);
+    if (profileRejectReason) {
+        Log.warn("SmartStall GATT rejected (hub: no NOTIFY/INDICATE on status/battery/counts): %s", profileRejectReason);
+        finishPollRejected(link, profileRejectReason);
+        return;
+    }
+    startPollReads(link);
+}
+
+// Profile OK (discovered or bound from cache): clear any legacy block and start the reads
+static void startPollReads(PollLink &link) {
+    int idxProbe = findDeviceIndex(link.peer.address());
+    if (idxProbe >= 0 && knownDevices.at(idxProbe).legacyProfileBlocked) {
+        knownDevices.at(idxProbe).legacyProfileBlocked = false;
+        knownDevices.at(idxProbe).legacyProfileRetryAfterMs = 0;
+        markDeviceLedgerDirty(idxProbe);
+        Log.info("GATT probe passed; cleared legacy-profile block for %s", link.data.deviceAddress.c_str());
+    }
+    TRACE_INFO(TRACE_PROFILE_OK, idxProbe, link.pollStep == POLL_DISCOVER_SERVICES, 0);
+    noteLatency(LATENCY_DISCOVERY, millis() - link.phaseStartMs);
+    link.phaseStartMs = millis();
+    link.state = HUB_READING_DATA;
+    advancePollStep(link, POLL_READ_STATUS);
+}
+
+// Service missing (reason null) or profile rejected: no reads this poll
+static void finishPollRejected(PollLink &link, const char *reason) {
+    hubMetrics.pollCyclesFailed++;
+    link.data.isValid = false;
+    BleAddress addr = link.peer.address();
+    int idx = findDeviceIndex(addr);
+    String rs(reason ? reason : "");
+    if (rs.indexOf("NOTIFY") >= 0 || rs.indexOf("INDICATE") >= 0) {
+        hubMetrics.profileRejected++;
+        markLegacyProfileRejected(addr);
+    } else {
+        notePollFailure(idx, true);
     }
+    finishPoll(link, false);
+}
 
+// Publish/registry bookkeeping of a completed read, then disconnect. Ends every poll that got past connect.
+// A poll succeeds when status was read; it publishes when every field was read or has an earlier value.
+static void finishPoll(PollLink &link, bool didRead) {
+    SmartStallData &data = link.data;
     if (didRead) {
-        if (currentData.isValid) {
+        noteLatency(LATENCY_READS, millis() - link.phaseStartMs);
+        if (link.statusRead) {
             hubMetrics.pollCyclesSucceeded++;
-            // Decide whether to publish based on status OR counts change
-            BleAddress addr = peer.address();
-            int idx = findDeviceIndex(addr);
-            bool shouldPublish = true; // default: publish if no registry info
-            if (idx >= 0) {
-                DeviceInfo &d = knownDevices.at(idx);
-                bool statusChanged = (!d.hasLastStatus || d.lastStatusPublished != currentData.stallStatus);
-                bool countsChanged = (!d.hasLastCounts
-                    || d.lastLimitSwitchPublished != currentData.sensorCounts.limit_switch_triggers
-                    || d.lastCapTouchPublished != currentData.sensorCounts.cap_touch_triggers
-                    || d.lastHallPublished != currentData.sensorCounts.hall_sensor_triggers);
-                if (!statusChanged && !countsChanged) {
-                    shouldPublish = false;
-                    Log.info("Status and counts unchanged for %s; skipping publish",
-                        currentData.deviceAddress.c_str());
-                } else {
-                    Log.info("Change detected for %s (status_changed=%d counts_changed=%d)",
-                        currentData.deviceAddress.c_str(),
-                        (int)statusChanged,
-                        (int)countsChanged);
-                }
+            if (link.readPartial) {
+                hubMetrics.pollPartial++;
             }
-
-            if (shouldPublish) {
-                publishSmartStallData();
-                if (idx >= 0) {
-                    knownDevices.at(idx).hasLastStatus = true;
-                    knownDevices.at(idx).lastStatusPublished = currentData.stallStatus;
-                    knownDevices.at(idx).hasLastCounts = true;
-                    knownDevices.at(idx).lastLimitSwitchPublished = currentData.sensorCounts.limit_switch_triggers;
-                    knownDevices.at(idx).lastCapTouchPublished = currentData.sensorCounts.cap_touch_triggers;
-                    knownDevices.at(idx).lastHallPublished = currentData.sensorCounts.hall_sensor_triggers;
-                }
+            BleAddress addr = link.peer.address();
+            int idx = findDeviceIndex(addr);
+            if (data.isValid) {
+#if SMARTSTALL_ROLLUPS
+                noteRollupRead(idx, data);
+#endif
+                publishDataIfChanged(idx, data);
+            } else {
+                Log.warn("No earlier battery/counts value for %s; not publishing this poll", data.deviceAddress.c_str());
             }
 
             // Update registry lastRead and reset failureCount on success
             if (idx >= 0) {
-                knownDevices.at(idx).lastRead = millis();
-                if (knownDevices.at(idx).failureCount > 0) knownDevices.at(idx).failureCount--;
-                knownDevices.at(idx).legacyProfileBlocked = false;
-                knownDevices.at(idx).legacyProfileRetryAfterMs = 0;
-                devicesLedgerDirty = true;
+                DeviceInfo &d = knownDevices.at(idx);
+                noteObservedStatus(d, data.stallStatus);
+                d.lastObservedMs = millis();
+                if (data.isValid) {
+                    d.detectPending = false; // published above, or unchanged
+                }
+                if (d.advPublishPending && data.isValid) {
+                    // This read's publish decision already covers the advertised change
+                    d.advPublishPending = false;
+                    advPublishPendingCount--;
+                }
+                d.lastRead = millis();
+                if (d.failureCount > 0) d.failureCount--;
+                d.legacyProfileBlocked = false;
+                d.legacyProfileRetryAfterMs = 0;
+#if SMARTSTALL_GATT_CACHE
+                d.gattCacheValid = true;
+#endif
+                reschedulePoll(idx);
             }
         } else {
             hubMetrics.pollCyclesFailed++;
             Log.warn("Data invalid after read; marking failure");
-            BleAddress addr = peer.address();
+            BleAddress addr = link.peer.address();
             int idx = findDeviceIndex(addr);
-            if (idx >= 0) {
-                knownDevices.at(idx).failureCount = (uint8_t)min<int>(knownDevices.at(idx).failureCount + 1, 10);
+            if (idx >= 0 && knownDevices.at(idx).gattCacheValid) {
+                // Failed or short read: the cached binding may be stale, rediscover next poll
+                knownDevices.at(idx).gattCacheValid = false;
             }
+            notePollFailure(idx, false);
         }
     }
     
     // Disconnect now to allow cycling among devices quickly
-    if (peer.connected()) {
-        Log.info("Disconnecting after poll cycle");
-        expectingUserInitiatedDisconnect = true;
-        peer.disconnect();
+    if (link.peer.connected()) {
+        link.expectingUserInitiatedDisconnect = true;
+        link.peer.disconnect();
+        armBleCooldown(); // now, so another link does not connect before this one resets
     }
-    currentState = HUB_DISCONNECTED; // Trigger reset/scan in loop
-    Log.info("Poll cycle complete; device queued for next interval");
+    link.state = HUB_DISCONNECTED; // Trigger reset/scan in loop
+    TRACE_INFO(TRACE_POLL_COMPLETE, findDeviceIndex(link.target), didRead && link.statusRead, data.isValid);
 
     // Ledger snapshot on poll completion (rate-limited). Force write on success.
+    lastReadData = data;
     if (ledgersInitialized) {
-        writeUnifiedLedger(currentData.isValid);
+        writeLedgers(data.isValid);
     }
 }
 
-// Read all characteristics manually (for periodic data collection)
-void readAllCharacteristics() {
-    if (!peer.connected()) {
-        Log.warn("Not connected to device, cannot read characteristics");
+// ch.getValue() for poll step `step` of registry entry devIdx, recorded when capturing
+static ssize_t readPollValue(PollLink &link, BleCharacteristic &ch, PollStep step, int devIdx, uint8_t *buf,
+                             size_t len) {
+#if SMARTSTALL_CAPTURE
+    unsigned long start = millis();
+    ssize_t count = ch.getValue(buf, len);
+    uint8_t attr = step == POLL_READ_STATUS ? CAPTURE_ATTR_STATUS
+        : step == POLL_READ_BATTERY ? CAPTURE_ATTR_BATTERY : CAPTURE_ATTR_COUNTS;
+    inputCapture.read((uint32_t)start, devIdx, link.peer.address(), attr, (uint32_t)(millis() - start),
+                      (int32_t)count, buf);
+    return count;
+#else
+    (void)link;
+    (void)step;
+    (void)devIdx;
+    return ch.getValue(buf, len);
+#endif
+}
+
+// One 16-bit characteristic read of poll step `step` for registry entry devIdx
+static bool readCharacteristic16(PollLink &link, BleCharacteristic &ch, PollStep step, int devIdx, uint16_t &outVal) {
+    if (!ch.isValid()) {
+        TRACE_WARN(TRACE_READ_INVALID_CHAR, devIdx, step, 0);
+        return false;
+    }
+    uint8_t buf[8] = {0};
+    const int EXPECT = 2;
+    ssize_t count = readPollValue(link, ch, step, devIdx, buf, EXPECT);
+    if (count >= EXPECT) {
+        outVal = decodeUint16Value(buf);
+        return true;
+    }
+    TRACE_WARN(TRACE_READ_FAILED, devIdx, step, link.pollStepAttempt + 1);
+    return false;
+}
+
+static bool readSensorCounts(PollLink &link, int devIdx, DeviceInfo *dev) {
+    if (!link.sensorCountsChar.isValid()) {
+        TRACE_WARN(TRACE_READ_INVALID_CHAR, devIdx, POLL_READ_COUNTS, 0);
+        return false;
+    }
+    uint8_t sensorData[16] = {0};
+    const int EXPECT = SENSOR_COUNTS_VALUE_LEN;
+    ssize_t count = readPollValue(link, link.sensorCountsChar, POLL_READ_COUNTS, devIdx, sensorData, EXPECT);
+    if (count < EXPECT) {
+        TRACE_WARN(TRACE_READ_FAILED, devIdx, POLL_READ_COUNTS, link.pollStepAttempt + 1);
+        return false;
+    }
+    SensorCounts &counts = link.data.sensorCounts;
+    decodeSensorCounts(sensorData, counts);
+    TRACE_INFO(TRACE_READ_COUNTS, devIdx, counts.limit_switch_triggers, counts.cap_touch_triggers);
+    TRACE_INFO(TRACE_READ_COUNTS_HALL, devIdx, counts.hall_sensor_triggers, 0);
+    if (dev) {
+        dev->countsRead[0] = counts.limit_switch_triggers;
+        dev->countsRead[1] = counts.cap_touch_triggers;
+        dev->countsRead[2] = counts.hall_sensor_triggers;
+        dev->countsDigest = sensorCountsDigest(dev->countsRead[0], dev->countsRead[1], dev->countsRead[2]);
+        dev->hasCountsRead = true;
+        dev->countsReadAtMs = millis();
+    }
+    return true;
+}
+
+// Whether this poll reads Sensor Counts. Devices advertising status are only connected for counts.
+static bool countsReadDue(const DeviceInfo *dev, uint16_t status) {
+#if SMARTSTALL_TIERED_READS
+    if (dev && dev->hasCountsRead && !dev->advTelemetry
+            && (millis() - dev->countsReadAtMs) < COUNTS_READ_INTERVAL_MS
+            && dev->hasObservedStatus && dev->observedStatus == status) {
+        return false;
+    }
+#else
+    (void)dev;
+    (void)status;
+#endif
+    return true;
+}
+
+// A battery or counts read failed all its attempts: use the device's last value for it, if any
+static bool useLastReadValue(PollLink &link, const DeviceInfo *dev) {
+    SmartStallData &data = link.data;
+    if (link.pollStep == POLL_READ_BATTERY) {
+        if (!dev || dev->batteryMv == 0) return false;
+        data.batteryVoltage = dev->batteryMv;
+        return true;
+    }
+    if (!dev || !dev->hasCountsRead) return false;
+    data.sensorCounts.limit_switch_triggers = dev->countsRead[0];
+    data.sensorCounts.cap_touch_triggers = dev->countsRead[1];
+    data.sensorCounts.hall_sensor_triggers = dev->countsRead[2];
+    return true;
+}
+
+// HUB_READING_DATA: one characteristic read per call, or the publish/disconnect step after the last one.
+// A failed read is retried on a later tick. Once a status read runs out of attempts the poll ends there; a
+// battery or counts read that does keeps the field's last value and the poll goes on.
+static void readAllCharacteristics(PollLink &link) {
+    if (link.pollStep == POLL_FINISH) {
+        finishPoll(link, true);
         return;
     }
-    
-    Log.info("Reading all characteristics from SmartStall device...");
-
-    auto readWithRetry16 = [&](BleCharacteristic &ch, const char *label, uint16_t &outVal)->bool {
-        if (!ch.isValid()) { Log.warn("%s characteristic invalid", label); return false; }
-        uint8_t buf[8] = {0};
-        const int EXPECT = 2;
-        const int MAX_RETRIES = 3;
-        for (int attempt = 0; attempt < MAX_RETRIES; ++attempt) {
-            ssize_t count = ch.getValue(buf, EXPECT);
-            if (count >= EXPECT) {
-                outVal = buf[0] | (buf[1] << 8);
-                Log.info("%s read (%d bytes) value=%u", label, (int)count, (unsigned)outVal);
-                return true; }
-            Log.warn("%s read attempt %d failed (bytes=%d)", label, attempt + 1, (int)count);
-            delay(150);
-        }
+
+    SmartStallData &data = link.data;
+    int devIdx = findDeviceIndex(link.peer.address());
+    DeviceInfo *dev = (devIdx >= 0) ? &knownDevices.at(devIdx) : nullptr;
+    bool ok = false;
+    PollStep next = POLL_FINISH;
+    switch (link.pollStep) {
+        case POLL_READ_STATUS:
+            ok = readCharacteristic16(link, link.stallStatusChar, POLL_READ_STATUS, devIdx, data.stallStatus);
+            if (ok) {
+                TRACE_INFO(TRACE_READ_STATUS, devIdx, data.stallStatus, 0);
+                link.statusRead = true;
+            }
+            next = POLL_READ_BATTERY;
+            break;
+        case POLL_READ_BATTERY:
+            // Battery drifts slowly: re-read it on its own cadence and reuse the cached value in between
+            if (dev && dev->batteryMv != 0 && (millis() - dev->batteryReadAtMs) < BATTERY_READ_INTERVAL_MS) {
+                data.batteryVoltage = dev->batteryMv;
+                ok = true;
+                TRACE_INFO(TRACE_READ_BATTERY, devIdx, data.batteryVoltage, 1);
+            } else {
+                ok = readCharacteristic16(link, link.batteryVoltageChar, POLL_READ_BATTERY, devIdx,
+                                          data.batteryVoltage);
+                if (ok) {
+                    TRACE_INFO(TRACE_READ_BATTERY, devIdx, data.batteryVoltage, 0);
+                    if (dev) {
+                        dev->batteryMv = data.batteryVoltage;
+                        dev->batteryReadAtMs = millis();
+                    }
+                }
+            }
+            next = POLL_READ_COUNTS;
+            break;
+        case POLL_READ_COUNTS:
+            if (!countsReadDue(dev, data.stallStatus)) {
+                // Status unchanged and counts fresh: no ATT traffic, the snapshot carries the last counts
+                ok = useLastReadValue(link, dev);
+                TRACE_INFO(TRACE_COUNTS_CACHED, devIdx, millis() - dev->countsReadAtMs, 0);
+            } else {
+                ok = readSensorCounts(link, devIdx, dev);
+            }
+            next = POLL_FINISH;
+            break;
+        default:
+            break;
+    }
+    if (!link.peer.connected()) {
+        return; // link dropped during the read; its disconnect event ends the poll
+    }
+    if (!ok && ++link.pollStepAttempt < MAX_CHARACTERISTIC_READ_ATTEMPTS) {
+        link.nextPollStepAt = millis() + CHARACTERISTIC_READ_RETRY_MS;
+        return;
+    }
+    if (!ok && (!SMARTSTALL_TIERED_READS || link.pollStep == POLL_READ_STATUS)) {
+        Log.warn("Characteristic read step %d failed %d times; ending poll", (int)link.pollStep, link.pollStepAttempt);
+        link.statusRead = false;
+        next = POLL_FINISH;
+    } else if (!ok) {
+        // Status was read: the poll stands, with this field's last value when the device has one
+        bool stale = useLastReadValue(link, dev);
+        TRACE_WARN(TRACE_READ_KEPT_LAST, devIdx, link.pollStep, stale);
+        link.readPartial = true;
+        link.readMissing = link.readMissing || !stale;
+    }
+    data.timestamp = Time.now();
+    data.isValid = link.statusRead && !link.readMissing && next == POLL_FINISH;
+    advancePollStep(link, next);
+}
+
+// Without the queue a publish is not retried, so its snapshot counts as published either way
+const bool PUBLISH_STATE_ON_ACK_ONLY = SMARTSTALL_EVENT_QUEUE;
+
+#if SMARTSTALL_EVENT_QUEUE || SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY_DELTA
+static void formatSnapshotAddress(const SnapshotFields &f, char out[18]) {
+    snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X", f.address[0], f.address[1], f.address[2], f.address[3],
+             f.address[4], f.address[5]);
+}
+#endif
+
+// Registry slot of a snapshot's device, or -1 (untracked, or queued before a reboot and not seen since)
+static int findSnapshotDevice(const SnapshotFields &f) {
+    uint8_t octets[BLE_SIG_ADDR_LEN];
+    for (int i = 0; i < BLE_SIG_ADDR_LEN; ++i) {
+        octets[i] = f.address[BLE_SIG_ADDR_LEN - 1 - i];
+    }
+    return deviceIndex.find(DeviceAddressIndex<MAX_TRACKED_DEVICES>::pack(octets));
+}
+
+static QueuedSnapshot snapshotOfData(const SmartStallData &data, bool urgent) {
+    QueuedSnapshot s;
+    BleAddress addr(data.deviceAddress.c_str());
+    for (int i = 0; i < BLE_SIG_ADDR_LEN; ++i) {
+        s.fields.address[i] = addr[BLE_SIG_ADDR_LEN - 1 - i];
+    }
+    s.fields.timestamp = (uint32_t)data.timestamp;
+    s.fields.status = data.stallStatus;
+    s.fields.batteryMv = data.batteryVoltage;
+    s.fields.counts[0] = data.sensorCounts.limit_switch_triggers;
+    s.fields.counts[1] = data.sensorCounts.cap_touch_triggers;
+    s.fields.counts[2] = data.sensorCounts.hall_sensor_triggers;
+    s.flags = urgent ? QUEUED_SNAPSHOT_URGENT : 0;
+    s.usage = data.usage;
+    return s;
+}
+
+#if SMARTSTALL_EVENT_QUEUE
+// Rendering view of a queued snapshot (the live path renders the poll's data directly)
+static void snapshotToData(const QueuedSnapshot &s, SmartStallData &out) {
+    const SnapshotFields &f = s.fields;
+    char addr[18];
+    formatSnapshotAddress(f, addr);
+    out.deviceAddress = addr;
+    out.timestamp = f.timestamp;
+    out.stallStatus = f.status;
+    out.batteryVoltage = f.batteryMv;
+    out.sensorCounts.limit_switch_triggers = f.counts[0];
+    out.sensorCounts.cap_touch_triggers = f.counts[1];
+    out.sensorCounts.hall_sensor_triggers = f.counts[2];
+    out.usage = s.usage;
+    out.isValid = true;
+}
+#endif
+
+// The cloud acknowledged the snapshot (without the queue: it was handed to Particle.publish)
+static void notePublishedSnapshot(const SnapshotFields &f) {
+    int idx = findSnapshotDevice(f);
+    if (idx < 0) return;
+    DeviceInfo &d = knownDevices.at(idx);
+    d.hasLastStatus = true;
+    d.lastStatusPublished = f.status;
+    d.hasLastCounts = true;
+    d.lastLimitSwitchPublished = f.counts[0];
+    d.lastCapTouchPublished = f.counts[1];
+    d.lastHallPublished = f.counts[2];
+    markDeviceLedgerDirty(idx);
+}
+
+#if SMARTSTALL_EVENT_QUEUE
+static void noteEventQueueState() {
+    hubMetrics.eventQueueDepth = eventQueue.size();
+    hubMetrics.eventQueueDropped = eventQueue.dropped();
+}
+
+static void openEventQueue() {
+    if (eventQueue.open(SMARTSTALL_EVENT_QUEUE_PATH)) {
+        Log.info("Event queue %s: %u pending, %lu dropped", SMARTSTALL_EVENT_QUEUE_PATH,
+            (unsigned)eventQueue.size(), (unsigned long)eventQueue.dropped());
+    } else {
+        Log.error("Event queue %s unavailable; unacknowledged snapshots will be lost", SMARTSTALL_EVENT_QUEUE_PATH);
+    }
+    noteEventQueueState();
+}
+
+static void enqueueSnapshot(const QueuedSnapshot &s) {
+    if (eventQueue.push(s)) {
+        hubMetrics.eventsQueued++;
+        Log.info("Snapshot queued for replay (%u pending)", (unsigned)eventQueue.size());
+    } else {
+        Log.warn("Snapshot could not be queued; dropped");
+    }
+    noteEventQueueState();
+}
+#endif
+
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+static bool publishBatchEvent() {
+    const char *payload = publishBatch.finish();
+    Log.info("Publishing SmartStall batch (%u devices, %u bytes)",
+        (unsigned)publishBatch.count(), (unsigned)publishBatch.finishedLength());
+    return Particle.publish("smartstall/batch", payload, PRIVATE);
+}
+
+// Compact snapshot: ["device",timestamp,status,battery_mv,limit_switch,cap_touch,hall_sensor]
+// (status_name, occupied and battery_v are derived from these by the consumer).
+// false (nothing added) when the batch is full or the item cannot be rendered.
+static bool addToPublishBatch(const QueuedSnapshot &s, const SmartStallData &data, unsigned long now) {
+    char item[SMARTSTALL_BATCH_ITEM_MAX];
+    JsonWriter json(item, sizeof(item));
+    if (!writeSmartStallBatchItem(json, data)) {
+        Log.warn("Snapshot for %s too long; not published", data.deviceAddress.c_str());
         return false;
-    };
+    }
+    size_t itemLen = json.length();
+    if (!publishBatch.fits(itemLen) || publishBatch.count() >= PUBLISH_BATCH_MAX_ITEMS) {
+        return false;
+    }
+    publishBatchSnapshots[publishBatch.count()] = s;
+    publishBatch.add(item, itemLen, (s.flags & QUEUED_SNAPSHOT_URGENT) != 0, now);
+    Log.info("Queued SmartStall snapshot (%u in batch%s): %s",
+        (unsigned)publishBatch.count(), (s.flags & QUEUED_SNAPSHOT_URGENT) ? ", urgent" : "", item);
+    return true;
+}
 
-    auto readSensorCountsRetry = [&](BleCharacteristic &ch)->bool {
-        if (!ch.isValid()) { Log.warn("Sensor counts characteristic invalid"); return false; }
-        uint8_t sensorData[16] = {0};
-        const int EXPECT = 12;
-        const int MAX_RETRIES = 3;
-        for (int attempt = 0; attempt < MAX_RETRIES; ++attempt) {
-            ssize_t count = ch.getValue(sensorData, EXPECT);
-            if (count >= EXPECT) {
-                Log.info("Sensor counts read (%d bytes)", (int)count);
-                currentData.sensorCounts.limit_switch_triggers = 
-                    sensorData[0] | (sensorData[1] << 8) | (sensorData[2] << 16) | (sensorData[3] << 24);
-                currentData.sensorCounts.cap_touch_triggers = 
-                    sensorData[4] | (sensorData[5] << 8) | (sensorData[6] << 16) | (sensorData[7] << 24);
-                currentData.sensorCounts.hall_sensor_triggers = 
-                    sensorData[8] | (sensorData[9] << 8) | (sensorData[10] << 16) | (sensorData[11] << 24);
-                Log.info("Counts - Limit:%lu CapTouch:%lu Hall:%lu", 
-                    currentData.sensorCounts.limit_switch_triggers,
-                    currentData.sensorCounts.cap_touch_triggers,
-                    currentData.sensorCounts.hall_sensor_triggers);
-                return true; }
-            Log.warn("Sensor counts read attempt %d failed (bytes=%d)", attempt + 1, (int)count);
-            delay(150);
+#if SMARTSTALL_EVENT_QUEUE
+// Move the unsent batch into the queue so it stays ahead of newer snapshots
+static void spillPublishBatch() {
+    for (size_t i = 0; i < publishBatch.count(); ++i) {
+        enqueueSnapshot(publishBatchSnapshots[i]);
+    }
+    publishBatch.clear();
+}
+#endif
+
+// Publish and empty the pending batch. Unacknowledged snapshots go to the queue.
+static void flushPublishBatch() {
+    if (publishBatch.empty()) {
+        return;
+    }
+    bool acked = publishBatchEvent();
+#if SMARTSTALL_EVENT_QUEUE
+    if (!acked) {
+        spillPublishBatch();
+        return;
+    }
+    for (size_t i = 0; i < publishBatch.count(); ++i) {
+        notePublishedSnapshot(publishBatchSnapshots[i].fields);
+    }
+#else
+    (void)acked;
+#endif
+    publishBatch.clear();
+}
+#elif SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY_DELTA
+// Encode one smartstall/bin frame: a delta against what the cloud last acknowledged for the device,
+// or a keyframe (first frame, counter reset, clock step back, or BIN_KEYFRAME_INTERVAL reached).
+static bool publishBinarySnapshot(const SnapshotFields &cur) {
+    int idx = findSnapshotDevice(cur);
+    uint16_t wireIndex = DELTA_INDEX_UNTRACKED;
+    uint8_t sequence = 0;
+    SnapshotFields base;
+    const SnapshotFields *deltaBase = nullptr;
+    if (idx >= 0) {
+        const DeviceInfo &d = knownDevices.at(idx);
+        wireIndex = (uint16_t)idx;
+        sequence = d.binSequence;
+        if (d.binHasBase && d.hasLastCounts && d.binSinceKeyframe < BIN_KEYFRAME_INTERVAL) {
+            base = cur;
+            base.timestamp = d.binLastTimestamp;
+            base.batteryMv = d.binLastBatteryMv;
+            base.counts[0] = d.lastLimitSwitchPublished;
+            base.counts[1] = d.lastCapTouchPublished;
+            base.counts[2] = d.lastHallPublished;
+            if (deltaEncodable(cur, base)) {
+                deltaBase = &base;
+            }
         }
+    }
+
+    uint8_t frame[DELTA_FRAME_MAX];
+    size_t frameLen = encodeSnapshotFrame(cur, deltaBase, wireIndex, sequence, frame);
+    char payload[DELTA_BASE64_MAX];
+    base64Encode(frame, frameLen, payload, sizeof(payload));
+    char addr[18];
+    formatSnapshotAddress(cur, addr);
+    Log.info("Publishing SmartStall %s frame for %s (%u bytes): %s", deltaBase ? "delta" : "key",
+        addr, (unsigned)frameLen, payload);
+    bool acked = Particle.publish("smartstall/bin", payload, PRIVATE);
+    if (!acked && PUBLISH_STATE_ON_ACK_ONLY) {
         return false;
-    };
-    
-    bool okStatus = readWithRetry16(stallStatusChar, "StallStatus", currentData.stallStatus);
-    if (okStatus) {
-        Log.info("Stall Status Name: %s", getStatusString(currentData.stallStatus));
     }
-    bool okBattery = readWithRetry16(batteryVoltageChar, "BatteryVoltage", currentData.batteryVoltage);
-    if (okBattery) {
-        Log.info("Battery Voltage: %u mV (%.2f V)", (unsigned)currentData.batteryVoltage, currentData.batteryVoltage / 1000.0f);
+
+    if (idx >= 0) {
+        DeviceInfo &d = knownDevices.at(idx);
+        d.binHasBase = true;
+        d.binSequence++;
+        d.binSinceKeyframe = deltaBase ? d.binSinceKeyframe + 1 : 0;
+        d.binLastTimestamp = cur.timestamp;
+        d.binLastBatteryMv = cur.batteryMv;
     }
-    bool okCounts = readSensorCountsRetry(sensorCountsChar);
-    
-    if (!(okStatus && okBattery && okCounts)) {
-        Log.warn("One or more characteristic reads failed (status=%d battery=%d counts=%d)", okStatus, okBattery, okCounts);
+    notePublishedSnapshot(cur);
+    return acked;
+}
+#endif
+
+#if SMARTSTALL_PUBLISH_FORMAT != PUBLISH_FORMAT_BATCHED
+// Publish one snapshot (data is its rendering view). true when acknowledged, or when there is
+// nothing to retry.
+static bool publishSnapshot(const QueuedSnapshot &s, const SmartStallData &data) {
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY_DELTA
+    (void)data;
+    return publishBinarySnapshot(s.fields);
+#else
+    // Rendered into a stack buffer (no heap); same bytes as the former String::format payload, plus the
+    // usage object when the snapshot has one
+    char payload[SMARTSTALL_DATA_JSON_MAX];
+    JsonWriter json(payload, sizeof(payload));
+    if (!writeSmartStallDataJson(json, data)) {
+        Log.warn("Payload for %s too long; not published", data.deviceAddress.c_str());
+        return true;
     }
-    
-    currentData.timestamp = Time.now();
-    currentData.isValid = (okStatus && okBattery && okCounts);
+
+    Log.info("Publishing SmartStall data: %s", payload);
+
+    // Single consolidated event (removed separate battery-only publish to reduce redundancy)
+    bool acked = Particle.publish("smartstall/data", payload, PRIVATE);
+    if (!acked && PUBLISH_STATE_ON_ACK_ONLY) {
+        return false;
+    }
+    notePublishedSnapshot(s.fields);
+    return acked;
+#endif
 }
+#endif
 
-// Publish complete SmartStall data to Particle cloud
-void publishSmartStallData() {
-    if (!currentData.isValid) {
+// Publish data to the Particle cloud as SMARTSTALL_PUBLISH_FORMAT: one smartstall/data event,
+// one smartstall/bin frame, or an item of the pending smartstall/batch. urgent (status changed) only
+// matters in batched format, where it makes the batch flush on the next loop iteration instead of
+// waiting for size/age.
+void publishSmartStallData(const SmartStallData &data, bool urgent) {
+    if (!data.isValid) {
         Log.warn("No valid data to publish");
         return;
     }
-    
-    // Determine occupancy from status: 0,1,3,4 = non-occupied; 2,5 = occupied
-    bool isOccupied = (currentData.stallStatus == 2 || currentData.stallStatus == 5);
-
-    // Create comprehensive JSON payload
-    String jsonData = String::format(
-        "{"
-        "\"device\":\"%s\","
-        "\"timestamp\":%lu,"
-        "\"status\":%d,"
-        "\"status_name\":\"%s\","
-        "\"occupied\":%s,"
-        "\"battery_mv\":%d,"
-        "\"battery_v\":%.2f,"
-        "\"sensor_counts\":{"
-            "\"limit_switch\":%lu,"
-            "\"cap_touch\":%lu,"
-            "\"hall_sensor\":%lu"
-        "}"
-        "}",
-        currentData.deviceAddress.c_str(),
-        currentData.timestamp,
-        currentData.stallStatus,
-        getStatusString(currentData.stallStatus),
-        isOccupied ? "true" : "false",
-        currentData.batteryVoltage,
-        currentData.batteryVoltage / 1000.0f,
-        currentData.sensorCounts.limit_switch_triggers,
-        currentData.sensorCounts.cap_touch_triggers,
-        currentData.sensorCounts.hall_sensor_triggers
-    );
-    
-    Log.info("Publishing SmartStall data: %s", jsonData.c_str());
-    
-    // Single consolidated event (removed separate battery-only publish to reduce redundancy)
-    Particle.publish("smartstall/data", jsonData, PRIVATE);
+    QueuedSnapshot s = snapshotOfData(data, urgent);
+
+#if SMARTSTALL_EVENT_QUEUE
+    // Delivery stays in read order: while a backlog exists or the cloud is down, queue behind it
+    if (!eventQueue.empty() || !cloudConnected()) {
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+        spillPublishBatch();
+#endif
+        enqueueSnapshot(s);
+        return;
+    }
+#endif
+
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+    if (!addToPublishBatch(s, data, millis())) {
+        flushPublishBatch();
+#if SMARTSTALL_EVENT_QUEUE
+        if (!eventQueue.empty()) {
+            enqueueSnapshot(s);
+            return;
+        }
+#endif
+        if (!addToPublishBatch(s, data, millis())) {
+            return;
+        }
+    }
+    if (!PUBLISH_STATE_ON_ACK_ONLY) {
+        notePublishedSnapshot(s.fields);
+    }
+#elif SMARTSTALL_EVENT_QUEUE
+    if (!publishSnapshot(s, data)) {
+        enqueueSnapshot(s);
+    }
+#else
+    publishSnapshot(s, data);
+#endif
+}
+
+#if SMARTSTALL_EVENT_QUEUE
+// Replay the oldest queued snapshots: one event per EVENT_QUEUE_DRAIN_INTERVAL_MS (in batched format,
+// as many snapshots as fit in it). A record that fails its checksum is discarded and counted as dropped.
+static void drainEventQueue(unsigned long now) {
+    if (!cloudConnected() || (now - lastEventQueueDrainMs) < EVENT_QUEUE_DRAIN_INTERVAL_MS) {
+        return;
+    }
+    lastEventQueueDrainMs = now;
+    QueuedSnapshot s;
+    SmartStallData data;
+#if SMARTSTALL_PUBLISH_FORMAT == PUBLISH_FORMAT_BATCHED
+    if (!publishBatch.empty()) {
+        return; // the live batch goes first (flushPublishBatch)
+    }
+    uint16_t n = 0;
+    while (n < eventQueue.size()) {
+        if (!eventQueue.peek(n, s)) {
+            if (n > 0) break;
+            Log.warn("Discarding unreadable queued snapshot");
+            eventQueue.discardOldest();
+            continue;
+        }
+        snapshotToData(s, data);
+        if (!addToPublishBatch(s, data, now)) {
+            if (n > 0) break;
+            eventQueue.discardOldest(); // cannot be rendered at all
+            continue;
+        }
+        n++;
+    }
+    if (n > 0) {
+        if (publishBatchEvent()) {
+            for (uint16_t i = 0; i < n; ++i) {
+                notePublishedSnapshot(publishBatchSnapshots[i].fields);
+            }
+            eventQueue.pop(n);
+            hubMetrics.eventsReplayed += n;
+        }
+        publishBatch.clear();
+    }
+#else
+    if (!eventQueue.peek(0, s)) {
+        Log.warn("Discarding unreadable queued snapshot");
+        eventQueue.discardOldest();
+    } else {
+        snapshotToData(s, data);
+        if (publishSnapshot(s, data)) {
+            eventQueue.pop();
+            hubMetrics.eventsReplayed++;
+        }
+    }
+#endif
+    noteEventQueueState();
+}
+#endif
+
+#if SMARTSTALL_REGISTRY_CHECKPOINT
+// Unix time of a millis() stamp (0 = never), or 0 when either is unknown
+static uint32_t unixAt(unsigned long ms, uint32_t nowS) {
+    if (ms == 0 || nowS == 0) return 0;
+    return nowS - (uint32_t)((millis() - ms) / 1000);
+}
+
+// millis() stamp of a unix time at or before now, 0 when either is unknown. Times more than 24 days back
+// are clamped so the difference still fits millis().
+static unsigned long millisAt(uint32_t unixTime, uint32_t nowS) {
+    if (unixTime == 0 || nowS == 0) return 0;
+    uint32_t agoS = nowS > unixTime ? nowS - unixTime : 0;
+    if (agoS > 24UL * 86400UL) agoS = 24UL * 86400UL;
+    return millis() - agoS * 1000UL;
+}
+
+static bool deviceStale(const DeviceInfo &d) {
+    return (millis() - d.lastSeen) > DEVICE_STALE_MS;
+}
+
+// FNV-1a over the fields worth a flash write: not times, battery or radio alone
+static uint32_t checkpointDigestOf(const DeviceInfo &d) {
+    const uint32_t words[] = {
+        (uint32_t)d.hasLastStatus | (uint32_t)d.hasLastCounts << 1 | (uint32_t)d.hasLastSubmitted << 2
+            | (uint32_t)d.legacyProfileBlocked << 3 | (uint32_t)d.gattCacheValid << 4
+            | (uint32_t)d.hasObservedStatus << 5 | (uint32_t)d.advTelemetry << 6 | (uint32_t)d.hasCountsRead << 7
+            | (uint32_t)deviceStale(d) << 8,
+        d.failureCount, (uint32_t)d.legacyProfileRetryAfterMs,
+        d.lastStatusPublished, d.lastLimitSwitchPublished, d.lastCapTouchPublished, d.lastHallPublished,
+        d.lastStatusSubmitted, d.lastCountsSubmitted[0], d.lastCountsSubmitted[1], d.lastCountsSubmitted[2],
+        d.lastTimestampSubmitted, d.observedStatus, d.countsRead[0], d.countsRead[1], d.countsRead[2], d.countsDigest,
+    };
+    uint32_t h = 2166136261u;
+    for (uint32_t w : words) {
+        for (int i = 0; i < 4; ++i) {
+            h = (h ^ ((w >> (8 * i)) & 0xFF)) * 16777619u;
+        }
+    }
+    return h;
+}
+
+static void checkpointRecordOf(const DeviceInfo &d, uint32_t nowS, RegistryRecord &r) {
+    r = RegistryRecord();
+    for (uint8_t i = 0; i < BLE_SIG_ADDR_LEN; ++i) {
+        r.address[i] = d.address[i];
+    }
+    r.addressType = (uint8_t)d.address.type();
+    r.flags = (d.hasLastStatus ? REGISTRY_HAS_PUBLISHED_STATUS : 0)
+        | (d.hasLastCounts ? REGISTRY_HAS_PUBLISHED_COUNTS : 0) | (d.hasLastSubmitted ? REGISTRY_HAS_SUBMITTED : 0)
+        | (d.legacyProfileBlocked ? REGISTRY_LEGACY_BLOCKED : 0)
+        | (d.gattCacheValid ? REGISTRY_GATT_CACHE_VALID : 0) | (d.hasObservedStatus ? REGISTRY_HAS_OBSERVED_STATUS : 0)
+        | (d.advTelemetry ? REGISTRY_ADV_TELEMETRY : 0) | (d.hasCountsRead ? REGISTRY_HAS_COUNTS_READ : 0)
+        | (deviceStale(d) ? REGISTRY_STALE : 0);
+    r.failureCount = d.failureCount;
+    r.activity = d.activity;
+    if (d.legacyProfileBlocked && nowS != 0) {
+        long leftMs = (long)(d.legacyProfileRetryAfterMs - millis());
+        r.legacyRetryAt = nowS + (leftMs > 0 ? (uint32_t)(leftMs / 1000) : 0);
+    }
+    r.publishedStatus = d.lastStatusPublished;
+    r.publishedCounts[0] = d.lastLimitSwitchPublished;
+    r.publishedCounts[1] = d.lastCapTouchPublished;
+    r.publishedCounts[2] = d.lastHallPublished;
+    r.submittedStatus = d.lastStatusSubmitted;
+    memcpy(r.submittedCounts, d.lastCountsSubmitted, sizeof(r.submittedCounts));
+    r.submittedTimestamp = d.lastTimestampSubmitted;
+    r.observedStatus = d.observedStatus;
+    r.statusChangedAt = unixAt(d.statusChangedAtMs, nowS);
+    memcpy(r.countsRead, d.countsRead, sizeof(r.countsRead));
+    r.countsDigest = d.countsDigest;
+    r.countsReadAt = unixAt(d.countsReadAtMs, nowS);
+    r.lastSeenAt = unixAt(d.lastSeen, nowS);
+    r.lastReadAt = unixAt(d.lastRead, nowS);
+    r.batteryMv = d.batteryMv;
+    r.batteryReadAt = unixAt(d.batteryReadAtMs, nowS);
+    r.rssiQ4 = d.radio.rssiQ4;
+    r.sightings = d.radio.sightings;
+    r.connectHistory = d.radio.connectHistory;
+    r.connectCount = d.radio.connectCount;
+}
+
+// Registry entry from a checkpoint record, as of unix time nowS (the last commit's while the clock is not
+// set). A device that was not stale counts as seen at boot and is polled on its former schedule, overdue
+// ones at once; a stale one (asleep or gone) waits for a sighting. A legacy-profile block keeps its
+// wall-clock end, or restarts without one. Counter usage restarts: the checkpoint may miss the last
+// snapshots submitted before the reset.
+static void restoreDevice(const RegistryRecord &r, uint32_t nowS, DeviceInfo &d) {
+    d.address = BleAddress(r.address, (BleAddressType)r.addressType);
+    d.lastSeen = millis();
+    if (r.flags & REGISTRY_STALE) {
+        unsigned long seenAt = millisAt(r.lastSeenAt, nowS);
+        d.lastSeen = seenAt != 0 ? seenAt : millis() - DEVICE_STALE_MS - 1;
+    }
+    d.lastRead = millisAt(r.lastReadAt, nowS);
+    d.failureCount = r.failureCount;
+    d.hasLastStatus = (r.flags & REGISTRY_HAS_PUBLISHED_STATUS) != 0;
+    d.lastStatusPublished = r.publishedStatus;
+    d.hasLastCounts = (r.flags & REGISTRY_HAS_PUBLISHED_COUNTS) != 0;
+    d.lastLimitSwitchPublished = r.publishedCounts[0];
+    d.lastCapTouchPublished = r.publishedCounts[1];
+    d.lastHallPublished = r.publishedCounts[2];
+    d.hasLastSubmitted = (r.flags & REGISTRY_HAS_SUBMITTED) != 0;
+    d.lastSubmittedRestored = d.hasLastSubmitted;
+    d.lastStatusSubmitted = r.submittedStatus;
+    memcpy(d.lastCountsSubmitted, r.submittedCounts, sizeof(d.lastCountsSubmitted));
+    d.lastTimestampSubmitted = r.submittedTimestamp;
+    d.legacyProfileBlocked = (r.flags & REGISTRY_LEGACY_BLOCKED) != 0;
+    if (d.legacyProfileBlocked) {
+        uint32_t leftS = LEGACY_PROFILE_RETRY_MS / 1000;
+        if (r.legacyRetryAt != 0 && nowS != 0) {
+            leftS = r.legacyRetryAt > nowS ? min<uint32_t>(r.legacyRetryAt - nowS, leftS) : 0;
+        }
+        d.legacyProfileRetryAfterMs = registryRestoredMs + leftS * 1000UL;
+    }
+#if SMARTSTALL_GATT_CACHE
+    d.gattCacheValid = (r.flags & REGISTRY_GATT_CACHE_VALID) != 0;
+#endif
+    d.hasObservedStatus = (r.flags & REGISTRY_HAS_OBSERVED_STATUS) != 0;
+    d.observedStatus = r.observedStatus;
+    d.statusChangedAtMs = millisAt(r.statusChangedAt, nowS);
+    d.activity = r.activity;
+    d.batteryMv = r.batteryMv;
+    d.batteryReadAtMs = millisAt(r.batteryReadAt, nowS);
+    d.advTelemetry = (r.flags & REGISTRY_ADV_TELEMETRY) != 0;
+    d.hasCountsRead = (r.flags & REGISTRY_HAS_COUNTS_READ) != 0;
+    memcpy(d.countsRead, r.countsRead, sizeof(d.countsRead));
+    d.countsDigest = r.countsDigest;
+    d.countsReadAtMs = millisAt(r.countsReadAt, nowS);
+    d.radio.rssiQ4 = r.rssiQ4;
+    d.radio.sightings = r.sightings;
+    d.radio.connectHistory = r.connectHistory;
+    d.radio.connectCount = r.connectCount;
+}
+
+// Rebuild the registry, index and poll queue from the checkpoint (setup(), registry still empty)
+static void openRegistryCheckpoint() {
+    if (!registryCheckpoint.open(SMARTSTALL_REGISTRY_CHECKPOINT_PATH)) {
+        Log.error("Registry checkpoint %s unavailable; devices are found by scanning",
+            SMARTSTALL_REGISTRY_CHECKPOINT_PATH);
+        return;
+    }
+    uint32_t nowS = Time.isValid() ? (uint32_t)Time.now() : registryCheckpoint.committedAt();
+    registryRestoredMs = millis();
+    registryRestoredAsOfS = Time.isValid() ? 0 : nowS;
+    uint16_t unreadable = 0;
+    for (uint16_t slot = 0; slot < registryCheckpoint.size(); ++slot) {
+        RegistryRecord r;
+        if (!registryCheckpoint.read(slot, r)) {
+            unreadable++;
+            continue;
+        }
+        if (deviceIndex.find(DeviceAddressIndex<MAX_TRACKED_DEVICES>::pack(r.address)) >= 0) {
+            continue;
+        }
+        DeviceInfo d;
+        restoreDevice(r, nowS, d);
+        int idx = knownDevices.size();
+        // Entries moved up past an unreadable slot are rewritten by the next pass
+        d.checkpointed = idx == slot;
+        d.checkpointDigest = checkpointDigestOf(d);
+        knownDevices.append(d);
+        deviceIndex.insert(packAddress(d.address), (uint16_t)idx);
+        reschedulePoll(idx);
+    }
+    hubMetrics.checkpointRestored = (uint16_t)knownDevices.size();
+    Log.info("Registry checkpoint %s: %u devices restored, %u unreadable%s", SMARTSTALL_REGISTRY_CHECKPOINT_PATH,
+        (unsigned)knownDevices.size(), (unsigned)unreadable, registryRestoredAsOfS ? " (clock not set)" : "");
+}
+
+// A restored past stamp, not updated since the restore, lateS further back (within millisAt()'s 24 days)
+static void moveRestoredStamp(unsigned long &ms, uint32_t lateS) {
+    if (ms == 0 || (long)(registryRestoredMs - ms) <= 0) return;
+    unsigned long agoMs = min<unsigned long>(registryRestoredMs - ms + lateS * 1000UL, 24UL * 86400000UL);
+    ms = registryRestoredMs - agoMs;
+}
+
+// The clock is valid after a restore without one: the reset was lateS after the last commit, so restored
+// stamps and legacy-profile blocks are that much older, and the devices are rescheduled
+static void retimeRestoredDevices(uint32_t nowS) {
+    uint32_t assumedS = registryRestoredAsOfS + (uint32_t)((millis() - registryRestoredMs) / 1000);
+    uint32_t lateS = nowS > assumedS ? min<uint32_t>(nowS - assumedS, 24UL * 86400UL) : 0; // as millisAt()
+    registryRestoredAsOfS = 0;
+    if (lateS == 0) return;
+    for (int i = 0; i < knownDevices.size(); ++i) {
+        DeviceInfo &d = knownDevices.at(i);
+        moveRestoredStamp(d.lastRead, lateS);
+        moveRestoredStamp(d.statusChangedAtMs, lateS);
+        moveRestoredStamp(d.countsReadAtMs, lateS);
+        moveRestoredStamp(d.batteryReadAtMs, lateS);
+        moveRestoredStamp(d.lastSeen, lateS); // stale ones; the others count as seen at the restore
+        // A block set since the restore ends a full LEGACY_PROFILE_RETRY_MS after it
+        unsigned long blockEndMs = d.legacyProfileRetryAfterMs - registryRestoredMs;
+        if (d.legacyProfileBlocked && blockEndMs <= LEGACY_PROFILE_RETRY_MS) {
+            unsigned long leftMs = blockEndMs > lateS * 1000UL ? blockEndMs - lateS * 1000UL : 0;
+            d.legacyProfileRetryAfterMs = registryRestoredMs + leftMs;
+        }
+        reschedulePoll(i);
+    }
+    Log.info("Registry checkpoint: restored times moved back %lu s", (unsigned long)lateS);
+}
+
+// Rewrite the entries whose durable fields (or staleness) changed since they were written, then commit the
+// leading entries the file holds: one fsync per pass. Waits for a valid clock, first retiming a restore
+// made without one.
+static void checkpointRegistry(unsigned long now) {
+    // Records need wall-clock times
+    if (!registryCheckpoint.isOpen() || !Time.isValid()) {
+        return;
+    }
+    uint32_t nowS = (uint32_t)Time.now();
+    if (registryRestoredAsOfS != 0) {
+        retimeRestoredDevices(nowS);
+    }
+    if ((now - lastCheckpointMs) < REGISTRY_CHECKPOINT_INTERVAL_MS) {
+        return;
+    }
+    lastCheckpointMs = now;
+    int written = 0;
+    for (DeviceInfo &d : knownDevices) {
+        if (written >= REGISTRY_CHECKPOINT_MAX_RECORDS) break;
+        uint32_t digest = checkpointDigestOf(d);
+        if (d.checkpointed && d.checkpointDigest == digest) {
+            continue;
+        }
+        RegistryRecord r;
+        checkpointRecordOf(d, nowS, r);
+        d.checkpointed = registryCheckpoint.write((uint16_t)(&d - knownDevices.begin()), r);
+        if (!d.checkpointed) {
+            Log.warn("Registry checkpoint write failed");
+            break;
+        }
+        d.checkpointDigest = digest;
+        written++;
+    }
+    if (written == 0) {
+        return;
+    }
+    uint16_t count = 0;
+    for (const DeviceInfo &d : knownDevices) {
+        if (!d.checkpointed) break;
+        count++;
+    }
+    registryCheckpoint.commit(count, nowS);
+    hubMetrics.checkpointWrites += written;
 }
+#endif
 
-// Reset connection and return to scanning
-void resetConnection() {
-    if (peer.connected()) {
-        expectingUserInitiatedDisconnect = true;
-        peer.disconnect();
+// Reset a link's connection and free it (scanning resumes once every link is free)
+static void resetConnection(PollLink &link) {
+    if (link.state != HUB_SCANNING) {
+        noteLatency(LATENCY_CYCLE, millis() - link.scheduledAtMs);
+        TRACE_INFO(TRACE_LINK_RESET, findDeviceIndex(link.target), (int)link.state, 0);
+    }
+    if (link.peer.connected()) {
+        link.expectingUserInitiatedDisconnect = true;
+        link.peer.disconnect();
     }
     
-    currentState = HUB_SCANNING;
+    link.state = HUB_SCANNING;
     lastScanTime = millis() - 9000; // Start scanning soon
-    connectedDeviceAddress = "";
-    currentData.isValid = false;
+    link.data.isValid = false;
+    lastReadData.isValid = false;
     armBleCooldown();
-    
-    Log.info("Connection reset, returning to scan mode");
 }
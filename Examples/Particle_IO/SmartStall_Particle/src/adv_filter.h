@@ -0,0 +1,55 @@
+/*
+ * Allocation-free SmartStall advertisement matcher.
+ *
+ * Walks the raw AD structures (len, type, payload...) of an advertising or scan-response
+ * payload in place and reports whether it carries the SmartStall 128-bit service UUID
+ * and/or the "SmartStall" local name. No String, no Vector, no UUID objects — this runs
+ * for every advertisement the radio hears, most of which are phones and beacons.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+enum AdvMatch : uint8_t {
+    ADV_MATCH_NONE = 0x00,
+    ADV_MATCH_NAME = 0x01,
+    ADV_MATCH_SERVICE = 0x02
+};
+
+// AD types (Bluetooth Core Supplement, Part A, 1.1 / 1.2)
+const uint8_t AD_TYPE_UUID128_INCOMPLETE = 0x06;
+const uint8_t AD_TYPE_UUID128_COMPLETE = 0x07;
+const uint8_t AD_TYPE_SHORT_LOCAL_NAME = 0x08;
+const uint8_t AD_TYPE_COMPLETE_LOCAL_NAME = 0x09;
+
+// serviceUuidLe: 16 bytes in over-the-air (little-endian) order, as BleUuid::rawBytes() returns.
+inline uint8_t matchSmartStallAdvertisement(const uint8_t *data, size_t len, const uint8_t *serviceUuidLe,
+                                            const char *name, size_t nameLen) {
+    uint8_t match = ADV_MATCH_NONE;
+    size_t i = 0;
+    while (i + 1 < len) {
+        uint8_t fieldLen = data[i];
+        if (fieldLen == 0 || i + 1 + fieldLen > len) {
+            break; // padding or malformed: stop rather than read past the payload
+        }
+        uint8_t type = data[i + 1];
+        const uint8_t *payload = data + i + 2;
+        size_t payloadLen = (size_t)fieldLen - 1;
+        if (type == AD_TYPE_UUID128_COMPLETE || type == AD_TYPE_UUID128_INCOMPLETE) {
+            for (size_t k = 0; k + 16 <= payloadLen; k += 16) {
+                if (memcmp(payload + k, serviceUuidLe, 16) == 0) {
+                    match |= ADV_MATCH_SERVICE;
+                    break;
+                }
+            }
+        } else if (type == AD_TYPE_COMPLETE_LOCAL_NAME || type == AD_TYPE_SHORT_LOCAL_NAME) {
+            if (payloadLen == nameLen && memcmp(payload, name, nameLen) == 0) {
+                match |= ADV_MATCH_NAME;
+            }
+        }
+        i += 1 + (size_t)fieldLen;
+    }
+    return match;
+}
@@ -0,0 +1,114 @@
+/*
+ * Optional SmartStall status telemetry carried in the advertisement, so the hub can observe
+ * status/battery without a connection.
+ *
+ * The same 9-byte payload may appear in either AD structure:
+ *   Manufacturer Specific Data (0xFF): company 0xFFFF (LE) followed by the payload — fits in the
+ *                                      advert next to flags and the "SmartStall" name
+ *   Service Data - 128-bit UUID (0x21): SmartStall service UUID (LE) followed by the payload — fits
+ *                                      in the scan response
+ *
+ * Payload (little-endian):
+ *   [0]    format version (ADV_STATUS_VERSION)
+ *   [1]    stall status (same values as the Stall Status characteristic)
+ *   [2..3] battery mV
+ *   [4..7] counts digest: FNV-1a 32 over the 12-byte Sensor Counts characteristic value
+ *   [8]    sequence, incremented by the peripheral on every status or counts change
+ *
+ * Header-only and independent of Particle.h so it can be exercised on the host with synthetic adverts.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const uint8_t AD_TYPE_SERVICE_DATA_UUID128 = 0x21;
+const uint8_t AD_TYPE_MANUFACTURER_DATA = 0xFF;
+const uint16_t ADV_STATUS_COMPANY_ID = 0xFFFF; // Bluetooth SIG "no company" ID, reserved for testing
+const uint8_t ADV_STATUS_VERSION = 1;
+const size_t ADV_STATUS_PAYLOAD_LEN = 9;
+
+struct AdvStatus {
+    uint8_t status;
+    uint16_t batteryMv;
+    uint32_t countsDigest;
+    uint8_t sequence;
+};
+
+// FNV-1a over the Sensor Counts characteristic layout (three uint32 LE: limit, cap touch, hall)
+inline uint32_t sensorCountsDigest(uint32_t limitSwitch, uint32_t capTouch, uint32_t hall) {
+    const uint32_t counts[3] = {limitSwitch, capTouch, hall};
+    uint32_t h = 2166136261u;
+    for (uint32_t c : counts) {
+        for (int b = 0; b < 4; ++b) {
+            h ^= (uint8_t)(c >> (8 * b));
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+inline void encodeAdvStatusPayload(const AdvStatus &s, uint8_t out[ADV_STATUS_PAYLOAD_LEN]) {
+    out[0] = ADV_STATUS_VERSION;
+    out[1] = s.status;
+    out[2] = (uint8_t)(s.batteryMv & 0xFF);
+    out[3] = (uint8_t)(s.batteryMv >> 8);
+    for (int b = 0; b < 4; ++b) {
+        out[4 + b] = (uint8_t)(s.countsDigest >> (8 * b));
+    }
+    out[8] = s.sequence;
+}
+
+inline bool decodeAdvStatusPayload(const uint8_t *p, size_t len, AdvStatus &out) {
+    if (len < ADV_STATUS_PAYLOAD_LEN || p[0] != ADV_STATUS_VERSION) {
+        return false;
+    }
+    out.status = p[1];
+    out.batteryMv = (uint16_t)(p[2] | (p[3] << 8));
+    out.countsDigest = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+    out.sequence = p[8];
+    return true;
+}
+
+// Find and decode the telemetry field in one advertising or scan-response payload.
+// serviceUuidLe: 16 bytes in over-the-air order, as BleUuid::rawBytes() returns.
+inline bool parseSmartStallAdvStatus(const uint8_t *data, size_t len, const uint8_t *serviceUuidLe, AdvStatus &out) {
+    size_t i = 0;
+    while (i + 1 < len) {
+        uint8_t fieldLen = data[i];
+        if (fieldLen == 0 || i + 1 + fieldLen > len) {
+            break; // padding or malformed
+        }
+        uint8_t type = data[i + 1];
+        const uint8_t *payload = data + i + 2;
+        size_t payloadLen = (size_t)fieldLen - 1;
+        if (type == AD_TYPE_MANUFACTURER_DATA && payloadLen >= 2
+                && (uint16_t)(payload[0] | (payload[1] << 8)) == ADV_STATUS_COMPANY_ID) {
+            if (decodeAdvStatusPayload(payload + 2, payloadLen - 2, out)) return true;
+        } else if (type == AD_TYPE_SERVICE_DATA_UUID128 && payloadLen >= 16
+                && memcmp(payload, serviceUuidLe, 16) == 0) {
+            if (decodeAdvStatusPayload(payload + 16, payloadLen - 16, out)) return true;
+        }
+        i += 1 + (size_t)fieldLen;
+    }
+    return false;
+}
+
+enum AdvIngestAction : uint8_t {
+    ADV_INGEST_UPDATE = 0,   // counts unchanged since the last full read: take status/battery, no connection
+    ADV_INGEST_FULL_READ = 1 // never read, counts digest changed, or periodic full read due: connect
+};
+
+// haveFullRead/countsDigest/lastFullReadMs describe the hub's last successful GATT read of this device.
+inline AdvIngestAction decideAdvIngest(const AdvStatus &s, bool haveFullRead, uint32_t countsDigest,
+                                       unsigned long lastFullReadMs, unsigned long now,
+                                       unsigned long fullReadIntervalMs) {
+    if (!haveFullRead || s.countsDigest != countsDigest) {
+        return ADV_INGEST_FULL_READ;
+    }
+    if ((now - lastFullReadMs) >= fullReadIntervalMs) {
+        return ADV_INGEST_FULL_READ;
+    }
+    return ADV_INGEST_UPDATE;
+}
@@ -0,0 +1,51 @@
+/*
+ * Per-device usage derived from the absolute Sensor Counts totals.
+ *
+ * Each snapshot a device submits for publishing carries the counter increments since the snapshot
+ * it submitted before (its base), the seconds between the two reads and a reset flag. The counters
+ * only grow, except that a pin reset zeroes them (BLUETOOTH_API.md). So a counter below its base
+ * means a reset: the increments are then the counts since the reset, and any made between the base
+ * read and the reset are lost.
+ *
+ * Usage is computed once, when the snapshot is submitted. Snapshots are only submitted when status or
+ * counts changed, so an unchanged re-read adds nothing. A failed counts read that reuses the last value
+ * adds nothing either. The usage is kept with the snapshot through the event queue, so a replayed or
+ * re-sent snapshot carries the same usage, and a receiver can drop duplicates by device and timestamp.
+ * A receiver that holds the device's snapshot at timestamp - interval_s has seen every increment; one
+ * that does not has missed a snapshot, whose increments are lost unless it arrives later.
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <stdint.h>
+
+const uint8_t COUNTER_USAGE_VALID = 0x01; // the device had a base (not its first snapshot since boot)
+const uint8_t COUNTER_USAGE_RESET = 0x02; // a counter went below its base: deltas count from zero
+
+struct CounterUsage {
+    uint32_t delta[3];  // limit switch, cap touch, hall
+    uint32_t intervalS; // base read to this read; 0 when the base time is unknown or later
+    uint8_t flags;
+};
+
+inline CounterUsage counterUsageSince(const uint32_t base[3], uint32_t baseTimestamp, const uint32_t counts[3],
+                                      uint32_t timestamp) {
+    CounterUsage u = {};
+    u.flags = COUNTER_USAGE_VALID;
+    bool reset = counts[0] < base[0] || counts[1] < base[1] || counts[2] < base[2];
+    if (reset) {
+        u.flags |= COUNTER_USAGE_RESET;
+    }
+    for (int i = 0; i < 3; ++i) {
+        u.delta[i] = reset ? counts[i] : counts[i] - base[i];
+    }
+    u.intervalS = (baseTimestamp != 0 && timestamp >= baseTimestamp) ? timestamp - baseTimestamp : 0;
+    return u;
+}
+
+// Increments per hour in hundredths, rounded half up; 0 when the interval is 0
+inline uint64_t counterRatePerHourCenti(uint32_t delta, uint32_t intervalS) {
+    if (intervalS == 0) return 0;
+    return ((uint64_t)delta * 360000 + intervalS / 2) / intervalS;
+}
@@ -0,0 +1,145 @@
+/*
+ * Compact binary snapshot encoding for smartstall/bin events (format version 1).
+ *
+ * Each event carries one frame, base64-encoded (standard alphabet, padded) for the publish API:
+ *   [0]     (DELTA_FORMAT_VERSION << 4) | frame type (DELTA_FRAME_KEY or DELTA_FRAME_DELTA)
+ *   varint  device index: the hub registry slot, or DELTA_INDEX_UNTRACKED
+ *   [1]     sequence: per device, incremented on every frame (mod 256)
+ *   keyframe: 6-byte address, most significant byte first (as printed), then varints
+ *             timestamp, status, battery_mv, limit_switch, cap_touch, hall_sensor
+ *   delta:    varints timestamp - base, status, zigzag(battery_mv - base), then
+ *             limit_switch, cap_touch, hall_sensor minus base
+ * The base is the device's previous frame. Varints are LEB128 (7 bits per byte, low bits first).
+ *
+ * A receiver applies a delta only when it holds a base for that index and the sequence follows the
+ * last one it saw. Otherwise it waits for the next keyframe. The hub sends a keyframe:
+ *   - as a device's first frame;
+ *   - when a delta cannot be expressed (counters reset, clock stepped back);
+ *   - every few frames, so a lost event costs at most that many updates.
+ *
+ * Header-only and independent of Particle.h; the host decoder (host/decoder) shares these helpers.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+const uint8_t DELTA_FORMAT_VERSION = 1;
+const uint16_t DELTA_INDEX_UNTRACKED = 0xFFFF; // keyframe for a device outside the registry
+const size_t DELTA_FRAME_MAX = 48;             // header + index + sequence + address + 6 varints
+const size_t DELTA_BASE64_MAX = ((DELTA_FRAME_MAX + 2) / 3) * 4 + 1;
+
+enum DeltaFrameType : uint8_t {
+    DELTA_FRAME_KEY = 0,
+    DELTA_FRAME_DELTA = 1
+};
+
+struct SnapshotFields {
+    uint8_t address[6]; // most significant byte first
+    uint32_t timestamp;
+    uint16_t status;
+    uint16_t batteryMv;
+    uint32_t counts[3]; // limit switch, cap touch, hall
+};
+
+inline size_t putVarint(uint8_t *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint32_t zigzagEncode(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t zigzagDecode(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+// A delta needs non-decreasing timestamp and counters
+inline bool deltaEncodable(const SnapshotFields &cur, const SnapshotFields &base) {
+    if (cur.timestamp < base.timestamp) return false;
+    for (int i = 0; i < 3; ++i) {
+        if (cur.counts[i] < base.counts[i]) return false;
+    }
+    return true;
+}
+
+// base == nullptr writes a keyframe. Returns the frame length (at most DELTA_FRAME_MAX).
+inline size_t encodeSnapshotFrame(const SnapshotFields &cur, const SnapshotFields *base, uint16_t deviceIndex,
+                                  uint8_t sequence, uint8_t out[DELTA_FRAME_MAX]) {
+    size_t n = 0;
+    out[n++] = (uint8_t)((DELTA_FORMAT_VERSION << 4) | (base ? DELTA_FRAME_DELTA : DELTA_FRAME_KEY));
+    n += putVarint(out + n, deviceIndex);
+    out[n++] = sequence;
+    if (!base) {
+        for (int i = 0; i < 6; ++i) out[n++] = cur.address[i];
+        n += putVarint(out + n, cur.timestamp);
+        n += putVarint(out + n, cur.status);
+        n += putVarint(out + n, cur.batteryMv);
+        for (int i = 0; i < 3; ++i) n += putVarint(out + n, cur.counts[i]);
+    } else {
+        n += putVarint(out + n, cur.timestamp - base->timestamp);
+        n += putVarint(out + n, cur.status);
+        n += putVarint(out + n, zigzagEncode((int32_t)cur.batteryMv - (int32_t)base->batteryMv));
+        for (int i = 0; i < 3; ++i) n += putVarint(out + n, cur.counts[i] - base->counts[i]);
+    }
+    return n;
+}
+
+// NUL-terminated base64 of in[0..len). Returns the text length, or 0 if cap is too small.
+inline size_t base64Encode(const uint8_t *in, size_t len, char *out, size_t cap) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t outLen = ((len + 2) / 3) * 4;
+    if (outLen + 1 > cap) return 0;
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = ALPHABET[(v >> 18) & 0x3F];
+        out[o++] = ALPHABET[(v >> 12) & 0x3F];
+        out[o++] = i + 1 < len ? ALPHABET[(v >> 6) & 0x3F] : '=';
+        out[o++] = i + 2 < len ? ALPHABET[v & 0x3F] : '=';
+    }
+    out[o] = '\0';
+    return o;
+}
+
+// Inverse of base64Encode; rejects anything but padded standard base64. Returns bytes written or -1.
+inline int base64Decode(const char *in, size_t len, uint8_t *out, size_t cap) {
+    if (len % 4 != 0) return -1;
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 4) {
+        uint32_t v = 0;
+        int pad = 0;
+        for (int k = 0; k < 4; ++k) {
+            char c = in[i + k];
+            int d;
+            if (c >= 'A' && c <= 'Z') d = c - 'A';
+            else if (c >= 'a' && c <= 'z') d = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') d = c - '0' + 52;
+            else if (c == '+') d = 62;
+            else if (c == '/') d = 63;
+            else if (c == '=' && k >= 2 && i + 4 == len) { d = 0; pad++; }
+            else return -1;
+            if (pad && c != '=') return -1;
+            v = (v << 6) | (uint32_t)d;
+        }
+        size_t bytes = 3 - (size_t)pad;
+        if (o + bytes > cap) return -1;
+        out[o++] = (uint8_t)(v >> 16);
+        if (bytes > 1) out[o++] = (uint8_t)(v >> 8);
+        if (bytes > 2) out[o++] = (uint8_t)v;
+    }
+    return (int)o;
+}
@@ -0,0 +1,122 @@
+/*
+ * Fixed-capacity storage for the SmartStall device registry.
+ *
+ * FixedVector<T, N>     statically sized arena with the subset of the Vector API the hub uses
+ *                       (size/at/append). It never allocates, so registry growth cannot hit the
+ *                       heap while the BLE system thread is delivering callbacks.
+ * DeviceAddressIndex<N> open-addressing (linear probe) hash index from a packed 48-bit BLE
+ *                       address to a registry slot. The table is a power of two at least twice
+ *                       N, so load stays <= 0.5 and lookups are O(1) expected.
+ *
+ * The registry is append-only, so the index has no delete (no tombstones needed).
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t Capacity>
+class FixedVector {
+public:
+    int size() const { return (int)count_; }
+    int capacity() const { return (int)Capacity; }
+    bool isEmpty() const { return count_ == 0; }
+    bool full() const { return count_ >= Capacity; }
+    bool append(const T &item) {
+        if (full()) return false;
+        items_[count_++] = item;
+        return true;
+    }
+    void clear() { count_ = 0; }
+    T &at(int i) { return items_[i]; }
+    const T &at(int i) const { return items_[i]; }
+    T *begin() { return items_; }
+    T *end() { return items_ + count_; }
+    const T *begin() const { return items_; }
+    const T *end() const { return items_ + count_; }
+
+private:
+    T items_[Capacity];
+    size_t count_ = 0;
+};
+
+template <size_t Capacity>
+class DeviceAddressIndex {
+public:
+    static const uint16_t EMPTY = 0xFFFF;
+    static_assert(Capacity < EMPTY, "DeviceAddressIndex capacity must fit in uint16_t");
+
+    DeviceAddressIndex() { clear(); }
+
+    // Pack a 6-byte little-endian BLE address (octet 0 = LSB, as BleAddress stores it).
+    static uint64_t pack(const uint8_t addr[6]) {
+        return (uint64_t)addr[0] | ((uint64_t)addr[1] << 8) | ((uint64_t)addr[2] << 16) | ((uint64_t)addr[3] << 24)
+            | ((uint64_t)addr[4] << 32) | ((uint64_t)addr[5] << 40);
+    }
+
+    void clear() {
+        count_ = 0;
+        for (size_t i = 0; i < SLOTS; ++i) {
+            slots_[i].value = EMPTY;
+        }
+    }
+
+    size_t size() const { return count_; }
+
+    int find(uint64_t key) const {
+        uint32_t lo = (uint32_t)key;
+        uint16_t hi = (uint16_t)(key >> 32);
+        for (size_t i = hash(lo, hi);; i = (i + 1) & (SLOTS - 1)) {
+            const Slot &s = slots_[i];
+            if (s.value == EMPTY) return -1;
+            if (s.keyLo == lo && s.keyHi == hi) return s.value;
+        }
+    }
+
+    // Insert or overwrite; false only when full.
+    bool insert(uint64_t key, uint16_t value) {
+        uint32_t lo = (uint32_t)key;
+        uint16_t hi = (uint16_t)(key >> 32);
+        for (size_t i = hash(lo, hi);; i = (i + 1) & (SLOTS - 1)) {
+            Slot &s = slots_[i];
+            if (s.value == EMPTY) {
+                if (count_ >= Capacity) return false;
+                s.keyLo = lo;
+                s.keyHi = hi;
+                s.value = value;
+                count_++;
+                return true;
+            }
+            if (s.keyLo == lo && s.keyHi == hi) {
+                s.value = value;
+                return true;
+            }
+        }
+    }
+
+private:
+    static constexpr size_t slotsFor(size_t n) {
+        return n <= 1 ? 1 : 2 * slotsFor((n + 1) / 2);
+    }
+    static const size_t SLOTS = slotsFor(2 * Capacity);
+
+    // 32-bit finalizer (murmur3 fmix) over the folded address; cheap on Cortex-M.
+    static size_t hash(uint32_t lo, uint16_t hi) {
+        uint32_t h = lo ^ ((uint32_t)hi * 0x9E3779B1u);
+        h ^= h >> 16;
+        h *= 0x85EBCA6Bu;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35u;
+        h ^= h >> 16;
+        return h & (SLOTS - 1);
+    }
+
+    struct Slot {
+        uint32_t keyLo;
+        uint16_t keyHi;
+        uint16_t value;
+    };
+
+    Slot slots_[SLOTS];
+    size_t count_;
+};
@@ -0,0 +1,240 @@
+/*
+ * Persistent store-and-forward queue for snapshots the cloud has not acknowledged.
+ *
+ * A ring of Capacity fixed-size records kept in one file: on device a file on the flash file system
+ * (Device OS POSIX file API), on the host build a regular file. Layout, little-endian:
+ *   header  magic "SSQ1", version, record size, capacity, head, count, dropped, checksum
+ *   records Capacity slots of EVENT_QUEUE_RECORD_SIZE bytes, each ending in its own checksum
+ * When the ring is full, push() overwrites the oldest record and counts it as dropped.
+ *
+ * Each change writes the record first and then the header, followed by fsync(). A reset in between
+ * loses at most the record being written. A torn record fails its checksum, and peek() reports it so
+ * the owner can discard it. A header that does not match this build (other capacity or version) or
+ * fails its checksum starts an empty queue.
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "counter_usage.h"
+#include "delta_codec.h"
+
+// 2: records carry the snapshot's counter usage
+const uint8_t EVENT_QUEUE_VERSION = 2;
+const uint8_t QUEUED_SNAPSHOT_URGENT = 0x01;
+
+// Snapshot as read from a device; fields.timestamp is the read time, kept through any replay
+struct QueuedSnapshot {
+    SnapshotFields fields;
+    uint8_t flags;
+    CounterUsage usage; // computed when submitted; replays carry it unchanged
+};
+
+// address, timestamp, status, battery_mv, counts, flags, usage (interval, deltas, flags), checksum
+const size_t EVENT_QUEUE_RECORD_SIZE = 6 + 4 + 2 + 2 + 3 * 4 + 1 + 4 + 3 * 4 + 1 + 2;
+const size_t EVENT_QUEUE_HEADER_SIZE = 4 + 1 + 1 + 2 + 2 + 2 + 4 + 2;
+
+// Fletcher-16
+inline uint16_t eventQueueChecksum(const uint8_t *p, size_t len) {
+    uint16_t a = 0, b = 0;
+    for (size_t i = 0; i < len; ++i) {
+        a = (uint16_t)((a + p[i]) % 255);
+        b = (uint16_t)((b + a) % 255);
+    }
+    return (uint16_t)((b << 8) | a);
+}
+
+template <uint16_t Capacity>
+class SnapshotQueue {
+public:
+    ~SnapshotQueue() { close(); }
+
+    // Load the queue from path, or start an empty one there. false if the file cannot be used: the
+    // queue then holds nothing and push() only counts drops.
+    bool open(const char *path) {
+        close();
+        fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) return false;
+        if (loadHeader()) return true;
+        head_ = 0;
+        count_ = 0;
+        dropped_ = 0;
+        if (!writeHeader()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool isOpen() const { return fd_ >= 0; }
+    uint16_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    uint32_t dropped() const { return dropped_; }
+
+    // Append at the tail; when full the oldest record is overwritten. false if nothing was stored.
+    bool push(const QueuedSnapshot &s) {
+        if (fd_ < 0) {
+            dropped_++;
+            return false;
+        }
+        uint16_t slot = (uint16_t)((head_ + count_) % Capacity);
+        uint8_t rec[EVENT_QUEUE_RECORD_SIZE];
+        encodeRecord(s, rec);
+        if (!writeAt(recordOffset(slot), rec, sizeof(rec))) {
+            dropped_++;
+            return false;
+        }
+        if (count_ == Capacity) {
+            head_ = (uint16_t)((head_ + 1) % Capacity);
+            dropped_++;
+        } else {
+            count_++;
+        }
+        return writeHeader();
+    }
+
+    // i-th oldest record. false if it cannot be read or fails its checksum (torn write).
+    bool peek(uint16_t i, QueuedSnapshot &out) const {
+        if (fd_ < 0 || i >= count_) return false;
+        uint8_t rec[EVENT_QUEUE_RECORD_SIZE];
+        if (!readAt(recordOffset((uint16_t)((head_ + i) % Capacity)), rec, sizeof(rec))) return false;
+        return decodeRecord(rec, out);
+    }
+
+    // Remove the n oldest records (delivered)
+    void pop(uint16_t n = 1) {
+        if (n > count_) n = count_;
+        if (n == 0) return;
+        head_ = (uint16_t)((head_ + n) % Capacity);
+        count_ = (uint16_t)(count_ - n);
+        writeHeader();
+    }
+
+    // Remove the oldest record without delivering it (unreadable); counted as dropped
+    void discardOldest() {
+        if (count_ == 0) return;
+        dropped_++;
+        pop(1);
+    }
+
+private:
+    static_assert(Capacity > 0, "SnapshotQueue capacity must be positive");
+
+    static off_t recordOffset(uint16_t slot) {
+        return (off_t)(EVENT_QUEUE_HEADER_SIZE + (size_t)slot * EVENT_QUEUE_RECORD_SIZE);
+    }
+
+    static void put16(uint8_t *&p, uint16_t v) {
+        *p++ = (uint8_t)v;
+        *p++ = (uint8_t)(v >> 8);
+    }
+    static void put32(uint8_t *&p, uint32_t v) {
+        put16(p, (uint16_t)v);
+        put16(p, (uint16_t)(v >> 16));
+    }
+    static uint16_t get16(const uint8_t *&p) {
+        uint16_t v = (uint16_t)(p[0] | (p[1] << 8));
+        p += 2;
+        return v;
+    }
+    static uint32_t get32(const uint8_t *&p) {
+        uint32_t lo = get16(p);
+        return lo | ((uint32_t)get16(p) << 16);
+    }
+
+    static void encodeRecord(const QueuedSnapshot &s, uint8_t rec[EVENT_QUEUE_RECORD_SIZE]) {
+        uint8_t *p = rec;
+        memcpy(p, s.fields.address, 6);
+        p += 6;
+        put32(p, s.fields.timestamp);
+        put16(p, s.fields.status);
+        put16(p, s.fields.batteryMv);
+        for (int i = 0; i < 3; ++i) put32(p, s.fields.counts[i]);
+        *p++ = s.flags;
+        put32(p, s.usage.intervalS);
+        for (int i = 0; i < 3; ++i) put32(p, s.usage.delta[i]);
+        *p++ = s.usage.flags;
+        put16(p, eventQueueChecksum(rec, (size_t)(p - rec)));
+    }
+
+    static bool decodeRecord(const uint8_t rec[EVENT_QUEUE_RECORD_SIZE], QueuedSnapshot &s) {
+        const uint8_t *p = rec + EVENT_QUEUE_RECORD_SIZE - 2;
+        if (get16(p) != eventQueueChecksum(rec, EVENT_QUEUE_RECORD_SIZE - 2)) return false;
+        p = rec;
+        memcpy(s.fields.address, p, 6);
+        p += 6;
+        s.fields.timestamp = get32(p);
+        s.fields.status = get16(p);
+        s.fields.batteryMv = get16(p);
+        for (int i = 0; i < 3; ++i) s.fields.counts[i] = get32(p);
+        s.flags = *p++;
+        s.usage.intervalS = get32(p);
+        for (int i = 0; i < 3; ++i) s.usage.delta[i] = get32(p);
+        s.usage.flags = *p;
+        return true;
+    }
+
+    bool loadHeader() {
+        uint8_t h[EVENT_QUEUE_HEADER_SIZE];
+        if (!readAt(0, h, sizeof(h))) return false;
+        const uint8_t *p = h + sizeof(h) - 2;
+        if (get16(p) != eventQueueChecksum(h, sizeof(h) - 2)) return false;
+        if (memcmp(h, MAGIC, 4) != 0 || h[4] != EVENT_QUEUE_VERSION || h[5] != EVENT_QUEUE_RECORD_SIZE) return false;
+        p = h + 6;
+        uint16_t capacity = get16(p);
+        uint16_t head = get16(p);
+        uint16_t count = get16(p);
+        uint32_t dropped = get32(p);
+        if (capacity != Capacity || head >= Capacity || count > Capacity) return false;
+        head_ = head;
+        count_ = count;
+        dropped_ = dropped;
+        return true;
+    }
+
+    bool writeHeader() {
+        uint8_t h[EVENT_QUEUE_HEADER_SIZE];
+        memcpy(h, MAGIC, 4);
+        h[4] = EVENT_QUEUE_VERSION;
+        h[5] = (uint8_t)EVENT_QUEUE_RECORD_SIZE;
+        uint8_t *p = h + 6;
+        put16(p, Capacity);
+        put16(p, head_);
+        put16(p, count_);
+        put32(p, dropped_);
+        put16(p, eventQueueChecksum(h, sizeof(h) - 2));
+        if (!writeAt(0, h, sizeof(h))) return false;
+        return fsync(fd_) == 0;
+    }
+
+    bool writeAt(off_t off, const uint8_t *buf, size_t len) {
+        return lseek(fd_, off, SEEK_SET) == off && ::write(fd_, buf, len) == (ssize_t)len;
+    }
+
+    bool readAt(off_t off, uint8_t *buf, size_t len) const {
+        return lseek(fd_, off, SEEK_SET) == off && ::read(fd_, buf, len) == (ssize_t)len;
+    }
+
+    static constexpr uint8_t MAGIC[4] = {'S', 'S', 'Q', '1'};
+
+    int fd_ = -1;
+    uint16_t head_ = 0;
+    uint16_t count_ = 0;
+    uint32_t dropped_ = 0;
+};
+
+template <uint16_t Capacity>
+constexpr uint8_t SnapshotQueue<Capacity>::MAGIC[4];
@@ -0,0 +1,431 @@
+/*
+ * Input capture: a compact record of what the hub observed from BLE and the cloud, for replay on the
+ * host (host/replay). Each record is one input, with the millis() at which it happened:
+ *   CAPTURE_SCAN        a BLE.scan() call: duration and the number of reports the callback saw
+ *   CAPTURE_SIGHTING    one SmartStall report from a scan: device, RSSI, advert match, advertised status
+ *   CAPTURE_CONNECT     a BLE.connect() call: duration, connected or not, characteristics it discovered
+ *   CAPTURE_DISCONNECT  a disconnect the hub did not ask for (link loss, peripheral gone)
+ *   CAPTURE_SERVICES    a service discovery: duration, services found, SmartStall service among them
+ *   CAPTURE_CHARS       a characteristic discovery: duration, count, properties of the three SmartStall ones
+ *   CAPTURE_READ        a characteristic read: duration, result (bytes or error) and the value
+ *   CAPTURE_CLOUD       Particle.connected() changed
+ *   CAPTURE_CLOCK       Time.now() was set or stepped
+ *   CAPTURE_MARK        nothing new: the capture covers the hub up to this time
+ *   CAPTURE_DEVICE      announces the address behind a device id
+ *
+ * Layout: "SSC1", version, then records of
+ *   [0]     record type
+ *   varint  zigzag(ms - previous record's ms): records are in the order the hub handled them, so a
+ *           sighting (stamped in the scan callback) follows the scan it came from
+ *   ...     the record's fields, varints unless noted
+ * A device is a varint: registry slot + 1, announced by one CAPTURE_DEVICE record the first time it is
+ * used, or 0 followed by the 6-byte address when the device has no registry slot.
+ *
+ * InputCaptureWriter appends records to a RAM buffer and writes it to the file when full or on
+ * flush(); it stops at the size cap rather than wrapping, since a replay starts from boot.
+ * InputCaptureReader walks a capture held in memory.
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "adv_status.h"
+#include "delta_codec.h"
+
+const uint8_t INPUT_CAPTURE_VERSION = 1;
+const size_t INPUT_CAPTURE_HEADER_SIZE = 5;
+const size_t INPUT_CAPTURE_READ_MAX = 12; // bytes of a read value kept (Sensor Counts)
+
+enum CaptureRecordType : uint8_t {
+    CAPTURE_DEVICE = 1,
+    CAPTURE_CLOCK,
+    CAPTURE_CLOUD,
+    CAPTURE_MARK,
+    CAPTURE_SCAN,
+    CAPTURE_SIGHTING,
+    CAPTURE_CONNECT,
+    CAPTURE_DISCONNECT,
+    CAPTURE_SERVICES,
+    CAPTURE_CHARS,
+    CAPTURE_READ
+};
+
+// Characteristics of the SmartStall service, as read and discovered (also CAPTURE_CONNECT mask bits)
+enum CaptureAttr : uint8_t {
+    CAPTURE_ATTR_STATUS = 0,
+    CAPTURE_ATTR_BATTERY = 1,
+    CAPTURE_ATTR_COUNTS = 2,
+    CAPTURE_ATTRS = 3
+};
+
+template <size_t MaxDevices, size_t BufferBytes>
+class InputCaptureWriter {
+public:
+    ~InputCaptureWriter() { close(); }
+
+    // Start a capture at path (truncated), moving an existing one to prevPath first. maxBytes caps the
+    // file, header included. false when the file cannot be created.
+    bool open(const char *path, const char *prevPath, uint32_t maxBytes) {
+        close();
+        if (prevPath) {
+            ::rename(path, prevPath);
+        }
+        fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) return false;
+        memset(announced_, 0, sizeof(announced_));
+        maxBytes_ = maxBytes;
+        fileBytes_ = 0;
+        used_ = 0;
+        lastMs_ = 0;
+        full_ = false;
+        memcpy(buf_, MAGIC, 4);
+        buf_[4] = INPUT_CAPTURE_VERSION;
+        used_ = INPUT_CAPTURE_HEADER_SIZE;
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            flush(true);
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    // Recording: open and under the size cap
+    bool active() const { return fd_ >= 0 && !full_; }
+    uint32_t bytes() const { return fileBytes_ + (uint32_t)used_; }
+
+    // Write the buffer to the file; sync also commits it to flash
+    void flush(bool sync) {
+        if (fd_ < 0) return;
+        if (used_ > 0) {
+            if (::write(fd_, buf_, used_) == (ssize_t)used_) {
+                fileBytes_ += (uint32_t)used_;
+            } else {
+                full_ = true; // file system full or failing: stop rather than leave a gap
+            }
+            used_ = 0;
+        }
+        if (sync) {
+            fsync(fd_);
+        }
+    }
+
+    void clock(uint32_t ms, uint32_t unixTime, bool valid) {
+        uint8_t *p = beginRecord(CAPTURE_CLOCK, ms);
+        if (!p) return;
+        p = put(p, unixTime);
+        *p++ = valid ? 1 : 0;
+        end(p);
+    }
+
+    void cloud(uint32_t ms, bool connected) {
+        uint8_t *p = beginRecord(CAPTURE_CLOUD, ms);
+        if (!p) return;
+        *p++ = connected ? 1 : 0;
+        end(p);
+    }
+
+    void mark(uint32_t ms) {
+        uint8_t *p = beginRecord(CAPTURE_MARK, ms);
+        if (p) end(p);
+    }
+
+    void scan(uint32_t startMs, uint32_t durationMs, uint32_t reports) {
+        uint8_t *p = beginRecord(CAPTURE_SCAN, startMs);
+        if (!p) return;
+        p = put(p, durationMs);
+        p = put(p, reports);
+        end(p);
+    }
+
+    template <typename Address>
+    void sighting(uint32_t ms, int slot, const Address &addr, int8_t rssi, uint8_t match, const AdvStatus *adv) {
+        uint8_t *p = beginDevice(CAPTURE_SIGHTING, ms, slot, addr);
+        if (!p) return;
+        *p++ = (uint8_t)rssi;
+        *p++ = (uint8_t)(match | (adv ? 0x80 : 0));
+        if (adv) {
+            encodeAdvStatusPayload(*adv, p);
+            p += ADV_STATUS_PAYLOAD_LEN;
+        }
+        end(p);
+    }
+
+    template <typename Address>
+    void connect(uint32_t startMs, int slot, const Address &addr, uint32_t durationMs, bool connected,
+                 uint8_t charsMask) {
+        uint8_t *p = beginDevice(CAPTURE_CONNECT, startMs, slot, addr);
+        if (!p) return;
+        p = put(p, durationMs);
+        *p++ = (uint8_t)((connected ? 1 : 0) | (charsMask << 1));
+        end(p);
+    }
+
+    template <typename Address>
+    void disconnect(uint32_t ms, int slot, const Address &addr) {
+        uint8_t *p = beginDevice(CAPTURE_DISCONNECT, ms, slot, addr);
+        if (p) end(p);
+    }
+
+    template <typename Address>
+    void services(uint32_t startMs, int slot, const Address &addr, uint32_t durationMs, uint32_t count,
+                  bool smartstall) {
+        uint8_t *p = beginDevice(CAPTURE_SERVICES, startMs, slot, addr);
+        if (!p) return;
+        p = put(p, durationMs);
+        p = put(p, count);
+        *p++ = smartstall ? 1 : 0;
+        end(p);
+    }
+
+    // props: properties byte of each CaptureAttr characteristic found, 0 when absent
+    template <typename Address>
+    void characteristics(uint32_t startMs, int slot, const Address &addr, uint32_t durationMs, uint32_t count,
+                         const uint8_t props[CAPTURE_ATTRS]) {
+        uint8_t *p = beginDevice(CAPTURE_CHARS, startMs, slot, addr);
+        if (!p) return;
+        p = put(p, durationMs);
+        p = put(p, count);
+        memcpy(p, props, CAPTURE_ATTRS);
+        end(p + CAPTURE_ATTRS);
+    }
+
+    // result: bytes read (value holds them) or a negative error
+    template <typename Address>
+    void read(uint32_t startMs, int slot, const Address &addr, uint8_t attr, uint32_t durationMs, int32_t result,
+              const uint8_t *value) {
+        uint8_t *p = beginDevice(CAPTURE_READ, startMs, slot, addr);
+        if (!p) return;
+        *p++ = attr;
+        p = put(p, durationMs);
+        p += putVarint(p, zigzagEncode(result));
+        size_t n = result > 0 ? ((size_t)result < INPUT_CAPTURE_READ_MAX ? (size_t)result : INPUT_CAPTURE_READ_MAX) : 0;
+        memcpy(p, value, n);
+        end(p + n);
+    }
+
+private:
+    static_assert(BufferBytes >= 64, "InputCaptureWriter buffer must hold the largest record");
+
+    // Largest record: type, time, device announcement plus reference, a sighting with telemetry
+    static const size_t RECORD_MAX = 48;
+
+    static uint8_t *put(uint8_t *p, uint32_t v) { return p + putVarint(p, v); }
+
+    // Room for one record in the buffer, header written; null when not recording
+    uint8_t *beginRecord(CaptureRecordType type, uint32_t ms) {
+        if (!active()) return nullptr;
+        if (fileBytes_ + used_ + RECORD_MAX > maxBytes_) {
+            full_ = true;
+            flush(true);
+            return nullptr;
+        }
+        if (used_ + RECORD_MAX > BufferBytes) {
+            flush(false);
+            if (!active()) return nullptr;
+        }
+        uint8_t *p = buf_ + used_;
+        *p++ = type;
+        p += putVarint(p, zigzagEncode((int32_t)(ms - lastMs_)));
+        lastMs_ = ms;
+        return p;
+    }
+
+    // As beginRecord(), followed by the device reference (announcing the slot first if new)
+    template <typename Address>
+    uint8_t *beginDevice(CaptureRecordType type, uint32_t ms, int slot, const Address &addr) {
+        if (slot >= 0 && (size_t)slot < MaxDevices && !(announced_[slot / 8] & (1 << (slot % 8)))) {
+            uint8_t *p = beginRecord(CAPTURE_DEVICE, ms);
+            if (!p) return nullptr;
+            p = put(p, (uint32_t)slot + 1);
+            for (int i = 0; i < 6; ++i) *p++ = addr[i];
+            end(p);
+            announced_[slot / 8] |= (uint8_t)(1 << (slot % 8));
+        }
+        uint8_t *p = beginRecord(type, ms);
+        if (!p) return nullptr;
+        if (slot >= 0 && (size_t)slot < MaxDevices) {
+            return put(p, (uint32_t)slot + 1);
+        }
+        *p++ = 0;
+        for (int i = 0; i < 6; ++i) *p++ = addr[i];
+        return p;
+    }
+
+    void end(uint8_t *p) { used_ = (size_t)(p - buf_); }
+
+    static constexpr uint8_t MAGIC[4] = {'S', 'S', 'C', '1'};
+
+    int fd_ = -1;
+    uint8_t buf_[BufferBytes];
+    size_t used_ = 0;
+    uint32_t fileBytes_ = 0;
+    uint32_t maxBytes_ = 0;
+    uint32_t lastMs_ = 0;
+    bool full_ = false;
+    uint8_t announced_[(MaxDevices + 7) / 8];
+};
+
+template <size_t MaxDevices, size_t BufferBytes>
+constexpr uint8_t InputCaptureWriter<MaxDevices, BufferBytes>::MAGIC[4];
+
+// One decoded record; fields beyond type, ms and address are set per type as in the writer
+struct CaptureRecord {
+    CaptureRecordType type;
+    uint32_t ms;
+    uint8_t address[6]; // BleAddress byte order (least significant first)
+    uint32_t durationMs;
+    uint32_t count;     // scan reports, services or characteristics found
+    int32_t result;     // read result; connect: 1 connected, 0 not
+    uint8_t flags;      // connect: characteristics mask; services: SmartStall found; clock: valid
+    uint8_t attr;
+    int8_t rssi;
+    uint8_t match;
+    bool hasAdvStatus;
+    AdvStatus advStatus;
+    uint8_t props[CAPTURE_ATTRS];
+    uint8_t value[INPUT_CAPTURE_READ_MAX];
+    uint32_t unixTime;
+    bool connected;
+};
+
+class InputCaptureReader {
+public:
+    // data must outlive the reader. false when it is not a capture of this version.
+    bool open(const uint8_t *data, size_t len) {
+        p_ = data;
+        end_ = data + len;
+        ms_ = 0;
+        malformed_ = false;
+        memset(known_, 0, sizeof(known_));
+        if (len < INPUT_CAPTURE_HEADER_SIZE || memcmp(data, "SSC1", 4) != 0 || data[4] != INPUT_CAPTURE_VERSION) {
+            return false;
+        }
+        p_ += INPUT_CAPTURE_HEADER_SIZE;
+        return true;
+    }
+
+    // Next input record (device announcements are applied, not returned). false at the end or at a
+    // truncated or malformed record (malformed() tells which).
+    bool next(CaptureRecord &r) {
+        for (;;) {
+            if (p_ >= end_) return false;
+            const uint8_t *start = p_;
+            if (!decode(r)) {
+                p_ = start;
+                malformed_ = true;
+                return false;
+            }
+            if (r.type != CAPTURE_DEVICE) return true;
+        }
+    }
+
+    bool malformed() const { return malformed_; }
+
+private:
+    static const uint32_t MAX_SLOTS = 1024;
+
+    bool varint(uint32_t &v) { return getVarint(p_, end_, v); }
+    bool bytes(uint8_t *out, size_t n) {
+        if ((size_t)(end_ - p_) < n) return false;
+        memcpy(out, p_, n);
+        p_ += n;
+        return true;
+    }
+
+    bool device(CaptureRecord &r) {
+        uint32_t ref;
+        if (!varint(ref)) return false;
+        if (ref == 0) return bytes(r.address, 6);
+        if (ref > MAX_SLOTS || !known_[ref - 1]) return false;
+        memcpy(r.address, devices_[ref - 1], 6);
+        return true;
+    }
+
+    bool decode(CaptureRecord &r) {
+        memset(&r, 0, sizeof(r));
+        r.type = (CaptureRecordType)*p_++;
+        uint32_t delta;
+        if (!varint(delta)) return false;
+        ms_ += (uint32_t)zigzagDecode(delta);
+        r.ms = ms_;
+        uint32_t v;
+        switch (r.type) {
+            case CAPTURE_DEVICE:
+                if (!varint(v) || v == 0 || v > MAX_SLOTS || !bytes(devices_[v - 1], 6)) return false;
+                known_[v - 1] = true;
+                return true;
+            case CAPTURE_CLOCK: {
+                uint8_t valid;
+                if (!varint(r.unixTime) || !bytes(&valid, 1)) return false;
+                r.flags = valid;
+                return true;
+            }
+            case CAPTURE_CLOUD: {
+                uint8_t up;
+                if (!bytes(&up, 1)) return false;
+                r.connected = up != 0;
+                return true;
+            }
+            case CAPTURE_MARK:
+                return true;
+            case CAPTURE_SCAN:
+                return varint(r.durationMs) && varint(r.count);
+            case CAPTURE_SIGHTING: {
+                uint8_t b[2];
+                if (!device(r) || !bytes(b, 2)) return false;
+                r.rssi = (int8_t)b[0];
+                r.match = b[1] & 0x7F;
+                r.hasAdvStatus = (b[1] & 0x80) != 0;
+                if (r.hasAdvStatus) {
+                    uint8_t payload[ADV_STATUS_PAYLOAD_LEN];
+                    if (!bytes(payload, sizeof(payload))) return false;
+                    decodeAdvStatusPayload(payload, sizeof(payload), r.advStatus);
+                }
+                return true;
+            }
+            case CAPTURE_CONNECT: {
+                uint8_t b;
+                if (!device(r) || !varint(r.durationMs) || !bytes(&b, 1)) return false;
+                r.connected = (b & 1) != 0;
+                r.result = r.connected ? 1 : 0;
+                r.flags = (uint8_t)(b >> 1);
+                return true;
+            }
+            case CAPTURE_DISCONNECT:
+                return device(r);
+            case CAPTURE_SERVICES: {
+                uint8_t b;
+                if (!device(r) || !varint(r.durationMs) || !varint(r.count) || !bytes(&b, 1)) return false;
+                r.flags = b;
+                return true;
+            }
+            case CAPTURE_CHARS:
+                return device(r) && varint(r.durationMs) && varint(r.count) && bytes(r.props, CAPTURE_ATTRS);
+            case CAPTURE_READ: {
+                if (!device(r) || !bytes(&r.attr, 1) || !varint(r.durationMs) || !varint(v)) return false;
+                r.result = zigzagDecode(v);
+                size_t n = r.result > 0 ? ((size_t)r.result < INPUT_CAPTURE_READ_MAX ? (size_t)r.result
+                                                                                      : INPUT_CAPTURE_READ_MAX) : 0;
+                return bytes(r.value, n);
+            }
+        }
+        return false;
+    }
+
+    const uint8_t *p_ = nullptr;
+    const uint8_t *end_ = nullptr;
+    uint32_t ms_ = 0;
+    bool malformed_ = false;
+    uint8_t devices_[MAX_SLOTS][6];
+    bool known_[MAX_SLOTS];
+};
@@ -0,0 +1,168 @@
+/*
+ * Fixed-capacity JSON writer for cloud event payloads.
+ *
+ * Appends into a caller-provided buffer using integer-only number formatting, so rendering a
+ * payload needs no heap and no printf float support. Overflow is sticky: once a write does not fit,
+ * nothing more is appended and ok() is false. The buffer is always NUL-terminated.
+ *
+ * Payload layouts are described at compile time by JsonField tables. Each entry holds the literal
+ * text before a value (punctuation and key), the value kind and a getter. writeJsonFields() walks
+ * the table.
+ *
+ * Header-only and independent of Particle.h so it can be exercised on the host.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Hundredths of a volt, rounded exactly as printf("%.2f", mv / 1000.0f) rounds them.
+// Only ties (mv ending in 5) can differ from plain rounding. There, the float quotient lands just
+// above or below the tie, or exactly on it (round half to even). We recompute that quotient in
+// integers: a 24-bit significand q with value q / 2^shift.
+inline uint32_t millivoltsToCentivolts(uint32_t mv) {
+    uint32_t centi = mv / 10;
+    uint32_t rem = mv % 10;
+    if (rem < 5) return centi;
+    if (rem > 5) return centi + 1;
+
+    int shift = 0;
+    while ((((uint64_t)mv << shift) / 1000) < (1u << 23)) {
+        shift++;
+    }
+    uint64_t scaled = (uint64_t)mv << shift;
+    uint64_t q = scaled / 1000;
+    uint64_t r = scaled % 1000;
+    if (r > 500 || (r == 500 && (q & 1))) {
+        q++; // round to nearest, ties to even, as the float division does
+    }
+    uint64_t floatTimes1000 = q * 1000; // compared against scaled: float value vs exact quotient
+    if (floatTimes1000 > scaled) return centi + 1;
+    if (floatTimes1000 < scaled) return centi;
+    return (centi & 1) ? centi + 1 : centi;
+}
+
+class JsonWriter {
+public:
+    JsonWriter(char *buf, size_t capacity) : buf_(buf), cap_(capacity) {
+        if (cap_ > 0) buf_[0] = '\0';
+        ok_ = cap_ > 0;
+    }
+
+    bool ok() const { return ok_; }
+    size_t length() const { return len_; }
+    const char *c_str() const { return buf_; }
+
+    // Text copied as-is (keys, punctuation)
+    JsonWriter &raw(const char *s, size_t n) {
+        if (!reserve(n)) return *this;
+        memcpy(buf_ + len_, s, n);
+        len_ += n;
+        buf_[len_] = '\0';
+        return *this;
+    }
+    JsonWriter &raw(const char *s) { return raw(s, strlen(s)); }
+
+    // Quoted string; escapes quote, backslash and control characters
+    JsonWriter &text(const char *s) {
+        raw("\"", 1);
+        for (const char *p = s; *p && ok_; ++p) {
+            unsigned char c = (unsigned char)*p;
+            if (c == '"' || c == '\\') {
+                char esc[2] = {'\\', (char)c};
+                raw(esc, 2);
+            } else if (c < 0x20) {
+                static const char HEX[] = "0123456789abcdef";
+                char esc[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF]};
+                raw(esc, 6);
+            } else {
+                raw((const char *)&c, 1);
+            }
+        }
+        return raw("\"", 1);
+    }
+
+    JsonWriter &number(int64_t v) {
+        char digits[20];
+        int n = 0;
+        uint64_t u = v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+        do {
+            digits[n++] = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0) raw("-", 1);
+        if (!reserve((size_t)n)) return *this;
+        while (n > 0) {
+            buf_[len_++] = digits[--n];
+        }
+        buf_[len_] = '\0';
+        return *this;
+    }
+
+    JsonWriter &boolean(bool v) { return v ? raw("true", 4) : raw("false", 5); }
+
+    // Hundredths as a number with two decimals
+    JsonWriter &centi(uint64_t hundredths) {
+        number((int64_t)(hundredths / 100));
+        char frac[3] = {'.', (char)('0' + (hundredths % 100) / 10), (char)('0' + hundredths % 10)};
+        return raw(frac, 3);
+    }
+
+    // Millivolts as volts with two decimals, identical to "%.2f" of mv / 1000.0f
+    JsonWriter &volts(uint32_t mv) { return centi(millivoltsToCentivolts(mv)); }
+
+private:
+    bool reserve(size_t n) {
+        if (!ok_ || len_ + n + 1 > cap_) {
+            ok_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    char *buf_;
+    size_t cap_;
+    size_t len_ = 0;
+    bool ok_;
+};
+
+enum JsonValueKind : uint8_t {
+    JSON_VALUE_NONE = 0,  // literal only (closing brackets)
+    JSON_VALUE_TEXT = 1,  // text getter, quoted
+    JSON_VALUE_NUMBER = 2,
+    JSON_VALUE_BOOL = 3,
+    JSON_VALUE_VOLTS = 4, // number getter returns millivolts
+    JSON_VALUE_CENTI = 5  // number getter returns hundredths
+};
+
+template <typename T>
+struct JsonField {
+    const char *literal;
+    JsonValueKind kind;
+    int64_t (*number)(const T &);
+    const char *(*text)(const T &);
+};
+
+// The first count entries of a table
+template <typename T>
+inline bool writeJsonFields(JsonWriter &w, const JsonField<T> *fields, size_t count, const T &value) {
+    for (size_t i = 0; i < count; ++i) {
+        const JsonField<T> &f = fields[i];
+        w.raw(f.literal);
+        switch (f.kind) {
+            case JSON_VALUE_TEXT: w.text(f.text(value)); break;
+            case JSON_VALUE_NUMBER: w.number(f.number(value)); break;
+            case JSON_VALUE_BOOL: w.boolean(f.number(value) != 0); break;
+            case JSON_VALUE_VOLTS: w.volts((uint32_t)f.number(value)); break;
+            case JSON_VALUE_CENTI: w.centi((uint64_t)f.number(value)); break;
+            case JSON_VALUE_NONE: break;
+        }
+    }
+    return w.ok();
+}
+
+template <typename T, size_t N>
+inline bool writeJsonFields(JsonWriter &w, const JsonField<T> (&fields)[N], const T &value) {
+    return writeJsonFields(w, fields, N, value);
+}
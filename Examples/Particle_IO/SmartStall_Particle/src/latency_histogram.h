@@ -0,0 +1,76 @@
+/*
+ * Fixed-memory, log-scaled latency histogram.
+ *
+ * Values (any unit; the hub records ms, and µs for publishes) fall into four linear sub-buckets per
+ * power of two: exact below 4, then [4,5) [5,6) [6,7) [7,8) [8,10) [10,12) ... so a bucket is at most
+ * 25 % wider than its lower bound. The top bucket also takes everything at or above 2^LATENCY_OCTAVES;
+ * max() stays exact. record() is O(1) (one count-leading-zeros and a shift) and nothing allocates.
+ * percentile() walks the buckets and returns the upper bound of the one holding the requested rank,
+ * clamped to max().
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+const int LATENCY_OCTAVES = 20;                                     // 2^20 ms is about 17 minutes
+const int LATENCY_HISTOGRAM_BUCKETS = 4 + (LATENCY_OCTAVES - 2) * 4; // 76
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        memset(buckets_, 0, sizeof(buckets_));
+        count_ = 0;
+        max_ = 0;
+    }
+
+    void record(uint32_t v) {
+        buckets_[bucketOf(v)]++;
+        count_++;
+        if (v > max_) max_ = v;
+    }
+
+    uint32_t count() const { return count_; }
+    uint32_t max() const { return max_; }
+
+    // Value at or below which `permille` of the recorded values fall (0 when empty)
+    uint32_t percentile(uint16_t permille) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = ((uint64_t)count_ * permille + 999) / 1000;
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) {
+                uint32_t upper = upperBoundOf(i);
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+
+    static int bucketOf(uint32_t v) {
+        if (v < 4) return (int)v;
+        int msb = 31 - __builtin_clz(v);
+        if (msb >= LATENCY_OCTAVES) return LATENCY_HISTOGRAM_BUCKETS - 1;
+        return 4 + (msb - 2) * 4 + (int)((v >> (msb - 2)) & 3);
+    }
+
+    // Largest value bucketOf() maps to bucket i (the top bucket is open-ended)
+    static uint32_t upperBoundOf(int i) {
+        if (i < 4) return (uint32_t)i;
+        if (i == LATENCY_HISTOGRAM_BUCKETS - 1) return UINT32_MAX;
+        int shift = (i - 4) / 4;
+        uint32_t sub = (uint32_t)((i - 4) % 4);
+        return ((4 + sub + 1) << shift) - 1;
+    }
+
+private:
+    uint32_t buckets_[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count_;
+    uint32_t max_;
+};
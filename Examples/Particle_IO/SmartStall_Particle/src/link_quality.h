@@ -0,0 +1,99 @@
+/*
+ * Per-device radio link estimate, used to decide whether a due poll is worth a BLE.connect() now.
+ *
+ * LinkQuality keeps
+ *   - an exponentially weighted RSSI over scan sightings (alpha 1/4, fixed point in 1/16 dBm)
+ *   - when the device was last heard at or above LINK_RSSI_STRONG_DBM
+ *   - the outcome of its last 8 BLE.connect() attempts
+ * predictedConnectPermille() blends an RSSI prior with that history: the prior counts as
+ * LINK_PRIOR_WEIGHT attempts, so a device with no history is judged by signal alone and a few real
+ * outcomes quickly outweigh it.
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <stdint.h>
+
+const int8_t LINK_RSSI_STRONG_DBM = -80;         // a sighting this strong means a connect is likely to succeed
+const int8_t LINK_RSSI_WEAK_DBM = -86;           // average below this marks the device weak
+const int8_t LINK_PRIOR_GOOD_DBM = -75;          // RSSI prior: LINK_PRIOR_GOOD_PERMILLE at or above
+const int8_t LINK_PRIOR_BAD_DBM = -95;           // ... LINK_PRIOR_BAD_PERMILLE at or below, linear between
+const uint16_t LINK_PRIOR_GOOD_PERMILLE = 950;
+const uint16_t LINK_PRIOR_BAD_PERMILLE = 50;
+const uint8_t LINK_PRIOR_WEIGHT = 2;
+const uint8_t LINK_HISTORY_LEN = 8;
+const uint16_t LINK_WEAK_PERMILLE = 500;         // predicted connect success below this marks the device weak
+
+struct LinkQuality {
+    int16_t rssiQ4 = 0;           // average RSSI in 1/16 dBm; valid once sightings > 0
+    uint16_t sightings = 0;       // saturates
+    bool hasStrong = false;
+    unsigned long strongAtMs = 0; // last sighting at or above LINK_RSSI_STRONG_DBM
+    uint8_t connectHistory = 0;   // bit 0 = latest attempt, 1 = connected
+    uint8_t connectCount = 0;     // attempts in connectHistory, at most LINK_HISTORY_LEN
+};
+
+inline void noteLinkSighting(LinkQuality &q, int8_t rssi, unsigned long now) {
+    int16_t sample = (int16_t)(rssi * 16);
+    if (q.sightings == 0) {
+        q.rssiQ4 = sample;
+    } else {
+        q.rssiQ4 = (int16_t)(q.rssiQ4 + (sample - q.rssiQ4) / 4);
+    }
+    if (q.sightings < 0xFFFF) q.sightings++;
+    if (rssi >= LINK_RSSI_STRONG_DBM) {
+        q.hasStrong = true;
+        q.strongAtMs = now;
+    }
+}
+
+inline void noteLinkConnect(LinkQuality &q, bool connected) {
+    q.connectHistory = (uint8_t)((q.connectHistory << 1) | (connected ? 1 : 0));
+    if (q.connectCount < LINK_HISTORY_LEN) q.connectCount++;
+}
+
+// Average RSSI rounded to whole dBm (0 before the first sighting)
+inline int linkRssiDbm(const LinkQuality &q) {
+    if (q.sightings == 0) return 0;
+    return q.rssiQ4 >= 0 ? (q.rssiQ4 + 8) / 16 : -((-q.rssiQ4 + 8) / 16);
+}
+
+inline uint8_t linkConnectSuccesses(const LinkQuality &q) {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < q.connectCount; ++i) {
+        n += (q.connectHistory >> i) & 1;
+    }
+    return n;
+}
+
+// Connect success rate over the recorded history in percent, or -1 with no history
+inline int linkConnectOkPercent(const LinkQuality &q) {
+    if (q.connectCount == 0) return -1;
+    return (linkConnectSuccesses(q) * 100 + q.connectCount / 2) / q.connectCount;
+}
+
+inline uint16_t linkRssiPriorPermille(const LinkQuality &q) {
+    if (q.sightings == 0) return LINK_PRIOR_GOOD_PERMILLE; // nothing known: do not hold the device back
+    int rssiQ4 = q.rssiQ4;
+    const int good = LINK_PRIOR_GOOD_DBM * 16;
+    const int bad = LINK_PRIOR_BAD_DBM * 16;
+    if (rssiQ4 >= good) return LINK_PRIOR_GOOD_PERMILLE;
+    if (rssiQ4 <= bad) return LINK_PRIOR_BAD_PERMILLE;
+    return (uint16_t)(LINK_PRIOR_BAD_PERMILLE
+        + (int)(LINK_PRIOR_GOOD_PERMILLE - LINK_PRIOR_BAD_PERMILLE) * (rssiQ4 - bad) / (good - bad));
+}
+
+inline uint16_t predictedConnectPermille(const LinkQuality &q) {
+    uint32_t prior = linkRssiPriorPermille(q);
+    return (uint16_t)((prior * LINK_PRIOR_WEIGHT + 1000u * linkConnectSuccesses(q))
+        / (uint32_t)(LINK_PRIOR_WEIGHT + q.connectCount));
+}
+
+inline bool linkIsWeak(const LinkQuality &q) {
+    return (q.sightings > 0 && q.rssiQ4 < LINK_RSSI_WEAK_DBM * 16) || predictedConnectPermille(q) < LINK_WEAK_PERMILLE;
+}
+
+inline bool linkStrongSince(const LinkQuality &q, unsigned long now, unsigned long windowMs) {
+    return q.hasStrong && (now - q.strongAtMs) <= windowMs;
+}
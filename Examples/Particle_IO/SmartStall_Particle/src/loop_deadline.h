@@ -0,0 +1,41 @@
+/*
+ * Next-deadline collector for the hub's main loop.
+ *
+ * At the end of each loop() pass every timer that can make the next pass do work registers the
+ * millis() time it is due (or that it is due now); loop() then sleeps until the earliest one, at
+ * most maxSleepMs. A timer that is not armed simply does not register.
+ *
+ * Deadlines are compared wrap-safely ((long)(a - b) < 0), like PollScheduler.
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+class LoopDeadline {
+public:
+    LoopDeadline(unsigned long now, unsigned long maxSleepMs) : now_(now), sleepMs_(maxSleepMs) {}
+
+    static bool before(unsigned long a, unsigned long b) { return (long)(a - b) < 0; }
+    static unsigned long later(unsigned long a, unsigned long b) { return before(a, b) ? b : a; }
+
+    // Due at absolute time t; a deadline already passed means the next pass must run at once
+    void at(unsigned long t) { wait(before(now_, t) ? t - now_ : 0); }
+
+    // Due once (now - since) >= interval, the idiom the hub's periodic timers use
+    void after(unsigned long since, unsigned long interval) {
+        unsigned long elapsed = now_ - since;
+        wait(elapsed >= interval ? 0 : interval - elapsed);
+    }
+
+    void dueNow() { sleepMs_ = 0; }
+
+    unsigned long sleepMs() const { return sleepMs_; }
+
+private:
+    void wait(unsigned long ms) {
+        if (ms < sleepMs_) sleepMs_ = ms;
+    }
+
+    unsigned long now_;
+    unsigned long sleepMs_;
+};
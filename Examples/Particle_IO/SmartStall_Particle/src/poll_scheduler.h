@@ -0,0 +1,139 @@
+/*
+ * Deadline-ordered poll scheduler for the SmartStall hub.
+ *
+ * Fixed-capacity indexed binary min-heap of registry indices keyed on each device's next
+ * eligible poll time (millis()). Selection is O(1) peek + O(log n) update; every schedule,
+ * reschedule or removal is O(log n). No heap allocation — storage is sized at compile time.
+ *
+ * Deadlines are compared wrap-safely ((long)(a - b) < 0), so keys must stay within
+ * ~24 days of each other on 32-bit targets; the longest deadline the hub uses is 24 h.
+ * Equal deadlines are served in the order they were scheduled, which keeps the old
+ * round-robin fairness between devices that become due together. bestDue() lets the hub pick
+ * among the earliest due devices by its own score instead of strictly by deadline.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <size_t Capacity>
+class PollScheduler {
+public:
+    static const uint16_t NONE = 0xFFFF;
+    static_assert(Capacity < NONE, "PollScheduler capacity must fit in uint16_t");
+
+    PollScheduler() { clear(); }
+
+    void clear() {
+        count_ = 0;
+        seq_ = 0;
+        for (size_t i = 0; i < Capacity; ++i) {
+            pos_[i] = NONE;
+        }
+    }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool contains(uint16_t id) const { return id < Capacity && pos_[id] != NONE; }
+
+    // Earliest-deadline device; only valid when !empty().
+    uint16_t top() const { return heap_[0]; }
+    unsigned long topDueAt() const { return due_[heap_[0]]; }
+    unsigned long dueAt(uint16_t id) const { return due_[id]; }
+
+    static bool before(unsigned long a, unsigned long b) { return (long)(a - b) < 0; }
+    bool isDue(uint16_t id, unsigned long now) const { return contains(id) && !before(now, due_[id]); }
+
+    // Among due devices in the first `window` heap slots, the one with the highest score(id, dueAt); ties
+    // go to the earlier slot. A due child implies a due parent, so these are the earliest-deadline due
+    // devices and the cost stays O(window). NONE when top() is not due.
+    template <typename Score>
+    uint16_t bestDue(unsigned long now, size_t window, Score score) const {
+        if (empty() || before(now, due_[heap_[0]])) return NONE;
+        uint16_t best = heap_[0];
+        uint32_t bestScore = score(best, due_[best]);
+        size_t n = window < count_ ? window : count_;
+        for (size_t i = 1; i < n; ++i) {
+            uint16_t id = heap_[i];
+            if (before(now, due_[id])) continue;
+            uint32_t s = score(id, due_[id]);
+            if (s > bestScore) {
+                best = id;
+                bestScore = s;
+            }
+        }
+        return best;
+    }
+
+    // Insert `id` or move it to a new deadline.
+    bool schedule(uint16_t id, unsigned long dueAt) {
+        if (id >= Capacity) return false;
+        due_[id] = dueAt;
+        stamp_[id] = seq_++;
+        if (pos_[id] == NONE) {
+            pos_[id] = (uint16_t)count_;
+            heap_[count_++] = id;
+            siftUp(pos_[id]);
+        } else {
+            siftUp(pos_[id]);
+            siftDown(pos_[id]);
+        }
+        return true;
+    }
+
+    void remove(uint16_t id) {
+        if (!contains(id)) return;
+        uint16_t at = pos_[id];
+        pos_[id] = NONE;
+        count_--;
+        if (at == count_) return;
+        uint16_t moved = heap_[count_];
+        heap_[at] = moved;
+        pos_[moved] = at;
+        siftUp(at);
+        siftDown(pos_[moved]);
+    }
+
+private:
+    bool less(uint16_t a, uint16_t b) const {
+        if (due_[a] != due_[b]) return before(due_[a], due_[b]);
+        return (int32_t)(stamp_[a] - stamp_[b]) < 0;
+    }
+
+    void swapAt(uint16_t i, uint16_t j) {
+        uint16_t t = heap_[i];
+        heap_[i] = heap_[j];
+        heap_[j] = t;
+        pos_[heap_[i]] = i;
+        pos_[heap_[j]] = j;
+    }
+
+    void siftUp(uint16_t i) {
+        while (i > 0) {
+            uint16_t parent = (uint16_t)((i - 1) / 2);
+            if (!less(heap_[i], heap_[parent])) break;
+            swapAt(i, parent);
+            i = parent;
+        }
+    }
+
+    void siftDown(uint16_t i) {
+        for (;;) {
+            size_t l = 2 * (size_t)i + 1;
+            size_t r = l + 1;
+            size_t m = i;
+            if (l < count_ && less(heap_[l], heap_[m])) m = l;
+            if (r < count_ && less(heap_[r], heap_[m])) m = r;
+            if (m == i) break;
+            swapAt(i, (uint16_t)m);
+            i = (uint16_t)m;
+        }
+    }
+
+    uint16_t heap_[Capacity];
+    uint16_t pos_[Capacity];
+    unsigned long due_[Capacity];
+    uint32_t stamp_[Capacity];
+    size_t count_;
+    uint32_t seq_;
+};
@@ -0,0 +1,86 @@
+/*
+ * Batching buffer for multi-device cloud events.
+ *
+ * Collects pre-rendered JSON array items (one per device snapshot) into a single payload
+ *   {"v":1,"d":[item,item,...]}
+ * held in a fixed buffer of Capacity bytes, including the terminating NUL. That bound is the
+ * platform publish limit, so a finished payload can never exceed it.
+ *
+ * The owner decides when to flush:
+ *   - fits(len) is false: flush before adding (size)
+ *   - due(now) is true:   the oldest item reached its age limit, or an urgent item was added
+ * Items that could not fit even in an empty batch are rejected by add().
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t Capacity>
+class PublishBatcher {
+public:
+    explicit PublishBatcher(unsigned long maxAgeMs) : maxAgeMs_(maxAgeMs) { clear(); }
+
+    void clear() {
+        len_ = sizeof(PREFIX) - 1;
+        memcpy(buf_, PREFIX, len_);
+        count_ = 0;
+        urgent_ = false;
+    }
+
+    size_t count() const { return count_; }
+    bool empty() const { return count_ == 0; }
+
+    // Whether an item of itemLen bytes fits, counting its separator and the closing suffix.
+    bool fits(size_t itemLen) const {
+        size_t sep = count_ > 0 ? 1 : 0;
+        return len_ + sep + itemLen + (sizeof(SUFFIX) - 1) + 1 <= Capacity;
+    }
+
+    bool add(const char *item, size_t itemLen, bool urgent, unsigned long now) {
+        if (!fits(itemLen)) return false;
+        if (count_ == 0) {
+            firstAddedMs_ = now;
+        } else {
+            buf_[len_++] = ',';
+        }
+        memcpy(buf_ + len_, item, itemLen);
+        len_ += itemLen;
+        count_++;
+        urgent_ = urgent_ || urgent;
+        return true;
+    }
+
+    bool due(unsigned long now) const {
+        return count_ > 0 && (urgent_ || (now - firstAddedMs_) >= maxAgeMs_);
+    }
+
+    // millis() time at which due() becomes true; only valid when !empty().
+    unsigned long dueAt() const { return urgent_ ? firstAddedMs_ : firstAddedMs_ + maxAgeMs_; }
+
+    // Close the payload and return it; valid until the next add()/clear().
+    const char *finish() {
+        memcpy(buf_ + len_, SUFFIX, sizeof(SUFFIX)); // includes NUL
+        return buf_;
+    }
+
+    size_t finishedLength() const { return len_ + sizeof(SUFFIX) - 1; }
+
+private:
+    static constexpr char PREFIX[] = "{\"v\":1,\"d\":[";
+    static constexpr char SUFFIX[] = "]}";
+    static_assert(Capacity > sizeof(PREFIX) + sizeof(SUFFIX), "PublishBatcher capacity too small");
+
+    char buf_[Capacity];
+    size_t len_;
+    size_t count_;
+    bool urgent_;
+    unsigned long firstAddedMs_ = 0;
+    unsigned long maxAgeMs_;
+};
+
+template <size_t Capacity>
+constexpr char PublishBatcher<Capacity>::PREFIX[];
+template <size_t Capacity>
+constexpr char PublishBatcher<Capacity>::SUFFIX[];
@@ -0,0 +1,275 @@
+/*
+ * Device registry checkpoint, so a reboot or OTA update starts with the devices the hub already knew.
+ *
+ * Capacity fixed-size slots kept in one file, slot i holding registry entry i: on device a file on the
+ * flash file system (Device OS POSIX file API), on the host build a regular file. Layout, little-endian:
+ *   header  magic "SSR1", version, record size, capacity, count, records written, commit time, checksum
+ *   records count slots of REGISTRY_RECORD_SIZE bytes, each ending in its own checksum
+ * millis() starts over at boot, so times are stored as unix seconds (0 = unknown). The commit time lets an
+ * owner that boots without a clock date the records no later than they can be: as of the last commit.
+ *
+ * The owner rewrites the slots whose entry changed with write(), then commit()s the entry count and the
+ * time with the header, followed by fsync(). A reset in between loses at most those changes. A torn
+ * record fails its checksum and read() reports it, so the owner can leave that device to the next scan. A
+ * header that does not match this build (other capacity, version or record size, as after an OTA update
+ * that changed the format) or fails its checksum starts an empty checkpoint.
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event_queue.h"
+
+const uint8_t REGISTRY_CHECKPOINT_VERSION = 2;
+
+const uint16_t REGISTRY_HAS_PUBLISHED_STATUS = 0x0001;
+const uint16_t REGISTRY_HAS_PUBLISHED_COUNTS = 0x0002;
+const uint16_t REGISTRY_HAS_SUBMITTED = 0x0004;
+const uint16_t REGISTRY_LEGACY_BLOCKED = 0x0008;
+const uint16_t REGISTRY_GATT_CACHE_VALID = 0x0010;
+const uint16_t REGISTRY_HAS_OBSERVED_STATUS = 0x0020;
+const uint16_t REGISTRY_ADV_TELEMETRY = 0x0040;
+const uint16_t REGISTRY_HAS_COUNTS_READ = 0x0080;
+const uint16_t REGISTRY_STALE = 0x0100; // not heard for the hub's stale limit when written
+
+// One registry entry as checkpointed; counts are limit switch, cap touch, hall
+struct RegistryRecord {
+    uint8_t address[6];          // BleAddress byte order
+    uint8_t addressType;
+    uint16_t flags;              // REGISTRY_*
+    uint8_t failureCount;
+    uint8_t activity;
+    uint32_t legacyRetryAt;      // end of the legacy-profile block
+    uint16_t publishedStatus;    // last acknowledged by the cloud
+    uint32_t publishedCounts[3];
+    uint16_t submittedStatus;    // last handed to the publish path
+    uint32_t submittedCounts[3];
+    uint32_t submittedTimestamp;
+    uint16_t observedStatus;
+    uint32_t statusChangedAt;
+    uint32_t countsRead[3];
+    uint32_t countsDigest;
+    uint32_t countsReadAt;
+    uint32_t lastSeenAt;
+    uint32_t lastReadAt;
+    uint16_t batteryMv;
+    uint32_t batteryReadAt;
+    int16_t rssiQ4;              // link_quality.h
+    uint16_t sightings;
+    uint8_t connectHistory;
+    uint8_t connectCount;
+};
+
+// Fields of RegistryRecord in order, then the checksum
+const size_t REGISTRY_RECORD_SIZE = 6 + 1 + 2 + 1 + 1 + 4 + 2 + 3 * 4 + 2 + 3 * 4 + 4 + 2 + 4 + 3 * 4 + 4 + 4 + 4 + 4
+                                    + 2 + 4 + 2 + 2 + 1 + 1 + 2;
+const size_t REGISTRY_HEADER_SIZE = 4 + 1 + 1 + 2 + 2 + 4 + 4 + 2;
+
+template <uint16_t Capacity>
+class RegistryCheckpoint {
+public:
+    ~RegistryCheckpoint() { close(); }
+
+    // Load the checkpoint from path, or start an empty one there. false if the file cannot be used.
+    bool open(const char *path) {
+        close();
+        fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) return false;
+        if (loadHeader()) return true;
+        count_ = 0;
+        written_ = 0;
+        committedAt_ = 0;
+        if (!writeHeader()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool isOpen() const { return fd_ >= 0; }
+    // Entries as of the last commit()
+    uint16_t size() const { return count_; }
+    // Records written over the file's lifetime (flash wear)
+    uint32_t recordsWritten() const { return written_; }
+    // Unix time given to the last commit() (0 = none)
+    uint32_t committedAt() const { return committedAt_; }
+
+    // Entry i. false if it cannot be read or fails its checksum (torn write).
+    bool read(uint16_t i, RegistryRecord &out) const {
+        if (fd_ < 0 || i >= count_) return false;
+        uint8_t rec[REGISTRY_RECORD_SIZE];
+        if (!readAt(recordOffset(i), rec, sizeof(rec))) return false;
+        return decodeRecord(rec, out);
+    }
+
+    // Rewrite slot i; not durable until commit()
+    bool write(uint16_t i, const RegistryRecord &r) {
+        if (fd_ < 0 || i >= Capacity) return false;
+        uint8_t rec[REGISTRY_RECORD_SIZE];
+        encodeRecord(r, rec);
+        if (!writeAt(recordOffset(i), rec, sizeof(rec))) return false;
+        written_++;
+        return true;
+    }
+
+    // Make slots [0, count) the checkpoint, as of unix time now
+    bool commit(uint16_t count, uint32_t now) {
+        if (fd_ < 0) return false;
+        count_ = count > Capacity ? Capacity : count;
+        committedAt_ = now;
+        return writeHeader();
+    }
+
+private:
+    static_assert(Capacity > 0, "RegistryCheckpoint capacity must be positive");
+
+    static off_t recordOffset(uint16_t slot) {
+        return (off_t)(REGISTRY_HEADER_SIZE + (size_t)slot * REGISTRY_RECORD_SIZE);
+    }
+
+    static void put16(uint8_t *&p, uint16_t v) {
+        *p++ = (uint8_t)v;
+        *p++ = (uint8_t)(v >> 8);
+    }
+    static void put32(uint8_t *&p, uint32_t v) {
+        put16(p, (uint16_t)v);
+        put16(p, (uint16_t)(v >> 16));
+    }
+    static uint16_t get16(const uint8_t *&p) {
+        uint16_t v = (uint16_t)(p[0] | (p[1] << 8));
+        p += 2;
+        return v;
+    }
+    static uint32_t get32(const uint8_t *&p) {
+        uint32_t lo = get16(p);
+        return lo | ((uint32_t)get16(p) << 16);
+    }
+
+    static void encodeRecord(const RegistryRecord &r, uint8_t rec[REGISTRY_RECORD_SIZE]) {
+        uint8_t *p = rec;
+        memcpy(p, r.address, 6);
+        p += 6;
+        *p++ = r.addressType;
+        put16(p, r.flags);
+        *p++ = r.failureCount;
+        *p++ = r.activity;
+        put32(p, r.legacyRetryAt);
+        put16(p, r.publishedStatus);
+        for (int i = 0; i < 3; ++i) put32(p, r.publishedCounts[i]);
+        put16(p, r.submittedStatus);
+        for (int i = 0; i < 3; ++i) put32(p, r.submittedCounts[i]);
+        put32(p, r.submittedTimestamp);
+        put16(p, r.observedStatus);
+        put32(p, r.statusChangedAt);
+        for (int i = 0; i < 3; ++i) put32(p, r.countsRead[i]);
+        put32(p, r.countsDigest);
+        put32(p, r.countsReadAt);
+        put32(p, r.lastSeenAt);
+        put32(p, r.lastReadAt);
+        put16(p, r.batteryMv);
+        put32(p, r.batteryReadAt);
+        put16(p, (uint16_t)r.rssiQ4);
+        put16(p, r.sightings);
+        *p++ = r.connectHistory;
+        *p++ = r.connectCount;
+        put16(p, eventQueueChecksum(rec, (size_t)(p - rec)));
+    }
+
+    static bool decodeRecord(const uint8_t rec[REGISTRY_RECORD_SIZE], RegistryRecord &r) {
+        const uint8_t *p = rec + REGISTRY_RECORD_SIZE - 2;
+        if (get16(p) != eventQueueChecksum(rec, REGISTRY_RECORD_SIZE - 2)) return false;
+        p = rec;
+        memcpy(r.address, p, 6);
+        p += 6;
+        r.addressType = *p++;
+        r.flags = get16(p);
+        r.failureCount = *p++;
+        r.activity = *p++;
+        r.legacyRetryAt = get32(p);
+        r.publishedStatus = get16(p);
+        for (int i = 0; i < 3; ++i) r.publishedCounts[i] = get32(p);
+        r.submittedStatus = get16(p);
+        for (int i = 0; i < 3; ++i) r.submittedCounts[i] = get32(p);
+        r.submittedTimestamp = get32(p);
+        r.observedStatus = get16(p);
+        r.statusChangedAt = get32(p);
+        for (int i = 0; i < 3; ++i) r.countsRead[i] = get32(p);
+        r.countsDigest = get32(p);
+        r.countsReadAt = get32(p);
+        r.lastSeenAt = get32(p);
+        r.lastReadAt = get32(p);
+        r.batteryMv = get16(p);
+        r.batteryReadAt = get32(p);
+        r.rssiQ4 = (int16_t)get16(p);
+        r.sightings = get16(p);
+        r.connectHistory = *p++;
+        r.connectCount = *p;
+        return true;
+    }
+
+    bool loadHeader() {
+        uint8_t h[REGISTRY_HEADER_SIZE];
+        if (!readAt(0, h, sizeof(h))) return false;
+        const uint8_t *p = h + sizeof(h) - 2;
+        if (get16(p) != eventQueueChecksum(h, sizeof(h) - 2)) return false;
+        if (memcmp(h, MAGIC, 4) != 0 || h[4] != REGISTRY_CHECKPOINT_VERSION || h[5] != REGISTRY_RECORD_SIZE) {
+            return false;
+        }
+        p = h + 6;
+        uint16_t capacity = get16(p);
+        uint16_t count = get16(p);
+        uint32_t written = get32(p);
+        uint32_t committedAt = get32(p);
+        if (capacity != Capacity || count > Capacity) return false;
+        count_ = count;
+        written_ = written;
+        committedAt_ = committedAt;
+        return true;
+    }
+
+    bool writeHeader() {
+        uint8_t h[REGISTRY_HEADER_SIZE];
+        memcpy(h, MAGIC, 4);
+        h[4] = REGISTRY_CHECKPOINT_VERSION;
+        h[5] = (uint8_t)REGISTRY_RECORD_SIZE;
+        uint8_t *p = h + 6;
+        put16(p, Capacity);
+        put16(p, count_);
+        put32(p, written_);
+        put32(p, committedAt_);
+        put16(p, eventQueueChecksum(h, sizeof(h) - 2));
+        if (!writeAt(0, h, sizeof(h))) return false;
+        return fsync(fd_) == 0;
+    }
+
+    bool writeAt(off_t off, const uint8_t *buf, size_t len) {
+        return lseek(fd_, off, SEEK_SET) == off && ::write(fd_, buf, len) == (ssize_t)len;
+    }
+
+    bool readAt(off_t off, uint8_t *buf, size_t len) const {
+        return lseek(fd_, off, SEEK_SET) == off && ::read(fd_, buf, len) == (ssize_t)len;
+    }
+
+    static constexpr uint8_t MAGIC[4] = {'S', 'S', 'R', '1'};
+
+    int fd_ = -1;
+    uint16_t count_ = 0;
+    uint32_t written_ = 0;
+    uint32_t committedAt_ = 0;
+};
+
+template <uint16_t Capacity>
+constexpr uint8_t RegistryCheckpoint<Capacity>::MAGIC[4];
@@ -0,0 +1,170 @@
+/*
+ * SmartStall snapshot layout (one device's read) and its cloud payload field tables.
+ *
+ * SMARTSTALL_DATA_JSON_FIELDS renders the smartstall/data payload byte for byte as the former
+ * String::format path did. SMARTSTALL_BATCH_ITEM_FIELDS renders the compact array item used by
+ * smartstall/batch. A snapshot with counter usage (counter_usage.h) has its usage appended to
+ * either form; writeSmartStallDataJson() and writeSmartStallBatchItem() pick the layout. All are
+ * rendered with json_writer.h into caller buffers.
+ */
+#pragma once
+
+#include "Particle.h"
+#include "counter_usage.h"
+#include "json_writer.h"
+
+// Data structures matching SmartStall API
+struct SensorCounts {
+    uint32_t limit_switch_triggers;
+    uint32_t cap_touch_triggers; // was ir_sensor_triggers; matches peripheral / BLUETOOTH_API.md
+    uint32_t hall_sensor_triggers;
+};
+
+struct SmartStallData {
+    String deviceAddress;
+    uint16_t stallStatus;
+    uint16_t batteryVoltage;
+    SensorCounts sensorCounts;
+    unsigned long timestamp;
+    bool isValid;
+    CounterUsage usage = {}; // set when the snapshot is submitted for publishing
+};
+
+// GATT characteristic values are little-endian (BLUETOOTH_API.md): Stall Status and Battery Voltage
+// are 16-bit, Sensor Counts is three 32-bit counters
+const size_t SENSOR_COUNTS_VALUE_LEN = 12;
+
+inline uint16_t decodeUint16Value(const uint8_t *b) {
+    return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+inline uint32_t decodeUint32Value(const uint8_t *b) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+inline void decodeSensorCounts(const uint8_t *b, SensorCounts &out) {
+    out.limit_switch_triggers = decodeUint32Value(b);
+    out.cap_touch_triggers = decodeUint32Value(b + 4);
+    out.hall_sensor_triggers = decodeUint32Value(b + 8);
+}
+
+// Status value definitions
+inline const char* getStatusString(uint16_t status) {
+    switch(status) {
+        case 0: return "UNKNOWN";             // Initial/undefined state
+        case 1: return "INIT";                // System initializing or idle
+        case 2: return "LOCKED";              // Active locking sequence
+        case 3: return "UNLOCKED";            // Active unlocking sequence
+        case 4: return "SLEEP";               // Entering deep sleep mode
+        case 5: return "PRE_SLEEP";           // 20-min idle; peripheral disconnecting before sleep (see BLUETOOTH_API.md)
+        default: return "INVALID";
+    }
+}
+
+// Occupancy from status: 0,1,3,4 = non-occupied; 2,5 = occupied
+inline bool isOccupiedStatus(uint16_t status) {
+    return status == 2 || status == 5;
+}
+
+// Longest smartstall/data payload: 17-char address, 10-digit timestamp and counts, "PRE_SLEEP"/"INVALID",
+// and about 300 more for the usage object with 10-digit deltas and 17-character rates
+const size_t SMARTSTALL_DATA_JSON_MAX = 640;
+// Longest smartstall/batch item, including the NUL, with its usage values
+const size_t SMARTSTALL_BATCH_ITEM_MAX = 160;
+
+static constexpr JsonField<SmartStallData> SMARTSTALL_DATA_JSON_FIELDS[] = {
+    {"{\"device\":", JSON_VALUE_TEXT, nullptr,
+        [](const SmartStallData &d) { return d.deviceAddress.c_str(); }},
+    {",\"timestamp\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.timestamp; }, nullptr},
+    {",\"status\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.stallStatus; }, nullptr},
+    {",\"status_name\":", JSON_VALUE_TEXT, nullptr,
+        [](const SmartStallData &d) { return getStatusString(d.stallStatus); }},
+    {",\"occupied\":", JSON_VALUE_BOOL,
+        [](const SmartStallData &d) { return (int64_t)isOccupiedStatus(d.stallStatus); }, nullptr},
+    {",\"battery_mv\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.batteryVoltage; }, nullptr},
+    {",\"battery_v\":", JSON_VALUE_VOLTS,
+        [](const SmartStallData &d) { return (int64_t)d.batteryVoltage; }, nullptr},
+    {",\"sensor_counts\":{\"limit_switch\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.sensorCounts.limit_switch_triggers; }, nullptr},
+    {",\"cap_touch\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.sensorCounts.cap_touch_triggers; }, nullptr},
+    {",\"hall_sensor\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.sensorCounts.hall_sensor_triggers; }, nullptr},
+    {"}}", JSON_VALUE_NONE, nullptr, nullptr},
+};
+
+// ["device",timestamp,status,battery_mv,limit_switch,cap_touch,hall_sensor]
+static constexpr JsonField<SmartStallData> SMARTSTALL_BATCH_ITEM_FIELDS[] = {
+    {"[", JSON_VALUE_TEXT, nullptr,
+        [](const SmartStallData &d) { return d.deviceAddress.c_str(); }},
+    {",", JSON_VALUE_NUMBER, [](const SmartStallData &d) { return (int64_t)d.timestamp; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const SmartStallData &d) { return (int64_t)d.stallStatus; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const SmartStallData &d) { return (int64_t)d.batteryVoltage; }, nullptr},
+    {",", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.sensorCounts.limit_switch_triggers; }, nullptr},
+    {",", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.sensorCounts.cap_touch_triggers; }, nullptr},
+    {",", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.sensorCounts.hall_sensor_triggers; }, nullptr},
+    {"]", JSON_VALUE_NONE, nullptr, nullptr},
+};
+
+// Replaces the closing "}}" of SMARTSTALL_DATA_JSON_FIELDS:
+// ...},"usage":{"interval_s":600,"reset":false,"delta":{...},"per_hour":{...}}}
+static constexpr JsonField<SmartStallData> SMARTSTALL_USAGE_JSON_FIELDS[] = {
+    {"},\"usage\":{\"interval_s\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.usage.intervalS; }, nullptr},
+    {",\"reset\":", JSON_VALUE_BOOL,
+        [](const SmartStallData &d) { return (int64_t)((d.usage.flags & COUNTER_USAGE_RESET) != 0); }, nullptr},
+    {",\"delta\":{\"limit_switch\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.usage.delta[0]; }, nullptr},
+    {",\"cap_touch\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.usage.delta[1]; }, nullptr},
+    {",\"hall_sensor\":", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)d.usage.delta[2]; }, nullptr},
+    {"},\"per_hour\":{\"limit_switch\":", JSON_VALUE_CENTI,
+        [](const SmartStallData &d) { return (int64_t)counterRatePerHourCenti(d.usage.delta[0], d.usage.intervalS); },
+        nullptr},
+    {",\"cap_touch\":", JSON_VALUE_CENTI,
+        [](const SmartStallData &d) { return (int64_t)counterRatePerHourCenti(d.usage.delta[1], d.usage.intervalS); },
+        nullptr},
+    {",\"hall_sensor\":", JSON_VALUE_CENTI,
+        [](const SmartStallData &d) { return (int64_t)counterRatePerHourCenti(d.usage.delta[2], d.usage.intervalS); },
+        nullptr},
+    {"}}}", JSON_VALUE_NONE, nullptr, nullptr},
+};
+
+// Replaces the closing "]" of SMARTSTALL_BATCH_ITEM_FIELDS: ...,interval_s,reset,limit_switch,cap_touch,hall_sensor]
+// (deltas; a rate per hour is delta * 3600 / interval_s)
+static constexpr JsonField<SmartStallData> SMARTSTALL_BATCH_USAGE_FIELDS[] = {
+    {",", JSON_VALUE_NUMBER, [](const SmartStallData &d) { return (int64_t)d.usage.intervalS; }, nullptr},
+    {",", JSON_VALUE_NUMBER,
+        [](const SmartStallData &d) { return (int64_t)((d.usage.flags & COUNTER_USAGE_RESET) != 0); }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const SmartStallData &d) { return (int64_t)d.usage.delta[0]; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const SmartStallData &d) { return (int64_t)d.usage.delta[1]; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const SmartStallData &d) { return (int64_t)d.usage.delta[2]; }, nullptr},
+    {"]", JSON_VALUE_NONE, nullptr, nullptr},
+};
+
+// smartstall/data payload: the former layout, with the usage object when the snapshot has usage
+inline bool writeSmartStallDataJson(JsonWriter &w, const SmartStallData &d) {
+    const size_t n = sizeof(SMARTSTALL_DATA_JSON_FIELDS) / sizeof(SMARTSTALL_DATA_JSON_FIELDS[0]);
+    if (!(d.usage.flags & COUNTER_USAGE_VALID)) {
+        return writeJsonFields(w, SMARTSTALL_DATA_JSON_FIELDS, d);
+    }
+    writeJsonFields(w, SMARTSTALL_DATA_JSON_FIELDS, n - 1, d);
+    return writeJsonFields(w, SMARTSTALL_USAGE_JSON_FIELDS, d);
+}
+
+// smartstall/batch item, with the usage values when the snapshot has usage
+inline bool writeSmartStallBatchItem(JsonWriter &w, const SmartStallData &d) {
+    const size_t n = sizeof(SMARTSTALL_BATCH_ITEM_FIELDS) / sizeof(SMARTSTALL_BATCH_ITEM_FIELDS[0]);
+    if (!(d.usage.flags & COUNTER_USAGE_VALID)) {
+        return writeJsonFields(w, SMARTSTALL_BATCH_ITEM_FIELDS, d);
+    }
+    writeJsonFields(w, SMARTSTALL_BATCH_ITEM_FIELDS, n - 1, d);
+    return writeJsonFields(w, SMARTSTALL_BATCH_USAGE_FIELDS, d);
+}
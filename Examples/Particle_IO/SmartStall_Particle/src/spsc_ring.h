@@ -0,0 +1,56 @@
+/*
+ * Bounded lock-free single-producer / single-consumer ring.
+ *
+ * Exactly one thread calls push() (on device the BLE thread, from the hub's BLE callbacks) and exactly
+ * one thread calls pop() (the application thread, in loop()). Head and tail are free-running 32-bit
+ * counters published with release stores and read with acquire loads, so an item is fully written
+ * before the consumer can see it and a slot is not reused before the consumer is done with it.
+ * Neither side blocks: push() onto a full ring drops the item and counts it in dropped().
+ *
+ * Capacity must be a power of two. Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+template <typename T, uint32_t Capacity>
+class SpscRing {
+public:
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+    // Producer only. false (and counted) when the ring is full.
+    bool push(const T &item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items_[tail & (Capacity - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. false when the ring is empty.
+    bool pop(T &out) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = items_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only; a concurrent push may make it non-empty right after.
+    bool empty() const { return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire); }
+
+    // Items push() could not store, from either thread
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> dropped_{0};
+    T items_[Capacity];
+};
@@ -0,0 +1,63 @@
+/*
+ * Binary trace ring for the SmartStall hub.
+ *
+ * A trace record is 16 bytes: millis(), an event id, a registry index and two integer arguments. Records
+ * go into a fixed power-of-two ring that overwrites the oldest entry when full; nothing is formatted or
+ * allocated when a record is written. The hub keeps the event ids and their format strings and renders
+ * records only when the ring is dumped.
+ *
+ * Single writer: push() and the readers run on the application thread (loop(), cloud functions).
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+const uint16_t TRACE_NO_DEVICE = 0xFFFF;
+
+struct TraceRecord {
+    uint32_t ms;
+    uint16_t event;
+    uint16_t device; // registry index, TRACE_NO_DEVICE when none
+    int32_t a;
+    int32_t b;
+};
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord is meant to pack into 16 bytes");
+
+template <size_t Capacity>
+class TraceRing {
+public:
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "TraceRing capacity must be a power of two");
+
+    TraceRing() { clear(); }
+
+    void clear() {
+        written_ = 0;
+    }
+
+    void push(uint32_t ms, uint16_t event, uint16_t device, int32_t a, int32_t b) {
+        TraceRecord &r = records_[written_ & (Capacity - 1)];
+        r.ms = ms;
+        r.event = event;
+        r.device = device;
+        r.a = a;
+        r.b = b;
+        written_++;
+    }
+
+    size_t size() const { return written_ < Capacity ? (size_t)written_ : Capacity; }
+    // Records written since clear(), including those overwritten since
+    uint32_t written() const { return written_; }
+    uint32_t overwritten() const { return written_ - (uint32_t)size(); }
+
+    // i-th retained record, oldest first (i < size())
+    const TraceRecord &at(size_t i) const {
+        return records_[(written_ - (uint32_t)size() + (uint32_t)i) & (Capacity - 1)];
+    }
+
+private:
+    TraceRecord records_[Capacity];
+    uint32_t written_;
+};
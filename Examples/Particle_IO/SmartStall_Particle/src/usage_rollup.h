@@ -0,0 +1,157 @@
+/*
+ * Per-device rollups over fixed wall-clock windows, folded from successful reads.
+ *
+ * A window is [start, start + windowS) with start a multiple of windowS, so every device's windows line
+ * up. Per window a UsageRollup holds:
+ *   - reads folded in, and status transitions between consecutive reads;
+ *   - observed and occupied seconds: the status of a read is taken to hold until the next read, for at
+ *     most ROLLUP_MAX_HOLD_S, with the occupancy the caller gives the read (isOccupiedStatus() in
+ *     smartstall_data.h). Time past the hold limit is unobserved, so occupiedS / observedS is the
+ *     occupied fraction of what the hub saw;
+ *   - battery min/max/last over the reads (reads without a battery value, 0 mV, are skipped);
+ *   - counter increments since the previous read (counter_usage.h), in the window of the later read.
+ *     A counter below its base sets ROLLUP_COUNTS_RESET and counts from zero.
+ *
+ * RollupState is all a device keeps, whatever the read rate. A window closes when a read lands past its
+ * end or rollupCloseDue() is called after it; either extends the hold of the last read to the window's
+ * end. Windows without a read produce no rollup; the hold carried into the next window starts at that
+ * window's start. A read older than the previous one (clock stepped back) closes the window and starts
+ * over without a base.
+ *
+ * Header-only and independent of Particle.h.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "counter_usage.h"
+#include "json_writer.h"
+
+const uint32_t ROLLUP_MAX_HOLD_S = 1200;  // twice the longest regular poll interval
+const uint32_t ROLLUP_WINDOW_MAX_S = 65535; // observed/occupied seconds are 16-bit
+const uint8_t ROLLUP_COUNTS_RESET = 0x01;
+
+struct UsageRollup {
+    uint32_t windowStart;
+    uint16_t observedS;
+    uint16_t occupiedS;
+    uint16_t reads;
+    uint16_t transitions;
+    uint16_t batteryMinMv; // 0 when no read in the window had a battery value
+    uint16_t batteryMaxMv;
+    uint16_t batteryLastMv;
+    uint32_t delta[3];     // limit switch, cap touch, hall
+    uint8_t flags;
+};
+
+struct RollupState {
+    bool open = false;     // current holds the window being filled
+    bool hasLast = false;  // last* describe the previous read
+    bool lastOccupied = false;
+    uint16_t lastStatus = 0;
+    uint32_t lastTimestamp = 0;
+    uint32_t lastCounts[3] = {0, 0, 0};
+    UsageRollup current = {};
+};
+
+inline uint32_t rollupWindowStart(uint32_t t, uint32_t windowS) { return t - t % windowS; }
+
+// Credit the last read's status from its time (or the window start) to `to`, within the hold limit
+inline void rollupHold(RollupState &s, uint32_t to, uint32_t windowS) {
+    if (!s.open || !s.hasLast) return;
+    UsageRollup &r = s.current;
+    uint32_t from = s.lastTimestamp > r.windowStart ? s.lastTimestamp : r.windowStart;
+    uint32_t end = r.windowStart + windowS;
+    if (to < end) end = to;
+    if (s.lastTimestamp + ROLLUP_MAX_HOLD_S < end) end = s.lastTimestamp + ROLLUP_MAX_HOLD_S;
+    if (end <= from) return;
+    r.observedS = (uint16_t)(r.observedS + (end - from));
+    if (s.lastOccupied) {
+        r.occupiedS = (uint16_t)(r.occupiedS + (end - from));
+    }
+}
+
+// Close the open window; false when none was open
+inline bool rollupClose(RollupState &s, uint32_t windowS, UsageRollup &closed) {
+    if (!s.open) return false;
+    rollupHold(s, s.current.windowStart + windowS, windowS);
+    closed = s.current;
+    s.open = false;
+    return true;
+}
+
+// Close the open window once now (unix seconds) is past its end
+inline bool rollupCloseDue(RollupState &s, uint32_t now, uint32_t windowS, UsageRollup &closed) {
+    if (!s.open || now < s.current.windowStart + windowS) return false;
+    return rollupClose(s, windowS, closed);
+}
+
+// Fold in a successful read at unix time t. true when it closed the previous window (into closed).
+inline bool rollupAddRead(RollupState &s, uint32_t t, uint16_t status, bool occupied, uint16_t batteryMv,
+                          const uint32_t counts[3], uint32_t windowS, UsageRollup &closed) {
+    bool didClose = false;
+    if (s.hasLast && t < s.lastTimestamp) {
+        didClose = rollupClose(s, windowS, closed);
+        s.hasLast = false;
+    } else if (s.open && t >= s.current.windowStart + windowS) {
+        didClose = rollupClose(s, windowS, closed);
+    }
+    if (!s.open) {
+        s.current = UsageRollup();
+        s.current.windowStart = rollupWindowStart(t, windowS);
+        s.open = true;
+    }
+    rollupHold(s, t, windowS);
+
+    UsageRollup &r = s.current;
+    if (s.hasLast) {
+        if (status != s.lastStatus && r.transitions < 0xFFFF) r.transitions++;
+        CounterUsage u = counterUsageSince(s.lastCounts, s.lastTimestamp, counts, t);
+        if (u.flags & COUNTER_USAGE_RESET) r.flags |= ROLLUP_COUNTS_RESET;
+        for (int i = 0; i < 3; ++i) r.delta[i] += u.delta[i];
+    }
+    if (batteryMv != 0) {
+        if (r.batteryMinMv == 0 || batteryMv < r.batteryMinMv) r.batteryMinMv = batteryMv;
+        if (batteryMv > r.batteryMaxMv) r.batteryMaxMv = batteryMv;
+        r.batteryLastMv = batteryMv;
+    }
+    if (r.reads < 0xFFFF) r.reads++;
+
+    s.hasLast = true;
+    s.lastOccupied = occupied;
+    s.lastStatus = status;
+    s.lastTimestamp = t;
+    for (int i = 0; i < 3; ++i) s.lastCounts[i] = counts[i];
+    return didClose;
+}
+
+// One smartstall/rollup item:
+// ["device",window_start,window_s,reads,observed_s,occupied_s,transitions,battery_min_mv,battery_max_mv,
+//  battery_last_mv,limit_switch,cap_touch,hall_sensor,reset]
+struct RollupItem {
+    const char *device;
+    uint32_t windowS;
+    UsageRollup rollup;
+};
+
+// Longest item: 17-char address, 10-digit numbers for the window start and counters
+const size_t ROLLUP_ITEM_MAX = 192;
+
+static constexpr JsonField<RollupItem> ROLLUP_ITEM_FIELDS[] = {
+    {"[", JSON_VALUE_TEXT, nullptr, [](const RollupItem &i) { return i.device; }},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.windowStart; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.windowS; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.reads; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.observedS; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.occupiedS; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.transitions; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.batteryMinMv; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.batteryMaxMv; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.batteryLastMv; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.delta[0]; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.delta[1]; }, nullptr},
+    {",", JSON_VALUE_NUMBER, [](const RollupItem &i) { return (int64_t)i.rollup.delta[2]; }, nullptr},
+    {",", JSON_VALUE_NUMBER,
+     [](const RollupItem &i) { return (int64_t)((i.rollup.flags & ROLLUP_COUNTS_RESET) ? 1 : 0); }, nullptr},
+    {"]", JSON_VALUE_NONE, nullptr, nullptr},
+};